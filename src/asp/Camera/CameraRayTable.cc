@@ -0,0 +1,261 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file CameraRayTable.cc
+///
+
+#include <vw/Camera/CameraModel.h>
+#include <asp/Camera/CameraRayTable.h>
+#include <algorithm>
+#include <cmath>
+
+using namespace vw;
+using namespace std;
+
+namespace asp {
+
+CameraRayTable::CameraRayTable(camera::CameraModel const* camera, BBox2 const& box,
+                               int spacing, double tolerance, double range):
+  m_camera(camera), m_box(box), m_spacing(std::max(spacing, 2)),
+  m_tolerance(tolerance), m_range(std::max(range, 1.0)), m_footprint(0),
+  m_num_cols(0), m_num_rows(0), m_num_exact(0) {
+
+  // With no table every ray is exact
+  if (!(m_box.width() > 0) || !(m_box.height() > 0))
+    return;
+
+  // How far apart the rays of neighboring pixels are, for the units of
+  // the errors. For a linescan camera the center moves from a line to
+  // the next, so this is not just the angle between the rays.
+  Vector2 mid = (m_box.min() + m_box.max())/2;
+  Node a = exact_ray(mid), b = exact_ray(mid + Vector2(1, 0)), c = exact_ray(mid + Vector2(0, 1));
+  if (!a.valid || !b.valid || !c.valid)
+    return;
+  m_footprint = std::min(ray_distance(a, b), ray_distance(a, c));
+  if (!(m_footprint > 0))
+    return;
+
+  // The coarse grid, which may go a little past the box
+  m_num_cols = int(ceil(m_box.width ()/m_spacing));
+  m_num_rows = int(ceil(m_box.height()/m_spacing));
+  int node_cols = m_num_cols + 1;
+  vector<Node> nodes(size_t(node_cols)*(m_num_rows + 1));
+  for (int row = 0; row <= m_num_rows; row++)
+    for (int col = 0; col <= m_num_cols; col++)
+      nodes[row*node_cols + col] = exact_ray(m_box.min() + m_spacing*Vector2(col, row));
+
+  m_cells.resize(size_t(m_num_cols)*m_num_rows);
+  for (int row = 0; row < m_num_rows; row++) {
+    for (int col = 0; col < m_num_cols; col++) {
+      Cell & cell = m_cells[row*m_num_cols + col];
+      cell.box = BBox2(m_box.min() + m_spacing*Vector2(col,     row    ),
+                       m_box.min() + m_spacing*Vector2(col + 1, row + 1));
+      cell.corners[0] = nodes[ row     *node_cols + col    ];
+      cell.corners[1] = nodes[ row     *node_cols + col + 1];
+      cell.corners[2] = nodes[(row + 1)*node_cols + col    ];
+      cell.corners[3] = nodes[(row + 1)*node_cols + col + 1];
+    }
+  }
+  for (int k = 0; k < m_num_cols*m_num_rows; k++)
+    refine(k);
+}
+
+CameraRayTable::Node CameraRayTable::exact_ray(Vector2 const& pix) const {
+  Node node;
+  m_num_exact++;
+  try {
+    node.ctr   = m_camera->camera_center(pix);
+    node.dir   = m_camera->pixel_to_vector(pix);
+    node.valid = true;
+  } catch (...) {}
+  return node;
+}
+
+CameraRayTable::Node CameraRayTable::interpolate(Cell const& cell, Vector2 const& pix) const {
+  double tx = (pix.x() - cell.box.min().x())/cell.box.width ();
+  double ty = (pix.y() - cell.box.min().y())/cell.box.height();
+  double w[4] = {(1 - tx)*(1 - ty), tx*(1 - ty), (1 - tx)*ty, tx*ty};
+  Node node;
+  for (int i = 0; i < 4; i++) {
+    node.ctr += w[i]*cell.corners[i].ctr;
+    node.dir += w[i]*cell.corners[i].dir;
+  }
+  node.dir   = normalize(node.dir);
+  node.valid = true;
+  return node;
+}
+
+// How far apart the rays are at the range
+double CameraRayTable::ray_distance(Node const& a, Node const& b) const {
+  return norm_2((a.ctr + m_range*a.dir) - (b.ctr + m_range*b.dir));
+}
+
+void CameraRayTable::refine(int k) {
+
+  // A copy, as the cells may move when children are added
+  Cell cell = m_cells[k];
+  for (int i = 0; i < 4; i++) {
+    if (!cell.corners[i].valid) {
+      m_cells[k].exact = true;
+      return;
+    }
+  }
+  if (cell.box.width() <= 2)
+    return;
+
+  // Check the interpolation half way along the edges and in the middle
+  Vector2 lo = cell.box.min(), hi = cell.box.max(), mid = (lo + hi)/2;
+  Vector2 points[5] = {Vector2(mid.x(), lo.y()), Vector2(lo.x(), mid.y()), mid,
+                       Vector2(hi.x(), mid.y()), Vector2(mid.x(), hi.y())};
+  Node exact[5];
+  bool split = false;
+  for (int i = 0; i < 5; i++) {
+    exact[i] = exact_ray(points[i]);
+    split = split || !exact[i].valid ||
+      ray_distance(exact[i], interpolate(cell, points[i])) > m_tolerance*m_footprint;
+  }
+  if (!split)
+    return;
+
+  // The nodes of the four children, row by row
+  Node grid[9] = {cell.corners[0], exact[0], cell.corners[1],
+                  exact[1],        exact[2], exact[3],
+                  cell.corners[2], exact[4], cell.corners[3]};
+  Vector2 xs(lo.x(), mid.x()), ys(lo.y(), mid.y());
+  int first = m_cells.size();
+  m_cells[k].children = first;
+  for (int q = 0; q < 4; q++) {
+    int qx = q % 2, qy = q / 2;
+    Cell child;
+    child.box = BBox2(Vector2(xs[qx], ys[qy]), Vector2(xs[qx], ys[qy]) + (hi - lo)/2);
+    child.corners[0] = grid[ qy     *3 + qx    ];
+    child.corners[1] = grid[ qy     *3 + qx + 1];
+    child.corners[2] = grid[(qy + 1)*3 + qx    ];
+    child.corners[3] = grid[(qy + 1)*3 + qx + 1];
+    m_cells.push_back(child);
+  }
+  for (int q = 0; q < 4; q++)
+    refine(first + q);
+}
+
+void CameraRayTable::ray(Vector2 const& pix, Vector3 & ctr, Vector3 & dir) const {
+  if (m_num_cols > 0) {
+    double x = (pix.x() - m_box.min().x())/m_spacing;
+    double y = (pix.y() - m_box.min().y())/m_spacing;
+    if (x >= 0 && y >= 0 && x < m_num_cols && y < m_num_rows) {
+      int k = int(y)*m_num_cols + int(x);
+      while (m_cells[k].children >= 0) {
+        Cell const& cell = m_cells[k];
+        Vector2 mid = (cell.box.min() + cell.box.max())/2;
+        k = cell.children + int(pix.x() >= mid.x()) + 2*int(pix.y() >= mid.y());
+      }
+      if (!m_cells[k].exact) {
+        Node node = interpolate(m_cells[k], pix);
+        ctr = node.ctr;
+        dir = node.dir;
+        return;
+      }
+    }
+  }
+  ctr = m_camera->camera_center(pix);
+  dir = m_camera->pixel_to_vector(pix);
+}
+
+RayTableStereoModel::RayTableStereoModel(vector<const camera::CameraModel *> const& cameras,
+                                         double angle_tol, int spacing, double tolerance,
+                                         double planet_radius):
+  vw::stereo::StereoModel(cameras, false, angle_tol),
+  m_spacing(spacing), m_tolerance(tolerance), m_planet_radius(planet_radius) {}
+
+vector<CameraRayTable> RayTableStereoModel::tabulate(vector<BBox2> const& boxes) const {
+  VW_ASSERT(boxes.size() == m_cameras.size(),
+            vw::ArgumentErr() << "Expecting one box per camera.\n");
+  vector<CameraRayTable> tables;
+  for (size_t p = 0; p < m_cameras.size(); p++) {
+    double range = 0;
+    try {
+      range = norm_2(m_cameras[p]->camera_center((boxes[p].min() + boxes[p].max())/2))
+        - m_planet_radius;
+    } catch (...) {}
+    tables.push_back(CameraRayTable(m_cameras[p], boxes[p], m_spacing, m_tolerance, range));
+  }
+  return tables;
+}
+
+void RayTableStereoModel::triangulate_batch(vector<CameraRayTable> const& tables,
+                                            vector< vector<Vector2> > const& pixels,
+                                            vector<Vector3> & points,
+                                            vector<Vector3> & errors) const {
+
+  int num_cams = m_cameras.size();
+  VW_ASSERT((int)pixels.size() == num_cams && (int)tables.size() == num_cams,
+            vw::ArgumentErr() << "the number of rays must match "
+                              << "the number of cameras.\n");
+  size_t num_pixels = pixels.empty() ? 0 : pixels[0].size();
+  points.assign(num_pixels, Vector3());
+  errors.assign(num_pixels, Vector3());
+
+  vector< vector<Vector3> > ctrs(num_cams, vector<Vector3>(num_pixels)),
+                            dirs(num_cams, vector<Vector3>(num_pixels));
+  vector< vector<unsigned char> > has_ray(num_cams, vector<unsigned char>(num_pixels, 0));
+  vector<unsigned char> failed(num_pixels, 0);
+  for (int p = 0; p < num_cams; p++){
+    for (size_t i = 0; i < num_pixels; i++){
+      Vector2 const& pix = pixels[p][i];
+      if (failed[i] || pix != pix || // i.e., NaN
+          pix == camera::CameraModel::invalid_pixel() ) continue;
+      try {
+        tables[p].ray(pix, ctrs[p][i], dirs[p][i]);
+        has_ray[p][i] = 1;
+      } catch (const camera::PixelToRayErr& /*e*/) {
+        failed[i] = 1;
+      }
+    }
+  }
+
+  vector<Vector3> camDirs, camCtrs;
+  for (size_t i = 0; i < num_pixels; i++){
+    if (failed[i])
+      continue;
+    camDirs.clear();
+    camCtrs.clear();
+    for (int p = 0; p < num_cams; p++){
+      if (!has_ray[p][i])
+        continue;
+      camDirs.push_back(dirs[p][i]);
+      camCtrs.push_back(ctrs[p][i]);
+    }
+
+    // Not enough valid rays
+    if (camDirs.size() < 2 || are_nearly_parallel(m_least_squares, m_angle_tol, camDirs))
+      continue;
+
+    Vector3 result = triangulate_point(camDirs, camCtrs, errors[i]);
+
+    // Reflect points that fall behind one of the two cameras
+    bool reflect = false;
+    for (int p = 0; p < (int)camCtrs.size(); p++)
+      if (dot_prod(result - camCtrs[p], camDirs[p]) < 0 ) reflect = true;
+    if (reflect)
+      result = -result + 2*camCtrs[0];
+
+    points[i] = result;
+  }
+}
+
+} // namespace asp
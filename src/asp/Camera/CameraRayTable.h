@@ -0,0 +1,123 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file CameraRayTable.h
+///
+/// Lookup tables of camera rays, for triangulating with cameras whose
+/// rays are expensive to find, such as linescan and RPC models. The
+/// center and direction of the rays are found exactly on a coarse grid
+/// of pixels and interpolated bilinearly in between. A cell of the grid
+/// is split in four, as many times as needed, where the interpolated
+/// rays are further than a tolerance from the exact ones.
+
+#ifndef __ASP_CAMERA_CAMERA_RAY_TABLE_H__
+#define __ASP_CAMERA_CAMERA_RAY_TABLE_H__
+
+#include <vw/Math/BBox.h>
+#include <vw/Math/Vector.h>
+#include <vw/Stereo/StereoModel.h>
+#include <vector>
+
+namespace vw {
+  namespace camera {
+    class CameraModel;
+  }
+}
+
+namespace asp {
+
+  class CameraRayTable {
+  public:
+    CameraRayTable(): m_camera(NULL), m_spacing(0), m_tolerance(0), m_range(0),
+                      m_footprint(0), m_num_cols(0), m_num_rows(0), m_num_exact(0) {}
+
+    /// Tabulate the camera over a box of its pixels, starting with
+    /// nodes spacing pixels apart. The error of an interpolated ray is
+    /// how far it is from the exact one at range meters from the
+    /// camera, in units of the distance between the rays of neighboring
+    /// pixels there. Cells are split until it is within tolerance, or
+    /// they are 2 pixels wide.
+    CameraRayTable(vw::camera::CameraModel const* camera, vw::BBox2 const& box,
+                   int spacing, double tolerance, double range);
+
+    /// The ray through a pixel. Pixels out of the table, or in cells
+    /// where the camera had no ray at some node, get the exact ray.
+    void ray(vw::Vector2 const& pix, vw::Vector3 & ctr, vw::Vector3 & dir) const;
+
+    size_t num_cells() const { return m_cells.size(); }
+    size_t num_exact() const { return m_num_exact; } ///< Exact rays found to build the table
+
+  private:
+    struct Node {
+      vw::Vector3 ctr, dir;
+      bool        valid;
+      Node(): valid(false) {}
+    };
+
+    /// Corners are in the order: min, (max x, min y), (min x, max y), max.
+    struct Cell {
+      vw::BBox2 box;
+      Node      corners[4];
+      int       children; // Index of the first of four, or -1 for a leaf
+      bool      exact;    // Leaf where the exact rays must be used
+      Cell(): children(-1), exact(false) {}
+    };
+
+    Node   exact_ray   (vw::Vector2 const& pix) const;
+    Node   interpolate (Cell const& cell, vw::Vector2 const& pix) const;
+    double ray_distance(Node const& a, Node const& b) const;
+    void   refine      (int cell);
+
+    vw::camera::CameraModel const* m_camera;
+    vw::BBox2         m_box;
+    int               m_spacing;
+    double            m_tolerance, m_range, m_footprint;
+    int               m_num_cols, m_num_rows; // Of the coarse grid of cells
+    std::vector<Cell> m_cells;                // The coarse grid comes first
+    mutable size_t    m_num_exact;
+  };
+
+  /// Triangulation from rays looked up in tables, for a batch of pixels
+  /// at a time. The intersection is the one of the base class, without
+  /// least squares refinement.
+  class RayTableStereoModel: public vw::stereo::StereoModel {
+  public:
+    RayTableStereoModel(std::vector<const vw::camera::CameraModel *> const& cameras,
+                        double angle_tol, int spacing, double tolerance,
+                        double planet_radius);
+
+    /// Tabulate each camera over the box of its pixels that a batch will
+    /// use. The range for the errors is the height of the camera over
+    /// the planet radius.
+    std::vector<CameraRayTable> tabulate(std::vector<vw::BBox2> const& boxes) const;
+
+    /// pixels[c][i] is pixel i as seen in camera c, as in
+    /// RPCStereoModel::triangulate_batch().
+    void triangulate_batch(std::vector<CameraRayTable> const& tables,
+                           std::vector< std::vector<vw::Vector2> > const& pixels,
+                           std::vector<vw::Vector3> & points,
+                           std::vector<vw::Vector3> & errors) const;
+
+  private:
+    int    m_spacing;
+    double m_tolerance, m_planet_radius;
+  };
+
+} // namespace asp
+
+#endif // __ASP_CAMERA_CAMERA_RAY_TABLE_H__
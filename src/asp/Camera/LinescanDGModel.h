@@ -27,6 +27,7 @@
 #include <vw/Camera/LinescanModel.h>
 #include <vw/Camera/PinholeModel.h>
 #include <vw/Camera/Extrinsics.h>
+#include <limits>
 
 namespace asp {
 
@@ -160,6 +161,50 @@ namespace asp {
   typedef LinescanDGModel<vw::camera::PiecewiseAPositionInterpolation,
                   			  vw::camera::SLERPPoseInterpolation> DGCameraModel;
 
+  /// A DG linescan model which keeps the position, velocity and pose of
+  /// the last time each was asked for. The pixels of one image line, and
+  /// the several calls made for one pixel, then interpolate them only
+  /// once. It is made for a batch of pixels on one thread, and refers to
+  /// the model it wraps, which must outlive it.
+  template <class PositionFuncT, class PoseFuncT>
+  class LinescanDGLineCache : public vw::camera::LinescanModel {
+  public:
+    typedef LinescanDGModel<PositionFuncT, PoseFuncT> model_type;
+
+    LinescanDGLineCache(model_type const& model):
+      vw::camera::LinescanModel(model.get_image_size(), true), // As the model
+      m_model(model),
+      m_position_time(std::numeric_limits<double>::quiet_NaN()),
+      m_velocity_time(m_position_time), m_pose_time(m_position_time) {}
+    virtual ~LinescanDGLineCache() {}
+    virtual std::string type() const { return m_model.type(); }
+
+    virtual vw::Vector3 get_camera_center_at_time  (double time) const;
+    virtual vw::Vector3 get_camera_velocity_at_time(double time) const;
+    virtual vw::Quat    get_camera_pose_at_time    (double time) const;
+    virtual double      get_time_at_line           (double line) const {
+      return m_model.get_time_at_line(line);
+    }
+    virtual vw::Vector3 get_local_pixel_vector(vw::Vector2 const& pix) const {
+      return m_model.get_local_pixel_vector(pix);
+    }
+    virtual vw::Vector2 point_to_pixel(vw::Vector3 const& point, double starty) const {
+      return m_model.point_to_pixel(point, starty);
+    }
+
+  private:
+    // As in LinescanDGModel
+    virtual vw::Vector3 get_rotation_corrected_velocity(vw::Vector2 const& pixel,
+                                                    vw::Vector3 const& uncorrected_vector) const {
+      return vw::camera::LinescanModel::get_rotation_corrected_velocity(pixel, uncorrected_vector);
+    }
+
+    model_type const& m_model;
+    mutable double      m_position_time, m_velocity_time, m_pose_time; // NaN when not set
+    mutable vw::Vector3 m_position, m_velocity;
+    mutable vw::Quat    m_pose;
+  };
+
   /// Load a DG camera model from an XML file.
   /// - This function does not take care of Xerces XML init/de-init, the caller must
   ///   make sure this is done before/after this function is called!
@@ -128,6 +128,37 @@ LinescanDGModel<PositionFuncT, PoseFuncT>::LinescanLMA::operator()( domain_type
 }
 
 
+// -----------------------------------------------------------------
+// LinescanDGLineCache class functions
+
+template <class PositionFuncT, class PoseFuncT>
+vw::Vector3 LinescanDGLineCache<PositionFuncT, PoseFuncT>::get_camera_center_at_time(double time) const {
+  if (!(m_position_time == time)) {
+    m_position      = m_model.get_camera_center_at_time(time);
+    m_position_time = time;
+  }
+  return m_position;
+}
+
+template <class PositionFuncT, class PoseFuncT>
+vw::Vector3 LinescanDGLineCache<PositionFuncT, PoseFuncT>::get_camera_velocity_at_time(double time) const {
+  if (!(m_velocity_time == time)) {
+    m_velocity      = m_model.get_camera_velocity_at_time(time);
+    m_velocity_time = time;
+  }
+  return m_velocity;
+}
+
+template <class PositionFuncT, class PoseFuncT>
+vw::Quat LinescanDGLineCache<PositionFuncT, PoseFuncT>::get_camera_pose_at_time(double time) const {
+  if (!(m_pose_time == time)) {
+    m_pose      = m_model.get_camera_pose_at_time(time);
+    m_pose_time = time;
+  }
+  return m_pose;
+}
+
+
 // -----------------------------------------------------------------
 // LinescanDGModel supporting functions
 
@@ -59,6 +59,18 @@ namespace asp {
     };
   }
 
+  vector<const RPCModel*> RPCStereoModel::rpc_models() const {
+    vector<const RPCModel*> rpc_cams;
+    for (size_t p = 0; p < m_cameras.size(); p++){
+      // Get the RPC pointer so we can call RPC specific functions on it
+      const RPCModel *rpc_cam = dynamic_cast<const RPCModel*>(vw::camera::unadjusted_model(m_cameras[p]));
+      VW_ASSERT(rpc_cam != NULL,
+                vw::ArgumentErr() << "Camera models are not RPC.\n");
+      rpc_cams.push_back(rpc_cam);
+    }
+    return rpc_cams;
+  }
+
   Vector3 RPCStereoModel::operator()(vector<Vector2> const& pixVec,
                                      Vector3& errorVec) const {
 
@@ -74,76 +86,136 @@ namespace asp {
     try {
       vector<Vector3> camDirs(num_cams), 
                       camCtrs(num_cams);
-      vector<const RPCModel*> rpc_cams(num_cams);
+      vector<const RPCModel*> rpc_cams = rpc_models();
       camDirs.clear(); 
       camCtrs.clear(); 
-      rpc_cams.clear();
 
       // Pick the valid rays
       for (int p = 0; p < num_cams; p++){
 
-        // Get the RPC pointer so we can call RPC specific functions on it
-        const RPCModel *rpc_cam = dynamic_cast<const RPCModel*>(vw::camera::unadjusted_model(m_cameras[p]));
-        VW_ASSERT(rpc_cam != NULL,
-                  vw::ArgumentErr() << "Camera models are not RPC.\n");
-        rpc_cams.push_back(rpc_cam);
-
         Vector2 pix = pixVec[p];
         if (pix != pix || // i.e., NaN
             pix == camera::CameraModel::invalid_pixel() ) continue;
 
         // The base class function would call point_and_dir twice, but we only need to call it once!
         Vector3 ctr, dir;
-        rpc_cam->point_and_dir(pix, ctr, dir);
+        rpc_cams[p]->point_and_dir(pix, ctr, dir);
         camDirs.push_back(dir);
         camCtrs.push_back(ctr);
       }
 
+      return intersect(rpc_cams, pixVec, camDirs, camCtrs, errorVec);
+
+    } catch (const camera::PixelToRayErr& /*e*/) {}
+    return Vector3();
+  }
+
+  void RPCStereoModel::triangulate_batch(vector< vector<Vector2> > const& pixels,
+                                         vector<Vector3> & points,
+                                         vector<Vector3> & errors) const {
+
+    int num_cams = m_cameras.size();
+    VW_ASSERT((int)pixels.size() == num_cams,
+              vw::ArgumentErr() << "the number of rays must match "
+                                << "the number of cameras.\n");
+    size_t num_pixels = pixels.empty() ? 0 : pixels[0].size();
+    for (int p = 1; p < num_cams; p++)
+      VW_ASSERT(pixels[p].size() == num_pixels,
+                vw::ArgumentErr() << "Each camera must see the same number of pixels.\n");
+
+    vector<const RPCModel*> rpc_cams = rpc_models();
+    points.assign(num_pixels, Vector3());
+    errors.assign(num_pixels, Vector3());
+
+    // The rays, one array per camera. A pixel with a ray which could
+    // not be found is dropped, as operator() would.
+    vector< vector<Vector3> > ctrs(num_cams, vector<Vector3>(num_pixels)),
+                              dirs(num_cams, vector<Vector3>(num_pixels));
+    vector< vector<unsigned char> > has_ray(num_cams, vector<unsigned char>(num_pixels, 0));
+    vector<unsigned char> failed(num_pixels, 0);
+    for (int p = 0; p < num_cams; p++){
+      for (size_t i = 0; i < num_pixels; i++){
+        Vector2 const& pix = pixels[p][i];
+        if (failed[i] || pix != pix || // i.e., NaN
+            pix == camera::CameraModel::invalid_pixel() ) continue;
+        try {
+          rpc_cams[p]->point_and_dir(pix, ctrs[p][i], dirs[p][i]);
+          has_ray[p][i] = 1;
+        } catch (const camera::PixelToRayErr& /*e*/) {
+          failed[i] = 1;
+        }
+      }
+    }
+
+    vector<Vector2> pixVec(num_cams);
+    vector<Vector3> camDirs, camCtrs;
+    for (size_t i = 0; i < num_pixels; i++){
+      if (failed[i])
+        continue;
+      camDirs.clear();
+      camCtrs.clear();
+      for (int p = 0; p < num_cams; p++){
+        pixVec[p] = pixels[p][i];
+        if (!has_ray[p][i])
+          continue;
+        camDirs.push_back(dirs[p][i]);
+        camCtrs.push_back(ctrs[p][i]);
+      }
+      try {
+        points[i] = intersect(rpc_cams, pixVec, camDirs, camCtrs, errors[i]);
+      } catch (const camera::PixelToRayErr& /*e*/) {
+        points[i] = Vector3();
+      }
+    }
+  }
 
-      // Not enough valid rays
-      if (camDirs.size() < 2) 
-          return Vector3();
+  Vector3 RPCStereoModel::intersect(vector<const RPCModel*> const& rpc_cams,
+                                    vector<Vector2> const& pixVec,
+                                    vector<Vector3> const& camDirs,
+                                    vector<Vector3> const& camCtrs,
+                                    Vector3& errorVec) const {
 
-      if (are_nearly_parallel(m_least_squares, m_angle_tol, camDirs)) 
-          return Vector3();
+    // Not enough valid rays
+    if (camDirs.size() < 2) 
+        return Vector3();
 
-      // Determine range by triangulation
-      Vector3 result = triangulate_point(camDirs, camCtrs, errorVec);
+    if (are_nearly_parallel(m_least_squares, m_angle_tol, camDirs)) 
+        return Vector3();
 
-      if ( m_least_squares ){
+    // Determine range by triangulation
+    Vector3 result = triangulate_point(camDirs, camCtrs, errorVec);
 
-        // Refine triangulation
+    if ( m_least_squares ){
 
-        if (num_cams != 2)
-          vw::vw_throw(vw::NoImplErr() << "Least squares refinement is not "
-                       << "implemented for multi-view stereo.");
+      // Refine triangulation
 
-        detail::RPCTriangulateLMA model(rpc_cams[0], rpc_cams[1]);
-        Vector4 objective(pixVec[0][0], pixVec[0][1], pixVec[1][0], pixVec[1][1]);
-        int status = 0;
+      if (rpc_cams.size() != 2)
+        vw::vw_throw(vw::NoImplErr() << "Least squares refinement is not "
+                     << "implemented for multi-view stereo.");
 
-        Vector3 initialGeodetic = rpc_cams[0]->datum().cartesian_to_geodetic(result);
+      detail::RPCTriangulateLMA model(rpc_cams[0], rpc_cams[1]);
+      Vector4 objective(pixVec[0][0], pixVec[0][1], pixVec[1][0], pixVec[1][1]);
+      int status = 0;
 
-        // To do: Find good values for the numbers controlling the convergence
-        Vector3 finalGeodetic = levenberg_marquardt( model, initialGeodetic,
-                                                     objective, status, 1e-3, 1e-6, 10 );
+      Vector3 initialGeodetic = rpc_cams[0]->datum().cartesian_to_geodetic(result);
 
-        if ( status > 0 )
-          result = rpc_cams[0]->datum().geodetic_to_cartesian(finalGeodetic);
-      } // End least squares case
+      // To do: Find good values for the numbers controlling the convergence
+      Vector3 finalGeodetic = levenberg_marquardt( model, initialGeodetic,
+                                                   objective, status, 1e-3, 1e-6, 10 );
 
+      if ( status > 0 )
+        result = rpc_cams[0]->datum().geodetic_to_cartesian(finalGeodetic);
+    } // End least squares case
 
-      // Reflect points that fall behind one of the two cameras
-      bool reflect = false;
-      for (int p = 0; p < (int)camCtrs.size(); p++)
-        if (dot_prod(result - camCtrs[p], camDirs[p]) < 0 ) reflect = true;
-      if (reflect)
-        result = -result + 2*camCtrs[0];
 
-      return result;
+    // Reflect points that fall behind one of the two cameras
+    bool reflect = false;
+    for (int p = 0; p < (int)camCtrs.size(); p++)
+      if (dot_prod(result - camCtrs[p], camDirs[p]) < 0 ) reflect = true;
+    if (reflect)
+      result = -result + 2*camCtrs[0];
 
-    } catch (const camera::PixelToRayErr& /*e*/) {}
-    return Vector3();
+    return result;
   }
 
   Vector3 RPCStereoModel::operator()(vw::Vector2 const& pix1,
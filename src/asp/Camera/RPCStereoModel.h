@@ -32,6 +32,8 @@ namespace vw {
 
 namespace asp {
 
+  class RPCModel;
+
   /// Derived StereoModel class implementing the RPC camera model.
   /// - Using a seperate class allows us to get a speed improvement in ray generation.
   class RPCStereoModel: public vw::stereo::StereoModel {
@@ -64,6 +66,26 @@ namespace asp {
     virtual vw::Vector3 operator()(vw::Vector2 const& pix1,
                                    vw::Vector2 const& pix2,
                                    double& error) const;
+
+    /// Triangulate many pixels at once, such as a row of a tile.
+    /// pixels[c][i] is pixel i as seen in camera c. The RPC models are
+    /// looked up once, and the rays of each camera are found for all
+    /// the pixels before any of them is intersected. Gives the same
+    /// points and errors as operator() on each pixel.
+    void triangulate_batch(std::vector< std::vector<vw::Vector2> > const& pixels,
+                           std::vector<vw::Vector3> & points,
+                           std::vector<vw::Vector3> & errors) const;
+
+  private:
+
+    std::vector<const RPCModel*> rpc_models() const;
+
+    /// Intersect the valid rays of one pixel, given in camera order.
+    vw::Vector3 intersect(std::vector<const RPCModel*> const& rpc_cams,
+                          std::vector<vw::Vector2> const& pixVec,
+                          std::vector<vw::Vector3> const& camDirs,
+                          std::vector<vw::Vector3> const& camCtrs,
+                          vw::Vector3& errorVec) const;
   };
   
 } // namespace asp
@@ -0,0 +1,151 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <vw/Camera/CameraModel.h>
+#include <vw/Stereo/StereoModel.h>
+#include <test/Helpers.h>
+#include <asp/Camera/CameraRayTable.h>
+
+#include <cmath>
+#include <cstdlib>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+
+  const double PLANET_RADIUS = 6.4e6, HEIGHT = 6.0e5;
+
+  // A pushbroom camera in orbit, with pointing jitter along the track
+  // and a lens distortion across it. It has no rays past a column.
+  class ToyLinescan: public camera::CameraModel {
+    double m_tilt, m_max_col;
+  public:
+    ToyLinescan(double tilt, double max_col): m_tilt(tilt), m_max_col(max_col) {}
+
+    virtual Vector3 camera_center(Vector2 const& pix) const {
+      check(pix);
+      double a = pix.y()*1e-7;
+      return Vector3((PLANET_RADIUS + HEIGHT)*cos(a), (PLANET_RADIUS + HEIGHT)*sin(a),
+                     m_tilt*HEIGHT);
+    }
+    virtual Vector3 pixel_to_vector(Vector2 const& pix) const {
+      check(pix);
+      double a = pix.y()*1e-7, x = pix.x() - 500;
+      Vector3 down(-cos(a), -sin(a), 0), along(-sin(a), cos(a), 0), across(0, 0, 1);
+      return normalize(down + (x*1e-6*(1 + 1e-4*x) - m_tilt)*across
+                       + 2e-6*sin(pix.y()/40)*along);
+    }
+    virtual Vector2 point_to_pixel(Vector3 const& /*point*/) const { return Vector2(); }
+    virtual std::string type() const { return "ToyLinescan"; }
+
+  private:
+    void check(Vector2 const& pix) const {
+      if (pix.x() > m_max_col)
+        vw_throw(camera::PixelToRayErr() << "No ray.\n");
+    }
+  };
+
+  // The error of a ray in pixels, which are about 0.6 m on the ground
+  double ray_error(Vector3 const& ctr1, Vector3 const& dir1,
+                   Vector3 const& ctr2, Vector3 const& dir2, double range) {
+    return norm_2((ctr1 + range*dir1) - (ctr2 + range*dir2))/(range*1e-6);
+  }
+}
+
+TEST( CameraRayTable, WithinTolerance ) {
+  ToyLinescan camera(0, 1e6);
+  BBox2 box(0, 0, 500, 400);
+  CameraRayTable coarse(&camera, box, 64, 1.0,  HEIGHT);
+  CameraRayTable fine  (&camera, box, 64, 0.05, HEIGHT);
+  EXPECT_GT(fine.num_cells(), coarse.num_cells());
+  // Far fewer rays than pixels were found exactly
+  EXPECT_LT(fine.num_exact(), size_t(500*400/20));
+
+  srand(4);
+  double max_error = 0;
+  for (int i = 0; i < 2000; i++) {
+    Vector2 pix(rand() % 5000 / 10.0, rand() % 4000 / 10.0);
+    Vector3 ctr, dir;
+    fine.ray(pix, ctr, dir);
+    max_error = std::max(max_error, ray_error(ctr, dir, camera.camera_center(pix),
+                                              camera.pixel_to_vector(pix), HEIGHT));
+  }
+  // The cells are only checked at a few points each
+  EXPECT_LT(max_error, 0.1);
+}
+
+TEST( CameraRayTable, ExactWhereNoTable ) {
+  ToyLinescan camera(0, 300);
+  CameraRayTable table(&camera, BBox2(0, 0, 500, 400), 64, 0.1, HEIGHT);
+
+  // Out of the table
+  Vector2 pix(-10.5, 20.25);
+  Vector3 ctr, dir;
+  table.ray(pix, ctr, dir);
+  EXPECT_EQ(ctr, camera.camera_center(pix));
+  EXPECT_EQ(dir, camera.pixel_to_vector(pix));
+
+  // In cells where the camera has no ray at some node
+  pix = Vector2(290.5, 20.25);
+  table.ray(pix, ctr, dir);
+  EXPECT_EQ(dir, camera.pixel_to_vector(pix));
+  EXPECT_THROW(table.ray(Vector2(350, 20), ctr, dir), camera::PixelToRayErr);
+
+  // Elsewhere it is interpolated
+  pix = Vector2(100.5, 20.25);
+  table.ray(pix, ctr, dir);
+  EXPECT_LT(ray_error(ctr, dir, camera.camera_center(pix), camera.pixel_to_vector(pix), HEIGHT),
+            0.2);
+}
+
+TEST( CameraRayTable, MatchesExactTriangulation ) {
+  ToyLinescan left(0, 1e6), right(0.3, 450);
+  std::vector<const camera::CameraModel*> cameras;
+  cameras.push_back(&left);
+  cameras.push_back(&right);
+  RayTableStereoModel table_model(cameras, 0, 64, 0.05, PLANET_RADIUS);
+  vw::stereo::StereoModel exact_model(cameras, false, 0);
+
+  std::vector<BBox2> boxes(2, BBox2(0, 0, 500, 300));
+  std::vector<CameraRayTable> tables = table_model.tabulate(boxes);
+
+  const int NUM_PIXELS = 50;
+  std::vector< std::vector<Vector2> > pixels(2, std::vector<Vector2>(NUM_PIXELS));
+  for (int i = 0; i < NUM_PIXELS; i++) {
+    pixels[0][i] = Vector2(10.5*i, 3.25*i);
+    pixels[1][i] = pixels[0][i] + Vector2(0.5, 0);
+  }
+  pixels[1][7] = Vector2(std::nan(""), std::nan(""));
+
+  std::vector<Vector3> points, errors;
+  table_model.triangulate_batch(tables, pixels, points, errors);
+  ASSERT_EQ(points.size(), size_t(NUM_PIXELS));
+  for (int i = 0; i < NUM_PIXELS; i++) {
+    if (i == 7 || pixels[1][i].x() > 450) {
+      // No match, or no ray in the right camera
+      EXPECT_EQ(points[i], Vector3());
+      continue;
+    }
+    std::vector<Vector2> pixVec(2);
+    pixVec[0] = pixels[0][i];
+    pixVec[1] = pixels[1][i];
+    Vector3 error;
+    Vector3 exact = exact_model(pixVec, error);
+    EXPECT_LT(norm_2(points[i] - exact), 0.5) << i; // A pixel is 0.6 m
+  }
+}
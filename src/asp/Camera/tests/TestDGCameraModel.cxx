@@ -158,3 +158,43 @@ TEST(DGCameraModel, CreateCamera) {
   XMLPlatformUtils::Terminate();
 }
 
+
+TEST(DGCameraModel, LineCache) {
+
+  xercesc::XMLPlatformUtils::Initialize();
+
+  boost::shared_ptr<DGCameraModel> cam1 = load_dg_camera_model_from_xml("dg_example1.xml");
+  boost::shared_ptr<DGCameraModel> cam2 = load_dg_camera_model_from_xml("dg_example2.xml");
+  stereo::StereoModel sm(cam1.get(), cam2.get());
+
+  // A row of the left image, seen on varying lines of the right one
+  std::vector<Vector2> left, right;
+  for (int i = 0; i < 40; i++) {
+    left .push_back(Vector2(27728 + 3*i, 10702));
+    right.push_back(Vector2(30090 + 3*i, 10366 + 0.25*(i % 5)));
+  }
+  std::vector<Vector3> points;
+  std::vector<double>  errors;
+  for (size_t i = 0; i < left.size(); i++) {
+    double error;
+    points.push_back(sm(left[i], right[i], error));
+    errors.push_back(error);
+  }
+
+  // The values kept for a line are the ones found without them
+  typedef LinescanDGLineCache<vw::camera::PiecewiseAPositionInterpolation,
+                              vw::camera::SLERPPoseInterpolation> DGLineCache;
+  DGLineCache cache1(*cam1), cache2(*cam2);
+  stereo::StereoModel cached_sm(&cache1, &cache2);
+  for (size_t i = 0; i < left.size(); i++) {
+    double error;
+    EXPECT_EQ(points[i], cached_sm(left[i], right[i], error));
+    EXPECT_EQ(errors[i], error);
+    EXPECT_EQ(cache1.camera_center(left[i]), cam1->camera_center(left[i]));
+    EXPECT_EQ(cache1.pixel_to_vector(left[i]), cam1->pixel_to_vector(left[i]));
+    EXPECT_EQ(cache2.point_to_pixel(points[i], right[i].y()),
+              cam2->point_to_pixel(points[i], right[i].y()));
+  }
+
+  XMLPlatformUtils::Terminate();
+}
@@ -31,6 +31,7 @@
 #include <asp/Camera/RPCStereoModel.h>
 #include <asp/Core/StereoSettings.h>
 #include <xercesc/util/PlatformUtils.hpp>
+#include <limits>
 
 
 using namespace vw;
@@ -136,6 +137,43 @@ TEST( RPCStereoModel, greenlandMatchTest ) {
   xercesc::XMLPlatformUtils::Terminate();
 }
 
+TEST( RPCStereoModel, batchMatchesPixels ) {
+  xercesc::XMLPlatformUtils::Initialize();
+
+  boost::shared_ptr<vw::camera::CameraModel> camPtr1, camPtr2;
+  camPtr1 = load_rpc_camera_model("wv_mvp_1.xml");
+  camPtr2 = load_rpc_camera_model("wv_mvp_2.xml");
+  asp::RPCStereoModel rpcStereoModel(camPtr1.get(), camPtr2.get());
+
+  // A row of pixels, one of which has no match
+  const int NUM_PIXELS = 10;
+  std::vector< std::vector<Vector2> > pixels(2, std::vector<Vector2>(NUM_PIXELS));
+  for (int i=0; i<NUM_PIXELS; ++i) {
+    pixels[0][i] = Vector2(10000 + i, 10000);
+    pixels[1][i] = Vector2(10000 + 0.5*i, 10000);
+  }
+  pixels[1][3] = Vector2(std::numeric_limits<double>::quiet_NaN(),
+                         std::numeric_limits<double>::quiet_NaN());
+
+  std::vector<Vector3> points, errors;
+  rpcStereoModel.triangulate_batch(pixels, points, errors);
+  ASSERT_EQ(points.size(), size_t(NUM_PIXELS));
+  ASSERT_EQ(errors.size(), size_t(NUM_PIXELS));
+
+  std::vector<Vector2> pixVec(2);
+  for (int i=0; i<NUM_PIXELS; ++i) {
+    pixVec[0] = pixels[0][i];
+    pixVec[1] = pixels[1][i];
+    Vector3 errorVec;
+    Vector3 xyz = rpcStereoModel(pixVec, errorVec);
+    EXPECT_VECTOR_NEAR(xyz,      points[i], 1e-8);
+    EXPECT_VECTOR_NEAR(errorVec, errors[i], 1e-8);
+  }
+  EXPECT_EQ(points[3], Vector3());
+
+  xercesc::XMLPlatformUtils::Terminate();
+}
+
 
 
 TEST( StereoSessionRPC, InstantiateTest ) {
@@ -0,0 +1,358 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file AffineSubpixel.cc
+///
+
+#include <vw/Core/Exception.h>
+#include <asp/Core/AffineSubpixel.h>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+using namespace vw;
+
+namespace asp {
+
+namespace {
+
+  const int NUM_PARAMS = 6;
+
+  // Bilinear interpolation, with coordinates past the edges clamped
+  inline float sample(ImageView<float> const& image, double x, double y) {
+    x = std::min(std::max(x, 0.0), double(image.cols() - 1));
+    y = std::min(std::max(y, 0.0), double(image.rows() - 1));
+    int x0 = std::min(int(x), image.cols() - 2), y0 = std::min(int(y), image.rows() - 2);
+    x0 = std::max(x0, 0);
+    y0 = std::max(y0, 0);
+    int x1 = std::min(x0 + 1, image.cols() - 1), y1 = std::min(y0 + 1, image.rows() - 1);
+    double ax = x - x0, ay = y - y0;
+    return float((1 - ay)*((1 - ax)*image(x0, y0) + ax*image(x1, y0)) +
+                 ay      *((1 - ax)*image(x0, y1) + ax*image(x1, y1)));
+  }
+
+  template <class PixelT>
+  inline PixelT fetch(ImageView<PixelT> const& image, int x, int y) {
+    x = std::min(std::max(x, 0), image.cols() - 1);
+    y = std::min(std::max(y, 0), image.rows() - 1);
+    return image(x, y);
+  }
+
+  // Whether all the pixels bilinear sampling at (x, y) reads are valid
+  inline bool sample_valid(ImageView<uint8> const& mask, double x, double y) {
+    x = std::min(std::max(x, 0.0), double(mask.cols() - 1));
+    y = std::min(std::max(y, 0.0), double(mask.rows() - 1));
+    int x0 = std::max(std::min(int(x), mask.cols() - 2), 0);
+    int y0 = std::max(std::min(int(y), mask.rows() - 2), 0);
+    int x1 = std::min(x0 + 1, mask.cols() - 1), y1 = std::min(y0 + 1, mask.rows() - 1);
+    return mask(x0, y0) && mask(x1, y0) && mask(x0, y1) && mask(x1, y1);
+  }
+
+  // Central differences, one-sided at the edges and next to the pixels
+  // the mask leaves out, if there is a mask
+  void gradients(ImageView<float> const& image, ImageView<uint8> const& mask,
+                 ImageView<float> & grad_x, ImageView<float> & grad_y) {
+    int cols = image.cols(), rows = image.rows();
+    bool masked = (mask.cols() > 0);
+    grad_x.set_size(cols, rows);
+    grad_y.set_size(cols, rows);
+    for (int row = 0; row < rows; row++) {
+      for (int col = 0; col < cols; col++) {
+        int l = std::max(col - 1, 0), r = std::min(col + 1, cols - 1);
+        int t = std::max(row - 1, 0), b = std::min(row + 1, rows - 1);
+        if (masked) {
+          if (!mask(l, row)) l = col;
+          if (!mask(r, row)) r = col;
+          if (!mask(col, t)) t = row;
+          if (!mask(col, b)) b = row;
+        }
+        grad_x(col, row) = (r > l) ? (image(r, row) - image(l, row)) / float(r - l) : 0.0f;
+        grad_y(col, row) = (b > t) ? (image(col, b) - image(col, t)) / float(b - t) : 0.0f;
+      }
+    }
+  }
+
+  // Solve the symmetric system in place by Gaussian elimination with
+  // partial pivoting. Returns false if it is singular.
+  bool solve(double H[NUM_PARAMS][NUM_PARAMS], double b[NUM_PARAMS], double x[NUM_PARAMS]) {
+    double scale = 0;
+    for (int i = 0; i < NUM_PARAMS; i++)
+      scale = std::max(scale, std::abs(H[i][i]));
+    if (scale <= 0)
+      return false;
+
+    for (int k = 0; k < NUM_PARAMS; k++) {
+      int pivot = k;
+      for (int i = k + 1; i < NUM_PARAMS; i++)
+        if (std::abs(H[i][k]) > std::abs(H[pivot][k]))
+          pivot = i;
+      if (std::abs(H[pivot][k]) <= 1e-12*scale)
+        return false;
+      if (pivot != k) {
+        for (int j = 0; j < NUM_PARAMS; j++)
+          std::swap(H[k][j], H[pivot][j]);
+        std::swap(b[k], b[pivot]);
+      }
+      for (int i = k + 1; i < NUM_PARAMS; i++) {
+        double f = H[i][k] / H[k][k];
+        for (int j = k; j < NUM_PARAMS; j++)
+          H[i][j] -= f*H[k][j];
+        b[i] -= f*b[k];
+      }
+    }
+    for (int i = NUM_PARAMS - 1; i >= 0; i--) {
+      double s = b[i];
+      for (int j = i + 1; j < NUM_PARAMS; j++)
+        s -= H[i][j]*x[j];
+      x[i] = s / H[i][i];
+    }
+    return true;
+  }
+
+} // end anonymous namespace
+
+IterationHistogram::IterationHistogram(int max_iterations):
+  m_counts(std::max(max_iterations, 0), 0), m_unconverged(0), m_failed(0), m_iterations(0) {}
+
+void IterationHistogram::add(int iterations, Outcome outcome) {
+  m_iterations += iterations;
+  if (outcome == FAILED) {
+    m_failed++;
+  } else if (outcome == UNCONVERGED) {
+    m_unconverged++;
+  } else {
+    VW_ASSERT(iterations >= 1,
+              ArgumentErr() << "IterationHistogram: A pixel cannot converge in "
+              << iterations << " iterations.\n");
+    if (size_t(iterations) > m_counts.size())
+      m_counts.resize(iterations, 0);
+    m_counts[iterations - 1]++;
+  }
+}
+
+IterationHistogram & IterationHistogram::operator+=(IterationHistogram const& other) {
+  if (other.m_counts.size() > m_counts.size())
+    m_counts.resize(other.m_counts.size(), 0);
+  for (size_t i = 0; i < other.m_counts.size(); i++)
+    m_counts[i] += other.m_counts[i];
+  m_unconverged += other.m_unconverged;
+  m_failed      += other.m_failed;
+  m_iterations  += other.m_iterations;
+  return *this;
+}
+
+size_t IterationHistogram::converged_after(int iterations) const {
+  if (iterations < 1 || size_t(iterations) > m_counts.size())
+    return 0;
+  return m_counts[iterations - 1];
+}
+
+size_t IterationHistogram::num_converged() const {
+  size_t n = 0;
+  for (size_t i = 0; i < m_counts.size(); i++)
+    n += m_counts[i];
+  return n;
+}
+
+double IterationHistogram::mean_iterations() const {
+  size_t n = num_pixels();
+  return (n == 0) ? 0.0 : double(m_iterations) / n;
+}
+
+std::string IterationHistogram::summary() const {
+  std::ostringstream os;
+  for (size_t i = 0; i < m_counts.size(); i++)
+    os << i + 1 << ":" << m_counts[i] << " ";
+  os << "unconverged:" << m_unconverged << " failed:" << m_failed
+     << " mean:" << std::fixed << std::setprecision(2) << mean_iterations();
+  return os.str();
+}
+
+// Forward-additive Gauss-Newton on the window around each pixel. A
+// window offset (u, v) of the left pixel p is matched to the right
+// point p + (u, v) + d + B*(u, v), for the disparity d and the 2x2
+// deformation B, which starts at zero.
+void converging_affine_subpixel(ImageView<float> const& left,  Vector2i const& left_origin,
+                                ImageView<float> const& right, Vector2i const& right_origin,
+                                Vector2i const& disp_origin, DisparityPlanes & disparity,
+                                AffineSubpixelOptions const& opt, IterationHistogram & histogram) {
+  converging_affine_subpixel(left, ImageView<uint8>(), left_origin,
+                             right, ImageView<uint8>(), right_origin,
+                             disp_origin, disparity, opt, histogram);
+}
+
+void converging_affine_subpixel(ImageView<float> const& left, ImageView<uint8> const& left_mask,
+                                Vector2i const& left_origin,
+                                ImageView<float> const& right, ImageView<uint8> const& right_mask,
+                                Vector2i const& right_origin,
+                                Vector2i const& disp_origin, DisparityPlanes & disparity,
+                                AffineSubpixelOptions const& opt, IterationHistogram & histogram) {
+
+  VW_ASSERT(opt.kernel_size.x() >= 3 && opt.kernel_size.x() % 2 == 1 &&
+            opt.kernel_size.y() >= 3 && opt.kernel_size.y() % 2 == 1,
+            ArgumentErr() << "converging_affine_subpixel: The kernel sizes must be odd "
+            << "and at least 3, not " << opt.kernel_size << ".\n");
+  VW_ASSERT(opt.max_iterations >= 1 && opt.threshold > 0,
+            ArgumentErr() << "converging_affine_subpixel: Need at least one iteration "
+            << "and a positive threshold.\n");
+  if (left.cols() < 2 || left.rows() < 2 || right.cols() < 2 || right.rows() < 2)
+    vw_throw(ArgumentErr() << "converging_affine_subpixel: The images must be at least "
+             << "2 x 2 pixels.\n");
+  const bool masked = (left_mask.cols() > 0 || right_mask.cols() > 0);
+  if (masked && (left_mask.cols()  != left.cols()  || left_mask.rows()  != left.rows() ||
+                 right_mask.cols() != right.cols() || right_mask.rows() != right.rows()))
+    vw_throw(ArgumentErr() << "converging_affine_subpixel: The masks must be the size "
+             << "of the images.\n");
+
+  ImageView<float> grad_x, grad_y;
+  gradients(right, right_mask, grad_x, grad_y);
+
+  const int half_x = opt.kernel_size.x() / 2, half_y = opt.kernel_size.y() / 2;
+  const int window_size = opt.kernel_size.x() * opt.kernel_size.y();
+  std::vector<float> templ(window_size);
+  std::vector<uint8> templ_valid(window_size, 1);
+
+  for (int row = 0; row < disparity.rows; row++) {
+    for (int col = 0; col < disparity.cols; col++) {
+      size_t k = disparity.index(col, row);
+      if (!disparity.valid[k])
+        continue;
+
+      // The pixel, in the left and right crops
+      int lx = disp_origin.x() + col - left_origin.x();
+      int ly = disp_origin.y() + row - left_origin.y();
+      double rx = disp_origin.x() + col - right_origin.x();
+      double ry = disp_origin.y() + row - right_origin.y();
+
+      if (masked && !fetch(left_mask, lx, ly)) {
+        histogram.add(0, IterationHistogram::FAILED);
+        disparity.valid[k] = 0;
+        continue;
+      }
+
+      int w = 0;
+      for (int v = -half_y; v <= half_y; v++) {
+        for (int u = -half_x; u <= half_x; u++, w++) {
+          templ[w] = fetch(left, lx + u, ly + v);
+          if (masked)
+            templ_valid[w] = fetch(left_mask, lx + u, ly + v);
+        }
+      }
+
+      double p[NUM_PARAMS] = {disparity.dx[k], disparity.dy[k], 0, 0, 0, 0};
+      const double seed_x = p[0], seed_y = p[1];
+      int iterations = 0;
+      IterationHistogram::Outcome outcome = IterationHistogram::UNCONVERGED;
+
+      while (iterations < opt.max_iterations) {
+        iterations++;
+        double H[NUM_PARAMS][NUM_PARAMS] = {{0}}, b[NUM_PARAMS] = {0};
+        w = 0;
+        for (int v = -half_y; v <= half_y; v++) {
+          for (int u = -half_x; u <= half_x; u++, w++) {
+            double qx = rx + u + p[0] + p[2]*u + p[3]*v;
+            double qy = ry + v + p[1] + p[4]*u + p[5]*v;
+            if (masked && (!templ_valid[w] || !sample_valid(right_mask, qx, qy)))
+              continue;
+            double r  = sample(right, qx, qy) - templ[w];
+            double gx = sample(grad_x, qx, qy), gy = sample(grad_y, qx, qy);
+
+            double J[NUM_PARAMS] = {gx, gy, gx*u, gx*v, gy*u, gy*v};
+            for (int i = 0; i < NUM_PARAMS; i++) {
+              b[i] -= J[i]*r;
+              for (int j = i; j < NUM_PARAMS; j++)
+                H[i][j] += J[i]*J[j];
+            }
+          }
+        }
+        for (int i = 0; i < NUM_PARAMS; i++)
+          for (int j = 0; j < i; j++)
+            H[i][j] = H[j][i];
+
+        double delta[NUM_PARAMS];
+        if (!solve(H, b, delta)) {
+          outcome = IterationHistogram::FAILED;
+          break;
+        }
+        for (int i = 0; i < NUM_PARAMS; i++)
+          p[i] += delta[i];
+
+        if (std::abs(p[0] - seed_x) > opt.max_shift || std::abs(p[1] - seed_y) > opt.max_shift ||
+            p[0] != p[0] || p[1] != p[1]) {
+          outcome = IterationHistogram::FAILED;
+          break;
+        }
+        if (std::abs(delta[0]) < opt.threshold && std::abs(delta[1]) < opt.threshold) {
+          outcome = IterationHistogram::CONVERGED;
+          break;
+        }
+      }
+
+      histogram.add(iterations, outcome);
+      if (outcome == IterationHistogram::FAILED) {
+        disparity.valid[k] = 0;
+        continue;
+      }
+      disparity.dx[k] = float(p[0]);
+      disparity.dy[k] = float(p[1]);
+    }
+  }
+}
+
+void SubpixelIterationLog::record(BBox2i const& tile, IterationHistogram const& histogram) {
+  Mutex::Lock lock(m_mutex);
+  m_tiles[std::make_pair(tile.min().y(), tile.min().x())] = std::make_pair(tile, histogram);
+}
+
+void SubpixelIterationLog::clear() {
+  Mutex::Lock lock(m_mutex);
+  m_tiles.clear();
+}
+
+size_t SubpixelIterationLog::num_tiles() const {
+  Mutex::Lock lock(m_mutex);
+  return m_tiles.size();
+}
+
+IterationHistogram SubpixelIterationLog::total() const {
+  Mutex::Lock lock(m_mutex);
+  IterationHistogram sum;
+  for (TileMap::const_iterator it = m_tiles.begin(); it != m_tiles.end(); it++)
+    sum += it->second.second;
+  return sum;
+}
+
+void SubpixelIterationLog::write(std::string const& filename) const {
+  std::ofstream out(filename.c_str());
+  if (!out)
+    vw_throw(IOErr() << "Cannot write: " << filename << "\n");
+
+  Mutex::Lock lock(m_mutex);
+  for (TileMap::const_iterator it = m_tiles.begin(); it != m_tiles.end(); it++) {
+    BBox2i const& tile = it->second.first;
+    out << tile.min().x() << " " << tile.min().y() << " "
+        << tile.width() << " " << tile.height() << " "
+        << it->second.second.summary() << "\n";
+  }
+  if (!out)
+    vw_throw(IOErr() << "Failed writing: " << filename << "\n");
+}
+
+} // namespace asp
@@ -0,0 +1,124 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file AffineSubpixel.h
+///
+/// Affine adaptive subpixel refinement in which each pixel iterates
+/// only until its disparity update falls under a threshold, rather
+/// than for a fixed number of iterations. The number of iterations
+/// each pixel used is tallied, per tile and for the whole run.
+
+#ifndef __ASP_CORE_AFFINE_SUBPIXEL_H__
+#define __ASP_CORE_AFFINE_SUBPIXEL_H__
+
+#include <asp/Core/DisparityPlanes.h>
+#include <vw/Core/Thread.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Math/BBox.h>
+#include <vw/Math/Vector.h>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace asp {
+
+  struct AffineSubpixelOptions {
+    vw::Vector2i kernel_size;    ///< Width and height of the matching window, both odd
+    int          max_iterations; ///< A pixel which has not converged by then is kept as is
+    double       threshold;      ///< A pixel converges when both disparity updates are under this
+    double       max_shift;      ///< Invalidate a pixel moving further than this from its seed
+
+    AffineSubpixelOptions(): kernel_size(21, 21), max_iterations(5), threshold(0.01),
+                             max_shift(1.5) {}
+  };
+
+  /// How many iterations the refined pixels took.
+  class IterationHistogram {
+  public:
+    enum Outcome { CONVERGED, UNCONVERGED, FAILED };
+
+    IterationHistogram(int max_iterations = 0);
+
+    void add(int iterations, Outcome outcome);
+    IterationHistogram & operator+=(IterationHistogram const& other);
+
+    /// Number of pixels which converged after exactly the given number of iterations
+    size_t converged_after(int iterations) const;
+    size_t num_converged  () const;
+    size_t num_unconverged() const { return m_unconverged; }
+    size_t num_failed     () const { return m_failed; }
+    size_t num_pixels     () const { return num_converged() + m_unconverged + m_failed; }
+    double mean_iterations() const;
+
+    /// One line, such as "1:5120 2:880 3:12 unconverged:3 failed:40 mean:1.15".
+    std::string summary() const;
+
+  private:
+    std::vector<size_t> m_counts; ///< m_counts[i] pixels converged after i+1 iterations
+    size_t m_unconverged, m_failed, m_iterations;
+  };
+
+  /// Refine the disparity of each valid pixel in place. The left and
+  /// right images must be filtered already, and are crops whose pixel
+  /// (0, 0) is at left_origin and right_origin of the full images, and
+  /// pixel (0, 0) of the disparity is at disp_origin. Samples outside
+  /// the crops take the value of the nearest edge, so the crops should
+  /// extend past the disparity by half the kernel and the search range.
+  /// A pixel is invalidated if its system is singular or it moves more
+  /// than max_shift from where it started.
+  void converging_affine_subpixel(vw::ImageView<float> const& left,  vw::Vector2i const& left_origin,
+                                  vw::ImageView<float> const& right, vw::Vector2i const& right_origin,
+                                  vw::Vector2i const& disp_origin, DisparityPlanes & disparity,
+                                  AffineSubpixelOptions const& opt, IterationHistogram & histogram);
+
+  /// As above, but each window leaves out the left pixels where the left
+  /// mask is 0, and the right samples which touch a pixel where the right
+  /// mask is 0. The masks are the size of the crops. A pixel whose own
+  /// left mask is 0 is invalidated.
+  void converging_affine_subpixel(vw::ImageView<float> const& left,
+                                  vw::ImageView<vw::uint8> const& left_mask,
+                                  vw::Vector2i const& left_origin,
+                                  vw::ImageView<float> const& right,
+                                  vw::ImageView<vw::uint8> const& right_mask,
+                                  vw::Vector2i const& right_origin,
+                                  vw::Vector2i const& disp_origin, DisparityPlanes & disparity,
+                                  AffineSubpixelOptions const& opt, IterationHistogram & histogram);
+
+  /// The histograms of the tiles of a run, filled from many threads.
+  /// A tile computed again replaces its earlier histogram.
+  class SubpixelIterationLog {
+  public:
+    void record(vw::BBox2i const& tile, IterationHistogram const& histogram);
+    void clear();
+
+    size_t             num_tiles() const;
+    IterationHistogram total    () const;
+
+    /// Write one line per tile, "min_x min_y width height histogram".
+    void write(std::string const& filename) const;
+
+  private:
+    typedef std::map<std::pair<int, int>, std::pair<vw::BBox2i, IterationHistogram> > TileMap;
+    mutable vw::Mutex m_mutex;
+    TileMap           m_tiles;
+  };
+
+} // namespace asp
+
+#endif // __ASP_CORE_AFFINE_SUBPIXEL_H__
@@ -0,0 +1,135 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file BBoxIndex.cc
+///
+
+#include <asp/Core/BBoxIndex.h>
+#include <algorithm>
+#include <cmath>
+
+using namespace vw;
+
+namespace asp {
+
+namespace {
+
+  const size_t NODE_SIZE = 16; // Children per node
+
+  struct CenterXLess {
+    template <class NodeT>
+    bool operator()(NodeT const& a, NodeT const& b) const {
+      return a.min_x + a.max_x < b.min_x + b.max_x;
+    }
+  };
+  struct CenterYLess {
+    template <class NodeT>
+    bool operator()(NodeT const& a, NodeT const& b) const {
+      return a.min_y + a.max_y < b.min_y + b.max_y;
+    }
+  };
+
+  // Sort the nodes into vertical slices, and each slice from bottom to
+  // top, then group each NODE_SIZE of them under a parent.
+  template <class NodeT>
+  void pack(std::vector<NodeT> & nodes, std::vector<NodeT> & parents) {
+    size_t num_parents = (nodes.size() + NODE_SIZE - 1)/NODE_SIZE;
+    size_t num_slices  = size_t(ceil(sqrt(double(num_parents))));
+    size_t slice_size  = num_slices*NODE_SIZE;
+
+    std::sort(nodes.begin(), nodes.end(), CenterXLess());
+    for (size_t start = 0; start < nodes.size(); start += slice_size)
+      std::sort(nodes.begin() + start,
+                nodes.begin() + std::min(start + slice_size, nodes.size()),
+                CenterYLess());
+
+    parents.clear();
+    for (size_t start = 0; start < nodes.size(); start += NODE_SIZE) {
+      NodeT parent = nodes[start];
+      parent.first = start;
+      parent.last  = std::min(start + NODE_SIZE, nodes.size());
+      for (size_t k = start + 1; k < parent.last; k++) {
+        parent.min_x = std::min(parent.min_x, nodes[k].min_x);
+        parent.min_y = std::min(parent.min_y, nodes[k].min_y);
+        parent.max_x = std::max(parent.max_x, nodes[k].max_x);
+        parent.max_y = std::max(parent.max_y, nodes[k].max_y);
+      }
+      parents.push_back(parent);
+    }
+  }
+
+  template <class NodeT>
+  bool overlaps(NodeT const& node, BBox2 const& box) {
+    return node.min_x <= box.max().x() && box.min().x() <= node.max_x &&
+           node.min_y <= box.max().y() && box.min().y() <= node.max_y;
+  }
+
+} // end anonymous namespace
+
+void BBoxIndex::build(std::vector<BBox2> const& boxes) {
+  m_leaves.clear();
+  m_levels.clear();
+  for (size_t i = 0; i < boxes.size(); i++) {
+    if (boxes[i].empty())
+      continue;
+    Node leaf;
+    leaf.min_x = boxes[i].min().x();
+    leaf.min_y = boxes[i].min().y();
+    leaf.max_x = boxes[i].max().x();
+    leaf.max_y = boxes[i].max().y();
+    leaf.first = i;
+    leaf.last  = i + 1;
+    m_leaves.push_back(leaf);
+  }
+  if (m_leaves.empty())
+    return;
+
+  // Each level is packed after its children are in place, so a node's
+  // children are always a contiguous range of the level below.
+  m_levels.push_back(std::vector<Node>());
+  pack(m_leaves, m_levels.back());
+  while (m_levels.back().size() > 1) {
+    std::vector<Node> parents;
+    pack(m_levels.back(), parents);
+    m_levels.push_back(parents);
+  }
+}
+
+void BBoxIndex::query(BBox2 const& box, std::vector<size_t> & indices) const {
+  indices.clear();
+  if (m_levels.empty() || box.empty())
+    return;
+  query(int(m_levels.size()) - 1, 0, box, indices);
+  std::sort(indices.begin(), indices.end());
+}
+
+void BBoxIndex::query(int level, size_t node, BBox2 const& box,
+                      std::vector<size_t> & indices) const {
+  Node const& n = m_levels[level][node];
+  if (!overlaps(n, box))
+    return;
+  for (size_t c = n.first; c < n.last; c++) {
+    if (level > 0) {
+      query(level - 1, c, box, indices);
+    } else if (overlaps(m_leaves[c], box)) {
+      indices.push_back(m_leaves[c].first);
+    }
+  }
+}
+
+} // namespace asp
@@ -0,0 +1,65 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file BBoxIndex.h
+///
+/// A static R-tree of 2D boxes, packed with the sort-tile-recursive
+/// method. It is built once from all the boxes and then finds the ones
+/// which intersect a query box without looking at each of them. It is
+/// safe to query from many threads.
+
+#ifndef __ASP_CORE_BBOX_INDEX_H__
+#define __ASP_CORE_BBOX_INDEX_H__
+
+#include <vw/Math/BBox.h>
+#include <vector>
+
+namespace asp {
+
+  class BBoxIndex {
+  public:
+    BBoxIndex() {}
+
+    /// Index the given boxes. Empty boxes are left out, as they
+    /// intersect nothing.
+    explicit BBoxIndex(std::vector<vw::BBox2> const& boxes) { build(boxes); }
+    void build(std::vector<vw::BBox2> const& boxes);
+
+    /// The indices of the boxes that intersect the query box, in
+    /// increasing order. Boxes which only touch it are included, so
+    /// callers wanting a strict test should make it on the result.
+    void query(vw::BBox2 const& box, std::vector<size_t> & indices) const;
+
+    size_t size() const { return m_leaves.size(); }
+
+  private:
+    struct Node {
+      double min_x, min_y, max_x, max_y;
+      size_t first, last; // Children, in the level below or in m_leaves
+    };
+
+    void query(int level, size_t node, vw::BBox2 const& box,
+               std::vector<size_t> & indices) const;
+
+    std::vector<Node>   m_leaves;  // One per box, with first the box index
+    std::vector< std::vector<Node> > m_levels; // m_levels.back() is the root
+  };
+
+} // namespace asp
+
+#endif // __ASP_CORE_BBOX_INDEX_H__
@@ -0,0 +1,184 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file CenterlineWeights.h
+///
+/// Centerline weights of a window of an image, computed without
+/// loading the rest of it. The weight of a valid pixel only depends on
+/// where the valid pixels begin and end along its row and column, and
+/// those ends are found by reading inwards from the image edges until
+/// a valid pixel is met, which for a mostly valid image touches little
+/// more than the window itself.
+
+#ifndef __ASP_CORE_CENTERLINE_WEIGHTS_H__
+#define __ASP_CORE_CENTERLINE_WEIGHTS_H__
+
+#include <vw/Core/Exception.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Math/BBox.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace asp {
+
+  /// Where the valid pixels begin and end, inclusive, along each row and
+  /// column crossing a window of an image. Both are -1 for a line with
+  /// no valid pixels.
+  struct CenterlineExtents {
+    vw::BBox2i       roi;
+    std::vector<int> row_begin, row_end; ///< Columns, for each row of roi
+    std::vector<int> col_begin, col_end; ///< Rows, for each column of roi
+  };
+
+  /// The weight of a position along a line whose valid pixels span from
+  /// begin to end, as vw::centerline_weights finds it: 1 at the center of
+  /// that span, falling linearly to 0 at either end. A line with a single
+  /// valid pixel, or none, gives 0.
+  inline double centerline_weight(double pos, int begin, int end) {
+    if (begin < 0)
+      return 0.0;
+    double center   = (begin + end) / 2.0;
+    double max_dist = (end - begin) / 2.0;
+    if (max_dist <= 0)
+      return 0.0;
+    double weight = (max_dist - std::abs(pos - center)) / max_dist;
+    return std::max(weight, 0.0);
+  }
+
+  /// For each line (row if along_rows, else column) from first_line on
+  /// with todo set, find the first valid pixel, searching from the start
+  /// of the line if forward, else from its end. The image is read in
+  /// strips of strip_size pixels across the lines still being searched.
+  template <class ViewT>
+  void find_valid_line_ends(ViewT const& image, int first_line, std::vector<char> todo,
+                            bool along_rows, bool forward, int strip_size,
+                            std::vector<int> & ends) {
+    VW_ASSERT(strip_size > 0, vw::ArgumentErr() << "find_valid_line_ends: "
+              << "The strip size must be positive.\n");
+
+    int length = along_rows ? image.cols() : image.rows();
+    ends.assign(todo.size(), -1);
+
+    // Lines lo to hi - 1 hold all those still to do
+    int lo = 0, hi = todo.size();
+    for (int done = 0; done < length; done += strip_size) {
+      while (lo < hi && !todo[lo    ]) lo++;
+      while (hi > lo && !todo[hi - 1]) hi--;
+      if (lo == hi)
+        break;
+
+      int width = std::min(strip_size, length - done);
+      int start = forward ? done : length - done - width;
+      vw::BBox2i box = along_rows ? vw::BBox2i(start, first_line + lo, width, hi - lo)
+                                  : vw::BBox2i(first_line + lo, start, hi - lo, width);
+      vw::ImageView<typename ViewT::pixel_type> strip = vw::crop(image, box);
+
+      for (int line = lo; line < hi; line++) {
+        if (!todo[line])
+          continue;
+        for (int k = 0; k < width; k++) {
+          int pos = forward ? k : width - 1 - k;
+          bool valid = along_rows ? is_valid(strip(pos, line - lo))
+                                  : is_valid(strip(line - lo, pos));
+          if (valid) {
+            ends[line] = start + pos;
+            todo[line] = 0;
+            break;
+          }
+        }
+      }
+    }
+  }
+
+  /// Find where the valid pixels begin and end along lines of an image.
+  template <class ViewT>
+  void find_valid_line_extents(ViewT const& image, int first_line, int num_lines,
+                               bool along_rows, int strip_size,
+                               std::vector<int> & begins, std::vector<int> & ends) {
+    std::vector<char> todo(num_lines, 1);
+    find_valid_line_ends(image, first_line, todo, along_rows, true, strip_size, begins);
+
+    // Lines with nothing valid need no second pass
+    for (int i = 0; i < num_lines; i++)
+      todo[i] = (begins[i] >= 0);
+    find_valid_line_ends(image, first_line, todo, along_rows, false, strip_size, ends);
+  }
+
+  /// Find the extents of the valid pixels along the rows and columns
+  /// crossing the given window, which must be inside the image.
+  template <class ViewT>
+  void centerline_extents(vw::ImageViewBase<ViewT> const& image, vw::BBox2i const& roi,
+                          int strip_size, CenterlineExtents & extents) {
+    ViewT const& img = image.impl();
+    VW_ASSERT(vw::bounding_box(img).contains(roi),
+              vw::ArgumentErr() << "centerline_extents: Region " << roi
+              << " is not inside the image.\n");
+    extents.roi = roi;
+    find_valid_line_extents(img, roi.min().y(), roi.height(), true,  strip_size,
+                            extents.row_begin, extents.row_end);
+    find_valid_line_extents(img, roi.min().x(), roi.width(),  false, strip_size,
+                            extents.col_begin, extents.col_end);
+  }
+
+  /// Centerline weights of the given window of an image, whose pixels
+  /// are passed in. The weight of a valid pixel is the product of its
+  /// weights along its row and column, and that of an invalid one is 0.
+  /// This is what vw::centerline_weights returns for the window, with no
+  /// hole filling and without taking the smaller of the two weights.
+  template <class PixelT>
+  void centerline_weights_from_extents(CenterlineExtents const& extents,
+                                       vw::ImageView<PixelT> const& cropped,
+                                       vw::ImageView<double> & weights) {
+    vw::BBox2i const& roi = extents.roi;
+    VW_ASSERT(cropped.cols() == roi.width() && cropped.rows() == roi.height(),
+              vw::ArgumentErr() << "centerline_weights_from_extents: "
+              << "Expecting an image of size " << roi.size() << ".\n");
+
+    weights.set_size(roi.width(), roi.height());
+    for (int row = 0; row < roi.height(); row++) {
+      for (int col = 0; col < roi.width(); col++) {
+        if (!is_valid(cropped(col, row))) {
+          weights(col, row) = 0.0;
+          continue;
+        }
+        weights(col, row)
+          = centerline_weight(roi.min().x() + col, extents.row_begin[row], extents.row_end[row])
+          * centerline_weight(roi.min().y() + row, extents.col_begin[col], extents.col_end[col]);
+      }
+    }
+  }
+
+  /// Crop a window out of an image, which may be on disk, and compute
+  /// its centerline weights, reading the rest of the image in strips of
+  /// strip_size pixels only as far as needed.
+  template <class ViewT>
+  void centerline_weights_in_roi(vw::ImageViewBase<ViewT> const& image, vw::BBox2i const& roi,
+                                 vw::ImageView<typename ViewT::pixel_type> & cropped,
+                                 vw::ImageView<double> & weights, int strip_size = 256) {
+    CenterlineExtents extents;
+    centerline_extents(image, roi, strip_size, extents);
+    cropped = vw::crop(image.impl(), roi);
+    centerline_weights_from_extents(extents, cropped, weights);
+  }
+
+} // namespace asp
+
+#endif // __ASP_CORE_CENTERLINE_WEIGHTS_H__
@@ -314,6 +314,32 @@ double asp::get_rounding_error(vw::Vector3 const& shift, double rounding_error){
     return rounding_error;
 }
 
+// Set up the keywords and options for writing a point cloud as 32-bit
+// integers. Neighboring points are close, so differencing them before
+// compression (the TIFF horizontal predictor) shrinks the file a lot.
+double asp::quantized_write_options(vw::Vector3 const& shift, double rounding_error,
+                                    vw::cartography::GdalWriteOptions const& opt,
+                                    std::map<std::string, std::string> & keywords,
+                                    vw::cartography::GdalWriteOptions & quantized_opt){
+
+  VW_ASSERT(norm_2(shift) > 0, vw::ArgumentErr()
+            << "A quantized point cloud must be saved with a shift.\n");
+  double scale = get_rounding_error(shift, rounding_error);
+
+  std::ostringstream os;
+  os.precision(17);
+  os << scale;
+  keywords[ASP_POINT_OFFSET_TAG_STR] = vw::vec_to_str(shift);
+  keywords[ASP_POINT_SCALE_TAG_STR ] = os.str();
+
+  quantized_opt = opt;
+  std::string compress = quantized_opt.gdal_options["COMPRESS"];
+  if (compress == "LZW" || compress == "DEFLATE")
+    quantized_opt.gdal_options["PREDICTOR"] = "2";
+
+  return scale;
+}
+
 // Run a system command and append the output to a given file
 void asp::run_cmd_app_to_file(std::string cmd, std::string file){
   std::string full_cmd;
@@ -38,6 +38,8 @@
 #include <vw/Image/ImageViewRef.h>
 #include <vw/Cartography/GeoReference.h>
 #include <vw/Cartography/GeoReferenceUtils.h>
+#include <cmath>
+#include <limits>
 #include <map>
 #include <string>
 
@@ -126,6 +128,10 @@ namespace asp {
   // Note: We use this constant in the python code as well
   const std::string ASP_POINT_OFFSET_TAG_STR = "POINT_OFFSET";
 
+  /// String we use in quantized point cloud files for the size of a
+  /// unit of the integers they are saved as.
+  const std::string ASP_POINT_SCALE_TAG_STR = "POINT_SCALE";
+
   // Specialized functions for reading/writing images with a shift.
   // The shift is meant to bring the pixel values closer to origin,
   // with goal of saving the pixels as float instead of double.
@@ -173,6 +179,41 @@ namespace asp {
   }
 
 
+  /// Store pixels in given image as integer multiples of given scale.
+  /// Points (the first 3 components) too far from the origin to fit are
+  /// made invalid, and the other components are clamped.
+  template <class VecT>
+  struct QuantizeImagePixels:
+    public vw::ReturnFixedType< vw::Vector<vw::int32, vw::math::VectorSize<VecT>::value> > {
+    typedef vw::Vector<vw::int32, vw::math::VectorSize<VecT>::value> result_type;
+    double m_scale;
+    QuantizeImagePixels(double scale):m_scale(scale){
+      VW_ASSERT( m_scale > 0.0,
+                 vw::ArgumentErr() << "Quantization scale must be positive.");
+    }
+    result_type operator() (VecT const& pt) const {
+      const double max_val = std::numeric_limits<vw::int32>::max();
+      result_type result;
+      for (int i = 0; i < (int)pt.size(); i++) {
+        double val = round(pt[i]/m_scale);
+        if (!(std::abs(val) <= max_val)) {
+          if (i < 3)
+            return result_type();
+          val = (val > 0) ? max_val : -max_val;
+        }
+        result[i] = vw::int32(val);
+      }
+      return result;
+    }
+  };
+  template <class ImageT>
+  vw::UnaryPerPixelView<ImageT, QuantizeImagePixels<typename ImageT::pixel_type> >
+  inline quantize_image_pixels( vw::ImageViewBase<ImageT> const& image,
+                                double scale ) {
+    return vw::UnaryPerPixelView<ImageT, QuantizeImagePixels<typename ImageT::pixel_type> >
+      ( image.impl(), QuantizeImagePixels<typename ImageT::pixel_type>(scale) );
+  }
+
   /// To help with compression, round to about 1mm, but
   /// use for rounding a number with few digits in binary.
   const double APPROX_ONE_MM = 1.0/1024.0;
@@ -219,6 +260,47 @@ namespace asp {
                                std::map<std::string, std::string> const& keywords =
                                std::map<std::string, std::string>() );
 
+  /// Set up the keywords and options for writing a point cloud as
+  /// 32-bit integers, which are multiples of the rounding error away
+  /// from the shift, and return that rounding error. The shift must
+  /// be non-zero, as points far from the origin do not fit.
+  double quantized_write_options(vw::Vector3 const& shift, double rounding_error,
+                                 vw::cartography::GdalWriteOptions const& opt,
+                                 std::map<std::string, std::string> & keywords,
+                                 vw::cartography::GdalWriteOptions & quantized_opt);
+
+  /// Block write image while subtracting a given value from all pixels
+  /// and saving the result as integer multiples of the rounding error.
+  /// Use read_asp_point_cloud() to read it back.
+  template <class ImageT>
+  void block_write_quantized_gdal_image(const std::string &filename,
+                                        vw::Vector3 const& shift,
+                                        double rounding_error,
+                                        vw::ImageViewBase<ImageT> const& image,
+                                        bool has_georef,
+                                        vw::cartography::GeoReference const& georef,
+                                        bool has_nodata, double nodata,
+                                        vw::cartography::GdalWriteOptions const& opt,
+                                        vw::ProgressCallback const& progress_callback
+                                        = vw::ProgressCallback::dummy_instance(),
+                                        std::map<std::string, std::string> const& keywords =
+                                        std::map<std::string, std::string>() );
+
+  /// Single-threaded version of block_write_quantized_gdal_image().
+  template <class ImageT>
+  void write_quantized_gdal_image(const std::string &filename,
+                                  vw::Vector3 const& shift,
+                                  double rounding_error,
+                                  vw::ImageViewBase<ImageT> const& image,
+                                  bool has_georef,
+                                  vw::cartography::GeoReference const& georef,
+                                  bool has_nodata, double nodata,
+                                  vw::cartography::GdalWriteOptions const& opt,
+                                  vw::ProgressCallback const& progress_callback
+                                  = vw::ProgressCallback::dummy_instance(),
+                                  std::map<std::string, std::string> const& keywords =
+                                  std::map<std::string, std::string>() );
+
 
   /// Often times, we'd like to save an image to disk by using big
   /// blocks, for performance reasons, then re-write it with desired blocks.
@@ -97,6 +97,53 @@ namespace asp {
     }
   }
 
+  // Block write image while subtracting a given value from all pixels
+  // and saving the result as integer multiples of the rounding error.
+  template <class ImageT>
+  void block_write_quantized_gdal_image(const std::string &filename,
+                                        vw::Vector3 const& shift,
+                                        double rounding_error,
+                                        vw::ImageViewBase<ImageT> const& image,
+                                        bool has_georef,
+                                        vw::cartography::GeoReference const& georef,
+                                        bool has_nodata, double nodata,
+                                        vw::cartography::GdalWriteOptions const& opt,
+                                        vw::ProgressCallback const& progress_callback,
+                                        std::map<std::string, std::string> const& keywords) {
+
+    std::map<std::string, std::string> local_keywords = keywords;
+    vw::cartography::GdalWriteOptions quantized_opt;
+    double scale = quantized_write_options(shift, rounding_error, opt,
+                                           local_keywords, quantized_opt);
+    block_write_gdal_image(filename,
+                           quantize_image_pixels(subtract_shift(image.impl(), shift), scale),
+                           has_georef, georef, has_nodata, nodata,
+                           quantized_opt, progress_callback, local_keywords);
+  }
+
+  // Single-threaded version of block_write_quantized_gdal_image().
+  template <class ImageT>
+  void write_quantized_gdal_image(const std::string &filename,
+                                  vw::Vector3 const& shift,
+                                  double rounding_error,
+                                  vw::ImageViewBase<ImageT> const& image,
+                                  bool has_georef,
+                                  vw::cartography::GeoReference const& georef,
+                                  bool has_nodata, double nodata,
+                                  vw::cartography::GdalWriteOptions const& opt,
+                                  vw::ProgressCallback const& progress_callback,
+                                  std::map<std::string, std::string> const& keywords) {
+
+    std::map<std::string, std::string> local_keywords = keywords;
+    vw::cartography::GdalWriteOptions quantized_opt;
+    double scale = quantized_write_options(shift, rounding_error, opt,
+                                           local_keywords, quantized_opt);
+    write_gdal_image(filename,
+                     quantize_image_pixels(subtract_shift(image.impl(), shift), scale),
+                     has_georef, georef, has_nodata, nodata,
+                     quantized_opt, progress_callback, local_keywords);
+  }
+
   // Often times, we'd like to save an image to disk by using big
   // blocks, for performance reasons, then re-write it with desired blocks.
   template <class ImageT>
@@ -0,0 +1,198 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file DisparityBlend.cc
+///
+
+#include <vw/Core/Exception.h>
+#include <asp/Core/DisparityBlend.h>
+#include <algorithm>
+#include <cstring>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define ASP_HAVE_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define ASP_HAVE_X86_SIMD 0
+#endif
+
+using namespace vw;
+
+namespace asp {
+
+namespace {
+
+  // Scalar reference. The selects instead of a branch leave the sums
+  // untouched, bit for bit, where the neighbor does not count.
+  void scalar_multiply_accumulate(size_t n,
+                                  float const* nbr_dx, float const* nbr_dy,
+                                  unsigned char const* nbr_valid, double const* nbr_weights,
+                                  float * dx, float * dy, unsigned char * valid,
+                                  double * weights) {
+    for (size_t i = 0; i < n; i++) {
+      double w   = nbr_weights[i];
+      bool   use = (nbr_valid[i] != 0) & (w > 0);
+      float  x   = float(dx[i] + double(nbr_dx[i])*w);
+      float  y   = float(dy[i] + double(nbr_dy[i])*w);
+      double ws  = weights[i] + w;
+      dx[i]      = use ? x  : dx[i];
+      dy[i]      = use ? y  : dy[i];
+      weights[i] = use ? ws : weights[i];
+      valid[i]  |= (unsigned char)use;
+    }
+  }
+
+#if ASP_HAVE_X86_SIMD
+
+  // Two pixels at a time, as that is how many doubles fit in a lane.
+  // SSE2 has no blend instruction, so the selects are done with masks.
+  inline __m128 sse2_accumulate(__m128 sum, float const* nbr, __m128d w, __m128 use) {
+    __m128 v = _mm_castsi128_ps(_mm_loadl_epi64((__m128i const*)nbr));
+    __m128 result = _mm_cvtpd_ps(_mm_add_pd(_mm_cvtps_pd(sum), _mm_mul_pd(_mm_cvtps_pd(v), w)));
+    return _mm_or_ps(_mm_and_ps(use, result), _mm_andnot_ps(use, sum));
+  }
+
+  void sse2_multiply_accumulate(size_t n,
+                                float const* nbr_dx, float const* nbr_dy,
+                                unsigned char const* nbr_valid, double const* nbr_weights,
+                                float * dx, float * dy, unsigned char * valid,
+                                double * weights) {
+    const __m128d zero = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+      __m128d w   = _mm_loadu_pd(nbr_weights + i);
+      __m128d ok  = _mm_castsi128_pd(_mm_set_epi64x(-(long long)(nbr_valid[i + 1] != 0),
+                                                    -(long long)(nbr_valid[i    ] != 0)));
+      __m128d use = _mm_and_pd(ok, _mm_cmpgt_pd(w, zero));
+      // The low halves of the two 64-bit masks, to select floats with
+      __m128  use_ps = _mm_shuffle_ps(_mm_castpd_ps(use), _mm_castpd_ps(use),
+                                      _MM_SHUFFLE(0, 0, 2, 0));
+
+      __m128 x = _mm_castsi128_ps(_mm_loadl_epi64((__m128i const*)(dx + i)));
+      __m128 y = _mm_castsi128_ps(_mm_loadl_epi64((__m128i const*)(dy + i)));
+      _mm_storel_pi((__m64*)(dx + i), sse2_accumulate(x, nbr_dx + i, w, use_ps));
+      _mm_storel_pi((__m64*)(dy + i), sse2_accumulate(y, nbr_dy + i, w, use_ps));
+
+      __m128d ws = _mm_loadu_pd(weights + i);
+      ws = _mm_or_pd(_mm_and_pd(use, _mm_add_pd(ws, w)), _mm_andnot_pd(use, ws));
+      _mm_storeu_pd(weights + i, ws);
+
+      int bits = _mm_movemask_pd(use);
+      valid[i    ] |= (bits     ) & 1;
+      valid[i + 1] |= (bits >> 1) & 1;
+    }
+    scalar_multiply_accumulate(n - i, nbr_dx + i, nbr_dy + i, nbr_valid + i,
+                               nbr_weights + i, dx + i, dy + i, valid + i, weights + i);
+  }
+
+  __attribute__((target("avx2")))
+  inline __m128 avx2_accumulate(__m128 sum, float const* nbr, __m256d w, __m128 use) {
+    __m256d result = _mm256_add_pd(_mm256_cvtps_pd(sum),
+                                   _mm256_mul_pd(_mm256_cvtps_pd(_mm_loadu_ps(nbr)), w));
+    return _mm_blendv_ps(sum, _mm256_cvtpd_ps(result), use);
+  }
+
+  __attribute__((target("avx2")))
+  void avx2_multiply_accumulate(size_t n,
+                                float const* nbr_dx, float const* nbr_dy,
+                                unsigned char const* nbr_valid, double const* nbr_weights,
+                                float * dx, float * dy, unsigned char * valid,
+                                double * weights) {
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256i low_halves = _mm256_setr_epi32(0, 2, 4, 6, 0, 0, 0, 0);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      int valid4;
+      std::memcpy(&valid4, nbr_valid + i, sizeof(valid4));
+      __m256i ok  = _mm256_cmpgt_epi64(_mm256_cvtepu8_epi64(_mm_cvtsi32_si128(valid4)),
+                                       _mm256_setzero_si256());
+      __m256d w   = _mm256_loadu_pd(nbr_weights + i);
+      __m256d use = _mm256_and_pd(_mm256_castsi256_pd(ok), _mm256_cmp_pd(w, zero, _CMP_GT_OQ));
+      __m128  use_ps = _mm256_castps256_ps128(_mm256_castsi256_ps
+        (_mm256_permutevar8x32_epi32(_mm256_castpd_si256(use), low_halves)));
+
+      _mm_storeu_ps(dx + i, avx2_accumulate(_mm_loadu_ps(dx + i), nbr_dx + i, w, use_ps));
+      _mm_storeu_ps(dy + i, avx2_accumulate(_mm_loadu_ps(dy + i), nbr_dy + i, w, use_ps));
+
+      __m256d ws = _mm256_loadu_pd(weights + i);
+      _mm256_storeu_pd(weights + i, _mm256_blendv_pd(ws, _mm256_add_pd(ws, w), use));
+
+      int bits = _mm256_movemask_pd(use);
+      for (int k = 0; k < 4; k++)
+        valid[i + k] |= (bits >> k) & 1;
+    }
+    // Finish the remaining pixels with the narrower kernel
+    sse2_multiply_accumulate(n - i, nbr_dx + i, nbr_dy + i, nbr_valid + i,
+                             nbr_weights + i, dx + i, dy + i, valid + i, weights + i);
+  }
+
+#endif // ASP_HAVE_X86_SIMD
+
+} // end anonymous namespace
+
+void blend_multiply_accumulate(SimdLevel level, size_t n,
+                               float const* nbr_dx, float const* nbr_dy,
+                               unsigned char const* nbr_valid, double const* nbr_weights,
+                               float * dx, float * dy, unsigned char * valid,
+                               double * weights) {
+#if ASP_HAVE_X86_SIMD
+  if (level >= SIMD_AVX2)
+    return avx2_multiply_accumulate(n, nbr_dx, nbr_dy, nbr_valid, nbr_weights,
+                                    dx, dy, valid, weights);
+  if (level >= SIMD_SSE2)
+    return sse2_multiply_accumulate(n, nbr_dx, nbr_dy, nbr_valid, nbr_weights,
+                                    dx, dy, valid, weights);
+#endif
+  scalar_multiply_accumulate(n, nbr_dx, nbr_dy, nbr_valid, nbr_weights,
+                             dx, dy, valid, weights);
+}
+
+void blend_disparity_region(SimdLevel level,
+                            DisparityPlanes & main, ImageView<double> & main_weights,
+                            BBox2i const& main_roi,
+                            DisparityPlanes const& neighbor,
+                            ImageView<double> const& neighbor_weights) {
+
+  VW_ASSERT(main_weights.cols() == main.cols && main_weights.rows() == main.rows,
+            ArgumentErr() << "blend_disparity_region: The main tile and its weights "
+            << "must have the same size.\n");
+  VW_ASSERT(neighbor.cols == main_roi.width() && neighbor.rows == main_roi.height() &&
+            neighbor_weights.cols() == main_roi.width() &&
+            neighbor_weights.rows() == main_roi.height(),
+            ArgumentErr() << "blend_disparity_region: The neighbor and its weights "
+            << "must have the size of the region " << main_roi << ".\n");
+  VW_ASSERT(BBox2i(0, 0, main.cols, main.rows).contains(main_roi),
+            ArgumentErr() << "blend_disparity_region: Region " << main_roi
+            << " is not inside the main tile.\n");
+  if (main_roi.empty())
+    return;
+
+  level = std::min(level, detect_simd_level());
+  for (int row = 0; row < main_roi.height(); row++) {
+    int    main_col = main_roi.min().x(), main_row = main_roi.min().y() + row;
+    size_t m = main.index(main_col, main_row);
+    size_t k = neighbor.index(0, row);
+    blend_multiply_accumulate(level, main_roi.width(),
+                              &neighbor.dx[k], &neighbor.dy[k], &neighbor.valid[k],
+                              &neighbor_weights(0, row),
+                              &main.dx[m], &main.dy[m], &main.valid[m],
+                              &main_weights(main_col, main_row));
+  }
+}
+
+} // namespace asp
@@ -0,0 +1,61 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file DisparityBlend.h
+///
+/// Weighted blending of overlapping disparity tiles. The disparity is
+/// kept as separate planes for the two components and the validity, so
+/// that the multiply-accumulate runs along rows without branches. The
+/// SSE2 and AVX2 kernels do the same double precision operations per
+/// pixel as the scalar reference, so the results are bit-identical.
+
+#ifndef __ASP_CORE_DISPARITY_BLEND_H__
+#define __ASP_CORE_DISPARITY_BLEND_H__
+
+#include <asp/Core/DisparityPlanes.h>
+#include <asp/Core/Simd.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Math/BBox.h>
+#include <cstddef>
+#include <vector>
+
+namespace asp {
+
+  /// Add n pixels of a neighboring tile, each times its weight, to the
+  /// running sums of disparities and weights. A neighbor pixel counts
+  /// only if it is valid and its weight is positive, and then it makes
+  /// the sum valid. The sums are accumulated in double precision and
+  /// rounded to float, as when adding to a PixelMask<Vector2f>.
+  void blend_multiply_accumulate(SimdLevel level, size_t n,
+                                 float const* nbr_dx, float const* nbr_dy,
+                                 unsigned char const* nbr_valid, double const* nbr_weights,
+                                 float * dx, float * dy, unsigned char * valid,
+                                 double * weights);
+
+  /// Blend a neighboring tile, with its weights, into the given region
+  /// of the main tile and its weights. The neighbor must be the size of
+  /// the region.
+  void blend_disparity_region(SimdLevel level,
+                              DisparityPlanes & main, vw::ImageView<double> & main_weights,
+                              vw::BBox2i const& main_roi,
+                              DisparityPlanes const& neighbor,
+                              vw::ImageView<double> const& neighbor_weights);
+
+} // namespace asp
+
+#endif // __ASP_CORE_DISPARITY_BLEND_H__
@@ -0,0 +1,56 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file DisparityPlanes.h
+///
+/// A disparity kept as one plane per component, so the loops over it run
+/// along rows without branching on each pixel's mask.
+
+#ifndef __ASP_CORE_DISPARITY_PLANES_H__
+#define __ASP_CORE_DISPARITY_PLANES_H__
+
+#include <cstddef>
+#include <vector>
+
+namespace asp {
+
+  /// A disparity image stored as one row-major plane per component,
+  /// plus a plane of validity flags which are 0 or 1.
+  struct DisparityPlanes {
+    int cols, rows;
+    std::vector<float>         dx, dy;
+    std::vector<unsigned char> valid;
+
+    DisparityPlanes(): cols(0), rows(0) {}
+    DisparityPlanes(int cols, int rows) { set_size(cols, rows); }
+
+    void set_size(int cols_, int rows_) {
+      cols = cols_;
+      rows = rows_;
+      size_t n = size_t(cols)*rows;
+      dx.assign(n, 0.0f);
+      dy.assign(n, 0.0f);
+      valid.assign(n, 0);
+    }
+
+    size_t index(int col, int row) const { return size_t(row)*cols + col; }
+  };
+
+} // namespace asp
+
+#endif // __ASP_CORE_DISPARITY_PLANES_H__
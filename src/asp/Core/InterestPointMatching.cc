@@ -21,6 +21,10 @@
 #include <vw/Math/RANSAC.h>
 #include <vw/Cartography/CameraBBox.h>
 #include <vw/Stereo/StereoModel.h>
+#include <vw/Image/Filter.h>
+#include <vw/Image/Transform.h>
+#include <algorithm>
+#include <cmath>
 
 using namespace vw;
 
@@ -817,4 +821,163 @@ namespace asp {
 
   }
   
+  namespace {
+    // Normalized cross correlation of the size x size windows with
+    // top-left corners l0 and r0. Larger is better.
+    float window_ncc(ImageView<float> const& left,  Vector2i const& l0,
+                     ImageView<float> const& right, Vector2i const& r0, int size) {
+      double sl = 0, sr = 0, sll = 0, srr = 0, slr = 0;
+      for (int row = 0; row < size; row++) {
+        for (int col = 0; col < size; col++) {
+          double a = left (l0.x() + col, l0.y() + row);
+          double b = right(r0.x() + col, r0.y() + row);
+          sl  += a;   sr  += b;
+          sll += a*a; srr += b*b; slr += a*b;
+        }
+      }
+      double n     = double(size)*size;
+      double denom = (sll - sl*sl/n)*(srr - sr*sr/n);
+      if (denom <= 0)
+        return 0.0f;
+      return float((slr - sl*sr/n)/std::sqrt(denom));
+    }
+
+    // Blur with nodata pixels left out, and keep those as nodata, so
+    // they do not spread into the valid pixels next to them. A pixel
+    // is nodata if it is no more than the nodata value.
+    ImageView<float> masked_gaussian_filter(ImageView<float> const& image,
+                                            double nodata, double sigma) {
+      if (boost::math::isnan(nodata))
+        return gaussian_filter(image, sigma);
+      ImageView<float> valid(image.cols(), image.rows()), values(image.cols(), image.rows());
+      for (int row = 0; row < image.rows(); row++) {
+        for (int col = 0; col < image.cols(); col++) {
+          bool is_valid    = (image(col, row) > nodata);
+          valid (col, row) = is_valid ? 1.0f : 0.0f;
+          values(col, row) = is_valid ? image(col, row) : 0.0f;
+        }
+      }
+      ImageView<float> weights = gaussian_filter(valid,  sigma);
+      ImageView<float> blurred = gaussian_filter(values, sigma);
+      for (int row = 0; row < image.rows(); row++) {
+        for (int col = 0; col < image.cols(); col++) {
+          if (valid(col, row) > 0 && weights(col, row) > 0)
+            blurred(col, row) /= weights(col, row);
+          else
+            blurred(col, row) = nodata;
+        }
+      }
+      return blurred;
+    }
+  }
+
+  void refine_ip_matches(vw::ImageView<float> const& image1,
+                         vw::ImageView<float> const& image2,
+                         int kernel_size, int search_radius, double min_correlation,
+                         std::vector<ip::InterestPoint> & ip1,
+                         std::vector<ip::InterestPoint> & ip2) {
+
+    VW_ASSERT(ip1.size() == ip2.size(),
+              ArgumentErr() << "refine_ip_matches: Expecting as many left as right points.\n");
+    VW_ASSERT(kernel_size > 0 && kernel_size % 2 == 1 && search_radius >= 0,
+              ArgumentErr() << "refine_ip_matches: Expecting an odd kernel size "
+              << "and a non-negative search radius.\n");
+
+    int half = kernel_size/2, span = 2*search_radius + 1;
+    std::vector<float> costs(span*span);
+
+    std::vector<ip::InterestPoint> out1, out2;
+    for (size_t i = 0; i < ip1.size(); i++) {
+
+      int lx = int(round(ip1[i].x)), ly = int(round(ip1[i].y));
+      int rx = int(round(ip2[i].x)), ry = int(round(ip2[i].y));
+      BBox2i left_box (lx - half, ly - half, kernel_size, kernel_size);
+      BBox2i right_box(rx - search_radius - half, ry - search_radius - half,
+                       kernel_size + span - 1, kernel_size + span - 1);
+      if (!bounding_box(image1).contains(left_box) ||
+          !bounding_box(image2).contains(right_box))
+        continue;
+
+      // Correlate the left window against every position in the search region
+      for (int dy = 0; dy < span; dy++)
+        for (int dx = 0; dx < span; dx++)
+          costs[dy*span + dx] = window_ncc(image1, left_box.min(), image2,
+                                           right_box.min() + Vector2i(dx, dy), kernel_size);
+
+      int best = int(std::max_element(costs.begin(), costs.end()) - costs.begin());
+      int bx = best % span, by = best / span;
+      if (costs[best] < min_correlation)
+        continue;
+
+      // Fit a parabola through the peak and its neighbors in each direction
+      double sx = 0, sy = 0;
+      if (bx > 0 && bx < span - 1) {
+        double a = costs[best - 1], b = costs[best], c = costs[best + 1];
+        double denom = a - 2*b + c;
+        if (denom < 0)
+          sx = 0.5*(a - c)/denom;
+      }
+      if (by > 0 && by < span - 1) {
+        double a = costs[best - span], b = costs[best], c = costs[best + span];
+        double denom = a - 2*b + c;
+        if (denom < 0)
+          sy = 0.5*(a - c)/denom;
+      }
+
+      ip::InterestPoint p1 = ip1[i], p2 = ip2[i];
+      p1.x  = lx; p1.y  = ly;
+      p1.ix = lx; p1.iy = ly;
+      p2.ix = rx - search_radius + bx;
+      p2.iy = ry - search_radius + by;
+      p2.x  = p2.ix + sx;
+      p2.y  = p2.iy + sy;
+      out1.push_back(p1);
+      out2.push_back(p2);
+    }
+
+    ip1.swap(out1);
+    ip2.swap(out2);
+  }
+
+  void pyramid_detect_match_ip(std::vector<ip::InterestPoint>& matched_ip1,
+                               std::vector<ip::InterestPoint>& matched_ip2,
+                               vw::ImageView<float> const& image1,
+                               vw::ImageView<float> const& image2,
+                               int ip_per_tile, int levels,
+                               double nodata1, double nodata2) {
+    if (levels <= 0) {
+      detect_match_ip(matched_ip1, matched_ip2, image1, image2, ip_per_tile,
+                      nodata1, nodata2);
+      return;
+    }
+
+    // Blur before subsampling to avoid aliasing
+    int factor = 1 << levels;
+    ImageView<float> sub1 = subsample(masked_gaussian_filter(image1, nodata1, factor/2.0), factor);
+    ImageView<float> sub2 = subsample(masked_gaussian_filter(image2, nodata2, factor/2.0), factor);
+    detect_match_ip(matched_ip1, matched_ip2, sub1, sub2, ip_per_tile,
+                    nodata1, nodata2);
+
+    // Back to full resolution coordinates
+    for (size_t i = 0; i < matched_ip1.size(); i++) {
+      ip::InterestPoint * ips[] = {&matched_ip1[i], &matched_ip2[i]};
+      for (int k = 0; k < 2; k++) {
+        ips[k]->x    *= factor;
+        ips[k]->y    *= factor;
+        ips[k]->ix    = int(ips[k]->x);
+        ips[k]->iy    = int(ips[k]->y);
+        ips[k]->scale *= factor;
+      }
+    }
+
+    // A coarse pixel covers factor full resolution pixels, and the
+    // window should see about as much as the coarse detector did.
+    size_t num_coarse = matched_ip1.size();
+    refine_ip_matches(image1, image2, 2*factor + 7, factor, 0.5,
+                      matched_ip1, matched_ip2);
+    vw_out(DebugMessage, "asp") << "\t--> Refined " << matched_ip1.size() << " of "
+                                << num_coarse << " matches found at 1/" << factor
+                                << " resolution.\n";
+  }
+
 }
@@ -1016,6 +1016,32 @@ namespace asp {
                                              vw::ImageView<float> const& image2,
                                              int ip_per_tile,
                                              double nodata1, double nodata2);
+
+  /// Refine matches whose right points are known only to within
+  /// search_radius pixels, as when they were found on subsampled images.
+  /// The left points are rounded to the nearest pixel, and each right
+  /// point is moved, with subpixel accuracy, to where a kernel_size
+  /// window best correlates with the window around its left point.
+  /// Matches too close to the image edges or with a normalized cross
+  /// correlation below min_correlation are dropped.
+  void refine_ip_matches(vw::ImageView<float> const& image1,
+                         vw::ImageView<float> const& image2,
+                         int kernel_size, int search_radius, double min_correlation,
+                         std::vector<vw::ip::InterestPoint> & ip1,
+                         std::vector<vw::ip::InterestPoint> & ip2);
+
+  /// Detect and match interest points on the images subsampled by
+  /// 2^levels, then refine the matches at full resolution with
+  /// refine_ip_matches(). Much cheaper than detect_match_ip() on large
+  /// images, as only the few surviving matches are looked at in full
+  /// resolution. With levels = 0 this is just detect_match_ip().
+  void pyramid_detect_match_ip(std::vector<vw::ip::InterestPoint>& matched_ip1,
+                               std::vector<vw::ip::InterestPoint>& matched_ip2,
+                               vw::ImageView<float> const& image1,
+                               vw::ImageView<float> const& image2,
+                               int ip_per_tile, int levels,
+                               double nodata1 = std::numeric_limits<double>::quiet_NaN(),
+                               double nodata2 = std::numeric_limits<double>::quiet_NaN());
   
 } // End namespace asp
 
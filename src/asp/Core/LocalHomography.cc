@@ -27,6 +27,10 @@
 #include <asp/Core/LocalHomography.h>
 #include <asp/Core/StereoSettings.h>
 #include <asp/Core/InterestPointMatching.h>
+#include <asp/Core/TileStats.h>
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <sstream>
 
 using namespace vw;
 
@@ -283,4 +287,191 @@ namespace asp {
     return;
   }
 
+  boost::uint64_t hash_bytes(void const* data, size_t num_bytes, boost::uint64_t seed){
+    const boost::uint64_t FNV_PRIME = 1099511628211ULL;
+    unsigned char const* ptr = static_cast<unsigned char const*>(data);
+    for (size_t i = 0; i < num_bytes; i++) {
+      seed ^= ptr[i];
+      seed *= FNV_PRIME;
+    }
+    return seed;
+  }
+
+  boost::uint64_t tile_alignment_key(BBox2i const& bbox, BBox2i const& expanded_bbox,
+                                     boost::uint64_t left_checksum,
+                                     boost::uint64_t right_checksum,
+                                     BBox2f const& input_search_range,
+                                     boost::uint64_t seed_checksum){
+
+    // Bump this if the piecewise alignment logic changes, to invalidate old caches.
+    const int CACHE_VERSION = 1;
+
+    StereoSettings const& s = stereo_settings();
+    int    ivals[] = {CACHE_VERSION,
+                      bbox.min().x(), bbox.min().y(), bbox.width(), bbox.height(),
+                      expanded_bbox.min().x(), expanded_bbox.min().y(),
+                      expanded_bbox.width(), expanded_bbox.height(),
+                      s.ip_per_tile, s.ip_matching_method, s.num_scales,
+                      s.ip_edge_buffer_percent, int(s.ip_normalize_tiles),
+                      s.corr_ip_pyramid_levels, s.corr_min_seed_matches};
+    double dvals[] = {input_search_range.min().x(), input_search_range.min().y(),
+                      input_search_range.max().x(), input_search_range.max().y(),
+                      s.ip_inlier_factor, s.ip_uniqueness_thresh};
+
+    boost::uint64_t key = hash_bytes(ivals, sizeof(ivals));
+    key = hash_bytes(dvals, sizeof(dvals), key);
+    key = hash_bytes(&left_checksum,  sizeof(left_checksum),  key);
+    key = hash_bytes(&right_checksum, sizeof(right_checksum), key);
+    key = hash_bytes(&seed_checksum,  sizeof(seed_checksum),  key);
+    return key;
+  }
+
+  std::string tile_alignment_file(std::string const& cache_dir, BBox2i const& bbox){
+    std::ostringstream os;
+    os << cache_dir << "/tile_" << bbox.min().x() << "_" << bbox.min().y() << ".txt";
+    return os.str();
+  }
+
+  bool read_tile_alignment(std::string const& file, boost::uint64_t key,
+                           TileAlignment & alignment){
+
+    std::ifstream fh(file.c_str());
+    if (!fh.good())
+      return false;
+
+    TileAlignment a;
+    if ( !(fh >> a.key) || a.key != key )
+      return false;
+    if ( !(fh >> a.aligned_size[0] >> a.aligned_size[1]) )
+      return false;
+    for (int r = 0; r < 3; r++)
+      for (int c = 0; c < 3; c++)
+        if ( !(fh >> a.left_matrix(r, c)) ) return false;
+    for (int r = 0; r < 3; r++)
+      for (int c = 0; c < 3; c++)
+        if ( !(fh >> a.right_matrix(r, c)) ) return false;
+    if ( !(fh >> a.search_range.min()[0] >> a.search_range.min()[1]
+              >> a.search_range.max()[0] >> a.search_range.max()[1]) )
+      return false;
+
+    size_t num_ip;
+    if ( !(fh >> num_ip) )
+      return false;
+    a.left_ip.resize(num_ip);
+    a.right_ip.resize(num_ip);
+    for (size_t i = 0; i < num_ip; i++) {
+      if ( !(fh >> a.left_ip[i].x >> a.left_ip[i].y >> a.right_ip[i].x >> a.right_ip[i].y) )
+        return false;
+      a.left_ip [i].ix = a.left_ip [i].x; a.left_ip [i].iy = a.left_ip [i].y;
+      a.right_ip[i].ix = a.right_ip[i].x; a.right_ip[i].iy = a.right_ip[i].y;
+    }
+
+    // Files written before the outcome of the fit was stored say only
+    // that they came from the cache.
+    if ( !(fh >> a.fit_status >> a.num_matches) ) {
+      a.fit_status  = TILE_FIT_CACHED;
+      a.num_matches = num_ip;
+    }
+
+    alignment = a;
+    return true;
+  }
+
+  void write_tile_alignment(std::string const& file, TileAlignment const& alignment){
+
+    std::string tmp_file = file + ".tmp";
+    std::ofstream fh(tmp_file.c_str());
+    if (!fh.good())
+      vw_throw( IOErr() << "write_tile_alignment: Cannot write: " << tmp_file << ".\n" );
+
+    fh.precision(18);
+    fh << alignment.key << std::endl;
+    fh << alignment.aligned_size[0] << " " << alignment.aligned_size[1] << std::endl;
+    for (int r = 0; r < 3; r++)
+      fh << alignment.left_matrix(r, 0) << " " << alignment.left_matrix(r, 1) << " "
+         << alignment.left_matrix(r, 2) << std::endl;
+    for (int r = 0; r < 3; r++)
+      fh << alignment.right_matrix(r, 0) << " " << alignment.right_matrix(r, 1) << " "
+         << alignment.right_matrix(r, 2) << std::endl;
+    fh << alignment.search_range.min()[0] << " " << alignment.search_range.min()[1] << " "
+       << alignment.search_range.max()[0] << " " << alignment.search_range.max()[1] << std::endl;
+    fh << alignment.left_ip.size() << std::endl;
+    for (size_t i = 0; i < alignment.left_ip.size(); i++)
+      fh << alignment.left_ip [i].x << " " << alignment.left_ip [i].y << " "
+         << alignment.right_ip[i].x << " " << alignment.right_ip[i].y << std::endl;
+    fh << alignment.fit_status << " " << alignment.num_matches << std::endl;
+    fh.close();
+
+    boost::filesystem::rename(tmp_file, file);
+  }
+
+  boost::uint64_t matches_checksum(std::vector<vw::ip::InterestPoint> const& ip1,
+                                   std::vector<vw::ip::InterestPoint> const& ip2){
+    boost::uint64_t key = hash_bytes(NULL, 0);
+    for (size_t i = 0; i < ip1.size() && i < ip2.size(); i++) {
+      float vals[] = {ip1[i].x, ip1[i].y, ip2[i].x, ip2[i].y};
+      key = hash_bytes(vals, sizeof(vals), key);
+    }
+    return key;
+  }
+
+  MatchIndex::MatchIndex(std::vector<vw::ip::InterestPoint> const& ip1,
+                         std::vector<vw::ip::InterestPoint> const& ip2,
+                         int cell_size): m_ip1(ip1), m_ip2(ip2), m_cell_size(cell_size){
+
+    VW_ASSERT(ip1.size() == ip2.size(),
+              ArgumentErr() << "MatchIndex: Expecting as many left as right points.\n");
+    VW_ASSERT(cell_size > 0, ArgumentErr() << "MatchIndex: The cell size must be positive.\n");
+
+    if (m_ip1.empty())
+      return;
+
+    // The grid covers the bounding box of the left points
+    BBox2i cells;
+    for (size_t i = 0; i < m_ip1.size(); i++)
+      cells.grow(Vector2i(floor(m_ip1[i].x/cell_size), floor(m_ip1[i].y/cell_size)));
+    m_origin    = cells.min();
+    m_num_cells = cells.size() + Vector2i(1, 1);
+    m_cells.resize(size_t(m_num_cells[0])*m_num_cells[1]);
+    for (size_t i = 0; i < m_ip1.size(); i++) {
+      Vector2i c = Vector2i(floor(m_ip1[i].x/cell_size), floor(m_ip1[i].y/cell_size)) - m_origin;
+      m_cells[size_t(c[1])*m_num_cells[0] + c[0]].push_back(i);
+    }
+  }
+
+  void MatchIndex::matches_in_box(BBox2i const& box,
+                                  std::vector<vw::ip::InterestPoint> & ip1,
+                                  std::vector<vw::ip::InterestPoint> & ip2) const{
+    if (m_cells.empty() || box.empty())
+      return;
+
+    // The range of cells overlapping the box, clamped to the grid
+    Vector2i beg = Vector2i(floor(double(box.min().x())/m_cell_size),
+                            floor(double(box.min().y())/m_cell_size)) - m_origin;
+    Vector2i end = Vector2i(floor(double(box.max().x() - 1)/m_cell_size),
+                            floor(double(box.max().y() - 1)/m_cell_size)) - m_origin;
+    for (int k = 0; k < 2; k++) {
+      beg[k] = std::max(beg[k], 0);
+      end[k] = std::min(end[k], m_num_cells[k] - 1);
+    }
+
+    BBox2f fbox(Vector2f(box.min()), Vector2f(box.max()));
+    for (int cy = beg[1]; cy <= end[1]; cy++) {
+      for (int cx = beg[0]; cx <= end[0]; cx++) {
+        std::vector<size_t> const& cell = m_cells[size_t(cy)*m_num_cells[0] + cx];
+        for (size_t j = 0; j < cell.size(); j++) {
+          vw::ip::InterestPoint p1 = m_ip1[cell[j]], p2 = m_ip2[cell[j]];
+          if (!fbox.contains(Vector2f(p1.x, p1.y)) || !fbox.contains(Vector2f(p2.x, p2.y)))
+            continue;
+          p1.x -= box.min().x(); p1.y -= box.min().y();
+          p2.x -= box.min().x(); p2.y -= box.min().y();
+          p1.ix = int(p1.x); p1.iy = int(p1.y);
+          p2.ix = int(p2.x); p2.iy = int(p2.y);
+          ip1.push_back(p1);
+          ip2.push_back(p2);
+        }
+      }
+    }
+  }
+
 } // namespace asp
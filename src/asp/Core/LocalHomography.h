@@ -23,6 +23,10 @@
 #define __LOCAL_DISPARITY_H__
 
 #include <vw/Image/ImageView.h>
+#include <vw/Math/BBox.h>
+#include <vw/Math/Matrix.h>
+#include <vw/InterestPoint/InterestData.h>
+#include <boost/cstdint.hpp>
 #include <vector>
 
 // Forward declaration
@@ -45,6 +49,84 @@ namespace asp {
   void read_local_homographies(std::string const& local_hom_file,
                                vw::ImageView<vw::Matrix3x3> & local_hom);
 
+  /// The outcome of the piecewise alignment of one correlation tile.
+  /// This is cached on disk so that repeated stereo_corr runs with
+  /// different correlation settings do not redo IP matching and fitting.
+  struct TileAlignment {
+    boost::uint64_t key;         ///< Hash of the tile pixels and of the settings used
+    vw::Vector2i    aligned_size; ///< Size of the aligned left and right tiles
+    vw::Matrix3x3   left_matrix, right_matrix;
+    vw::BBox2f      search_range; ///< Search range in the aligned tiles
+    std::vector<vw::ip::InterestPoint> left_ip, right_ip; ///< Inlier matches
+    int             fit_status;   ///< The asp::TileFitStatus of the fit
+    int             num_matches;  ///< Matches the fit was made from
+  };
+
+  /// FNV-1a hash of a block of memory, continuing from the given seed.
+  boost::uint64_t hash_bytes(void const* data, size_t num_bytes,
+                             boost::uint64_t seed = 14695981039346656037ULL);
+
+  /// Hash the pixels of an in-memory tile.
+  template <class PixelT>
+  boost::uint64_t tile_checksum(vw::ImageView<PixelT> const& tile,
+                                boost::uint64_t seed = 14695981039346656037ULL){
+    int dims[3] = {tile.cols(), tile.rows(), tile.planes()};
+    seed = hash_bytes(dims, sizeof(dims), seed);
+    return hash_bytes(tile.data(), sizeof(PixelT)*size_t(tile.cols())*tile.rows()*tile.planes(),
+                      seed);
+  }
+
+  /// Key identifying the piecewise alignment of a tile. It combines the
+  /// tile box (with its margin), the checksums of the left and right
+  /// tile pixels, the input search range, the IP detection settings,
+  /// and the checksum of the matches the tile was seeded with, if any.
+  boost::uint64_t tile_alignment_key(vw::BBox2i const& bbox, vw::BBox2i const& expanded_bbox,
+                                     boost::uint64_t left_checksum,
+                                     boost::uint64_t right_checksum,
+                                     vw::BBox2f const& input_search_range,
+                                     boost::uint64_t seed_checksum = 0);
+
+  /// The file in the cache directory storing the alignment of the tile
+  /// starting at the given box.
+  std::string tile_alignment_file(std::string const& cache_dir, vw::BBox2i const& bbox);
+
+  /// Read a cached tile alignment. Returns false if the file is missing,
+  /// invalid, or was produced with a different key.
+  bool read_tile_alignment(std::string const& file, boost::uint64_t key,
+                           TileAlignment & alignment);
+
+  /// Write a tile alignment to the cache. The file is written under a
+  /// temporary name first so that concurrent readers never see a partial file.
+  void write_tile_alignment(std::string const& file, TileAlignment const& alignment);
+
+  /// Hash the positions of a list of interest point matches.
+  boost::uint64_t matches_checksum(std::vector<vw::ip::InterestPoint> const& ip1,
+                                   std::vector<vw::ip::InterestPoint> const& ip2);
+
+  /// Interest point matches between the full resolution left and right
+  /// images, bucketed on a regular grid by their left position, so that
+  /// the matches falling in a tile are found without scanning them all.
+  class MatchIndex {
+  public:
+    MatchIndex(std::vector<vw::ip::InterestPoint> const& ip1,
+               std::vector<vw::ip::InterestPoint> const& ip2,
+               int cell_size);
+
+    /// Append the matches with both the left and right points in the
+    /// box, in the coordinates of a tile starting at the box corner.
+    void matches_in_box(vw::BBox2i const& box,
+                        std::vector<vw::ip::InterestPoint> & ip1,
+                        std::vector<vw::ip::InterestPoint> & ip2) const;
+
+    size_t size() const { return m_ip1.size(); }
+
+  private:
+    std::vector<vw::ip::InterestPoint> m_ip1, m_ip2;
+    int m_cell_size;
+    vw::Vector2i m_origin, m_num_cells;  // Grid origin and size, in cells
+    std::vector<std::vector<size_t> > m_cells; // Match indices, row-major
+  };
+
 
 } // namespace asp
 
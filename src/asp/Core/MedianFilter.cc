@@ -17,7 +17,10 @@
 
 
 #include <asp/Core/MedianFilter.h>
+#include <vw/Core/Exception.h>
 #include <vw/Math/Vector.h>
+#include <algorithm>
+#include <cmath>
 
 using namespace vw;
 
@@ -39,3 +42,77 @@ uint8 find_median_in_histogram(Vector<int, CALC_PIXEL_NUM_VALS> histogram,
 
   return i;
 }
+
+namespace {
+  // Order the indices by value, and equal values by index, so each
+  // value has a rank of its own.
+  struct ValueLess {
+    std::vector<double> const& values;
+    ValueLess(std::vector<double> const& v): values(v) {}
+    bool operator()(size_t a, size_t b) const {
+      return values[a] < values[b] || (values[a] == values[b] && a < b);
+    }
+  };
+}
+
+namespace vw {
+
+SlidingMedian::SlidingMedian(std::vector<double> const& values):
+  m_rank(values.size(), -1), m_count(0) {
+  std::vector<size_t> order;
+  for (size_t i = 0; i < values.size(); i++) {
+    if (!std::isnan(values[i]))
+      order.push_back(i);
+  }
+  std::sort(order.begin(), order.end(), ValueLess(values));
+  m_sorted.resize(order.size());
+  for (size_t r = 0; r < order.size(); r++) {
+    m_sorted[r] = values[order[r]];
+    m_rank[order[r]] = r;
+  }
+  m_tree.assign(m_sorted.size() + 1, 0); // One-based
+  m_top = 1;
+  while (size_t(2*m_top) <= m_sorted.size())
+    m_top *= 2;
+}
+
+void SlidingMedian::update(int rank, int delta) {
+  for (int i = rank + 1; i < int(m_tree.size()); i += i & (-i))
+    m_tree[i] += delta;
+}
+
+void SlidingMedian::add(size_t i) {
+  if (m_rank[i] < 0)
+    return;
+  update(m_rank[i], 1);
+  m_count++;
+}
+
+void SlidingMedian::remove(size_t i) {
+  if (m_rank[i] < 0)
+    return;
+  update(m_rank[i], -1);
+  m_count--;
+}
+
+double SlidingMedian::kth(size_t k) const {
+  // Go down the tree to the last rank with at most k before it
+  int pos = 0, left = int(k);
+  for (int step = m_top; step > 0; step /= 2) {
+    int next = pos + step;
+    if (next < int(m_tree.size()) && m_tree[next] <= left) {
+      pos = next;
+      left -= m_tree[next];
+    }
+  }
+  return m_sorted[pos];
+}
+
+double SlidingMedian::median() const {
+  VW_ASSERT(m_count > 0, ArgumentErr() << "SlidingMedian: The window is empty.\n");
+  if (m_count % 2)
+    return kth(m_count/2);
+  return (kth(m_count/2 - 1) + kth(m_count/2)) / 2;
+}
+
+} // namespace vw
@@ -31,12 +31,48 @@
 #include <vw/Image/ImageView.h>
 #include <vw/Image/EdgeExtension.h>
 #include <vw/Image/PerPixelAccessorViews.h>
+#include <vector>
 
 namespace vw {
 
   uint8 find_median_in_histogram(Vector<int, CALC_PIXEL_NUM_VALS> histogram,
                                  int kernSize);
 
+  /// The median of a window sliding over a fixed set of values, which
+  /// are added to and removed from it one at a time. The values are
+  /// ranked once, and a binary indexed tree over the ranks counts
+  /// those in the window, so an update and finding the median each take
+  /// O(log n), however large the window. The median is exact, the same
+  /// as from math::destructive_median of the values in the window.
+  class SlidingMedian {
+  public:
+    /// NaN values are never in the window. The ranks do not depend on
+    /// the window, so one instance serves any window size.
+    SlidingMedian(std::vector<double> const& values);
+
+    /// Add or remove value i. Each value must be in the window at most
+    /// once, and only be removed when it is in it.
+    void add(size_t i);
+    void remove(size_t i);
+
+    /// The number of values in the window
+    size_t size() const { return m_count; }
+
+    /// The middle value, or the mean of the two middle ones if there
+    /// are an even number of them. The window must not be empty.
+    double median() const;
+
+  private:
+    double kth(size_t k) const; // The value in the window with k below it
+    void update(int rank, int delta);
+
+    std::vector<double> m_sorted; // The values which are not NaN
+    std::vector<int>    m_rank;   // Of each value in m_sorted, or -1 for NaN
+    std::vector<int>    m_tree;   // Counts of the ranks in the window
+    size_t m_count;
+    int    m_top;                 // Largest power of two <= m_sorted.size()
+  };
+
   template<class ImageT>
   ImageView<typename ImageT::pixel_type> fast_median_filter(ImageViewBase<ImageT> const& img,  int kernSize) {
     typedef typename ImageT::pixel_type PixelT;
@@ -34,6 +34,7 @@
 #include <vw/Image/Filter.h>
 #include <vw/Image/InpaintView.h>
 
+#include <asp/Core/MedianFilter.h>
 #include <asp/Core/SoftwareRenderer.h>
 #include <asp/Core/Point2Grid.h>
 #include <boost/foreach.hpp>
@@ -273,26 +274,37 @@ namespace asp{
     int nc = image.cols(), nr = image.rows(); // shorten
     double nan = std::numeric_limits<double>::quiet_NaN();
 
+    // The window slides down each column, so only the rows entering
+    // and leaving it are added and removed.
+    std::vector<double> heights(size_t(nc)*nr);
+    for (int row = 0; row < nr; row++)
+      for (int col = 0; col < nc; col++)
+        heights[size_t(row)*nc + col] = image(col, row).z();
+    vw::SlidingMedian window(heights);
+
     ImageView<Vector3> image_out = copy(image);
 
-    for (int col = 0; col < image.cols(); col++){
-      for (int row = 0; row < image.rows(); row++){
+    for (int col = 0; col < nc; col++){
+      int c0 = std::max(col-half, 0), c1 = std::min(col+half, nc-1);
+      for (int row = -half; row < nr; row++){
+
+        int r = row + half; // Entering
+        if (r < nr)
+          for (int c = c0; c <= c1; c++) window.add(size_t(r)*nc + c);
+        r = row - half - 1; // Leaving
+        if (r >= 0)
+          for (int c = c0; c <= c1; c++) window.remove(size_t(r)*nc + c);
 
-        if (boost::math::isnan(image(col, row).z()))
+        if (row < 0 || boost::math::isnan(image(col, row).z()))
           continue;
 
-        std::vector<double> vals;
-        for (int c = std::max(col-half, 0); c <= std::min(col+half, nc-1); c++){
-          for (int r = std::max(row-half, 0); r <= std::min(row+half, nr-1); r++){
-            if (boost::math::isnan(image(c, r).z())) continue;
-            vals.push_back(image(c, r).z());
-          }
-        }
-        double median = vw::math::destructive_median(vals);
+        double median = window.median();
         if (fabs(median - image(col, row).z()) > thresh){
           image_out(col, row).z() = nan;
         }
       }
+      for (int r = std::max(nr-half-1, 0); r < nr; r++)
+        for (int c = c0; c <= c1; c++) window.remove(size_t(r)*nc + c);
     }
 
     image = copy(image_out);
@@ -382,7 +394,8 @@ namespace asp{
     m_projwin(projwin),
     m_hole_fill_len(0),
     m_error_image(error_image), m_error_cutoff(-1.0),
-    m_median_filter_params(median_filter_params), m_erode_len(erode_len), m_num_invalid_pixels(num_invalid_pixels),
+    m_median_filter_params(median_filter_params), m_erode_len(erode_len),
+    m_fill_companions(false), m_num_invalid_pixels(num_invalid_pixels),
     m_count_mutex(count_mutex){
 
     *m_num_invalid_pixels = 0; // Init counter
@@ -438,6 +451,16 @@ namespace asp{
     if ( m_bbox.empty() )
       vw_throw( ArgumentErr() << "OrthoRasterize: Input point cloud is empty!\n" );
 
+    // Index the boundaries, which do not depend on the spacing, to find
+    // those under a DEM tile quickly
+    std::vector<BBox2> boundary_boxes(m_point_image_boundaries.size());
+    for (size_t i = 0; i < m_point_image_boundaries.size(); i++) {
+      BBox3 const& box = m_point_image_boundaries[i].first;
+      if (!box.empty())
+        boundary_boxes[i] = BBox2(subvector(box.min(), 0, 2), subvector(box.max(), 0, 2));
+    }
+    m_boundary_index.build(boundary_boxes);
+
     // Override with user's projwin, if specified
     if (m_projwin != BBox2()){
       subvector(m_bbox.min(), 0, 2) = m_projwin.min();
@@ -538,29 +561,150 @@ namespace asp{
     this->set_spacing(spacing);
     VW_OUT(DebugMessage,"asp") << "Pixel spacing is " << m_spacing << " pnt/px\n";
 
+    m_snapped_bbox = snapped_bbox(spacing);
+
+    // Companions are relative to the grid at the spacing they were set for
+    m_fill_companions = false;
+
+  } // End function initialize_spacing()
+
+  double OrthoRasterizerView::resolve_spacing(double spacing) const {
+    if (spacing == 0.0)
+      return m_default_spacing;
+    return spacing;
+  }
+
+  BBox3 OrthoRasterizerView::snapped_bbox(double spacing) const {
+
     // We will snap the box so that its corners are integer multiples
     // of the grid size. This ensures that any two DEMs
     // with the same grid size and overlapping grids have those
     // grids match perfectly.
-    m_snapped_bbox = m_bbox;
+    BBox3 bbox = m_bbox;
 
     // If the user wants to use m_search_radius_factor to do filling,
     // expand the box to allow the DEM to grow.
-    if (m_search_radius_factor > 0) 
-      m_snapped_bbox.expand(spacing*m_search_radius_factor);
-    
-    snap_bbox(m_spacing, m_snapped_bbox); // TODO: Class function!
+    if (m_search_radius_factor > 0)
+      bbox.expand(spacing*m_search_radius_factor);
+
+    snap_bbox(resolve_spacing(spacing), bbox); // TODO: Class function!
 
     // Override with user's projwin, if specified
     if (m_projwin != BBox2()){
-      subvector(m_snapped_bbox.min(), 0, 2) = m_projwin.min();
-      subvector(m_snapped_bbox.max(), 0, 2) = m_projwin.max();
+      subvector(bbox.min(), 0, 2) = m_projwin.min();
+      subvector(bbox.max(), 0, 2) = m_projwin.max();
     }
+    return bbox;
+  }
+
+  // Given a DEM grid point, search for cloud points within the
+  // circular region of radius equal to grid size. As such, a
+  // given cloud point may contribute to multiple DEM points, but
+  // with different weights (set by Gaussian). We make this radius
+  // no smaller than the default DEM spacing. Search radius can be
+  // over-ridden by user.
+  double OrthoRasterizerView::search_radius(double spacing) const {
+    if (m_search_radius_factor <= 0.0)
+      return std::max(spacing, m_default_spacing);
+    return spacing*m_search_radius_factor;
+  }
+
+  double OrthoRasterizerView::fill_value() const {
+    if (m_use_alpha) {
+      // use this dummy value to denote transparency
+      return std::numeric_limits<float>::min();
+    } else if (m_minz_as_default) {
+      return m_snapped_bbox.min().z();
+    }
+    return m_default_value;
+  }
+
+  void OrthoRasterizerView::set_companion_spacings(std::vector<double> const& spacings) {
+    VW_ASSERT(!m_use_surface_sampling,
+              ArgumentErr() << "OrthoRasterizer: DEMs at several spacings at once "
+                            << "need the point to grid engine.");
+    m_companions.clear();
+    for (size_t i = 0; i < spacings.size(); i++) {
+      CompanionGrid grid;
+      grid.spacing       = resolve_spacing(spacings[i]);
+      grid.search_radius = search_radius(grid.spacing);
+      grid.snapped_bbox  = snapped_bbox(spacings[i]);
+      // As cols() and rows()
+      grid.cols = (int)round((fabs(grid.snapped_bbox.max().x() - grid.snapped_bbox.min().x()) / grid.spacing)) + 1;
+      grid.rows = (int)round((fabs(grid.snapped_bbox.max().y() - grid.snapped_bbox.min().y()) / grid.spacing)) + 1;
+      grid.dem.set_size(grid.cols, grid.rows);
+      fill(grid.dem, fill_value());
+      grid.filled.set_size(grid.cols, grid.rows);
+      fill(grid.filled, 0);
+      m_companions.push_back(grid);
+    }
+    m_fill_companions = !m_companions.empty();
+  }
+
+  ImageView<float> const& OrthoRasterizerView::companion_dem(int i) const {
+    CompanionGrid const& grid = m_companions[i];
+    for (int row = 0; row < grid.filled.rows(); row++) {
+      for (int col = 0; col < grid.filled.cols(); col++) {
+        if (!grid.filled(col, row))
+          vw_throw(LogicErr() << "OrthoRasterizer: The DEM at spacing " << grid.spacing
+                              << " is missing pixel " << Vector2i(col, row)
+                              << ", as not all tiles at spacing " << m_spacing
+                              << " were rasterized.");
+      }
+    }
+    return grid.dem;
+  }
+
+  void OrthoRasterizerView::release_companion_dem(int i) {
+    m_companions[i].dem    = ImageView<float>();
+    m_companions[i].filled = ImageView<uint8>();
+  }
+
+  // The pixels of a companion grid whose centers are in the area of a
+  // tile of this grid, with rows going up as in Point2Grid. Tiles at
+  // the edges also take the pixels past them, so every pixel belongs
+  // to just one tile of a set covering the grid.
+  BBox2i OrthoRasterizerView::companion_window(CompanionGrid const& grid,
+                                               BBox2i const& bbox) const {
+    const double inf = std::numeric_limits<double>::max();
+    double x_lo = (bbox.min().x() <= 0)      ? -inf :
+      m_snapped_bbox.min().x() + (bbox.min().x() - 0.5)*m_spacing;
+    double x_hi = (bbox.max().x() >= cols()) ?  inf :
+      m_snapped_bbox.min().x() + (bbox.max().x() - 0.5)*m_spacing;
+    double y_lo = (bbox.max().y() >= rows()) ? -inf :
+      m_snapped_bbox.min().y() + (rows() - bbox.max().y() - 0.5)*m_spacing;
+    double y_hi = (bbox.min().y() <= 0)      ?  inf :
+      m_snapped_bbox.min().y() + (rows() - bbox.min().y() - 0.5)*m_spacing;
+
+    // The first pixel with its center at or past a given coordinate
+    double S = grid.spacing;
+    double x0 = grid.snapped_bbox.min().x(), y0 = grid.snapped_bbox.min().y();
+    double col0 = std::max(0.0, std::min(double(grid.cols), ceil((x_lo - x0)/S)));
+    double col1 = std::max(0.0, std::min(double(grid.cols), ceil((x_hi - x0)/S)));
+    double row0 = std::max(0.0, std::min(double(grid.rows), ceil((y_lo - y0)/S)));
+    double row1 = std::max(0.0, std::min(double(grid.rows), ceil((y_hi - y0)/S)));
+    return BBox2i(Vector2i(col0, row0), Vector2i(std::max(col0, col1), std::max(row0, row1)));
+  }
 
-  } // End function initialize_spacing()
 
 
 
+  // Flip the rows, as the DEM at this spacing is flipped. A pixel may
+  // be found again if a tile is, but to the same value.
+  void OrthoRasterizerView::store_companion_pixels(size_t i, BBox2i const& window,
+                                                   ImageView<double> const& buffer) const {
+    CompanionGrid const& grid = m_companions[i];
+    ImageView<float> dem    = grid.dem; // Shares the pixels
+    ImageView<uint8> filled = grid.filled;
+    vw::Mutex::Lock lock(*m_count_mutex);
+    for (int iy = 0; iy < window.height(); iy++) {
+      for (int ix = 0; ix < window.width(); ix++) {
+        int col = window.min().x() + ix, row = grid.rows - 1 - (window.min().y() + iy);
+        dem(col, row)    = buffer(ix, iy);
+        filled(col, row) = 1;
+      }
+    }
+  }
 
   // Function to convert pixel coordinates to the point domain
   BBox3 OrthoRasterizerView::pixel_to_point_bbox( BBox2 const& px ) const {
@@ -595,34 +739,42 @@ namespace asp{
     renderer.Ortho2D(local_3d_bbox.min().x(), local_3d_bbox.max().x(),
                      local_3d_bbox.min().y(), local_3d_bbox.max().y());
 
-    // Given a DEM grid point, search for cloud points within the
-    // circular region of radius equal to grid size. As such, a
-    // given cloud point may contribute to multiple DEM points, but
-    // with different weights (set by Gaussian). We make this radius
-    // no smaller than the default DEM spacing. Search radius can be
-    // over-ridden by user.
-    double search_radius;
-    if (m_search_radius_factor <= 0.0)
-      search_radius = std::max(m_spacing, m_default_spacing);
-    else
-      search_radius = m_spacing*m_search_radius_factor;
     vw::stereo::Point2Grid point2grid(bbox_1.width(),
                                       bbox_1.height(),
                                       d_buffer, weights,
                                       local_3d_bbox.min().x(),
                                       local_3d_bbox.min().y(),
                                       m_spacing, m_default_spacing,
-                                      search_radius, m_sigma_factor);
+                                      search_radius(m_spacing), m_sigma_factor);
 
     // Set up the default color value
-    double min_val = 0.0;
-    if (m_use_alpha) {
-      // use this dummy value to denote transparency
-      min_val = std::numeric_limits<float>::min();
-    } else if (m_minz_as_default) {
-      min_val = m_snapped_bbox.min().z();
-    } else {
-      min_val = m_default_value;
+    double min_val = fill_value();
+
+    // The pixels of the companion grids this tile fills. The points
+    // within the search radius of those are needed as well.
+    BBox3 points_bbox = local_3d_bbox;
+    size_t num_companions = m_fill_companions ? m_companions.size() : 0;
+    std::vector<BBox2i> companion_windows(num_companions);
+    std::vector< ImageView<double> > companion_buffers(num_companions), companion_weights(num_companions);
+    std::vector< boost::shared_ptr<vw::stereo::Point2Grid> > companion_grids(num_companions);
+    for (size_t i = 0; i < num_companions; i++) {
+      CompanionGrid const& grid = m_companions[i];
+      BBox2i window = companion_window(grid, bbox);
+      companion_windows[i] = window;
+      if (window.width() <= 0 || window.height() <= 0)
+        continue;
+      double x0 = grid.snapped_bbox.min().x() + window.min().x()*grid.spacing;
+      double y0 = grid.snapped_bbox.min().y() + window.min().y()*grid.spacing;
+      companion_grids[i].reset(new vw::stereo::Point2Grid
+                               (window.width(), window.height(),
+                                companion_buffers[i], companion_weights[i],
+                                x0, y0, grid.spacing, m_default_spacing,
+                                grid.search_radius, m_sigma_factor));
+      companion_grids[i]->Clear(min_val);
+      double r = grid.search_radius, z = local_3d_bbox.min().z();
+      points_bbox.grow(Vector3(x0 - r, y0 - r, z));
+      points_bbox.grow(Vector3(x0 + (window.width()  - 1)*grid.spacing + r,
+                               y0 + (window.height() - 1)*grid.spacing + r, z));
     }
 
     std::valarray<float> vertices(10), intensities(5);
@@ -645,8 +797,12 @@ namespace asp{
     typedef std::map<BBox2i, BBox2i, compare_bboxes> BlockMapType;
     typedef BlockMapType::iterator MapIterType;
     BlockMapType blocks_map;
-    BOOST_FOREACH( BBoxPair const& boundary, m_point_image_boundaries ) {
-      if (! local_3d_bbox.intersects(boundary.first) )
+    std::vector<size_t> boundary_indices;
+    m_boundary_index.query(BBox2(subvector(points_bbox.min(), 0, 2),
+                                 subvector(points_bbox.max(), 0, 2)), boundary_indices);
+    BOOST_FOREACH( size_t i, boundary_indices ) {
+      BBoxPair const& boundary = m_point_image_boundaries[i];
+      if (! points_bbox.intersects(boundary.first) )
         continue;
 
       BBox2i pc_block = boundary.second;
@@ -665,6 +821,12 @@ namespace asp{
 
     if ( blocks_map.empty() ){
 
+      // No points near the companion pixels either
+      for (size_t i = 0; i < num_companions; i++) {
+        if (companion_grids[i])
+          store_companion_pixels(i, companion_windows[i], companion_buffers[i]);
+      }
+
       { // Lock and update the total number of invalid pixels in this tile.
         vw::Mutex::Lock lock(*m_count_mutex);
         (*m_num_invalid_pixels) += bbox.width()*bbox.height();
@@ -681,6 +843,10 @@ namespace asp{
     // pixel we need to see its next up and right neighbors.
     int d = (int)m_use_surface_sampling;
 
+    // The valid points of a block, for the point to grid engine
+    std::vector<double> points_x, points_y, points_z;
+    asp::SimdLevel simd_level = asp::detect_simd_level();
+
     for (MapIterType it = blocks_map.begin(); it != blocks_map.end(); it++){
 
       BBox2i block = it->second;
@@ -757,11 +923,11 @@ namespace asp{
             }
 
           }else{
-            // The new engine
+            // The new engine. The points are gathered and added below.
             if ( !boost::math::isnan(point_copy(col, row).z()) ){
-              point2grid.AddPoint(point_copy(col, row).x(),
-                                  point_copy(col, row).y(),
-                                  texture_copy(col,  row));
+              points_x.push_back(point_copy(col, row).x());
+              points_y.push_back(point_copy(col, row).y());
+              points_z.push_back(texture_copy(col,  row));
             }
           }
           point_ul.next_col();
@@ -769,11 +935,31 @@ namespace asp{
         row_acc.next_row();
       } // End row loop
 
+      if (!points_x.empty()) {
+        point2grid.AddPoints(points_x.size(), &points_x[0], &points_y[0], &points_z[0],
+                             simd_level);
+        for (size_t i = 0; i < num_companions; i++) {
+          if (companion_grids[i])
+            companion_grids[i]->AddPoints(points_x.size(), &points_x[0], &points_y[0],
+                                          &points_z[0], simd_level);
+        }
+        points_x.clear();
+        points_y.clear();
+        points_z.clear();
+      }
     }
 
     if (!m_use_surface_sampling)
       point2grid.normalize();
 
+    // Put the companion pixels in place
+    for (size_t i = 0; i < num_companions; i++) {
+      if (!companion_grids[i])
+        continue;
+      companion_grids[i]->normalize();
+      store_companion_pixels(i, companion_windows[i], companion_buffers[i]);
+    }
+
     // The software renderer returns an image which will render
     // upside down in most image formats, so we correct that here.
     // We also introduce transparent pixels into the result where necessary.
@@ -30,6 +30,7 @@
 #include <vw/Image/ImageViewRef.h>
 #include <vw/Math/Vector.h>
 #include <vw/Math/BBox.h>
+#include <asp/Core/BBoxIndex.h>
 
 namespace asp{
 
@@ -67,14 +68,40 @@ namespace asp{
     size_t     *m_num_invalid_pixels; ///< Keep a count of nodata output pixels, needs to be pointer due to VW weirdness.
     vw::Mutex  *m_count_mutex;        ///< A lock for m_num_invalid_pixels, needs to be pointer due to C++ weirdness.
 
-    // We could actually use a quadtree here .. but this should be a
-    // good enough improvement.
     std::vector<BBoxPair> m_point_image_boundaries;
     // These boundaries describe a point cloud 3D boundaries and then
     // their location in the the point cloud image. These boxes are
     // overlapping in the pc image X/Y domain to insure that
     // everything is triangulated.
 
+    // The x and y extents of the boundaries above, to find the ones
+    // under a DEM tile without going through all of them.
+    BBoxIndex m_boundary_index;
+
+    // DEMs at other spacings, filled in from the points read for the
+    // tiles at this spacing. The images are shared by copies of this view.
+    struct CompanionGrid {
+      double spacing, search_radius;
+      BBox3  snapped_bbox;
+      int    cols, rows;
+      ImageView<float> dem;
+      ImageView<uint8> filled; // Which pixels a tile has put in place
+    };
+    std::vector<CompanionGrid> m_companions;
+    bool m_fill_companions; // Off once the texture is no longer the height
+
+    // The spacing a requested one resolves to, and the box of its grid
+    double resolve_spacing(double spacing) const;
+    BBox3  snapped_bbox(double spacing) const;
+    double search_radius(double spacing) const;
+
+    // The pixels of a companion grid a tile of this grid fills
+    BBox2i companion_window(CompanionGrid const& grid, BBox2i const& bbox) const;
+
+    // Put the pixels of a companion grid found by a tile in place
+    void store_companion_pixels(size_t i, BBox2i const& window,
+                                ImageView<double> const& buffer) const;
+
     // Function to convert pixel coordinates to the point domain
     BBox3 pixel_to_point_bbox( BBox2 const& px ) const;
 
@@ -107,6 +134,24 @@ namespace asp{
     /// This must be called before the object can be used!
     void initialize_spacing(double spacing=0.0);
 
+    /// Also compute DEMs at these spacings, with the points read while
+    /// rasterizing the DEM at the current spacing, so the cloud is read
+    /// once for all of them. Each companion pixel is found from all the
+    /// points within its search radius, as it would be at its own
+    /// spacing. Call after initialize_spacing(), and write every tile
+    /// of the DEM at the current spacing before calling companion_dem().
+    /// Only for the height texture, without surface sampling.
+    void set_companion_spacings(std::vector<double> const& spacings);
+
+    /// The DEM at the i-th companion spacing, on the grid that
+    /// initialize_spacing() with that spacing would make. Throws if
+    /// some of its pixels were not found, as when not every tile of
+    /// the DEM at the current spacing was rasterized.
+    ImageView<float> const& companion_dem(int i) const;
+
+    /// Free the DEM at the i-th companion spacing, once it is written.
+    void release_companion_dem(int i);
+
     /// You can change the texture after the class has been
     /// initialized.  The texture image must have the same dimensions
     /// as the point image, and texture pixels must correspond exactly
@@ -118,6 +163,7 @@ namespace asp{
       ArgumentErr() << "Orthorasterizer: set_texture() failed."
                     << " Texture dimensions must match point image dimensions.");
       m_texture = channel_cast<float>(channels_to_planes(texture.impl()));
+      m_fill_companions = false;
     }
 
     inline int32 cols() const {return (int)round((fabs(m_snapped_bbox.max().x() - m_snapped_bbox.min().x()) / m_spacing)) + 1;}
@@ -149,6 +195,9 @@ namespace asp{
       else return m_default_value;
     }
 
+    /// The value of the pixels no points went into
+    double fill_value() const;
+
     /// If the DEM spacing is set to zero, we compute a DEM with
     /// approximately the same pixel dimensions as the input image.
     /// Note, however, that this could lead to a loss in DEM
@@ -19,16 +19,154 @@
 // grid, combine all points within given radius of the grid point and
 // calculate a single z value at the grid point.
 
+// The vector kernels are bit-identical to the scalar one only if the
+// compiler does not fuse the scalar multiply-adds.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC optimize ("fp-contract=off")
+#endif
+
 #include <vw/Core/Exception.h>
 #include <vw/Core/FundamentalTypes.h>
 #include <asp/Core/Point2Grid.h>
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 
+#if defined(__GNUC__) && defined(__x86_64__)
+#define ASP_HAVE_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define ASP_HAVE_X86_SIMD 0
+#endif
+
 using namespace std;
 using namespace vw;
 using namespace stereo;
 
+namespace {
+
+  // What the kernels need to weigh a point at a grid point
+  struct SplatParams {
+    double x0, grid_size, radius, dx;
+    double const* gauss;
+  };
+
+  // Add a point to the n grid points of a row starting at column ix0,
+  // with dy2 the squared distance from the point to the row.
+  void scalar_splat_row(SplatParams const& p, int ix0, int n,
+                        double x, double dy2, double z,
+                        double * buffer, double * weights) {
+    for (int k = 0; k < n; k++) {
+      double gx   = p.x0 + (ix0 + k)*p.grid_size;
+      double dist = sqrt( (x-gx)*(x-gx) + dy2 );
+      if ( dist > p.radius ) continue;
+
+      if (weights[k] == 0) buffer[k] = 0.0;
+      double wt = p.gauss[(int)round(dist/p.dx)];
+      if (wt <= 0) continue;
+      buffer[k]  += z*wt;
+      weights[k] += wt;
+    }
+  }
+
+#if ASP_HAVE_X86_SIMD
+
+  // The index into the sampled Gaussian, rounded half away from zero
+  // as round() does, since the distance is never negative. Truncating
+  // and comparing the remainder is exact, unlike adding 0.5.
+  inline __m128d sse2_round_index(__m128d q) {
+    __m128d t = _mm_cvtepi32_pd(_mm_cvttpd_epi32(q));
+    __m128d up = _mm_cmpge_pd(_mm_sub_pd(q, t), _mm_set1_pd(0.5));
+    return _mm_add_pd(t, _mm_and_pd(up, _mm_set1_pd(1.0)));
+  }
+
+  // Two grid points at a time. SSE2 has no gather, so the two weights
+  // are looked up one by one.
+  void sse2_splat_row(SplatParams const& p, int ix0, int n,
+                      double x, double dy2, double z,
+                      double * buffer, double * weights) {
+    const __m128d zero = _mm_setzero_pd();
+    const __m128d vx = _mm_set1_pd(x), vdy2 = _mm_set1_pd(dy2), vz = _mm_set1_pd(z);
+    const __m128d x0 = _mm_set1_pd(p.x0), grid_size = _mm_set1_pd(p.grid_size);
+    const __m128d radius = _mm_set1_pd(p.radius), dx = _mm_set1_pd(p.dx);
+    int k = 0;
+    for (; k + 2 <= n; k += 2) {
+      __m128d ix   = _mm_cvtepi32_pd(_mm_setr_epi32(ix0 + k, ix0 + k + 1, 0, 0));
+      __m128d d    = _mm_sub_pd(vx, _mm_add_pd(x0, _mm_mul_pd(ix, grid_size)));
+      __m128d dist = _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(d, d), vdy2));
+      __m128d in   = _mm_cmple_pd(dist, radius);
+      int in_bits  = _mm_movemask_pd(in);
+      if (in_bits == 0)
+        continue;
+
+      int idx[4];
+      _mm_storeu_si128((__m128i*)idx, _mm_cvttpd_epi32(sse2_round_index(_mm_div_pd(dist, dx))));
+      __m128d wt = _mm_setr_pd((in_bits & 1) ? p.gauss[idx[0]] : 0.0,
+                               (in_bits & 2) ? p.gauss[idx[1]] : 0.0);
+
+      __m128d b = _mm_loadu_pd(buffer + k), w = _mm_loadu_pd(weights + k);
+      b = _mm_andnot_pd(_mm_and_pd(in, _mm_cmpeq_pd(w, zero)), b);
+      __m128d use = _mm_and_pd(in, _mm_cmpgt_pd(wt, zero));
+      __m128d nb = _mm_add_pd(b, _mm_mul_pd(vz, wt)), nw = _mm_add_pd(w, wt);
+      _mm_storeu_pd(buffer  + k, _mm_or_pd(_mm_and_pd(use, nb), _mm_andnot_pd(use, b)));
+      _mm_storeu_pd(weights + k, _mm_or_pd(_mm_and_pd(use, nw), _mm_andnot_pd(use, w)));
+    }
+    scalar_splat_row(p, ix0 + k, n - k, x, dy2, z, buffer + k, weights + k);
+  }
+
+  // Four grid points at a time, with the weights gathered only for the
+  // ones within the radius.
+  __attribute__((target("avx2")))
+  void avx2_splat_row(SplatParams const& p, int ix0, int n,
+                      double x, double dy2, double z,
+                      double * buffer, double * weights) {
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d vx = _mm256_set1_pd(x), vdy2 = _mm256_set1_pd(dy2), vz = _mm256_set1_pd(z);
+    const __m256d x0 = _mm256_set1_pd(p.x0), grid_size = _mm256_set1_pd(p.grid_size);
+    const __m256d radius = _mm256_set1_pd(p.radius), dx = _mm256_set1_pd(p.dx);
+    const __m256d half = _mm256_set1_pd(0.5), one = _mm256_set1_pd(1.0);
+    const __m128i lanes = _mm_setr_epi32(0, 1, 2, 3);
+    int k = 0;
+    for (; k + 4 <= n; k += 4) {
+      __m256d ix   = _mm256_cvtepi32_pd(_mm_add_epi32(_mm_set1_epi32(ix0 + k), lanes));
+      __m256d d    = _mm256_sub_pd(vx, _mm256_add_pd(x0, _mm256_mul_pd(ix, grid_size)));
+      __m256d dist = _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(d, d), vdy2));
+      __m256d in   = _mm256_cmp_pd(dist, radius, _CMP_LE_OQ);
+      if (_mm256_movemask_pd(in) == 0)
+        continue;
+
+      __m256d q  = _mm256_div_pd(dist, dx);
+      __m256d t  = _mm256_round_pd(q, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+      __m256d up = _mm256_cmp_pd(_mm256_sub_pd(q, t), half, _CMP_GE_OQ);
+      __m128i idx = _mm256_cvttpd_epi32(_mm256_add_pd(t, _mm256_and_pd(up, one)));
+      __m256d wt = _mm256_mask_i32gather_pd(zero, p.gauss, idx, in, 8);
+
+      __m256d b = _mm256_loadu_pd(buffer + k), w = _mm256_loadu_pd(weights + k);
+      b = _mm256_andnot_pd(_mm256_and_pd(in, _mm256_cmp_pd(w, zero, _CMP_EQ_OQ)), b);
+      __m256d use = _mm256_and_pd(in, _mm256_cmp_pd(wt, zero, _CMP_GT_OQ));
+      _mm256_storeu_pd(buffer  + k, _mm256_blendv_pd(b, _mm256_add_pd(b, _mm256_mul_pd(vz, wt)), use));
+      _mm256_storeu_pd(weights + k, _mm256_blendv_pd(w, _mm256_add_pd(w, wt), use));
+    }
+    scalar_splat_row(p, ix0 + k, n - k, x, dy2, z, buffer + k, weights + k);
+  }
+
+#endif // ASP_HAVE_X86_SIMD
+
+  void splat_row(asp::SimdLevel level, SplatParams const& p, int ix0, int n,
+                 double x, double dy2, double z,
+                 double * buffer, double * weights) {
+#if ASP_HAVE_X86_SIMD
+    if (level >= asp::SIMD_AVX2)
+      return avx2_splat_row(p, ix0, n, x, dy2, z, buffer, weights);
+    if (level >= asp::SIMD_SSE2)
+      return sse2_splat_row(p, ix0, n, x, dy2, z, buffer, weights);
+#endif
+    scalar_splat_row(p, ix0, n, x, dy2, z, buffer, weights);
+  }
+
+} // end anonymous namespace
+
 // ===========================================================================
 // Class Member Functions
 // ===========================================================================
@@ -82,6 +220,11 @@ void Point2Grid::Clear(const float value) {
 }
 
 void Point2Grid::AddPoint(double x, double y, double z){
+  splat(asp::SIMD_SCALAR, x, y, z, &m_buffer(0, 0), &m_weights(0, 0));
+}
+
+void Point2Grid::splat(asp::SimdLevel level, double x, double y, double z,
+                       double * buffer, double * weights) const {
 
   int minx = std::max( (int)ceil( (x - m_radius - m_x0)/m_grid_size ), 0 );
   int miny = std::max( (int)ceil( (y - m_radius - m_y0)/m_grid_size ), 0 );
@@ -89,25 +232,33 @@ void Point2Grid::AddPoint(double x, double y, double z){
   int maxx = std::min( (int)floor( (x + m_radius - m_x0)/m_grid_size ), m_buffer.cols() - 1 );
   int maxy = std::min( (int)floor( (y + m_radius - m_y0)/m_grid_size ), m_buffer.rows() - 1 );
 
-  // Add the contribution of current point to all grid points within radius
-  for (int ix = minx; ix <= maxx; ix++){
-    for (int iy = miny; iy <= maxy; iy++){
-      
-      double gx = m_x0 + ix*m_grid_size;
-      double gy = m_y0 + iy*m_grid_size;
-      double dist = sqrt( (x-gx)*(x-gx) + (y-gy)*(y-gy) );
-      if ( dist > m_radius ) continue;
-
-      if (m_weights(ix, iy) == 0) m_buffer(ix, iy) = 0.0;
-      double wt = m_sampled_gauss[(int)round(dist/m_dx)];
-      if (wt <= 0) continue;
-      m_buffer(ix, iy)  += z*wt;
-      m_weights(ix, iy) += wt;
-    }
-    
+  if (minx > maxx)
+    return;
+
+  SplatParams params;
+  params.x0        = m_x0;
+  params.grid_size = m_grid_size;
+  params.radius    = m_radius;
+  params.dx        = m_dx;
+  params.gauss     = &m_sampled_gauss[0];
+
+  // Add the contribution of current point to all grid points within
+  // radius, a row at a time, as the rows are contiguous.
+  int cols = m_buffer.cols();
+  for (int iy = miny; iy <= maxy; iy++){
+    double gy = m_y0 + iy*m_grid_size;
+    size_t offset = size_t(iy)*cols + minx;
+    splat_row(level, params, minx, maxx - minx + 1, x, (y-gy)*(y-gy), z,
+              buffer + offset, weights + offset);
   }
 }
 
+void Point2Grid::AddPoints(size_t n, double const* x, double const* y, double const* z,
+                           asp::SimdLevel level){
+  for (size_t i = 0; i < n; i++)
+    splat(level, x[i], y[i], z[i], &m_buffer(0, 0), &m_weights(0, 0));
+}
+
 void Point2Grid::normalize(){
   for (int c = 0; c < m_buffer.cols(); c++){
     for (int r = 0; r < m_buffer.rows(); r++){
@@ -23,6 +23,8 @@
 #define __VW_POINT2GRID_H__
 
 #include <vw/Image/ImageView.h>
+#include <asp/Core/Simd.h>
+#include <vector>
 
 namespace vw { namespace stereo {
   
@@ -36,9 +38,21 @@ namespace vw { namespace stereo {
     ~Point2Grid(){}
     void Clear(const float val);
     void AddPoint(double x, double y, double z);
+
+    /// Add n points, with their coordinates in separate arrays. The
+    /// grid points near each point are done a vector at a time, with
+    /// the same operations as AddPoint(), so the result is bit-identical
+    /// to adding the points one by one.
+    void AddPoints(size_t n, double const* x, double const* y, double const* z,
+                   asp::SimdLevel level);
+
     void normalize();
 
   private:
+    // Add a point to the sums and weights of a grid the size of the buffer
+    void splat(asp::SimdLevel level, double x, double y, double z,
+               double * buffer, double * weights) const;
+
     int m_width, m_height; // DEM dimensions
     ImageView<double> & m_buffer;
     ImageView<double> & m_weights;
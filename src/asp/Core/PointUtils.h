@@ -23,6 +23,7 @@
 #ifndef __ASP_CORE_POINT_UTILS_H__
 #define __ASP_CORE_POINT_UTILS_H__
 
+#include <cstdlib>
 #include <string>
 #include <vw/Core/Functors.h>
 #include <vw/Image/PerPixelViews.h>
@@ -232,6 +233,7 @@ namespace asp {
   /// Given a point cloud with n channels, return the first m channels.
   /// We must have 1 <= m <= n <= 6.
   /// If the image was written by subtracting a shift, put that shift back.
+  /// If it was quantized to integers, scale them back to meters first.
   template<int m>
   vw::ImageViewRef< vw::Vector<double, m> > read_asp_point_cloud(std::string const& filename);
 
@@ -282,6 +284,25 @@ namespace asp {
     return vw::UnaryPerPixelView<ImageT,PointOffsetFunc>( image.impl(), PointOffsetFunc(offset) );
   }
 
+  // Multiply the points in the PointImage by a scale
+  class PointScaleFunc : public vw::UnaryReturnSameType {
+    double m_scale;
+
+  public:
+    PointScaleFunc(double scale) : m_scale(scale) {}
+
+    template <class T>
+    T operator()(T const& p) const {
+      return p*m_scale;
+    }
+  }; // End class PointScaleFunc
+
+  template <class ImageT>
+  vw::UnaryPerPixelView<ImageT, PointScaleFunc>
+  inline point_image_scale( vw::ImageViewBase<ImageT> const& image, double scale) {
+    return vw::UnaryPerPixelView<ImageT,PointScaleFunc>( image.impl(), PointScaleFunc(scale) );
+  }
+
   // TODO: Move center lon functions and use consistently.
 
   // Center Longitudes
@@ -338,17 +359,25 @@ template<int m>
 vw::ImageViewRef< vw::Vector<double, m> > read_asp_point_cloud(std::string const& filename){
 
   vw::Vector3 shift;
-  std::string shift_str;
+  double scale = 0;
+  std::string shift_str, scale_str;
   boost::shared_ptr<vw::DiskImageResource> rsrc
     ( new vw::DiskImageResourceGDAL(filename) );
   if (vw::cartography::read_header_string(*rsrc.get(), asp::ASP_POINT_OFFSET_TAG_STR, shift_str)){
     shift = vw::str_to_vec<vw::Vector3>(shift_str);
   }
+  if (vw::cartography::read_header_string(*rsrc.get(), asp::ASP_POINT_SCALE_TAG_STR, scale_str)){
+    scale = atof(scale_str.c_str());
+  }
 
   // Read the first m channels
   vw::ImageViewRef< vw::Vector<double, m> > out_image
     = vw::read_channels<m, double>(filename, 0);
 
+  // A quantized cloud is saved as integer multiples of the scale
+  if (scale > 0)
+    out_image = point_image_scale(out_image, scale);
+
   // Add the shift back to the first several channels.
   if (shift != vw::Vector3())
     out_image = subtract_shift(out_image, -shift);
@@ -0,0 +1,42 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file Simd.h
+///
+/// Detection of the vector instruction sets the ASP kernels dispatch on.
+
+#ifndef __ASP_CORE_SIMD_H__
+#define __ASP_CORE_SIMD_H__
+
+#include <string>
+
+namespace asp {
+
+  /// Instruction sets the kernels can use, in increasing order of width.
+  enum SimdLevel { SIMD_SCALAR = 0,
+                   SIMD_SSE2   = 1,
+                   SIMD_AVX2   = 2 };
+
+  /// The widest instruction set supported by the CPU we are running on.
+  SimdLevel detect_simd_level();
+
+  std::string simd_level_name(SimdLevel level);
+
+} // namespace asp
+
+#endif // __ASP_CORE_SIMD_H__
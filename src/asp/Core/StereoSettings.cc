@@ -201,6 +201,28 @@ namespace asp {
                      "Error (in meters) of the disparity estimation DEM.")
       ("use-local-homography",   po::bool_switch(&global.use_local_homography)->default_value(false)->implicit_value(true),
                      "Apply a local homography in each tile.")
+      ("corr-align-cache",       po::bool_switch(&global.corr_align_cache)->default_value(false)->implicit_value(true),
+                     "Cache the per-tile piecewise alignment (matches, alignment matrices, search range) in {output-prefix}-align-cache and reuse it in later runs on the same tiles.")
+      ("corr-align-threads",     po::value(&global.corr_align_threads)->default_value(0),
+                     "When using local homography, compute the piecewise alignment of upcoming tiles with this many extra threads, ahead of correlation. Set to 0 to align each tile in the thread correlating it.")
+      ("corr-tile-cache-mb",     po::value(&global.corr_tile_cache_mb)->default_value(0),
+                     "When using local homography, keep up to this many megabytes of input image blocks in memory, so that the margins shared by neighboring tiles are read only once. The default of 0 disables this.")
+      ("corr-ip-pyramid-levels", po::value(&global.corr_ip_pyramid_levels)->default_value(0),
+                     "When using local homography, detect and match the interest points of each tile on the tile subsampled by 2^levels, then refine the matches at full resolution. Set to 0 to detect at full resolution.")
+      ("corr-seed-from-match-file", po::bool_switch(&global.corr_seed_from_match_file)->default_value(false)->implicit_value(true),
+                     "When using local homography, align each tile using the interest point matches for the whole image pair which fall in it, and detect interest points in the tile only if there are too few of them.")
+      ("corr-min-seed-matches",  po::value(&global.corr_min_seed_matches)->default_value(20),
+                     "The minimum number of matches from the match file for the whole image pair which must survive the outlier removal in a tile for them to be used for its alignment.")
+      ("corr-incremental",       po::bool_switch(&global.corr_incremental)->default_value(false)->implicit_value(true),
+                     "If the disparity from a previous run exists, recompute only the tiles whose inputs or settings have changed, and update the disparity in place. The state is kept in {output-prefix}-D-manifest.txt.")
+      ("corr-tile-stats",        po::value(&global.corr_tile_stats)->default_value("none"),
+                     "Write the time spent on each tile in interest point matching and correlation, the number of matches, the alignment outcome, the search range area, the memory high-water mark and the fraction of valid pixels to {output-prefix}-D-tile-stats.csv or .json, with a heatmap of the time per tile in {output-prefix}-D-tile-stats.tif. Options: none, csv, json.")
+      ("corr-split-cost-factor", po::value(&global.corr_split_cost_factor)->default_value(0.0),
+                     "Correlate the tiles whose predicted cost, from the search range given by D_sub and D_sub_spread, is more than this many times the median in smaller pieces with their own search ranges, shared among the threads. Set to 0 to disable. Not used with SGM or local homography.")
+      ("corr-max-memory-mb",     po::value(&global.corr_max_memory_mb)->default_value(0),
+                     "Correlate at once only as many tiles as fit in this many megabytes, as predicted from their search ranges, the kernel size and, with SGM, the collar size. This includes the tile cache. Set to 0 for no limit.")
+      ("stream-save-intermediates", po::bool_switch(&global.stream_save_intermediates)->default_value(false)->implicit_value(true),
+                     "When running correlation through triangulation in one process with stereo_stream, also write the disparities D.tif, RD.tif and F.tif and the good pixel map, which are otherwise passed from one stage to the next in memory.")
       ("corr-timeout",           po::value(&global.corr_timeout)->default_value(900),
                      "Correlation timeout for a tile, in seconds.")
       ("stereo-algorithm",       po::value(&global.stereo_algorithm)->default_value(0),
@@ -235,7 +257,7 @@ namespace asp {
     StereoSettings& global = stereo_settings();
     (*this).add_options()
       ("subpixel-mode",       po::value(&global.subpixel_mode)->default_value(1),
-  "Subpixel algorithm. [0 None, 1 Parabola, 2 Bayes EM, 3 Affine, 4 LK, 5 Bayes EM w/gamma, 6 SGM Linear, 7 SGM Poly4, 8 SGM Cos, 9 SGM Parabola 10 SGM None 11 SGM Blend]")
+  "Subpixel algorithm. [0 None, 1 Parabola, 2 Bayes EM, 3 Affine, 4 LK, 5 Bayes EM w/gamma, 6 SGM Linear, 7 SGM Poly4, 8 SGM Cos, 9 SGM Parabola 10 SGM None 11 SGM Blend 12 Affine until converged]")
       ("subpixel-kernel",     po::value(&global.subpixel_kernel)->default_value(Vector2i(35,35), "35 35"),
                               "Kernel size used for subpixel method.")
       ("disable-h-subpixel",  po::bool_switch(&global.disable_h_subpixel)->default_value(false)->implicit_value(true),
@@ -250,7 +272,9 @@ namespace asp {
       ("subpixel-em-iter",        po::value(&global.subpixel_em_iter)->default_value(15),
                                   "Maximum number of EM iterations for EMSubpixelCorrelator.")
       ("subpixel-affine-iter",    po::value(&global.subpixel_affine_iter)->default_value(5),
-                                  "Maximum number of affine optimization iterations for EMSubpixelCorrelator.")
+                                  "Maximum number of affine optimization iterations for EMSubpixelCorrelator, and for subpixel mode 12.")
+      ("subpixel-convergence-threshold", po::value(&global.subpixel_convergence_threshold)->default_value(0.01),
+                                  "With subpixel mode 12, stop refining each pixel once its disparity changes by less than this many pixels in an iteration.")
       ("subpixel-pyramid-levels", po::value(&global.subpixel_pyramid_levels)->default_value(3),
                                   "Number of pyramid levels for EMSubpixelCorrelator.");
     (*this).add( experimental_subpixel_options );
@@ -318,6 +342,10 @@ namespace asp {
                                             "The minimum angle, in degrees, at which rays must meet at a triangulated point to accept this point as valid. The internal default is somewhat less than 1 degree.")
       ("use-least-squares",                 po::bool_switch(&global.use_least_squares)->default_value(false)->implicit_value(true),
                                             "Use rigorous least squares triangulation process. This is slow for ISIS processes.")
+      ("ray-table-tolerance",               po::value(&global.ray_table_tolerance)->default_value(0.0),
+                                            "If positive, interpolate the camera rays for each tile from a grid of exact ones, refined until the rays are within this many pixels of the exact ones. Much faster for linescan and RPC cameras. Not used with least squares.")
+      ("ray-table-spacing",                 po::value(&global.ray_table_spacing)->default_value(64),
+                                            "The spacing, in pixels, of the coarsest grid of exact camera rays for --ray-table-tolerance.")
       ("bundle-adjust-prefix", po::value(&global.bundle_adjust_prefix),
        "Use the camera adjustments obtained by previously running bundle_adjust with this output prefix.")
       ("num-matches-from-disparity", po::value(&global.num_matches_from_disparity)->default_value(0), "An experimental option to create, after stereo, a match file with this many points sampled from the stereo disparity. The matches are between original images (that is, before any alignment or map-projection). The match file is saved as {output-prefix}-disp.match.")
@@ -330,6 +358,8 @@ namespace asp {
                                             "How much to round the output point cloud values, in meters (more rounding means less precision but potentially smaller size on disk). The inverse of a power of 2 is suggested. Default: 1/2^10 for Earth and proportionally less for smaller bodies.")
       ("save-double-precision-point-cloud", po::bool_switch(&global.save_double_precision_point_cloud)->default_value(false)->implicit_value(true),
                                             "Save the final point cloud in double precision rather than bringing the points closer to origin and saving as float (marginally more precision at twice the storage).")
+      ("save-quantized-point-cloud",        po::bool_switch(&global.save_quantized_point_cloud)->default_value(false)->implicit_value(true),
+                                            "Save the final point cloud as 32-bit integer multiples of the point cloud rounding error away from its center, rather than as float. This is as precise and compresses much better.")
       ("compute-point-cloud-center-only",   po::bool_switch(&global.compute_point_cloud_center_only)->default_value(false)->implicit_value(true),
                                             "Only compute the center of triangulated point cloud and exit.")
       ("skip-point-cloud-center-comp", po::bool_switch(&global.skip_point_cloud_center_comp)->default_value(false)->implicit_value(true),
@@ -420,6 +450,13 @@ namespace asp {
                universe_center == "none",
                ArgumentErr() << "\"" << universe_center
                << "\" is not a valid option for UNIVERSE_CENTER." );
+
+    to_lower( corr_tile_stats );
+    trim( corr_tile_stats );
+    VW_ASSERT( corr_tile_stats == "none" || corr_tile_stats == "csv" ||
+               corr_tile_stats == "json",
+               ArgumentErr() << "\"" << corr_tile_stats
+               << "\" is not a valid option for corr-tile-stats." );
   }
 
   void StereoSettings::write_copy( int argc, char *argv[],
@@ -164,6 +164,17 @@ namespace asp {
     std::string disparity_estimation_dem;     // DEM to use in estimating the low-resolution disparity
     double disparity_estimation_dem_error; // Error (in meters) of the disparity estimation DEM
     bool   use_local_homography;      // Apply a local homography in each tile
+    bool   corr_align_cache;          // Cache the per-tile piecewise alignment on disk
+    int    corr_align_threads;        // Threads aligning tiles ahead of correlation
+    int    corr_tile_cache_mb;        // Memory for input blocks shared by overlapping tiles
+    int    corr_ip_pyramid_levels;    // Detect tile interest points on a subsampled tile
+    bool   corr_seed_from_match_file; // Align tiles with the global matches where possible
+    int    corr_min_seed_matches;     // Fewer global matches in a tile means detecting anew
+    bool   corr_incremental;          // Recompute only the tiles of D.tif whose inputs changed
+    std::string corr_tile_stats;      // Write per-tile timing and memory stats (none, csv, json)
+    double corr_split_cost_factor;    // Split tiles costing more than this times the median
+    int    corr_max_memory_mb;        // Memory budget for the tiles correlated at once
+    bool   stream_save_intermediates; // In stereo_stream, also write D, RD and F to disk
     int    corr_timeout;              // Correlation timeout for a tile, in seconds
     int    stereo_algorithm;          // 0 = Default local window search method.
                                       // 1 = Slower SGM method.
@@ -182,6 +193,7 @@ namespace asp {
                                       // 3 = affine
                                       // 4 = Lucas-Kanade
                                       // 5 = affine, bayes EM weighting
+                                      // 12 = affine, each pixel until it converges
     vw::Vector2i subpixel_kernel;     // Subpixel correlation kernel
     bool disable_h_subpixel, disable_v_subpixel;
     vw::uint16 subpixel_max_levels;   // Max pyramid levels to process. 0 hits only once.
@@ -189,6 +201,7 @@ namespace asp {
     // Experimental Subpixel Options (mode 3 only)
     int subpixel_em_iter;
     int subpixel_affine_iter;
+    double subpixel_convergence_threshold; // Mode 12 stops refining a pixel when its update is under this
     int subpixel_pyramid_levels;
 
     // Filtering Options
@@ -234,8 +247,11 @@ namespace asp {
 
     double min_triangulation_angle;           // min angle for valid triangulation
     bool   use_least_squares;                 // Use a more rigorous triangulation
+    double ray_table_tolerance;               // Interpolate camera rays from tables to within this many pixels
+    int    ray_table_spacing;                 // Starting spacing of the ray table nodes, in pixels
     bool   save_double_precision_point_cloud; // Save final point cloud in double precision rather than bringing the points closer to origin and saving as float (marginally more precision at 2x the storage).
     double point_cloud_rounding_error;        // How much to round the output point cloud values
+    bool   save_quantized_point_cloud;        // Save the final point cloud as integer multiples of the rounding error
     bool   compute_point_cloud_center_only;   // Only compute the center of triangulated point cloud and exit.
     bool   skip_point_cloud_center_comp;
 
@@ -0,0 +1,147 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file TextureSmoothing.cc
+///
+
+#include <vw/Core/Exception.h>
+#include <asp/Core/TextureSmoothing.h>
+#include <boost/math/special_functions/fpclassify.hpp>
+#include <algorithm>
+#include <cmath>
+
+using namespace vw;
+
+namespace asp {
+
+void SummedAreaTable::build(int cols, int rows, float const* values,
+                            unsigned char const* mask, double offset, bool square) {
+  m_cols = cols;
+  m_rows = rows;
+  size_t w = size_t(cols) + 1;
+  m_table.assign(w*(size_t(rows) + 1), 0.0);
+  for (int row = 0; row < rows; row++) {
+    double row_sum = 0;
+    double       * out   = &m_table[(row + 1)*w + 1];
+    double const * above = &m_table[row*w + 1];
+    for (int col = 0; col < cols; col++) {
+      size_t k = size_t(row)*cols + col;
+      // Skipped rather than multiplied by 0, as that keeps a NaN
+      double v = 0;
+      if ((!mask || mask[k]) && boost::math::isfinite(values[k])) {
+        v = double(values[k]) - offset;
+        if (square)
+          v *= v;
+      }
+      row_sum += v;
+      out[col] = above[col] + row_sum;
+    }
+  }
+}
+
+void texture_measure(ImageView<float> const& image, int kernel_size,
+                     ImageView<float> & texture) {
+  const int cols = image.cols(), rows = image.rows();
+  texture.set_size(cols, rows);
+  if (cols == 0 || rows == 0)
+    return;
+
+  // Pixels which are not finite are left out of the windows
+  std::vector<unsigned char> finite(size_t(cols)*rows);
+  std::vector<float> ones(finite.size());
+  double mean = 0;
+  for (int row = 0; row < rows; row++) {
+    for (int col = 0; col < cols; col++) {
+      size_t k = size_t(row)*cols + col;
+      finite[k] = boost::math::isfinite(image(col, row));
+      ones  [k] = finite[k];
+      if (finite[k])
+        mean += image(col, row);
+    }
+  }
+
+  // Taking out the mean first keeps the sum of squares from swamping
+  // the variance when the pixel values are large
+  SummedAreaTable sums, squares, counts;
+  counts.build(cols, rows, &ones[0], NULL, 0, false);
+  mean /= std::max(counts.sum(0, 0, cols, rows), 1.0);
+  sums.build   (cols, rows, &image(0, 0), &finite[0], mean, false);
+  squares.build(cols, rows, &image(0, 0), &finite[0], mean, true );
+
+  const int half = std::max(kernel_size, 1)/2;
+  for (int row = 0; row < rows; row++) {
+    int row0 = std::max(row - half, 0), row1 = std::min(row + half + 1, rows);
+    for (int col = 0; col < cols; col++) {
+      int col0 = std::max(col - half, 0), col1 = std::min(col + half + 1, cols);
+      double n    = counts.sum(col0, row0, col1, row1);
+      if (n <= 0) {
+        texture(col, row) = 0;
+        continue;
+      }
+      double m    = sums.sum(col0, row0, col1, row1)/n;
+      double var  = squares.sum(col0, row0, col1, row1)/n - m*m;
+      texture(col, row) = float(std::sqrt(std::max(var, 0.0)));
+    }
+  }
+}
+
+void texture_preserving_smoothing(DisparityPlanes const& disparity,
+                                  ImageView<float> const& texture,
+                                  float texture_max, int max_kernel_size,
+                                  DisparityPlanes & smoothed) {
+  const int cols = disparity.cols, rows = disparity.rows;
+  VW_ASSERT(texture.cols() == cols && texture.rows() == rows,
+            ArgumentErr() << "texture_preserving_smoothing: The texture must be "
+                          << "the size of the disparity.\n");
+  smoothed = disparity;
+  if (max_kernel_size <= 1 || texture_max <= 0 || cols == 0 || rows == 0)
+    return;
+
+  // A valid disparity which is not finite is not averaged in, nor changed
+  std::vector<unsigned char> usable(disparity.valid.size());
+  std::vector<float> ones(usable.size());
+  for (size_t k = 0; k < usable.size(); k++) {
+    usable[k] = disparity.valid[k] && boost::math::isfinite(disparity.dx[k]) &&
+      boost::math::isfinite(disparity.dy[k]);
+    ones[k] = usable[k];
+  }
+  SummedAreaTable dx_sums, dy_sums, counts;
+  dx_sums.build(cols, rows, &disparity.dx[0], &usable[0], 0, false);
+  dy_sums.build(cols, rows, &disparity.dy[0], &usable[0], 0, false);
+  counts.build (cols, rows, &ones[0],         NULL,       0, false);
+
+  for (int row = 0; row < rows; row++) {
+    for (int col = 0; col < cols; col++) {
+      size_t k = disparity.index(col, row);
+      float  t = texture(col, row);
+      if (!usable[k] || !(t < texture_max))
+        continue;
+      int half = int((1 - t/texture_max)*max_kernel_size)/2;
+      if (half <= 0)
+        continue;
+
+      int row0 = std::max(row - half, 0), row1 = std::min(row + half + 1, rows);
+      int col0 = std::max(col - half, 0), col1 = std::min(col + half + 1, cols);
+      double n = counts.sum(col0, row0, col1, row1); // At least the pixel itself
+      smoothed.dx[k] = float(dx_sums.sum(col0, row0, col1, row1)/n);
+      smoothed.dy[k] = float(dy_sums.sum(col0, row0, col1, row1)/n);
+    }
+  }
+}
+
+} // namespace asp
@@ -0,0 +1,77 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file TextureSmoothing.h
+///
+/// Texture-aware smoothing of a disparity. Both the texture measure and
+/// the masked box mean of the disparity are read from summed-area
+/// tables, so the cost per pixel does not depend on the kernel sizes.
+/// Windows are clipped to the image.
+
+#ifndef __ASP_CORE_TEXTURE_SMOOTHING_H__
+#define __ASP_CORE_TEXTURE_SMOOTHING_H__
+
+#include <asp/Core/DisparityPlanes.h>
+#include <vw/Image/ImageView.h>
+#include <vector>
+
+namespace asp {
+
+  /// Sums over any box of a plane in constant time. The table has one
+  /// more row and column than the plane, and entry (col, row) is the
+  /// sum of the values above and to the left of that pixel.
+  class SummedAreaTable {
+  public:
+    SummedAreaTable(): m_cols(0), m_rows(0) {}
+
+    /// From a row-major plane. Each value is taken minus the offset and
+    /// squared if asked. Values which are not finite, or whose mask is
+    /// 0 if a mask is given, count as 0.
+    void build(int cols, int rows, float const* values, unsigned char const* mask,
+               double offset, bool square);
+
+    /// The sum over columns [col0, col1) and rows [row0, row1), which
+    /// must be within the plane.
+    double sum(int col0, int row0, int col1, int row1) const {
+      size_t w = size_t(m_cols) + 1;
+      return m_table[row1*w + col1] - m_table[row0*w + col1]
+           - m_table[row1*w + col0] + m_table[row0*w + col0];
+    }
+
+  private:
+    int m_cols, m_rows;
+    std::vector<double> m_table;
+  };
+
+  /// The standard deviation of the image in the kernel_size square
+  /// window around each pixel, leaving out pixels which are not finite.
+  void texture_measure(vw::ImageView<float> const& image, int kernel_size,
+                       vw::ImageView<float> & texture);
+
+  /// Replace each valid disparity whose texture is below texture_max by
+  /// the mean of the valid disparities in a window around it. The window
+  /// shrinks linearly from max_kernel_size where there is no texture to
+  /// nothing at texture_max, so textured areas keep their detail.
+  void texture_preserving_smoothing(DisparityPlanes const& disparity,
+                                    vw::ImageView<float> const& texture,
+                                    float texture_max, int max_kernel_size,
+                                    DisparityPlanes & smoothed);
+
+} // namespace asp
+
+#endif // __ASP_CORE_TEXTURE_SMOOTHING_H__
@@ -0,0 +1,232 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file TileBlockCache.h
+///
+/// A cache of rasterized blocks of an image, shared by threads that
+/// crop overlapping regions out of it. Each block is read from the
+/// source view once while it stays in the cache, no matter how many
+/// expanded tiles overlap it.
+
+#ifndef __ASP_CORE_TILE_BLOCK_CACHE_H__
+#define __ASP_CORE_TILE_BLOCK_CACHE_H__
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Thread.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewBase.h>
+#include <vw/Image/PixelAccessors.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/Algorithms.h>
+#include <vw/Math/BBox.h>
+#include <boost/shared_ptr.hpp>
+#include <boost/noncopyable.hpp>
+#include <algorithm>
+#include <list>
+#include <map>
+
+namespace asp {
+
+  /// Crops regions of an image, assembling them from blocks of a fixed
+  /// size which are kept in memory up to a given number of bytes, least
+  /// recently used first out. Blocks are reference counted, so a block
+  /// dropped from the cache while another thread is copying from it
+  /// stays valid until that thread is done. Thread safe.
+  template <class ViewT>
+  class TileBlockCache: private boost::noncopyable {
+  public:
+    typedef typename ViewT::pixel_type   pixel_type;
+    typedef vw::ImageView<pixel_type>    BlockType;
+
+    TileBlockCache(ViewT const& image, vw::Vector2i const& block_size, size_t max_bytes):
+      m_image(image), m_block_size(block_size), m_max_bytes(max_bytes),
+      m_num_bytes(0), m_hits(0), m_misses(0) {
+      VW_ASSERT(block_size[0] > 0 && block_size[1] > 0,
+                vw::ArgumentErr() << "TileBlockCache: The block size must be positive.\n");
+    }
+
+    /// Return a copy of the given region, which must be inside the image.
+    BlockType crop(vw::BBox2i const& box) {
+      VW_ASSERT(vw::bounding_box(m_image).contains(box),
+                vw::ArgumentErr() << "TileBlockCache: Region " << box
+                << " is not inside the image.\n");
+      BlockType result(box.width(), box.height());
+      if (box.empty())
+        return result;
+
+      int bx0 = box.min().x() / m_block_size[0], bx1 = (box.max().x() - 1) / m_block_size[0];
+      int by0 = box.min().y() / m_block_size[1], by1 = (box.max().y() - 1) / m_block_size[1];
+      for (int by = by0; by <= by1; by++) {
+        for (int bx = bx0; bx <= bx1; bx++) {
+          boost::shared_ptr<BlockType> block = get_block(bx, by);
+          vw::BBox2i block_box = block_bbox(bx, by);
+          vw::BBox2i overlap = block_box;
+          overlap.crop(box);
+          vw::crop(result, overlap - box.min())
+            = vw::crop(*block, overlap - block_box.min());
+        }
+      }
+      return result;
+    }
+
+    /// Number of block requests served from memory and from the source.
+    size_t hits  () const { vw::Mutex::Lock lock(m_mutex); return m_hits;   }
+    size_t misses() const { vw::Mutex::Lock lock(m_mutex); return m_misses; }
+
+    /// Number of blocks the image is divided into. Misses beyond that
+    /// are blocks read again after being dropped.
+    size_t num_blocks() const {
+      return size_t((m_image.cols() + m_block_size[0] - 1) / m_block_size[0])
+           * size_t((m_image.rows() + m_block_size[1] - 1) / m_block_size[1]);
+    }
+
+    ViewT const& image() const { return m_image; }
+
+  private:
+    typedef std::pair<int, int> Key;
+
+    // A block gets its own lock, so that reading it from the source does
+    // not hold up threads which need other blocks.
+    struct Entry {
+      vw::Mutex mutex;
+      bool      loaded;
+      boost::shared_ptr<BlockType> data;
+      std::list<Key>::iterator lru_pos;
+      Entry(): loaded(false) {}
+    };
+
+    vw::BBox2i block_bbox(int bx, int by) const {
+      vw::BBox2i box(bx*m_block_size[0], by*m_block_size[1], m_block_size[0], m_block_size[1]);
+      box.crop(vw::bounding_box(m_image));
+      return box;
+    }
+
+    boost::shared_ptr<BlockType> get_block(int bx, int by) {
+      Key key(bx, by);
+      boost::shared_ptr<Entry> entry;
+      {
+        vw::Mutex::Lock lock(m_mutex);
+        typename std::map<Key, boost::shared_ptr<Entry> >::iterator it = m_entries.find(key);
+        if (it != m_entries.end()) {
+          entry = it->second;
+          m_lru.splice(m_lru.begin(), m_lru, entry->lru_pos); // Most recently used
+          m_hits++;
+        } else {
+          entry.reset(new Entry);
+          m_lru.push_front(key);
+          entry->lru_pos = m_lru.begin();
+          m_entries[key] = entry;
+          m_num_bytes += block_bytes(bx, by);
+          m_misses++;
+          evict();
+        }
+      }
+
+      // If the entry was evicted meanwhile, our reference keeps it alive
+      vw::Mutex::Lock lock(entry->mutex);
+      if (!entry->loaded) {
+        entry->data.reset(new BlockType(vw::crop(m_image, block_bbox(bx, by))));
+        entry->loaded = true;
+      }
+      return entry->data;
+    }
+
+    size_t block_bytes(int bx, int by) const {
+      vw::BBox2i box = block_bbox(bx, by);
+      return size_t(box.width()) * box.height() * sizeof(pixel_type);
+    }
+
+    // Drop least recently used blocks until within budget, but keep at
+    // least the newest one. Must be called with m_mutex held.
+    void evict() {
+      while (m_num_bytes > m_max_bytes && m_lru.size() > 1) {
+        Key key = m_lru.back();
+        m_num_bytes -= block_bytes(key.first, key.second);
+        m_entries.erase(key);
+        m_lru.pop_back();
+      }
+    }
+
+    ViewT        m_image;
+    vw::Vector2i m_block_size;
+    size_t       m_max_bytes, m_num_bytes;
+    size_t       m_hits, m_misses;
+    std::list<Key> m_lru; // Front is the most recently used
+    std::map<Key, boost::shared_ptr<Entry> > m_entries;
+    mutable vw::Mutex m_mutex;
+  };
+
+  /// Bytes of a cache with blocks of the given size holding a band of
+  /// rows across the image, tall enough for a reader working on up to
+  /// num_threads tiles of read_tile_size at once, in row-major order,
+  /// along with a collar of one tile around them.
+  inline size_t band_cache_bytes(vw::Vector2i const& image_size, vw::Vector2i const& block_size,
+                                 vw::Vector2i const& read_tile_size, int num_threads,
+                                 size_t pixel_bytes) {
+    int tiles_per_row = std::max((image_size[0] + read_tile_size[0] - 1) / read_tile_size[0], 1);
+    int tile_rows     = (std::max(num_threads, 1) + tiles_per_row - 1) / tiles_per_row;
+    int band_rows     = (tile_rows + 2) * read_tile_size[1];
+    int block_rows    = (band_rows + block_size[1] - 1) / block_size[1] + 1;
+    int block_cols    = (image_size[0] + block_size[0] - 1) / block_size[0];
+    return size_t(block_rows) * block_cols * block_size[0] * block_size[1] * pixel_bytes;
+  }
+
+  /// A view of the image behind a TileBlockCache, for the views which
+  /// read it in overlapping windows. Regions outside the image are left
+  /// as default pixels.
+  template <class ViewT>
+  class TileBlockCacheView: public vw::ImageViewBase<TileBlockCacheView<ViewT> > {
+    boost::shared_ptr<TileBlockCache<ViewT> > m_cache;
+  public:
+    typedef typename ViewT::pixel_type pixel_type;
+    typedef pixel_type                 result_type;
+    typedef vw::ProceduralPixelAccessor<TileBlockCacheView> pixel_accessor;
+
+    TileBlockCacheView(boost::shared_ptr<TileBlockCache<ViewT> > cache): m_cache(cache) {}
+
+    inline vw::int32 cols  () const { return m_cache->image().cols(); }
+    inline vw::int32 rows  () const { return m_cache->image().rows(); }
+    inline vw::int32 planes() const { return 1; }
+
+    inline pixel_accessor origin() const { return pixel_accessor(*this, 0, 0); }
+
+    inline result_type operator()(vw::int32 i, vw::int32 j, vw::int32 /*p*/ = 0) const {
+      return m_cache->crop(vw::BBox2i(i, j, 1, 1))(0, 0);
+    }
+
+    typedef vw::CropView<vw::ImageView<pixel_type> > prerasterize_type;
+    inline prerasterize_type prerasterize(vw::BBox2i const& bbox) const {
+      vw::ImageView<pixel_type> tile(bbox.width(), bbox.height());
+      vw::BBox2i inside = bbox;
+      inside.crop(vw::bounding_box(*this));
+      if (inside != bbox) // A new image is not initialized
+        vw::fill(tile, pixel_type());
+      if (!inside.empty())
+        vw::crop(tile, inside - bbox.min()) = m_cache->crop(inside);
+      return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(), cols(), rows());
+    }
+
+    template <class DestT>
+    inline void rasterize(DestT const& dest, vw::BBox2i const& bbox) const {
+      vw::rasterize(prerasterize(bbox), dest, bbox);
+    }
+  };
+
+} // namespace asp
+
+#endif // __ASP_CORE_TILE_BLOCK_CACHE_H__
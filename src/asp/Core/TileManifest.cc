@@ -0,0 +1,170 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file TileManifest.cc
+///
+
+#include <vw/Core/Exception.h>
+#include <asp/Core/TileManifest.h>
+#include <boost/filesystem.hpp>
+#include <gdal_priv.h>
+#include <algorithm>
+#include <fstream>
+#include <limits>
+
+using namespace vw;
+
+namespace asp {
+
+  bool TileBoxLess::operator()(BBox2i const& a, BBox2i const& b) const {
+    if (a.min().y() != b.min().y()) return a.min().y() < b.min().y();
+    if (a.min().x() != b.min().x()) return a.min().x() < b.min().x();
+    if (a.max().y() != b.max().y()) return a.max().y() < b.max().y();
+    return a.max().x() < b.max().x();
+  }
+
+  void TileManifest::add(std::vector<TileRecord> const& records) {
+    for (size_t i = 0; i < records.size(); i++)
+      add(records[i]);
+  }
+
+  TileRecord const* TileManifest::find(BBox2i const& bbox) const {
+    RecordMap::const_iterator it = tiles.find(bbox);
+    if (it == tiles.end())
+      return NULL;
+    return &it->second;
+  }
+
+  std::string tile_manifest_file(std::string const& image_file) {
+    boost::filesystem::path path(image_file);
+    return (path.parent_path() / (path.stem().string() + "-manifest.txt")).string();
+  }
+
+  bool read_tile_manifest(std::string const& file, TileManifest & manifest) {
+
+    std::ifstream fh(file.c_str());
+    if (!fh.good())
+      return false;
+
+    TileManifest m;
+    size_t num_tiles = 0;
+    if ( !(fh >> m.settings_key >> m.image_size[0] >> m.image_size[1]
+              >> m.corr_timeout >> m.seconds_per_op >> num_tiles) )
+      return false;
+
+    for (size_t i = 0; i < num_tiles; i++) {
+      TileRecord t;
+      int x, y, w, h;
+      if ( !(fh >> x >> y >> w >> h >> t.input_key >> t.seconds >> t.valid_fraction) )
+        return false;
+      t.bbox = BBox2i(x, y, w, h);
+      m.add(t);
+    }
+
+    manifest = m;
+    return true;
+  }
+
+  void write_tile_manifest(std::string const& file, TileManifest const& manifest) {
+
+    std::string tmp_file = file + ".tmp";
+    std::ofstream fh(tmp_file.c_str());
+    if (!fh.good())
+      vw_throw( IOErr() << "write_tile_manifest: Cannot write: " << tmp_file << ".\n" );
+
+    fh.precision(17);
+    fh << manifest.settings_key << " " << manifest.image_size[0] << " "
+       << manifest.image_size[1] << std::endl;
+    fh << manifest.corr_timeout << " " << manifest.seconds_per_op << std::endl;
+    fh << manifest.tiles.size() << std::endl;
+    for (TileManifest::RecordMap::const_iterator it = manifest.tiles.begin();
+         it != manifest.tiles.end(); it++) {
+      TileRecord const& t = it->second;
+      fh << t.bbox.min().x() << " " << t.bbox.min().y() << " "
+         << t.bbox.width()   << " " << t.bbox.height() << " "
+         << t.input_key << " " << t.seconds << " " << t.valid_fraction << std::endl;
+    }
+    fh.close();
+    if (!fh)
+      vw_throw( IOErr() << "write_tile_manifest: Failed writing: " << tmp_file << ".\n" );
+
+    boost::filesystem::rename(tmp_file, file);
+  }
+
+  bool tile_is_stale(TileManifest const& old_manifest, TileRecord const& current,
+                     int corr_timeout, double seconds_per_op) {
+
+    TileRecord const* old = old_manifest.find(current.bbox);
+    if (old == NULL || old->input_key != current.input_key)
+      return true;
+
+    if (old_manifest.corr_timeout == corr_timeout &&
+        old_manifest.seconds_per_op == seconds_per_op)
+      return false;
+
+    // A timeout of 0 means there is none. A tile may have been skipped or
+    // cut short by the old timeout, or may be by the new one, unless it
+    // finished in less than half of either.
+    double limit = std::numeric_limits<double>::max();
+    if (old_manifest.corr_timeout > 0)
+      limit = std::min(limit, double(old_manifest.corr_timeout));
+    if (corr_timeout > 0)
+      limit = std::min(limit, double(corr_timeout));
+    return (old->seconds >= 0.5*limit || old->valid_fraction == 0);
+  }
+
+  void patch_image_region(std::string const& file, std::vector<double> const& pixels,
+                          int num_channels, BBox2i const& region) {
+
+    VW_ASSERT(pixels.size() == size_t(region.width())*region.height()*num_channels,
+              ArgumentErr() << "patch_image_region: Expecting " << num_channels
+              << " channels for a region of size " << region.size() << ".\n");
+    if (pixels.empty())
+      return;
+
+    GDALAllRegister();
+    GDALDataset * dataset = (GDALDataset*) GDALOpen(file.c_str(), GA_Update);
+    if (dataset == NULL)
+      vw_throw( IOErr() << "patch_image_region: Cannot open for update: " << file << ".\n" );
+
+    if (dataset->GetRasterCount() != num_channels ||
+        region.min().x() < 0 || region.min().y() < 0 ||
+        region.max().x() > dataset->GetRasterXSize() ||
+        region.max().y() > dataset->GetRasterYSize()) {
+      GDALClose(dataset);
+      vw_throw( ArgumentErr() << "patch_image_region: Region " << region << " with "
+                << num_channels << " channels does not fit in " << file << ".\n" );
+    }
+
+    // The pixels are interleaved, so each band starts one value further
+    // along and every value of it is num_channels apart.
+    int pixel_space = num_channels*sizeof(double);
+    for (int band = 0; band < num_channels; band++) {
+      CPLErr err = dataset->GetRasterBand(band + 1)->RasterIO
+        (GF_Write, region.min().x(), region.min().y(), region.width(), region.height(),
+         (void*)(&pixels[0] + band), region.width(), region.height(), GDT_Float64,
+         pixel_space, pixel_space*region.width());
+      if (err != CE_None) {
+        GDALClose(dataset);
+        vw_throw( IOErr() << "patch_image_region: Failed writing to: " << file << ".\n" );
+      }
+    }
+    GDALClose(dataset);
+  }
+
+} // namespace asp
@@ -0,0 +1,118 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file TileManifest.h
+///
+/// Record of how each tile of an output image was produced, so that a
+/// later run can recompute only the tiles whose inputs or settings have
+/// changed and patch them into the existing file.
+
+#ifndef __ASP_CORE_TILE_MANIFEST_H__
+#define __ASP_CORE_TILE_MANIFEST_H__
+
+#include <vw/Image/ImageView.h>
+#include <vw/Image/PixelTypeInfo.h>
+#include <vw/Math/BBox.h>
+#include <boost/cstdint.hpp>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace asp {
+
+  /// How one tile was produced.
+  struct TileRecord {
+    vw::BBox2i      bbox;           ///< As passed to the producer of the image
+    boost::uint64_t input_key;      ///< Hash of the inputs the tile depends on
+    double          seconds;        ///< Time taken to compute it
+    double          valid_fraction; ///< Fraction of valid output pixels
+    TileRecord(): input_key(0), seconds(0), valid_fraction(0) {}
+  };
+
+  /// Orders tiles by row, then column, then size.
+  struct TileBoxLess {
+    bool operator()(vw::BBox2i const& a, vw::BBox2i const& b) const;
+  };
+
+  /// How an output image was produced, tile by tile.
+  struct TileManifest {
+    typedef std::map<vw::BBox2i, TileRecord, TileBoxLess> RecordMap;
+
+    boost::uint64_t settings_key;   ///< Hash of the settings affecting all tiles
+    vw::Vector2i    image_size;
+    int             corr_timeout;   ///< These only affect the slowest tiles
+    double          seconds_per_op;
+    RecordMap       tiles;          ///< Keyed by the box of the tile
+
+    TileManifest(): settings_key(0), corr_timeout(0), seconds_per_op(0) {}
+
+    /// Add a record, replacing any with the same box.
+    void add(TileRecord const& record) { tiles[record.bbox] = record; }
+    void add(std::vector<TileRecord> const& records);
+
+    /// The record of the tile with this box, or NULL if there is none.
+    TileRecord const* find(vw::BBox2i const& bbox) const;
+  };
+
+  /// The manifest file stored next to an output image.
+  std::string tile_manifest_file(std::string const& image_file);
+
+  /// Read a manifest. Returns false if the file is missing or invalid.
+  bool read_tile_manifest(std::string const& file, TileManifest & manifest);
+
+  /// Write a manifest, via a temporary file, so that an interrupted run
+  /// never leaves a partial one behind.
+  void write_tile_manifest(std::string const& file, TileManifest const& manifest);
+
+  /// Whether a tile must be recomputed, given the manifest of the
+  /// previous run, the current record of the tile (with its input key),
+  /// and the current timeout settings. A tile which finished well within
+  /// both the old and new timeouts, and had some valid output, is not
+  /// affected by changing them.
+  bool tile_is_stale(TileManifest const& old_manifest, TileRecord const& current,
+                     int corr_timeout, double seconds_per_op);
+
+  /// Overwrite a region of an existing image file in place. The pixels
+  /// are given channel-interleaved, in row-major order, and the file must
+  /// have num_channels bands. Data is converted to the file data type.
+  void patch_image_region(std::string const& file, std::vector<double> const& pixels,
+                          int num_channels, vw::BBox2i const& region);
+
+  /// Overwrite a region of an existing image file in place with the
+  /// given image, whose pixels are stored channel by channel as
+  /// block_write_gdal_image() does.
+  template <class PixelT>
+  void patch_image_region(std::string const& file, vw::ImageView<PixelT> const& image,
+                          vw::Vector2i const& offset) {
+    typedef typename vw::CompoundChannelType<PixelT>::type channel_type;
+    const int num_channels = vw::CompoundNumChannels<PixelT>::value;
+    std::vector<double> pixels(size_t(image.cols())*image.rows()*num_channels);
+    size_t k = 0;
+    for (int row = 0; row < image.rows(); row++) {
+      for (int col = 0; col < image.cols(); col++) {
+        for (int c = 0; c < num_channels; c++)
+          pixels[k++] = vw::compound_select_channel<channel_type const&>(image(col, row), c);
+      }
+    }
+    patch_image_region(file, pixels, num_channels,
+                       vw::BBox2i(offset[0], offset[1], image.cols(), image.rows()));
+  }
+
+} // namespace asp
+
+#endif // __ASP_CORE_TILE_MANIFEST_H__
@@ -0,0 +1,258 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+
+/// \file TilePlanner.cc
+///
+
+#include <vw/Core/Exception.h>
+#include <asp/Core/TilePlanner.h>
+#include <algorithm>
+
+using namespace vw;
+
+namespace asp {
+
+namespace {
+
+  bool row_major_less(BBox2i const& a, BBox2i const& b) {
+    if (a.min().y() != b.min().y())
+      return a.min().y() < b.min().y();
+    return a.min().x() < b.min().x();
+  }
+
+} // end anonymous namespace
+
+  double predicted_correlation_cost(BBox2i const& tile, BBox2i const& search_range) {
+    return double(tile.width()) * tile.height()
+         * (search_range.width() + 1.0) * (search_range.height() + 1.0);
+  }
+
+  size_t predicted_correlation_memory(BBox2i const& tile, BBox2i const& search_range,
+                                      Vector2i const& kernel_size, int max_levels,
+                                      bool use_sgm, int sgm_collar_size,
+                                      int sgm_memory_limit_mb) {
+
+    // The collar read around the tile grows with each pyramid level
+    int levels = std::max(std::min(max_levels, 8), 0);
+    double collar = (std::max(kernel_size[0], kernel_size[1]) / 2 + 1) << levels;
+    if (use_sgm)
+      collar += sgm_collar_size;
+    double left_w  = tile.width()  + 2*collar, left_h = tile.height() + 2*collar;
+    double right_w = left_w + search_range.width(), right_h = left_h + search_range.height();
+
+    // Float pixels and byte masks, with a third more for the pyramid levels
+    const double pyramid = 4.0/3.0;
+    double bytes = pyramid * (left_w*left_h + right_w*right_h) * (sizeof(float) + 1);
+    // The disparity with its mask, and a float cost per pixel
+    bytes += double(tile.width()) * tile.height() * (3*sizeof(float) + sizeof(float));
+
+    if (use_sgm) {
+      // A 16-bit accumulated cost per disparity per pixel, plus the 8-bit
+      // matching costs and the buffers of the path directions.
+      double num_disp = (search_range.width() + 1.0) * (search_range.height() + 1.0);
+      double volume   = left_w * left_h * num_disp * 3;
+      double limit    = double(sgm_memory_limit_mb) * 1024 * 1024;
+      if (sgm_memory_limit_mb > 0)
+        volume = std::min(volume, limit);
+      bytes += volume;
+    }
+    return size_t(bytes);
+  }
+
+  std::vector<BBox2i> split_tile_by_cost(BBox2i const& tile, TileCostFunc const& cost,
+                                         double max_cost, int min_size) {
+    std::vector<BBox2i> pieces;
+    int half_w = tile.width() / 2, half_h = tile.height() / 2;
+    if (half_w < min_size || half_h < min_size || cost(tile) <= max_cost) {
+      pieces.push_back(tile);
+      return pieces;
+    }
+
+    BBox2i quarters[4] = {
+      BBox2i(tile.min().x(),          tile.min().y(),          half_w,                half_h),
+      BBox2i(tile.min().x() + half_w, tile.min().y(),          tile.width() - half_w, half_h),
+      BBox2i(tile.min().x(),          tile.min().y() + half_h, half_w,                tile.height() - half_h),
+      BBox2i(tile.min().x() + half_w, tile.min().y() + half_h, tile.width() - half_w, tile.height() - half_h)
+    };
+    for (int q = 0; q < 4; q++) {
+      std::vector<BBox2i> split = split_tile_by_cost(quarters[q], cost, max_cost, min_size);
+      pieces.insert(pieces.end(), split.begin(), split.end());
+    }
+    std::sort(pieces.begin(), pieces.end(), row_major_less);
+    return pieces;
+  }
+
+  double median_cost(std::vector<double> costs) {
+    if (costs.empty())
+      return 0;
+    std::nth_element(costs.begin(), costs.begin() + costs.size()/2, costs.end());
+    return costs[costs.size()/2];
+  }
+
+  void MemoryBudget::acquire(size_t bytes) {
+    Mutex::Lock lock(m_mutex);
+    if (m_used > 0 && m_used + bytes > m_max_bytes) {
+      m_num_waits++;
+      while (m_used > 0 && m_used + bytes > m_max_bytes)
+        m_cond.wait(lock);
+    }
+    m_used += bytes;
+    m_peak  = std::max(m_peak, m_used);
+  }
+
+  void MemoryBudget::release(size_t bytes) {
+    {
+      Mutex::Lock lock(m_mutex);
+      m_used -= std::min(bytes, m_used); // Called from destructors, so do not throw
+    }
+    m_cond.notify_all();
+  }
+
+  class CooperativeTaskQueue::Helper: public Task, private boost::noncopyable {
+    CooperativeTaskQueue & m_queue;
+  public:
+    Helper(CooperativeTaskQueue & queue): m_queue(queue) {}
+    void operator()() { m_queue.help(); }
+  };
+
+  CooperativeTaskQueue::CooperativeTaskQueue(int num_threads):
+    m_num_stolen(0), m_num_threads(std::max(num_threads, 1)), m_busy(0), m_stop(false) {
+    if (m_num_threads <= 1)
+      return;
+    // One fewer than the threads, as some thread submitted the work
+    m_helpers.reset(new FifoWorkQueue(m_num_threads - 1));
+    for (int t = 0; t < m_num_threads - 1; t++)
+      m_helpers->add_task(boost::shared_ptr<Task>(new Helper(*this)));
+  }
+
+  CooperativeTaskQueue::~CooperativeTaskQueue() {
+    {
+      Mutex::Lock lock(m_mutex);
+      m_stop = true;
+    }
+    m_cond.notify_all();
+    if (m_helpers)
+      m_helpers->join_all();
+  }
+
+  CooperativeTaskQueue::Busy::Busy(boost::shared_ptr<CooperativeTaskQueue> queue):
+    m_queue(queue) {
+    if (!m_queue)
+      return;
+    Mutex::Lock lock(m_queue->m_mutex);
+    m_queue->m_busy++;
+  }
+
+  CooperativeTaskQueue::Busy::~Busy() {
+    if (!m_queue)
+      return;
+    {
+      Mutex::Lock lock(m_queue->m_mutex);
+      m_queue->m_busy--;
+    }
+    m_queue->m_cond.notify_all();
+  }
+
+  bool CooperativeTaskQueue::take(boost::shared_ptr<Batch> const& preferred, Item & item) {
+    if (m_pending.empty())
+      return false;
+    for (std::deque<Item>::iterator it = m_pending.begin(); it != m_pending.end(); it++) {
+      if (it->first == preferred) {
+        item = *it;
+        m_pending.erase(it);
+        return true;
+      }
+    }
+    item = m_pending.front();
+    m_pending.pop_front();
+    m_num_stolen++;
+    return true;
+  }
+
+  void CooperativeTaskQueue::run(std::vector<TaskFunc> const& tasks) {
+    if (tasks.empty())
+      return;
+
+    boost::shared_ptr<Batch> batch(new Batch(tasks));
+    {
+      Mutex::Lock lock(m_mutex);
+      for (size_t i = 0; i < tasks.size(); i++)
+        m_pending.push_back(Item(batch, i));
+    }
+    m_cond.notify_all();
+
+    while (true) {
+      Item item;
+      {
+        Mutex::Lock lock(m_mutex);
+        while (batch->remaining > 0 && m_pending.empty())
+          m_cond.wait(lock);
+        if (batch->remaining == 0)
+          break;
+        take(batch, item);
+        m_busy++;
+      }
+      execute(item);
+    }
+
+    // Failures on other threads could not be thrown from there
+    if (batch->error)
+      boost::rethrow_exception(batch->error);
+  }
+
+  void CooperativeTaskQueue::execute(Item const& item) {
+    boost::exception_ptr error;
+    try {
+      item.first->tasks[item.second]();
+    } catch (vw::Exception const& e) {
+      // Not thrown with boost::throw_exception(), so copy it to keep its message
+      error = boost::copy_exception(e);
+    } catch (...) {
+      error = boost::current_exception();
+    }
+
+    {
+      Mutex::Lock lock(m_mutex);
+      if (error && !item.first->error)
+        item.first->error = error;
+      item.first->remaining--;
+      m_busy--;
+    }
+    m_cond.notify_all();
+  }
+
+  void CooperativeTaskQueue::help() {
+    while (true) {
+      Item item;
+      {
+        Mutex::Lock lock(m_mutex);
+        while (!m_stop && (m_pending.empty() || m_busy >= m_num_threads))
+          m_cond.wait(lock);
+        if (m_stop)
+          return;
+        item = m_pending.front();
+        m_pending.pop_front();
+        m_num_stolen++;
+        m_busy++;
+      }
+      execute(item);
+    }
+  }
+
+} // namespace asp
@@ -0,0 +1,180 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+
+/// \file TilePlanner.h
+///
+/// Splitting of correlation tiles whose predicted cost is well above the
+/// rest, a queue through which the threads correlating the tiles share
+/// the resulting pieces, and a memory budget limiting how many tiles are
+/// correlated at once.
+
+#ifndef __ASP_CORE_TILE_PLANNER_H__
+#define __ASP_CORE_TILE_PLANNER_H__
+
+#include <vw/Core/Thread.h>
+#include <vw/Core/ThreadPool.h>
+#include <vw/Math/BBox.h>
+#include <vw/Math/Vector.h>
+#include <boost/function.hpp>
+#include <boost/exception_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/noncopyable.hpp>
+#include <deque>
+#include <vector>
+
+namespace asp {
+
+  /// The predicted cost of correlating a tile with a given search range,
+  /// proportional to the number of pixels times the number of disparities.
+  double predicted_correlation_cost(vw::BBox2i const& tile, vw::BBox2i const& search_range);
+
+  /// The predicted memory, in bytes, needed to correlate a tile with a
+  /// given search range. It counts the image pyramids of the left tile
+  /// and of the right region it is searched over, with their collars and
+  /// masks, and the output. SGM also keeps a cost for every disparity of
+  /// every pixel, up to sgm_memory_limit_mb.
+  size_t predicted_correlation_memory(vw::BBox2i const& tile, vw::BBox2i const& search_range,
+                                      vw::Vector2i const& kernel_size, int max_levels,
+                                      bool use_sgm, int sgm_collar_size,
+                                      int sgm_memory_limit_mb);
+
+  typedef boost::function<double(vw::BBox2i const&)> TileCostFunc;
+
+  /// Split a tile in quarters, and those in turn, until each piece is
+  /// predicted to cost no more than max_cost or would get smaller than
+  /// min_size on a side. Returns the pieces in row-major order, or just
+  /// the tile if it is cheap enough.
+  std::vector<vw::BBox2i> split_tile_by_cost(vw::BBox2i const& tile, TileCostFunc const& cost,
+                                             double max_cost, int min_size);
+
+  /// The median of some costs, or 0 if there are none.
+  double median_cost(std::vector<double> costs);
+
+  /// Runs batches of tasks, each submitted by a thread which then waits
+  /// for its batch to finish. While waiting, a thread runs the pending
+  /// tasks of its own batch first and then those of other batches. The
+  /// queue also has helper threads, which run pending tasks whenever
+  /// fewer than num_threads threads are busy, so an expensive batch is
+  /// spread over all cores even once the other threads have run out of
+  /// work of their own.
+  class CooperativeTaskQueue: private boost::noncopyable {
+  public:
+    typedef boost::function<void()> TaskFunc;
+
+    /// At most num_threads threads, counting those which are Busy, run
+    /// tasks at once, unless more threads submit batches than that.
+    CooperativeTaskQueue(int num_threads = 1);
+    ~CooperativeTaskQueue();
+
+    /// Run the tasks and return when they are all done. Each task is run
+    /// once. If any threw, the first exception is thrown from here.
+    void run(std::vector<TaskFunc> const& tasks);
+
+    /// Number of tasks run by a thread other than the one which submitted them.
+    size_t num_stolen() const { vw::Mutex::Lock lock(m_mutex); return m_num_stolen; }
+
+    /// Counts the calling thread as busy, doing work which does not go
+    /// through the queue, for as long as it exists, so that the helpers
+    /// do not take its core. Does nothing if there is no queue.
+    class Busy: private boost::noncopyable {
+    public:
+      Busy(boost::shared_ptr<CooperativeTaskQueue> queue);
+      ~Busy();
+    private:
+      boost::shared_ptr<CooperativeTaskQueue> m_queue;
+    };
+
+  private:
+    struct Batch {
+      std::vector<TaskFunc> tasks;
+      boost::exception_ptr  error;     // The first one a task threw
+      size_t                remaining; // Not yet finished
+      Batch(std::vector<TaskFunc> const& t): tasks(t), remaining(t.size()) {}
+    };
+    typedef std::pair<boost::shared_ptr<Batch>, size_t> Item;
+
+    class Helper;
+
+    // Take a pending task, preferably of the given batch. Must be called
+    // with m_mutex held. Returns false if there are none.
+    bool take(boost::shared_ptr<Batch> const& preferred, Item & item);
+
+    // Run a task taken from the queue, and mark it done
+    void execute(Item const& item);
+
+    // What the helper threads do until the queue is destroyed
+    void help();
+
+    std::deque<Item>  m_pending;
+    size_t            m_num_stolen;
+    int               m_num_threads;
+    int               m_busy;      // Threads running tasks, or Busy
+    bool              m_stop;
+    mutable vw::Mutex m_mutex;
+    vw::Condition     m_cond;
+    boost::scoped_ptr<vw::FifoWorkQueue> m_helpers;
+  };
+
+  /// Limits the total predicted memory of the tiles being worked on at
+  /// once. A thread reserves the memory of its tile before starting on it
+  /// and waits while that would go over the budget. A tile is always let
+  /// through when nothing else is reserved, even if it is over the budget
+  /// by itself, as waiting would not help.
+  class MemoryBudget: private boost::noncopyable {
+  public:
+    MemoryBudget(size_t max_bytes): m_max_bytes(max_bytes), m_used(0), m_peak(0),
+                                    m_num_waits(0) {}
+
+    void acquire(size_t bytes);
+    void release(size_t bytes);
+
+    size_t max_bytes () const { return m_max_bytes; }
+    /// The most memory reserved at any one time
+    size_t peak_bytes() const { vw::Mutex::Lock lock(m_mutex); return m_peak; }
+    /// Number of times a tile had to wait for memory
+    size_t num_waits () const { vw::Mutex::Lock lock(m_mutex); return m_num_waits; }
+
+    /// Holds a reservation for as long as it exists. Does nothing if
+    /// there is no budget.
+    class Reservation: private boost::noncopyable {
+    public:
+      Reservation(boost::shared_ptr<MemoryBudget> budget, size_t bytes):
+        m_budget(budget), m_bytes(bytes) {
+        if (m_budget)
+          m_budget->acquire(m_bytes);
+      }
+      ~Reservation() {
+        if (m_budget)
+          m_budget->release(m_bytes);
+      }
+    private:
+      boost::shared_ptr<MemoryBudget> m_budget;
+      size_t m_bytes;
+    };
+
+  private:
+    size_t m_max_bytes, m_used, m_peak, m_num_waits;
+    mutable vw::Mutex m_mutex;
+    vw::Condition     m_cond;
+  };
+
+} // namespace asp
+
+#endif // __ASP_CORE_TILE_PLANNER_H__
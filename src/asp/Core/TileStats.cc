@@ -0,0 +1,122 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+
+/// \file TileStats.cc
+///
+
+#include <vw/Core/Exception.h>
+#include <asp/Core/TileStats.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <fstream>
+
+using namespace vw;
+
+namespace asp {
+
+  std::string tile_fit_status_name(int status) {
+    switch (status) {
+      case TILE_FIT_CACHED:   return "cached";
+      case TILE_FIT_NO_MATCH: return "no_match";
+      case TILE_FIT_FAILED:   return "failed";
+      case TILE_FIT_REJECTED: return "rejected";
+      case TILE_FIT_ACCEPTED: return "accepted";
+      default:                return "none";
+    }
+  }
+
+  double max_resident_memory_mb() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+      return 0;
+#ifdef __APPLE__
+    return usage.ru_maxrss / (1024.0 * 1024.0); // In bytes
+#else
+    return usage.ru_maxrss / 1024.0;            // In kilobytes
+#endif
+  }
+
+  void write_tile_stats(std::string const& file, std::string const& format,
+                        std::vector<TileStats> const& stats) {
+
+    VW_ASSERT(format == "csv" || format == "json",
+              ArgumentErr() << "write_tile_stats: Unknown format: " << format << ".\n");
+    std::ofstream fh(file.c_str());
+    if (!fh.good())
+      vw_throw( IOErr() << "write_tile_stats: Cannot write: " << file << ".\n" );
+
+    if (format == "csv")
+      fh << "# x, y, width, height, ip_seconds, num_matches, fit_status, "
+         << "search_area, corr_seconds, max_rss_mb, valid_fraction\n";
+    else
+      fh << "[\n";
+
+    for (size_t i = 0; i < stats.size(); i++) {
+      TileStats const& s = stats[i];
+      std::string status = tile_fit_status_name(s.fit_status);
+      if (format == "csv") {
+        fh << s.bbox.min().x() << ", " << s.bbox.min().y() << ", "
+           << s.bbox.width()   << ", " << s.bbox.height()  << ", "
+           << s.ip_seconds     << ", " << s.num_matches    << ", " << status << ", "
+           << s.search_area    << ", " << s.corr_seconds   << ", "
+           << s.max_rss_mb     << ", " << s.valid_fraction << "\n";
+      } else {
+        fh << "  {\"x\": " << s.bbox.min().x() << ", \"y\": " << s.bbox.min().y()
+           << ", \"width\": " << s.bbox.width() << ", \"height\": " << s.bbox.height()
+           << ", \"ip_seconds\": "   << s.ip_seconds
+           << ", \"num_matches\": "  << s.num_matches
+           << ", \"fit_status\": \"" << status << "\""
+           << ", \"search_area\": "  << s.search_area
+           << ", \"corr_seconds\": " << s.corr_seconds
+           << ", \"max_rss_mb\": "   << s.max_rss_mb
+           << ", \"valid_fraction\": " << s.valid_fraction << "}"
+           << (i + 1 < stats.size() ? "," : "") << "\n";
+      }
+    }
+    if (format == "json")
+      fh << "]\n";
+
+    fh.close();
+    if (!fh)
+      vw_throw( IOErr() << "write_tile_stats: Failed writing: " << file << ".\n" );
+  }
+
+  ImageView<float> tile_stats_heatmap(std::vector<TileStats> const& stats,
+                                      BBox2i const& region, Vector2i const& tile_size,
+                                      float nodata) {
+    VW_ASSERT(tile_size[0] > 0 && tile_size[1] > 0,
+              ArgumentErr() << "tile_stats_heatmap: The tile size must be positive.\n");
+    int cols = (region.width()  + tile_size[0] - 1) / tile_size[0];
+    int rows = (region.height() + tile_size[1] - 1) / tile_size[1];
+    ImageView<float> heatmap(std::max(cols, 0), std::max(rows, 0));
+    for (int row = 0; row < heatmap.rows(); row++)
+      for (int col = 0; col < heatmap.cols(); col++)
+        heatmap(col, row) = nodata;
+
+    for (size_t i = 0; i < stats.size(); i++) {
+      Vector2i pos = stats[i].bbox.min() - region.min();
+      int col = pos[0] / tile_size[0], row = pos[1] / tile_size[1];
+      if (pos[0] < 0 || pos[1] < 0 || col >= heatmap.cols() || row >= heatmap.rows())
+        continue;
+      heatmap(col, row) = stats[i].ip_seconds + stats[i].corr_seconds;
+    }
+    return heatmap;
+  }
+
+} // namespace asp
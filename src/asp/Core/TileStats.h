@@ -0,0 +1,77 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+
+/// \file TileStats.h
+///
+/// Where the time and memory go when correlating an image tile by tile,
+/// so that expensive terrain can be found and the tile size tuned.
+
+#ifndef __ASP_CORE_TILE_STATS_H__
+#define __ASP_CORE_TILE_STATS_H__
+
+#include <vw/Image/ImageView.h>
+#include <vw/Math/BBox.h>
+#include <string>
+#include <vector>
+
+namespace asp {
+
+  /// The outcome of the piecewise alignment of a tile.
+  enum TileFitStatus { TILE_FIT_NONE     = 0, ///< No alignment was attempted
+                       TILE_FIT_CACHED   = 1, ///< From a cache file which does not say
+                       TILE_FIT_NO_MATCH = 2, ///< Too few matches to fit
+                       TILE_FIT_FAILED   = 3, ///< The fit itself failed
+                       TILE_FIT_REJECTED = 4, ///< check_homography_matrix() rejected it
+                       TILE_FIT_ACCEPTED = 5 };
+
+  std::string tile_fit_status_name(int status);
+
+  /// Measurements of the correlation of one tile.
+  struct TileStats {
+    vw::BBox2i bbox;
+    double ip_seconds;     ///< Interest point detection and matching
+    int    num_matches;    ///< Matches the alignment was fit to
+    int    fit_status;     ///< A TileFitStatus
+    double search_area;    ///< Width times height of the search range
+    double corr_seconds;   ///< Correlation proper
+    double max_rss_mb;     ///< Memory high-water mark of the process so far
+    double valid_fraction; ///< Fraction of valid output pixels
+    TileStats(): ip_seconds(0), num_matches(0), fit_status(TILE_FIT_NONE),
+                 search_area(0), corr_seconds(0), max_rss_mb(0), valid_fraction(0) {}
+  };
+
+  /// The memory high-water mark of this process, in MB, or 0 if not
+  /// known. It is shared by all threads, so for a tile it is an upper
+  /// bound on what the tile needed.
+  double max_resident_memory_mb();
+
+  /// Write the stats as CSV, one tile per line, or as a JSON array of
+  /// objects, depending on whether the format is "csv" or "json".
+  void write_tile_stats(std::string const& file, std::string const& format,
+                        std::vector<TileStats> const& stats);
+
+  /// An image with a pixel per tile of the given region, holding the
+  /// total time spent on the tile, or nodata for tiles with no stats.
+  vw::ImageView<float> tile_stats_heatmap(std::vector<TileStats> const& stats,
+                                          vw::BBox2i const& region,
+                                          vw::Vector2i const& tile_size, float nodata);
+
+} // namespace asp
+
+#endif // __ASP_CORE_TILE_STATS_H__
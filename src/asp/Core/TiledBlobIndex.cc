@@ -0,0 +1,319 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file TiledBlobIndex.cc
+///
+
+#include <vw/Core/Exception.h>
+#include <asp/Core/TiledBlobIndex.h>
+#include <algorithm>
+#include <limits>
+
+using namespace vw;
+
+namespace asp {
+
+namespace {
+
+  int32 find_root(std::vector<int32> & parent, int32 i) {
+    while (parent[i] != i) {
+      parent[i] = parent[parent[i]]; // Path halving
+      i = parent[i];
+    }
+    return i;
+  }
+
+  // The smaller id becomes the root, so the result does not depend on
+  // the order of the unions
+  void unite(std::vector<int32> & parent, int32 a, int32 b) {
+    if (a < 0 || b < 0)
+      return;
+    a = find_root(parent, a);
+    b = find_root(parent, b);
+    if (a < b)
+      parent[b] = a;
+    else if (b < a)
+      parent[a] = b;
+  }
+
+  BBox2i bbox_union(BBox2i a, BBox2i const& b) {
+    if (a.empty())
+      return b;
+    a.grow(b);
+    return a;
+  }
+
+} // end anonymous namespace
+
+int label_components(ImageView<uint8> const& mask, bool eight_connected,
+                     ImageView<int32> & labels) {
+  int cols = mask.cols(), rows = mask.rows();
+  labels.set_size(cols, rows);
+
+  // Provisional labels, joined as the rows are scanned. Each pixel looks
+  // back at the neighbors already labeled.
+  std::vector<int32> parent;
+  for (int row = 0; row < rows; row++) {
+    for (int col = 0; col < cols; col++) {
+      if (!mask(col, row)) {
+        labels(col, row) = -1;
+        continue;
+      }
+      int32 left = (col > 0) ? labels(col - 1, row) : -1;
+      int32 up   = (row > 0) ? labels(col, row - 1) : -1;
+      int32 up_left = -1, up_right = -1;
+      if (eight_connected && row > 0) {
+        if (col > 0)        up_left  = labels(col - 1, row - 1);
+        if (col < cols - 1) up_right = labels(col + 1, row - 1);
+      }
+      int32 label = std::max(std::max(left, up), std::max(up_left, up_right));
+      if (label < 0) {
+        label = int32(parent.size());
+        parent.push_back(label);
+      }
+      unite(parent, label, left);
+      unite(parent, label, up);
+      unite(parent, label, up_left);
+      unite(parent, label, up_right);
+      labels(col, row) = label;
+    }
+  }
+
+  // The root of a component is the label of its first pixel, so
+  // numbering the roots as they are met keeps the row-major order.
+  std::vector<int32> final_label(parent.size(), -1);
+  int num_components = 0;
+  for (int row = 0; row < rows; row++) {
+    for (int col = 0; col < cols; col++) {
+      int32 & label = labels(col, row);
+      if (label < 0)
+        continue;
+      int32 root = find_root(parent, label);
+      if (final_label[root] < 0)
+        final_label[root] = num_components++;
+      label = final_label[root];
+    }
+  }
+  return num_components;
+}
+
+TiledBlobIndex::TiledBlobIndex(Vector2i const& image_size, int tile_size, bool eight_connected):
+  m_image_size(image_size), m_tile_size(tile_size), m_tiles_per_row(0),
+  m_eight_connected(eight_connected), m_merged(false) {
+
+  VW_ASSERT(tile_size > 0 && image_size.x() >= 0 && image_size.y() >= 0,
+            ArgumentErr() << "TiledBlobIndex: Invalid image size " << image_size
+            << " or tile size " << tile_size << ".\n");
+
+  m_tiles_per_row = (image_size.x() + tile_size - 1) / tile_size;
+  for (int row = 0; row < image_size.y(); row += tile_size) {
+    for (int col = 0; col < image_size.x(); col += tile_size) {
+      m_tiles.push_back(BBox2i(col, row,
+                               std::min(tile_size, image_size.x() - col),
+                               std::min(tile_size, image_size.y() - row)));
+    }
+  }
+  m_labels.resize(m_tiles.size());
+}
+
+size_t TiledBlobIndex::tile_index(int col, int row) const {
+  VW_ASSERT(col >= 0 && row >= 0 && col < m_image_size.x() && row < m_image_size.y(),
+            ArgumentErr() << "TiledBlobIndex: Pixel (" << col << ", " << row
+            << ") is outside the image.\n");
+  return size_t(row / m_tile_size) * m_tiles_per_row + col / m_tile_size;
+}
+
+void TiledBlobIndex::add_tile(size_t tile, ImageView<uint8> const& mask) {
+  VW_ASSERT(tile < m_tiles.size() && mask.cols() == m_tiles[tile].width() &&
+            mask.rows() == m_tiles[tile].height(),
+            ArgumentErr() << "TiledBlobIndex: The mask does not match tile " << tile << ".\n");
+
+  ImageView<int32> labels;
+  TileLabels & tl = m_labels[tile];
+  tl.num_components = label_components(mask, m_eight_connected, labels);
+
+  int cols = mask.cols(), rows = mask.rows();
+  Vector2i origin = m_tiles[tile].min();
+  tl.sizes.assign(tl.num_components, 0);
+  tl.bboxes.assign(tl.num_components, BBox2i());
+  for (int row = 0; row < rows; row++) {
+    for (int col = 0; col < cols; col++) {
+      int32 label = labels(col, row);
+      if (label < 0)
+        continue;
+      tl.sizes[label]++;
+      tl.bboxes[label] = bbox_union(tl.bboxes[label],
+                                    BBox2i(origin.x() + col, origin.y() + row, 1, 1));
+    }
+  }
+
+  tl.top.resize(cols);
+  tl.bottom.resize(cols);
+  for (int col = 0; col < cols; col++) {
+    tl.top   [col] = labels(col, 0);
+    tl.bottom[col] = labels(col, rows - 1);
+  }
+  tl.left.resize(rows);
+  tl.right.resize(rows);
+  for (int row = 0; row < rows; row++) {
+    tl.left [row] = labels(0, row);
+    tl.right[row] = labels(cols - 1, row);
+  }
+}
+
+int32 TiledBlobIndex::global_id(TileLabels const& tl, int32 label) {
+  return (label < 0) ? -1 : int32(tl.offset + label);
+}
+
+void TiledBlobIndex::merge() {
+  VW_ASSERT(!m_merged, ArgumentErr() << "TiledBlobIndex: Already merged.\n");
+
+  size_t total = 0;
+  for (size_t t = 0; t < m_labels.size(); t++) {
+    VW_ASSERT(m_labels[t].num_components >= 0,
+              ArgumentErr() << "TiledBlobIndex: Tile " << m_tiles[t] << " was not added.\n");
+    m_labels[t].offset = total;
+    total += m_labels[t].num_components;
+  }
+  VW_ASSERT(total < size_t(std::numeric_limits<int32>::max()),
+            ArgumentErr() << "TiledBlobIndex: Too many components.\n");
+
+  std::vector<int32> parent(total);
+  for (size_t i = 0; i < total; i++)
+    parent[i] = int32(i);
+
+  int num_tile_rows = m_tiles.empty() ? 0 : int(m_tiles.size() / m_tiles_per_row);
+  for (int tj = 0; tj < num_tile_rows; tj++) {
+    for (int ti = 0; ti < m_tiles_per_row; ti++) {
+      TileLabels const& a = m_labels[tj*m_tiles_per_row + ti];
+
+      // The tile to the right shares the rows
+      if (ti + 1 < m_tiles_per_row) {
+        TileLabels const& b = m_labels[tj*m_tiles_per_row + ti + 1];
+        int n = int(a.right.size());
+        for (int r = 0; r < n; r++) {
+          int32 ga = global_id(a, a.right[r]);
+          if (ga < 0)
+            continue;
+          unite(parent, ga, global_id(b, b.left[r]));
+          if (m_eight_connected) {
+            if (r > 0)     unite(parent, ga, global_id(b, b.left[r - 1]));
+            if (r < n - 1) unite(parent, ga, global_id(b, b.left[r + 1]));
+          }
+        }
+      }
+
+      if (tj + 1 >= num_tile_rows)
+        continue;
+
+      // The tile below shares the columns
+      TileLabels const& b = m_labels[(tj + 1)*m_tiles_per_row + ti];
+      int n = int(a.bottom.size());
+      for (int c = 0; c < n; c++) {
+        int32 ga = global_id(a, a.bottom[c]);
+        if (ga < 0)
+          continue;
+        unite(parent, ga, global_id(b, b.top[c]));
+        if (m_eight_connected) {
+          if (c > 0)     unite(parent, ga, global_id(b, b.top[c - 1]));
+          if (c < n - 1) unite(parent, ga, global_id(b, b.top[c + 1]));
+        }
+      }
+
+      // Only corners touch diagonally
+      if (m_eight_connected) {
+        if (ti + 1 < m_tiles_per_row) {
+          TileLabels const& d = m_labels[(tj + 1)*m_tiles_per_row + ti + 1];
+          unite(parent, global_id(a, a.bottom.back()), global_id(d, d.top.front()));
+        }
+        if (ti > 0) {
+          TileLabels const& d = m_labels[(tj + 1)*m_tiles_per_row + ti - 1];
+          unite(parent, global_id(a, a.bottom.front()), global_id(d, d.top.back()));
+        }
+      }
+    }
+  }
+
+  // Number the blobs by their first component, and sum them up
+  m_component_blobs.assign(total, -1);
+  for (size_t t = 0; t < m_labels.size(); t++) {
+    TileLabels const& tl = m_labels[t];
+    for (int c = 0; c < tl.num_components; c++) {
+      int32 root = find_root(parent, int32(tl.offset + c));
+      int32 & blob = m_component_blobs[root];
+      if (blob < 0) {
+        blob = int32(m_blob_sizes.size());
+        m_blob_sizes.push_back(0);
+        m_blob_bboxes.push_back(BBox2i());
+      }
+      m_component_blobs[tl.offset + c] = blob;
+      m_blob_sizes [blob] += tl.sizes[c];
+      m_blob_bboxes[blob] = bbox_union(m_blob_bboxes[blob], tl.bboxes[c]);
+    }
+  }
+
+  // Only the ids and the sizes are needed past this point
+  for (size_t t = 0; t < m_labels.size(); t++) {
+    TileLabels & tl = m_labels[t];
+    std::vector<int32>().swap(tl.top);
+    std::vector<int32>().swap(tl.bottom);
+    std::vector<int32>().swap(tl.left);
+    std::vector<int32>().swap(tl.right);
+    std::vector<BBox2i>().swap(tl.bboxes);
+  }
+  m_merged = true;
+}
+
+bool TiledBlobIndex::tile_blobs(size_t tile, ImageView<uint8> const& mask,
+                                ImageView<int32> & blobs) const {
+  VW_ASSERT(m_merged, ArgumentErr() << "TiledBlobIndex: The tiles were not merged.\n");
+  VW_ASSERT(tile < m_tiles.size(),
+            ArgumentErr() << "TiledBlobIndex: No tile " << tile << ".\n");
+
+  TileLabels const& tl = m_labels[tile];
+  int num_components = label_components(mask, m_eight_connected, blobs);
+
+  // The components are numbered in the order they are met, so the same
+  // mask gives the same sizes
+  bool same = (num_components == tl.num_components);
+  if (same) {
+    std::vector<size_t> sizes(num_components, 0);
+    for (int row = 0; row < blobs.rows(); row++)
+      for (int col = 0; col < blobs.cols(); col++)
+        if (blobs(col, row) >= 0)
+          sizes[blobs(col, row)]++;
+    same = (sizes == tl.sizes);
+  }
+  if (!same) {
+    for (int row = 0; row < blobs.rows(); row++)
+      for (int col = 0; col < blobs.cols(); col++)
+        blobs(col, row) = -1;
+    return false;
+  }
+
+  for (int row = 0; row < blobs.rows(); row++) {
+    for (int col = 0; col < blobs.cols(); col++) {
+      int32 & label = blobs(col, row);
+      if (label >= 0)
+        label = m_component_blobs[tl.offset + label];
+    }
+  }
+  return true;
+}
+
+} // namespace asp
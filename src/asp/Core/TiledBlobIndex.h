@@ -0,0 +1,102 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file TiledBlobIndex.h
+///
+/// Connected components of an image too large to label at once. Each
+/// tile is labeled on its own, which can be done in parallel, keeping
+/// only the component sizes and the labels along the tile edges. The
+/// components which touch across the seams are then joined with
+/// union-find, so a blob has the same size and id whichever tile it is
+/// seen from. A tile is labeled again, from the same mask, to find the
+/// blob of each of its pixels.
+
+#ifndef __ASP_CORE_TILED_BLOB_INDEX_H__
+#define __ASP_CORE_TILED_BLOB_INDEX_H__
+
+#include <vw/Core/FundamentalTypes.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Math/BBox.h>
+#include <vw/Math/Vector.h>
+#include <vector>
+
+namespace asp {
+
+  /// Label the connected components of the nonzero pixels of a mask.
+  /// They are numbered from 0 in the order their first pixel is met
+  /// going along the rows, and the other pixels are set to -1. Returns
+  /// the number of components.
+  int label_components(vw::ImageView<vw::uint8> const& mask, bool eight_connected,
+                       vw::ImageView<vw::int32> & labels);
+
+  class TiledBlobIndex {
+  public:
+    /// Tiles are tile_size square, from the origin, and clipped to the image.
+    TiledBlobIndex(vw::Vector2i const& image_size, int tile_size, bool eight_connected);
+
+    std::vector<vw::BBox2i> const& tiles() const { return m_tiles; }
+    int tile_size() const { return m_tile_size; }
+
+    /// The tile a pixel is in.
+    size_t tile_index(int col, int row) const;
+
+    /// Label the mask of a tile. Different tiles may be added from
+    /// different threads at the same time.
+    void add_tile(size_t tile, vw::ImageView<vw::uint8> const& mask);
+
+    /// Join the components touching across tile seams. Call it once,
+    /// after all the tiles have been added.
+    void merge();
+
+    size_t     num_blobs() const { return m_blob_sizes.size(); }
+    size_t     blob_size(vw::int32 blob) const { return m_blob_sizes [blob]; }
+    vw::BBox2i blob_bbox(vw::int32 blob) const { return m_blob_bboxes[blob]; }
+
+    /// The blob of each pixel of a tile, or -1, given the mask the tile
+    /// was added with. If the components of the mask are not those of
+    /// the tile, as when the image it comes from is not computed the
+    /// same way twice, all the pixels are set to -1 and false is returned.
+    bool tile_blobs(size_t tile, vw::ImageView<vw::uint8> const& mask,
+                    vw::ImageView<vw::int32> & blobs) const;
+
+  private:
+    struct TileLabels {
+      int                      num_components;
+      size_t                   offset; // Of its components among all of them
+      std::vector<vw::int32>   top, bottom, left, right; // Labels along the edges
+      std::vector<size_t>      sizes;  // Kept to check the tile when labeled again
+      std::vector<vw::BBox2i>  bboxes; // In image pixels
+      TileLabels(): num_components(-1), offset(0) {}
+    };
+
+    /// The id among the components of all tiles of a label at a tile edge
+    static vw::int32 global_id(TileLabels const& tl, vw::int32 label);
+
+    vw::Vector2i            m_image_size;
+    int                     m_tile_size, m_tiles_per_row;
+    bool                    m_eight_connected, m_merged;
+    std::vector<vw::BBox2i> m_tiles;
+    std::vector<TileLabels> m_labels;
+    std::vector<vw::int32>  m_component_blobs; // For each component of each tile
+    std::vector<size_t>     m_blob_sizes;
+    std::vector<vw::BBox2i> m_blob_bboxes;
+  };
+
+} // namespace asp
+
+#endif // __ASP_CORE_TILED_BLOB_INDEX_H__
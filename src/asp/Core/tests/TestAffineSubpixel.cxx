@@ -0,0 +1,278 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Image/PixelTypes.h>
+#include <vw/Stereo/PreFilter.h>
+#include <vw/Stereo/SubpixelView.h>
+#include <asp/Core/AffineSubpixel.h>
+
+#include <cmath>
+#include <fstream>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+
+  // A smooth texture. Bilinear sampling of it is off by a few hundredths
+  // of a pixel, which bounds how closely a shift can be recovered.
+  float texture(double x, double y) {
+    return float(std::sin(0.31*x) + std::cos(0.23*y) + 0.5*std::sin(0.17*(x + y)));
+  }
+
+  // The right image is the left one moved by (shift_x, shift_y)
+  ImageView<float> make_image(int cols, int rows, double shift_x, double shift_y) {
+    ImageView<float> image(cols, rows);
+    for (int row = 0; row < rows; row++)
+      for (int col = 0; col < cols; col++)
+        image(col, row) = texture(col - shift_x, row - shift_y);
+    return image;
+  }
+}
+
+TEST( AffineSubpixel, RecoversShift ) {
+  const double shift_x = 3.3, shift_y = -0.4;
+  ImageView<float> left  = make_image(60, 50, 0, 0);
+  ImageView<float> right = make_image(60, 50, shift_x, shift_y);
+
+  // Refine the pixels away from the edges, from the integer disparity
+  DisparityPlanes disparity(20, 15);
+  for (size_t k = 0; k < disparity.dx.size(); k++) {
+    disparity.dx[k] = 3;
+    disparity.dy[k] = 0;
+    disparity.valid[k] = 1;
+  }
+  disparity.valid[disparity.index(4, 4)] = 0;
+
+  AffineSubpixelOptions opt;
+  opt.kernel_size    = Vector2i(11, 11);
+  opt.max_iterations = 10;
+  opt.threshold      = 1e-3;
+  IterationHistogram histogram(opt.max_iterations);
+  converging_affine_subpixel(left, Vector2i(0, 0), right, Vector2i(0, 0),
+                             Vector2i(20, 18), disparity, opt, histogram);
+
+  EXPECT_EQ(disparity.valid[disparity.index(4, 4)], 0); // Left alone
+  EXPECT_EQ(histogram.num_pixels(), 20u*15u - 1);
+  EXPECT_EQ(histogram.num_failed(), 0u);
+  EXPECT_EQ(histogram.num_unconverged(), 0u);
+  // Most pixels stop well short of the limit
+  EXPECT_LT(histogram.mean_iterations(), 5.0);
+  for (size_t k = 0; k < disparity.dx.size(); k++) {
+    if (!disparity.valid[k])
+      continue;
+    EXPECT_NEAR(disparity.dx[k], shift_x, 0.1);
+    EXPECT_NEAR(disparity.dy[k], shift_y, 0.1);
+  }
+}
+
+TEST( AffineSubpixel, CropOrigins ) {
+  // The same problem as crops of the full images
+  const double shift_x = -1.6, shift_y = 0.7;
+  ImageView<float> left_full  = make_image(80, 60, 0, 0);
+  ImageView<float> right_full = make_image(80, 60, shift_x, shift_y);
+  BBox2i left_box(20, 15, 30, 25), right_box(15, 12, 35, 30);
+  ImageView<float> left(left_box.width(), left_box.height());
+  ImageView<float> right(right_box.width(), right_box.height());
+  for (int row = 0; row < left.rows(); row++)
+    for (int col = 0; col < left.cols(); col++)
+      left(col, row) = left_full(col + left_box.min().x(), row + left_box.min().y());
+  for (int row = 0; row < right.rows(); row++)
+    for (int col = 0; col < right.cols(); col++)
+      right(col, row) = right_full(col + right_box.min().x(), row + right_box.min().y());
+
+  DisparityPlanes disparity(8, 6);
+  for (size_t k = 0; k < disparity.dx.size(); k++) {
+    disparity.dx[k] = -2;
+    disparity.dy[k] = 1;
+    disparity.valid[k] = 1;
+  }
+
+  AffineSubpixelOptions opt;
+  opt.kernel_size    = Vector2i(9, 7);
+  opt.max_iterations = 10;
+  opt.threshold      = 1e-3;
+  IterationHistogram histogram(opt.max_iterations);
+  converging_affine_subpixel(left, left_box.min(), right, right_box.min(),
+                             Vector2i(30, 25), disparity, opt, histogram);
+
+  EXPECT_EQ(histogram.num_converged(), 8u*6u);
+  for (size_t k = 0; k < disparity.dx.size(); k++) {
+    EXPECT_EQ(disparity.valid[k], 1);
+    EXPECT_NEAR(disparity.dx[k], shift_x, 0.1);
+    EXPECT_NEAR(disparity.dy[k], shift_y, 0.1);
+  }
+}
+
+TEST( AffineSubpixel, MaskedPixelsLeftOut ) {
+  const double shift_x = 2.4, shift_y = 0.3;
+  ImageView<float> left  = make_image(60, 50, 0, 0);
+  ImageView<float> right = make_image(60, 50, shift_x, shift_y);
+
+  // Nodata stripes through the windows, which would throw off the fit
+  ImageView<uint8> left_mask(60, 50), right_mask(60, 50);
+  for (int row = 0; row < 50; row++) {
+    for (int col = 0; col < 60; col++) {
+      left_mask (col, row) = (col % 10 != 3);
+      right_mask(col, row) = (row % 10 != 6);
+      if (!left_mask(col, row))
+        left(col, row) = -1000;
+      if (!right_mask(col, row))
+        right(col, row) = 1000;
+    }
+  }
+
+  DisparityPlanes disparity(20, 15);
+  for (size_t k = 0; k < disparity.dx.size(); k++) {
+    disparity.dx[k] = 2;
+    disparity.dy[k] = 0;
+    disparity.valid[k] = 1;
+  }
+
+  AffineSubpixelOptions opt;
+  opt.kernel_size    = Vector2i(11, 11);
+  opt.max_iterations = 10;
+  opt.threshold      = 1e-3;
+  IterationHistogram histogram(opt.max_iterations);
+  converging_affine_subpixel(left, left_mask, Vector2i(0, 0), right, right_mask, Vector2i(0, 0),
+                             Vector2i(20, 18), disparity, opt, histogram);
+
+  EXPECT_EQ(histogram.num_pixels(), 20u*15u);
+  for (int row = 0; row < disparity.rows; row++) {
+    for (int col = 0; col < disparity.cols; col++) {
+      size_t k = disparity.index(col, row);
+      if (!left_mask(col + 20, row + 18)) {
+        EXPECT_EQ(disparity.valid[k], 0);
+        continue;
+      }
+      EXPECT_EQ(disparity.valid[k], 1);
+      EXPECT_NEAR(disparity.dx[k], shift_x, 0.1);
+      EXPECT_NEAR(disparity.dy[k], shift_y, 0.1);
+    }
+  }
+}
+
+// Subpixel mode 3 on the same input. Both fit an affine window by
+// Gauss-Newton on LoG filtered images, so away from the edges they must
+// agree closely, and with the shift.
+TEST( AffineSubpixel, MatchesVisionWorkbenchAffine ) {
+  const double shift_x = 2.6, shift_y = 0.35;
+  const int cols = 90, rows = 80, margin = 20;
+  const float slog = 1.4;
+  const Vector2i kernel(11, 11);
+  ImageView<PixelGray<float> > left  = pixel_cast<PixelGray<float> >(make_image(cols, rows, 0, 0));
+  ImageView<PixelGray<float> > right = pixel_cast<PixelGray<float> >(make_image(cols, rows,
+                                                                                shift_x, shift_y));
+  ImageView<PixelMask<Vector2f> > integer_disp(cols, rows);
+  for (int row = 0; row < rows; row++)
+    for (int col = 0; col < cols; col++)
+      integer_disp(col, row) = PixelMask<Vector2f>(Vector2f(3, 0));
+
+  ImageView<PixelMask<Vector2f> > vw_disp
+    = vw::stereo::affine_subpixel(integer_disp, left, right, vw::stereo::PREFILTER_LOG,
+                                  slog, kernel, 0);
+
+  ImageView<float> left_log
+    = select_channel(vw::stereo::prefilter_image(left,  vw::stereo::PREFILTER_LOG, slog), 0);
+  ImageView<float> right_log
+    = select_channel(vw::stereo::prefilter_image(right, vw::stereo::PREFILTER_LOG, slog), 0);
+  DisparityPlanes disparity(cols - 2*margin, rows - 2*margin);
+  for (size_t k = 0; k < disparity.dx.size(); k++) {
+    disparity.dx[k] = 3;
+    disparity.dy[k] = 0;
+    disparity.valid[k] = 1;
+  }
+  AffineSubpixelOptions opt;
+  opt.kernel_size = kernel;
+  IterationHistogram histogram(opt.max_iterations);
+  converging_affine_subpixel(left_log, Vector2i(0, 0), right_log, Vector2i(0, 0),
+                             Vector2i(margin, margin), disparity, opt, histogram);
+
+  EXPECT_EQ(histogram.num_failed(), 0u);
+  for (int row = 0; row < disparity.rows; row++) {
+    for (int col = 0; col < disparity.cols; col++) {
+      size_t k = disparity.index(col, row);
+      PixelMask<Vector2f> const& d = vw_disp(col + margin, row + margin);
+      ASSERT_TRUE(is_valid(d));
+      ASSERT_EQ(disparity.valid[k], 1);
+      EXPECT_NEAR(d.child()[0], shift_x, 0.1);
+      EXPECT_NEAR(d.child()[1], shift_y, 0.1);
+      EXPECT_NEAR(disparity.dx[k], d.child()[0], 0.05) << "at " << col << ", " << row;
+      EXPECT_NEAR(disparity.dy[k], d.child()[1], 0.05) << "at " << col << ", " << row;
+    }
+  }
+}
+
+TEST( AffineSubpixel, FlatWindowFails ) {
+  // Nothing to match on, so the pixel is invalidated
+  ImageView<float> flat(30, 30);
+  DisparityPlanes disparity(1, 1);
+  disparity.dx[0] = 1;
+  disparity.dy[0] = 0;
+  disparity.valid[0] = 1;
+
+  AffineSubpixelOptions opt;
+  opt.kernel_size = Vector2i(7, 7);
+  IterationHistogram histogram(opt.max_iterations);
+  converging_affine_subpixel(flat, Vector2i(0, 0), flat, Vector2i(0, 0),
+                             Vector2i(15, 15), disparity, opt, histogram);
+  EXPECT_EQ(disparity.valid[0], 0);
+  EXPECT_EQ(histogram.num_failed(), 1u);
+
+  opt.kernel_size = Vector2i(7, 4);
+  EXPECT_THROW(converging_affine_subpixel(flat, Vector2i(0, 0), flat, Vector2i(0, 0),
+                                          Vector2i(15, 15), disparity, opt, histogram),
+               ArgumentErr);
+}
+
+TEST( AffineSubpixel, Histogram ) {
+  IterationHistogram a(3), b(5);
+  a.add(1, IterationHistogram::CONVERGED);
+  a.add(1, IterationHistogram::CONVERGED);
+  a.add(3, IterationHistogram::UNCONVERGED);
+  b.add(4, IterationHistogram::CONVERGED);
+  b.add(2, IterationHistogram::FAILED);
+  a += b;
+
+  EXPECT_EQ(a.converged_after(1), 2u);
+  EXPECT_EQ(a.converged_after(4), 1u);
+  EXPECT_EQ(a.converged_after(9), 0u);
+  EXPECT_EQ(a.num_converged(), 3u);
+  EXPECT_EQ(a.num_unconverged(), 1u);
+  EXPECT_EQ(a.num_failed(), 1u);
+  EXPECT_NEAR(a.mean_iterations(), 11.0/5, 1e-12);
+  EXPECT_EQ(a.summary(), "1:2 2:0 3:0 4:1 5:0 unconverged:1 failed:1 mean:2.20");
+
+  // Tiles computed again replace what they had
+  SubpixelIterationLog log;
+  log.record(BBox2i(0, 0, 10, 10), a);
+  log.record(BBox2i(10, 0, 10, 10), b);
+  log.record(BBox2i(0, 0, 10, 10), b);
+  EXPECT_EQ(log.num_tiles(), 2u);
+  EXPECT_EQ(log.total().num_pixels(), 4u);
+
+  std::string file = UnlinkName("subpixel-iterations.txt");
+  log.write(file);
+  std::ifstream in(file.c_str());
+  std::string line;
+  ASSERT_TRUE(std::getline(in, line));
+  EXPECT_EQ(line, "0 0 10 10 " + b.summary());
+}
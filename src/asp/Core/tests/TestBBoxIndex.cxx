@@ -0,0 +1,112 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <asp/Core/BBoxIndex.h>
+
+#include <algorithm>
+#include <cstdlib>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+
+  double random_in(double lo, double hi) {
+    return lo + (hi - lo)*rand()/RAND_MAX;
+  }
+
+  // The sub-blocks of a mosaic of point clouds: a grid of slightly
+  // overlapping boxes for each cloud, with the clouds overlapping too.
+  std::vector<BBox2> mosaic_boxes(int num_clouds, int blocks_per_side) {
+    std::vector<BBox2> boxes;
+    for (int c = 0; c < num_clouds; c++) {
+      Vector2 origin(random_in(0, 1e5), random_in(0, 1e5));
+      for (int row = 0; row < blocks_per_side; row++) {
+        for (int col = 0; col < blocks_per_side; col++) {
+          Vector2 corner = origin + 100.0*Vector2(col, row);
+          boxes.push_back(BBox2(corner, corner + Vector2(random_in(100, 110),
+                                                         random_in(100, 110))));
+        }
+      }
+    }
+    return boxes;
+  }
+
+  void brute_force_query(std::vector<BBox2> const& boxes, BBox2 const& box,
+                         std::vector<size_t> & indices) {
+    indices.clear();
+    for (size_t i = 0; i < boxes.size(); i++) {
+      if (boxes[i].empty())
+        continue;
+      if (boxes[i].min().x() <= box.max().x() && box.min().x() <= boxes[i].max().x() &&
+          boxes[i].min().y() <= box.max().y() && box.min().y() <= boxes[i].max().y())
+        indices.push_back(i);
+    }
+  }
+}
+
+TEST( BBoxIndex, MatchesBruteForce ) {
+  srand(11);
+  std::vector<BBox2> boxes;
+  for (int i = 0; i < 5000; i++) {
+    Vector2 corner(random_in(0, 1000), random_in(0, 1000));
+    boxes.push_back(BBox2(corner, corner + Vector2(random_in(0, 30), random_in(0, 30))));
+  }
+  boxes[17] = BBox2(); // Empty, as for blocks with no valid points
+  boxes.push_back(BBox2(Vector2(-50, -50), Vector2(2000, 2000))); // Covers all
+
+  BBoxIndex index(boxes);
+  EXPECT_EQ(index.size(), boxes.size() - 1);
+
+  std::vector<size_t> expected, actual;
+  for (int q = 0; q < 500; q++) {
+    Vector2 corner(random_in(-100, 1100), random_in(-100, 1100));
+    BBox2 box(corner, corner + Vector2(random_in(0, 200), random_in(0, 200)));
+    brute_force_query(boxes, box, expected);
+    index.query(box, actual);
+    EXPECT_EQ(expected, actual);
+  }
+
+  // Touching counts
+  index.query(BBox2(boxes[0].max(), boxes[0].max() + Vector2(1, 1)), actual);
+  EXPECT_TRUE(std::find(actual.begin(), actual.end(), size_t(0)) != actual.end());
+
+  BBoxIndex empty(std::vector<BBox2>(3));
+  empty.query(BBox2(0, 0, 10, 10), actual);
+  EXPECT_TRUE(actual.empty());
+}
+
+// The cloud blocks point2dem finds under DEM tiles, for a mosaic of
+// many clouds, are those a scan of all blocks finds.
+TEST( BBoxIndex, MatchesScanOnMosaic ) {
+  srand(12);
+  std::vector<BBox2> boxes = mosaic_boxes(50, 64); // About 200,000 blocks
+  BBoxIndex index(boxes);
+
+  std::vector<size_t> expected, actual;
+  size_t num_found = 0;
+  for (int t = 0; t < 2000; t++) {
+    Vector2 corner(random_in(0, 1.06e5), random_in(0, 1.06e5));
+    BBox2 tile(corner, corner + Vector2(256, 256));
+    brute_force_query(boxes, tile, expected);
+    index.query(tile, actual);
+    EXPECT_EQ(expected, actual);
+    num_found += actual.size();
+  }
+  EXPECT_GT(num_found, size_t(0));
+}
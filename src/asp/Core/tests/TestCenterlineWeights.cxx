@@ -0,0 +1,148 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Image/Algorithms.h>
+#include <asp/Core/CenterlineWeights.h>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+
+  // A disparity-like image with an irregular invalid border and holes
+  ImageView<PixelMask<float> > make_image(int cols, int rows) {
+    ImageView<PixelMask<float> > image(cols, rows);
+    for (int row = 0; row < rows; row++) {
+      for (int col = 0; col < cols; col++) {
+        image(col, row) = PixelMask<float>(col + 100*row);
+        if (col < (row % 7) || cols - 1 - col < (row % 5) || row < col % 3 ||
+            (col % 11 == 4 && row % 9 == 2))
+          image(col, row).invalidate();
+      }
+    }
+    // A row and a column with nothing valid
+    for (int col = 0; col < cols; col++)
+      image(col, 6).invalidate();
+    for (int row = 0; row < rows; row++)
+      image(9, row).invalidate();
+    return image;
+  }
+
+  // Weights found by scanning the whole image
+  ImageView<double> brute_force_weights(ImageView<PixelMask<float> > const& image,
+                                        BBox2i const& roi) {
+    ImageView<double> weights(roi.width(), roi.height());
+    for (int row = roi.min().y(); row < roi.max().y(); row++) {
+      for (int col = roi.min().x(); col < roi.max().x(); col++) {
+        int rb = -1, re = -1, cb = -1, ce = -1;
+        for (int k = 0; k < image.cols(); k++) {
+          if (is_valid(image(k, row))) {
+            if (rb < 0) rb = k;
+            re = k;
+          }
+        }
+        for (int k = 0; k < image.rows(); k++) {
+          if (is_valid(image(col, k))) {
+            if (cb < 0) cb = k;
+            ce = k;
+          }
+        }
+        double w = 0;
+        if (is_valid(image(col, row)))
+          w = centerline_weight(col, rb, re) * centerline_weight(row, cb, ce);
+        weights(col - roi.min().x(), row - roi.min().y()) = w;
+      }
+    }
+    return weights;
+  }
+}
+
+TEST( CenterlineWeights, LineWeight ) {
+  EXPECT_NEAR(centerline_weight(5, 0, 10), 1.0, 1e-12);
+  EXPECT_NEAR(centerline_weight(1, 0, 10), 0.2, 1e-12);
+  EXPECT_NEAR(centerline_weight(5, 2, 7), 0.8, 1e-12);
+  EXPECT_EQ(centerline_weight(0, 0, 10), 0.0);
+  EXPECT_EQ(centerline_weight(10, 0, 10), 0.0);
+  EXPECT_EQ(centerline_weight(3, 3, 3), 0.0);
+  EXPECT_EQ(centerline_weight(11, 0, 10), 0.0);
+  EXPECT_EQ(centerline_weight(2, -1, -1), 0.0);
+}
+
+TEST( CenterlineWeights, MatchesVW ) {
+  ImageView<PixelMask<float> > image = make_image(47, 31);
+
+  BBox2i rois[] = {BBox2i(0, 0, 47, 31), BBox2i(0, 0, 5, 5), BBox2i(42, 26, 5, 5),
+                   BBox2i(5, 0, 37, 5), BBox2i(7, 4, 6, 6)};
+  for (size_t r = 0; r < sizeof(rois)/sizeof(rois[0]); r++) {
+    ImageView<double> expected;
+    vw::centerline_weights(image, expected, rois[r]);
+
+    ImageView<PixelMask<float> > cropped;
+    ImageView<double> weights;
+    centerline_weights_in_roi(image, rois[r], cropped, weights, 4);
+    ASSERT_EQ(weights.cols(), expected.cols());
+    ASSERT_EQ(weights.rows(), expected.rows());
+    for (int row = 0; row < weights.rows(); row++) {
+      for (int col = 0; col < weights.cols(); col++)
+        EXPECT_NEAR(weights(col, row), expected(col, row), 1e-12);
+    }
+  }
+}
+
+TEST( CenterlineWeights, WindowMatchesWholeImage ) {
+  ImageView<PixelMask<float> > image = make_image(47, 31);
+
+  BBox2i rois[] = {BBox2i(0, 0, 47, 31), BBox2i(0, 0, 5, 5), BBox2i(42, 26, 5, 5),
+                   BBox2i(5, 0, 37, 5), BBox2i(0, 3, 5, 25), BBox2i(7, 4, 6, 6)};
+  int strip_sizes[] = {1, 4, 256};
+
+  for (size_t r = 0; r < sizeof(rois)/sizeof(rois[0]); r++) {
+    ImageView<double> expected = brute_force_weights(image, rois[r]);
+    for (size_t s = 0; s < sizeof(strip_sizes)/sizeof(strip_sizes[0]); s++) {
+      ImageView<PixelMask<float> > cropped;
+      ImageView<double> weights;
+      centerline_weights_in_roi(image, rois[r], cropped, weights, strip_sizes[s]);
+      ASSERT_EQ(weights.cols(), rois[r].width());
+      ASSERT_EQ(weights.rows(), rois[r].height());
+      for (int row = 0; row < weights.rows(); row++) {
+        for (int col = 0; col < weights.cols(); col++) {
+          EXPECT_NEAR(weights(col, row), expected(col, row), 1e-12);
+          EXPECT_EQ(is_valid(cropped(col, row)),
+                    is_valid(image(col + rois[r].min().x(), row + rois[r].min().y())));
+        }
+      }
+    }
+  }
+}
+
+TEST( CenterlineWeights, Extents ) {
+  ImageView<PixelMask<float> > image = make_image(47, 31);
+  CenterlineExtents extents;
+  centerline_extents(image, BBox2i(5, 4, 6, 3), 3, extents);
+
+  ASSERT_EQ(extents.row_begin.size(), 3u);
+  ASSERT_EQ(extents.col_begin.size(), 6u);
+  EXPECT_EQ(extents.row_begin[0], 4);  // Row 4 starts at column 4
+  EXPECT_EQ(extents.row_end  [0], 42); // and ends at 46 - (4 % 5)
+  EXPECT_EQ(extents.row_begin[2], -1); // Row 6 is all invalid
+  EXPECT_EQ(extents.row_end  [2], -1);
+  EXPECT_EQ(extents.col_begin[4], -1); // So is column 9
+  EXPECT_EQ(extents.col_end  [4], -1);
+}
@@ -0,0 +1,201 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <vw/Core/Stopwatch.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/PixelMask.h>
+#include <asp/Core/DisparityBlend.h>
+
+#include <cstdlib>
+#include <cstring>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+
+  void fill_random(DisparityPlanes & planes, ImageView<double> & weights,
+                   int cols, int rows) {
+    planes.set_size(cols, rows);
+    weights.set_size(cols, rows);
+    for (int row = 0; row < rows; row++) {
+      for (int col = 0; col < cols; col++) {
+        size_t k = planes.index(col, row);
+        planes.dx[k]    = 100.0f*rand()/RAND_MAX - 50;
+        planes.dy[k]    = 10.0f*rand()/RAND_MAX - 5;
+        planes.valid[k] = (rand() % 5 != 0);
+        // Some weights are zero, as past the valid pixels of a tile
+        weights(col, row) = (rand() % 7 == 0) ? 0.0 : double(rand())/RAND_MAX;
+      }
+    }
+  }
+
+  typedef ImageView<PixelMask<Vector2f> > DispImageType;
+  typedef ImageView<double>               WeightsType;
+
+  // The loop the kernel replaced, as it was in stereo_blend.cc
+  void blend_tile_region(DispImageType      & main_image, WeightsType      & main_weights,
+                         BBox2i const& main_roi,
+                         DispImageType const& neighbor,   WeightsType const& neighbor_weights,
+                         BBox2i const& neighbor_roi) {
+
+    // Multiply-accumulate the image values, then accumulate the weights.
+    // Careful when dealing with no-data values.
+    DispImageType cropped_image   = crop(main_image,   main_roi);
+    WeightsType   cropped_weights = crop(main_weights, main_roi);
+
+    for (int col = 0; col < neighbor.cols(); col++) {
+      for (int row = 0; row < neighbor.rows(); row++) {
+
+        if (!is_valid(neighbor(col, row)) || neighbor_weights(col, row) <= 0) continue;
+
+        // If there was no data before, there will be data now
+        cropped_image(col, row).validate();
+        cropped_image(col, row) += neighbor(col, row) * neighbor_weights(col, row);
+        cropped_weights(col, row) += neighbor_weights(col, row);
+      }
+    }
+
+    // Put the modified portion backs into the larger images
+    crop(main_image,   main_roi) = cropped_image;
+    crop(main_weights, main_roi) = cropped_weights;
+  }
+
+  DispImageType disparity_image(DisparityPlanes const& planes) {
+    DispImageType image(planes.cols, planes.rows);
+    for (int row = 0; row < planes.rows; row++) {
+      for (int col = 0; col < planes.cols; col++) {
+        size_t k = planes.index(col, row);
+        image(col, row) = PixelMask<Vector2f>(Vector2f(planes.dx[k], planes.dy[k]));
+        if (!planes.valid[k])
+          image(col, row).invalidate();
+      }
+    }
+    return image;
+  }
+
+  DisparityPlanes disparity_planes(DispImageType const& image) {
+    DisparityPlanes planes(image.cols(), image.rows());
+    for (int row = 0; row < image.rows(); row++) {
+      for (int col = 0; col < image.cols(); col++) {
+        size_t k = planes.index(col, row);
+        planes.dx[k]    = image(col, row).child()[0];
+        planes.dy[k]    = image(col, row).child()[1];
+        planes.valid[k] = is_valid(image(col, row));
+      }
+    }
+    return planes;
+  }
+
+  // The blend done by the old loop, on PixelMask images
+  void reference_blend(DisparityPlanes & main, ImageView<double> & main_weights,
+                       BBox2i const& roi, DisparityPlanes const& neighbor,
+                       ImageView<double> const& neighbor_weights) {
+    DispImageType main_image = disparity_image(main);
+    blend_tile_region(main_image, main_weights, roi, disparity_image(neighbor),
+                      neighbor_weights, BBox2i(0, 0, neighbor.cols, neighbor.rows));
+    main = disparity_planes(main_image);
+  }
+
+  bool same_bits(DisparityPlanes const& a, ImageView<double> const& wa,
+                 DisparityPlanes const& b, ImageView<double> const& wb) {
+    size_t n = a.dx.size();
+    return n == b.dx.size() &&
+      memcmp(&a.dx[0],    &b.dx[0],    n*sizeof(float))  == 0 &&
+      memcmp(&a.dy[0],    &b.dy[0],    n*sizeof(float))  == 0 &&
+      memcmp(&a.valid[0], &b.valid[0], n)                == 0 &&
+      memcmp(&wa(0, 0),   &wb(0, 0),   n*sizeof(double)) == 0;
+  }
+}
+
+TEST( DisparityBlend, KernelMatchesReference ) {
+  srand(7);
+  DisparityPlanes main;
+  ImageView<double> main_weights;
+  fill_random(main, main_weights, 40, 30);
+
+  SimdLevel levels[] = {SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2};
+  // Cover full vectors as well as leftover pixels in each row
+  for (int width = 1; width <= 13; width++) {
+    BBox2i roi(3, 5, width, 9);
+    DisparityPlanes neighbor;
+    ImageView<double> neighbor_weights;
+    fill_random(neighbor, neighbor_weights, width, 9);
+
+    DisparityPlanes expected = main;
+    ImageView<double> expected_weights = copy(main_weights);
+    reference_blend(expected, expected_weights, roi, neighbor, neighbor_weights);
+
+    for (size_t l = 0; l < sizeof(levels)/sizeof(levels[0]); l++) {
+      DisparityPlanes actual = main;
+      ImageView<double> actual_weights = copy(main_weights);
+      blend_disparity_region(levels[l], actual, actual_weights, roi,
+                             neighbor, neighbor_weights);
+      // Bit-exact, not just close
+      EXPECT_TRUE(same_bits(expected, expected_weights, actual, actual_weights))
+        << "width " << width << ", " << simd_level_name(levels[l]);
+    }
+  }
+
+  DisparityPlanes neighbor;
+  ImageView<double> neighbor_weights;
+  fill_random(neighbor, neighbor_weights, 5, 5);
+  EXPECT_THROW(blend_disparity_region(SIMD_SCALAR, main, main_weights, BBox2i(38, 0, 5, 5),
+                                      neighbor, neighbor_weights), ArgumentErr);
+}
+
+// Not a check, but a record of how the kernel compares with the loop it
+// replaced, on a collar the size of a typical SGM tile edge.
+TEST( DisparityBlend, Benchmark ) {
+  srand(11);
+  const int cols = 2048, collar = 256, repeats = 10;
+  DisparityPlanes main, neighbor;
+  ImageView<double> main_weights, neighbor_weights;
+  fill_random(main,     main_weights,     cols, collar);
+  fill_random(neighbor, neighbor_weights, cols, collar);
+  BBox2i roi(0, 0, cols, collar);
+
+  Stopwatch reference_time;
+  DispImageType expected_image = disparity_image(main), neighbor_image = disparity_image(neighbor);
+  ImageView<double> expected_weights = copy(main_weights);
+  reference_time.start();
+  for (int r = 0; r < repeats; r++)
+    blend_tile_region(expected_image, expected_weights, roi, neighbor_image,
+                      neighbor_weights, roi);
+  reference_time.stop();
+  vw_out() << "Reference loop: " << reference_time.elapsed_seconds() << " s.\n";
+  DisparityPlanes expected = disparity_planes(expected_image);
+
+  SimdLevel levels[] = {SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2};
+  for (size_t l = 0; l < sizeof(levels)/sizeof(levels[0]); l++) {
+    if (levels[l] > detect_simd_level())
+      continue;
+    Stopwatch kernel_time;
+    DisparityPlanes actual = main;
+    ImageView<double> actual_weights = copy(main_weights);
+    kernel_time.start();
+    for (int r = 0; r < repeats; r++)
+      blend_disparity_region(levels[l], actual, actual_weights, roi,
+                             neighbor, neighbor_weights);
+    kernel_time.stop();
+    vw_out() << simd_level_name(levels[l]) << " kernel: "
+             << kernel_time.elapsed_seconds() << " s.\n";
+    EXPECT_TRUE(same_bits(expected, expected_weights, actual, actual_weights));
+  }
+}
@@ -21,10 +21,32 @@
 #include <vw/Camera/PinholeModel.h>
 #include <vw/Camera/LensDistortion.h>
 #include <vw/Cartography/CameraBBox.h>
+#include <vw/Core/Stopwatch.h>
+#include <cstdlib>
 
 using namespace vw;
 using namespace asp;
 
+namespace {
+  // A texture of random gaussian blobs, shifted by (dx, dy)
+  ImageView<float> blob_texture(int cols, int rows, double dx, double dy) {
+    srand(7);
+    ImageView<float> image(cols, rows);
+    for (int b = 0; b < cols*rows/150; b++) {
+      double cx = double(rand())/RAND_MAX*cols + dx, cy = double(rand())/RAND_MAX*rows + dy;
+      double sigma = 1.5 + 3.0*rand()/RAND_MAX, amp = double(rand())/RAND_MAX - 0.5;
+      int r = int(3*sigma) + 1;
+      for (int row = std::max(0, int(cy) - r); row < std::min(rows, int(cy) + r + 1); row++) {
+        for (int col = std::max(0, int(cx) - r); col < std::min(cols, int(cx) + r + 1); col++) {
+          double d2 = (col - cx)*(col - cx) + (row - cy)*(row - cy);
+          image(col, row) += amp*exp(-d2/(2*sigma*sigma));
+        }
+      }
+    }
+    return image;
+  }
+}
+
 TEST( InterestPointMatching, DatumIntersection ) {
 
   // Make a synthetic camera (Parameters selected to mimic a DG like camera)
@@ -69,3 +91,58 @@ TEST( InterestPointMatching, DatumIntersection ) {
   }
 
 }
+
+TEST( InterestPointMatching, RefineMatches ) {
+  ImageView<float> left  = blob_texture(200, 150, 0, 0);
+  ImageView<float> right = blob_texture(200, 150, 3, -2);
+
+  // Right points off by up to 3 pixels from the truth
+  std::vector<ip::InterestPoint> ip1, ip2;
+  for (int k = 0; k < 20; k++) {
+    double x = 30 + 7*k, y = 40 + 4*k;
+    ip1.push_back(ip::InterestPoint(x + 0.3, y - 0.4));
+    ip2.push_back(ip::InterestPoint(x + 3 + (k%7) - 3, y - 2 + (k%5) - 2));
+  }
+  refine_ip_matches(left, right, 15, 4, 0.5, ip1, ip2);
+
+  ASSERT_EQ(20u, ip1.size());
+  for (size_t k = 0; k < ip1.size(); k++) {
+    EXPECT_EQ(ip1[k].ix + 3, ip2[k].ix);
+    EXPECT_EQ(ip1[k].iy - 2, ip2[k].iy);
+    EXPECT_NEAR(ip1[k].x + 3, ip2[k].x, 0.5);
+    EXPECT_NEAR(ip1[k].y - 2, ip2[k].y, 0.5);
+  }
+
+  // Too close to the edge to fit the windows
+  ip1.assign(1, ip::InterestPoint(2, 2));
+  ip2.assign(1, ip::InterestPoint(5, 0));
+  refine_ip_matches(left, right, 15, 4, 0.5, ip1, ip2);
+  EXPECT_EQ(0u, ip1.size());
+}
+
+TEST( InterestPointMatching, PyramidDetectMatch ) {
+  ImageView<float> left  = blob_texture(600, 600, 0, 0);
+  ImageView<float> right = blob_texture(600, 600, 5, 3);
+
+  // Compare with detection at full resolution, and report the timings
+  std::vector<ip::InterestPoint> full_ip1, full_ip2, pyr_ip1, pyr_ip2;
+  Stopwatch full_time, pyr_time;
+  full_time.start();
+  detect_match_ip(full_ip1, full_ip2, left, right, 0);
+  full_time.stop();
+  pyr_time.start();
+  pyramid_detect_match_ip(pyr_ip1, pyr_ip2, left, right, 0, 2);
+  pyr_time.stop();
+  vw_out() << "Full resolution: " << full_ip1.size() << " matches in "
+           << full_time.elapsed_seconds() << " s. Pyramid: " << pyr_ip1.size()
+           << " matches in " << pyr_time.elapsed_seconds() << " s.\n";
+
+  ASSERT_GE(pyr_ip1.size(), 10u);
+  size_t num_good = 0;
+  for (size_t k = 0; k < pyr_ip1.size(); k++) {
+    if (fabs(pyr_ip2[k].x - pyr_ip1[k].x - 5) < 1.0 &&
+        fabs(pyr_ip2[k].y - pyr_ip1[k].y - 3) < 1.0)
+      num_good++;
+  }
+  EXPECT_GE(num_good, pyr_ip1.size()*9/10);
+}
@@ -0,0 +1,92 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <asp/Core/LocalHomography.h>
+#include <asp/Core/TileStats.h>
+#include <boost/filesystem.hpp>
+
+using namespace vw;
+using namespace asp;
+
+TEST( LocalHomography, MatchIndex ) {
+  // A grid of matches, with the right point shifted by (5, -2)
+  std::vector<ip::InterestPoint> ip1, ip2;
+  for (int y = 0; y < 100; y += 10) {
+    for (int x = 0; x < 100; x += 10) {
+      ip1.push_back(ip::InterestPoint(x + 0.5, y + 0.5));
+      ip2.push_back(ip::InterestPoint(x + 5.5, y - 1.5));
+    }
+  }
+  MatchIndex index(ip1, ip2, 16);
+  EXPECT_EQ(ip1.size(), index.size());
+
+  // Left points at x = 20, 30, 40 and y = 20, 30 are in the box, but the
+  // right points of those at x = 40 are not.
+  std::vector<ip::InterestPoint> out1, out2;
+  index.matches_in_box(BBox2i(17, 12, 28, 20), out1, out2);
+  ASSERT_EQ(4u, out1.size());
+  ASSERT_EQ(4u, out2.size());
+  for (size_t i = 0; i < out1.size(); i++) {
+    // In tile coordinates
+    EXPECT_NEAR(5.0,  out2[i].x - out1[i].x, 1e-6);
+    EXPECT_NEAR(-2.0, out2[i].y - out1[i].y, 1e-6);
+    EXPECT_GE(out1[i].x, 0);
+    EXPECT_LT(out2[i].x, 28);
+  }
+
+  // Nothing outside the grid
+  out1.clear(); out2.clear();
+  index.matches_in_box(BBox2i(500, 500, 50, 50), out1, out2);
+  EXPECT_EQ(0u, out1.size());
+}
+
+TEST( LocalHomography, MatchesChecksum ) {
+  std::vector<ip::InterestPoint> ip1(3, ip::InterestPoint(1, 2)), ip2(3, ip::InterestPoint(3, 4));
+  boost::uint64_t key = matches_checksum(ip1, ip2);
+  EXPECT_EQ(key, matches_checksum(ip1, ip2));
+  ip2[1].x += 0.25;
+  EXPECT_NE(key, matches_checksum(ip1, ip2));
+}
+
+TEST( LocalHomography, TileAlignmentKeepsFitStatus ) {
+  TileAlignment a;
+  a.key          = 12345;
+  a.aligned_size = Vector2i(30, 20);
+  a.left_matrix  = math::identity_matrix<3>();
+  a.right_matrix = math::identity_matrix<3>();
+  a.right_matrix(0, 2) = 4;
+  a.search_range = BBox2f(-3, -1, 10, 2);
+  a.left_ip.push_back (ip::InterestPoint(1, 2));
+  a.right_ip.push_back(ip::InterestPoint(5, 2));
+  a.fit_status   = TILE_FIT_REJECTED;
+  a.num_matches  = 17;
+
+  std::string file = "TestLocalHomography-alignment.txt";
+  write_tile_alignment(file, a);
+  TileAlignment b;
+  EXPECT_FALSE(read_tile_alignment(file, 999, b));
+  ASSERT_TRUE(read_tile_alignment(file, 12345, b));
+  // What the fit came to, not that it was cached
+  EXPECT_EQ(TILE_FIT_REJECTED, b.fit_status);
+  EXPECT_EQ(17, b.num_matches);
+  EXPECT_EQ(a.aligned_size, b.aligned_size);
+  EXPECT_EQ(4, b.right_matrix(0, 2));
+  ASSERT_EQ(1u, b.left_ip.size());
+  EXPECT_EQ(5, b.right_ip[0].x);
+  boost::filesystem::remove(file);
+}
@@ -0,0 +1,143 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <vw/Core/ProgressCallback.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewRef.h>
+#include <vw/Image/Manipulation.h>
+#include <asp/Core/OrthoRasterizer.h>
+
+#include <cmath>
+#include <limits>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+
+  // A gently sloping cloud with a hole, as a stereo cloud projected
+  // on the plane, with rows going down in y
+  ImageView<Vector3> make_cloud(int cols, int rows) {
+    ImageView<Vector3> cloud(cols, rows);
+    for (int row = 0; row < rows; row++) {
+      for (int col = 0; col < cols; col++) {
+        double z = 10 + std::sin(0.1*col)*std::cos(0.13*row);
+        if (std::abs(col - 30) < 6 && std::abs(row - 25) < 4)
+          z = std::numeric_limits<double>::quiet_NaN();
+        cloud(col, row) = Vector3(0.5*col + 0.1*std::sin(double(row)), -0.5*row, z);
+      }
+    }
+    return cloud;
+  }
+
+  boost::shared_ptr<OrthoRasterizerView>
+  make_rasterizer(ImageViewRef<Vector3> const& cloud, ImageViewRef<double> const& errors,
+                  size_t *num_invalid, Mutex *mutex) {
+    boost::shared_ptr<OrthoRasterizerView> rasterizer
+      (new OrthoRasterizerView(cloud, select_channel(cloud, 2), 0.0, 0.0, false, 32,
+                               BBox2(), false, Vector2(75.0, 3.0), errors, 0.0, 0.0,
+                               Vector2(0, 0), 0, false, num_invalid, mutex,
+                               ProgressCallback::dummy_instance()));
+    rasterizer->set_use_minz_as_default(false);
+    rasterizer->set_default_value(-32768);
+    return rasterizer;
+  }
+}
+
+namespace {
+  // Rasterize in tiles, as when the DEM is written, leaving out the
+  // last tile if asked to
+  void rasterize_in_tiles(OrthoRasterizerView const& view, int tile, bool skip_last = false) {
+    ImageView<PixelGray<float> > dem(view.cols(), view.rows());
+    for (int row = 0; row < view.rows(); row += tile) {
+      for (int col = 0; col < view.cols(); col += tile) {
+        if (skip_last && row + tile >= view.rows() && col + tile >= view.cols())
+          continue;
+        BBox2i box(col, row, tile, tile);
+        box.crop(bounding_box(dem));
+        crop(dem, box) = crop(view, box);
+      }
+    }
+  }
+}
+
+// The DEMs found together with the one at the finest spacing are those
+// found at their own spacing, however the finest one is tiled
+TEST( OrthoRasterizer, CompanionsMatchOwnSpacing ) {
+  ImageViewRef<Vector3> cloud  = make_cloud(96, 80);
+  ImageViewRef<double>  errors = ImageView<double>(96, 80);
+  size_t num_invalid = 0;
+  Mutex  mutex;
+
+  std::vector<double> spacings;
+  spacings.push_back(2.0);
+  spacings.push_back(2.5);
+  spacings.push_back(10.0);
+
+  std::vector<boost::shared_ptr<OrthoRasterizerView> > own(spacings.size());
+  std::vector<ImageView<PixelGray<float> > > own_dems(spacings.size());
+  std::vector<size_t> own_num_invalid(spacings.size());
+  for (size_t i = 0; i < spacings.size(); i++) {
+    own[i] = make_rasterizer(cloud, errors, &num_invalid, &mutex);
+    own[i]->initialize_spacing(spacings[i]);
+    own_dems[i] = *own[i];
+    own_num_invalid[i] = num_invalid;
+  }
+
+  boost::shared_ptr<OrthoRasterizerView> fine = make_rasterizer(cloud, errors, &num_invalid, &mutex);
+  fine->initialize_spacing(1.0);
+
+  // None of the tiles was rasterized yet, and then all but one
+  fine->set_companion_spacings(spacings);
+  EXPECT_THROW(fine->companion_dem(0), LogicErr);
+  rasterize_in_tiles(*fine, 16, true);
+  EXPECT_THROW(fine->companion_dem(0), LogicErr);
+
+  // Small tiles, tiles which do not divide the DEM, and a single tile
+  int tiles[] = {7, 16, 1000};
+  for (size_t t = 0; t < sizeof(tiles)/sizeof(tiles[0]); t++) {
+    fine->set_companion_spacings(spacings);
+    rasterize_in_tiles(*fine, tiles[t]);
+
+    for (size_t i = 0; i < spacings.size(); i++) {
+      ImageView<float> const& dem = fine->companion_dem(i);
+      ImageView<PixelGray<float> > const& own_dem = own_dems[i];
+      double fill_value = own[i]->fill_value();
+      ASSERT_EQ(dem.cols(), own_dem.cols()) << "spacing " << spacings[i];
+      ASSERT_EQ(dem.rows(), own_dem.rows()) << "spacing " << spacings[i];
+      int num_valid = 0;
+      size_t num_unset = 0; // As point2dem counts them
+      for (int row = 0; row < dem.rows(); row++) {
+        for (int col = 0; col < dem.cols(); col++) {
+          if (double(dem(col, row)) == fill_value)
+            num_unset++;
+          float expected = own_dem(col, row)[0];
+          if (expected == fill_value) {
+            EXPECT_EQ(dem(col, row), expected) << "at " << col << ", " << row;
+            continue;
+          }
+          num_valid++;
+          EXPECT_NEAR(dem(col, row), expected, 1e-5) << "at " << col << ", " << row;
+        }
+      }
+      EXPECT_GT(num_valid, dem.cols()*dem.rows()/2);
+      EXPECT_EQ(num_unset, own_num_invalid[i])
+        << "spacing " << spacings[i] << ", tile " << tiles[t];
+    }
+  }
+}
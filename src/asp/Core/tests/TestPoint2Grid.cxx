@@ -0,0 +1,124 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <vw/Core/Stopwatch.h>
+#include <vw/Image/ImageView.h>
+#include <asp/Core/Point2Grid.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+using namespace vw;
+using namespace vw::stereo;
+using namespace asp;
+
+namespace {
+
+  // Points scattered over a DEM tile and a bit past it, as in a tile of
+  // a point2dem run, with their coordinates in separate arrays.
+  struct Points {
+    std::vector<double> x, y, z;
+  };
+
+  Points random_points(size_t n, double size) {
+    Points points;
+    for (size_t i = 0; i < n; i++) {
+      points.x.push_back(size*(1.1*rand()/RAND_MAX - 0.05));
+      points.y.push_back(size*(1.1*rand()/RAND_MAX - 0.05));
+      points.z.push_back(100.0 + 20.0*rand()/RAND_MAX);
+    }
+    return points;
+  }
+
+  bool same_bits(ImageView<double> const& a, ImageView<double> const& b) {
+    size_t n = size_t(a.cols())*a.rows();
+    return a.cols() == b.cols() && a.rows() == b.rows() &&
+      memcmp(&a(0, 0), &b(0, 0), n*sizeof(double)) == 0;
+  }
+}
+
+TEST( Point2Grid, AddPointsMatchesAddPoint ) {
+  srand(5);
+  const int cols = 37, rows = 29;
+  const double spacing = 2.0;
+  Points points = random_points(3000, cols*spacing);
+
+  // Radii of a few grid points cover full vectors as well as leftovers
+  double radii[] = {2.0, 3.3, 7.9};
+  SimdLevel levels[] = {SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2};
+  for (size_t r = 0; r < sizeof(radii)/sizeof(radii[0]); r++) {
+    ImageView<double> expected, expected_weights;
+    Point2Grid expected_grid(cols, rows, expected, expected_weights,
+                             0, 0, spacing, spacing, radii[r], 0);
+    expected_grid.Clear(-5);
+    for (size_t i = 0; i < points.x.size(); i++)
+      expected_grid.AddPoint(points.x[i], points.y[i], points.z[i]);
+
+    for (size_t l = 0; l < sizeof(levels)/sizeof(levels[0]); l++) {
+      if (levels[l] > detect_simd_level())
+        continue;
+      ImageView<double> actual, actual_weights;
+      Point2Grid grid(cols, rows, actual, actual_weights,
+                      0, 0, spacing, spacing, radii[r], 0);
+      grid.Clear(-5);
+      grid.AddPoints(points.x.size(), &points.x[0], &points.y[0], &points.z[0], levels[l]);
+      // Bit-exact, not just close
+      EXPECT_TRUE(same_bits(expected, actual) && same_bits(expected_weights, actual_weights))
+        << "radius " << radii[r] << ", " << simd_level_name(levels[l]);
+    }
+  }
+}
+
+// Not a check, but a record of how the batched splatting compares with
+// adding the points one by one, for a tile with many points per pixel.
+TEST( Point2Grid, Benchmark ) {
+  srand(9);
+  const int size = 266; // A 256 pixel tile and its collar
+  const double spacing = 1.0, radius = 3.0;
+  Points points = random_points(1000000, size*spacing);
+  size_t n = points.x.size();
+
+  ImageView<double> expected, expected_weights;
+  Point2Grid expected_grid(size, size, expected, expected_weights,
+                           0, 0, spacing, spacing, radius, 0);
+  expected_grid.Clear(0);
+  Stopwatch reference_time;
+  reference_time.start();
+  for (size_t i = 0; i < n; i++)
+    expected_grid.AddPoint(points.x[i], points.y[i], points.z[i]);
+  reference_time.stop();
+  vw_out() << "AddPoint: " << reference_time.elapsed_seconds() << " s.\n";
+
+  SimdLevel levels[] = {SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2};
+  for (size_t l = 0; l < sizeof(levels)/sizeof(levels[0]); l++) {
+    if (levels[l] > detect_simd_level())
+      continue;
+    ImageView<double> actual, actual_weights;
+    Point2Grid grid(size, size, actual, actual_weights,
+                    0, 0, spacing, spacing, radius, 0);
+    grid.Clear(0);
+    Stopwatch batch_time;
+    batch_time.start();
+    grid.AddPoints(n, &points.x[0], &points.y[0], &points.z[0], levels[l]);
+    batch_time.stop();
+    vw_out() << simd_level_name(levels[l]) << " AddPoints: "
+             << batch_time.elapsed_seconds() << " s.\n";
+    EXPECT_TRUE(same_bits(expected, actual) && same_bits(expected_weights, actual_weights));
+  }
+}
@@ -128,3 +128,40 @@ TEST( PointUtils, CsvConv ) {
   
   
 }
+
+TEST( PointUtils, QuantizedPointCloud ) {
+
+  // Points near the surface of Earth, and the errors
+  Vector3 shift(-2.5e6, 4.1e6, 3.8e6);
+  ImageView<Vector4> cloud(13, 7);
+  for (int row = 0; row < cloud.rows(); row++) {
+    for (int col = 0; col < cloud.cols(); col++) {
+      subvector(cloud(col, row), 0, 3) = shift + Vector3(0.37*col, -1.1*row, 250.0 + 0.01*col*row);
+      cloud(col, row)[3] = 0.05*col;
+    }
+  }
+  cloud(3, 2) = Vector4(); // Invalid
+  cloud(5, 4) = Vector4(1e10, 0, 0, 1); // Too far to be saved
+
+  double rounding_error = 0; // Use the default, 1/2^10 for Earth
+  double nodata = -std::numeric_limits<float>::max();
+  vw::cartography::GeoReference georef;
+  vw::cartography::GdalWriteOptions opt;
+  asp::write_quantized_gdal_image("quantized_pc.tif", shift, rounding_error, cloud,
+                                  false, georef, false, nodata, opt);
+
+  ImageViewRef<Vector4> read_cloud = asp::read_asp_point_cloud<4>("quantized_pc.tif");
+  ASSERT_EQ(read_cloud.cols(), cloud.cols());
+  ASSERT_EQ(read_cloud.rows(), cloud.rows());
+  double scale = get_rounding_error(shift, rounding_error);
+  for (int row = 0; row < cloud.rows(); row++) {
+    for (int col = 0; col < cloud.cols(); col++) {
+      if ((col == 3 && row == 2) || (col == 5 && row == 4)) {
+        EXPECT_EQ(Vector3(), subvector(Vector4(read_cloud(col, row)), 0, 3));
+        continue;
+      }
+      for (int i = 0; i < 4; i++)
+        EXPECT_NEAR(read_cloud(col, row)[i], cloud(col, row)[i], scale/2 + 1e-6);
+    }
+  }
+}
@@ -0,0 +1,275 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Image/PixelTypes.h>
+#include <vw/Stereo/DisparityMap.h>
+#include <asp/Core/TextureSmoothing.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+
+  // Smooth on the left, busy on the right
+  ImageView<float> make_image(int cols, int rows) {
+    ImageView<float> image(cols, rows);
+    for (int row = 0; row < rows; row++)
+      for (int col = 0; col < cols; col++)
+        image(col, row) = 1000 + 0.01f*col + (col > cols/2 ? float(rand() % 100)/100 : 0);
+    return image;
+  }
+
+  DisparityPlanes make_disparity(int cols, int rows) {
+    DisparityPlanes disparity(cols, rows);
+    for (int row = 0; row < rows; row++) {
+      for (int col = 0; col < cols; col++) {
+        size_t k = disparity.index(col, row);
+        disparity.dx[k]    = float(rand() % 1000)/10;
+        disparity.dy[k]    = float(rand() % 100)/10 - 5;
+        disparity.valid[k] = (rand() % 5 != 0);
+      }
+    }
+    return disparity;
+  }
+
+  ImageView<PixelMask<Vector2f> > masked_disparity(DisparityPlanes const& disparity) {
+    ImageView<PixelMask<Vector2f> > disp(disparity.cols, disparity.rows);
+    for (int row = 0; row < disparity.rows; row++) {
+      for (int col = 0; col < disparity.cols; col++) {
+        size_t k = disparity.index(col, row);
+        disp(col, row) = PixelMask<Vector2f>(Vector2f(disparity.dx[k], disparity.dy[k]));
+        if (!disparity.valid[k])
+          invalidate(disp(col, row));
+      }
+    }
+    return disp;
+  }
+
+  // Smooth with the same texture here and with VW, and compare the pixels
+  // at least edge away from the image border
+  void expect_same_smoothing(DisparityPlanes const& disparity, ImageView<float> const& texture,
+                             float texture_max, int max_kernel, int edge) {
+    DisparityPlanes smoothed;
+    ImageView<PixelMask<Vector2f> > vw_smoothed;
+    texture_preserving_smoothing(disparity, texture, texture_max, max_kernel, smoothed);
+    vw::stereo::texture_preserving_disparity_filter(masked_disparity(disparity), vw_smoothed,
+                                                    texture, texture_max, max_kernel);
+    ASSERT_EQ(vw_smoothed.cols(), smoothed.cols);
+    ASSERT_EQ(vw_smoothed.rows(), smoothed.rows);
+    for (int row = edge; row < smoothed.rows - edge; row++) {
+      for (int col = edge; col < smoothed.cols - edge; col++) {
+        size_t k = smoothed.index(col, row);
+        ASSERT_EQ(bool(smoothed.valid[k]), is_valid(vw_smoothed(col, row)));
+        if (!smoothed.valid[k])
+          continue;
+        EXPECT_NEAR(smoothed.dx[k], vw_smoothed(col, row).child()[0], 1e-3)
+          << "at " << col << ", " << row;
+        EXPECT_NEAR(smoothed.dy[k], vw_smoothed(col, row).child()[1], 1e-3)
+          << "at " << col << ", " << row;
+      }
+    }
+  }
+}
+
+TEST( TextureSmoothing, TextureMatchesWindows ) {
+  srand(5);
+  const int cols = 40, rows = 23, kernel = 7, half = kernel/2;
+  ImageView<float> image = make_image(cols, rows);
+  ImageView<float> texture;
+  texture_measure(image, kernel, texture);
+  ASSERT_EQ(texture.cols(), cols);
+  ASSERT_EQ(texture.rows(), rows);
+
+  for (int row = 0; row < rows; row++) {
+    for (int col = 0; col < cols; col++) {
+      double sum = 0, n = 0;
+      for (int r = std::max(row - half, 0); r <= std::min(row + half, rows - 1); r++)
+        for (int c = std::max(col - half, 0); c <= std::min(col + half, cols - 1); c++) {
+          sum += image(c, r);
+          n++;
+        }
+      double mean = sum/n, var = 0;
+      for (int r = std::max(row - half, 0); r <= std::min(row + half, rows - 1); r++)
+        for (int c = std::max(col - half, 0); c <= std::min(col + half, cols - 1); c++)
+          var += (image(c, r) - mean)*(image(c, r) - mean);
+      EXPECT_NEAR(texture(col, row), std::sqrt(var/n), 1e-4);
+    }
+  }
+}
+
+TEST( TextureSmoothing, SmoothingMatchesWindows ) {
+  srand(8);
+  const int cols = 37, rows = 29, max_kernel = 9;
+  const float texture_max = 0.2f;
+  DisparityPlanes disparity = make_disparity(cols, rows);
+  ImageView<float> texture(cols, rows);
+  for (int row = 0; row < rows; row++)
+    for (int col = 0; col < cols; col++)
+      texture(col, row) = float(rand() % 30)/100;
+
+  DisparityPlanes smoothed;
+  texture_preserving_smoothing(disparity, texture, texture_max, max_kernel, smoothed);
+  ASSERT_EQ(smoothed.cols, cols);
+  ASSERT_EQ(smoothed.rows, rows);
+
+  for (int row = 0; row < rows; row++) {
+    for (int col = 0; col < cols; col++) {
+      size_t k = disparity.index(col, row);
+      EXPECT_EQ(smoothed.valid[k], disparity.valid[k]);
+      int half = 0;
+      if (disparity.valid[k] && texture(col, row) < texture_max)
+        half = int((1 - texture(col, row)/texture_max)*max_kernel)/2;
+
+      double dx = 0, dy = 0, n = 0;
+      for (int r = std::max(row - half, 0); r <= std::min(row + half, rows - 1); r++)
+        for (int c = std::max(col - half, 0); c <= std::min(col + half, cols - 1); c++) {
+          size_t j = disparity.index(c, r);
+          if (half > 0 && !disparity.valid[j])
+            continue;
+          dx += disparity.dx[j];
+          dy += disparity.dy[j];
+          n++;
+        }
+      EXPECT_NEAR(smoothed.dx[k], dx/n, 1e-3);
+      EXPECT_NEAR(smoothed.dy[k], dy/n, 1e-3);
+    }
+  }
+
+  // No smoothing asked for
+  texture_preserving_smoothing(disparity, texture, texture_max, 0, smoothed);
+  EXPECT_EQ(smoothed.dx, disparity.dx);
+}
+
+TEST( TextureSmoothing, NonFiniteLeftOut ) {
+  srand(2);
+  const int cols = 30, rows = 20, kernel = 5, half = kernel/2;
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  ImageView<float> image = make_image(cols, rows), texture, expected;
+  texture_measure(image, kernel, expected);
+  image(3, 4) = nan;
+  image(20, 15) = std::numeric_limits<float>::infinity();
+  texture_measure(image, kernel, texture);
+
+  // Only the windows holding a bad pixel change, and stay finite
+  for (int row = 0; row < rows; row++) {
+    for (int col = 0; col < cols; col++) {
+      ASSERT_TRUE(texture(col, row) == texture(col, row));
+      bool near_bad = (std::abs(col - 3)  <= half && std::abs(row - 4)  <= half) ||
+                      (std::abs(col - 20) <= half && std::abs(row - 15) <= half);
+      if (!near_bad)
+        EXPECT_NEAR(texture(col, row), expected(col, row), 1e-4);
+    }
+  }
+
+  // Invalid disparities which are NaN do not spread
+  DisparityPlanes disparity = make_disparity(cols, rows), smoothed;
+  ImageView<float> flat(cols, rows);
+  for (int row = 0; row < rows; row++)
+    for (int col = 0; col < cols; col++)
+      flat(col, row) = 0;
+  for (size_t k = 0; k < disparity.valid.size(); k++)
+    if (!disparity.valid[k])
+      disparity.dx[k] = disparity.dy[k] = nan;
+  texture_preserving_smoothing(disparity, flat, 1, 7, smoothed);
+  for (size_t k = 0; k < smoothed.valid.size(); k++) {
+    if (!smoothed.valid[k])
+      continue;
+    EXPECT_TRUE(smoothed.dx[k] == smoothed.dx[k]);
+    EXPECT_TRUE(smoothed.dy[k] == smoothed.dy[k]);
+  }
+}
+
+// The filters these replace in stereo_fltr. Their windows may treat the
+// image edges in their own way, so only the pixels whose windows are
+// all inside are compared.
+TEST( TextureSmoothing, MatchesVisionWorkbench ) {
+  srand(11);
+  const int cols = 48, rows = 36, kernel = 7, max_kernel = 9;
+  const float texture_max = 0.3f;
+  ImageView<float> image = make_image(cols, rows);
+  ImageView<PixelGray<float> > gray(cols, rows);
+  for (int row = 0; row < rows; row++)
+    for (int col = 0; col < cols; col++)
+      gray(col, row) = image(col, row);
+
+  ImageView<float> texture, vw_texture;
+  texture_measure(image, kernel, texture);
+  vw::stereo::texture_measure(gray, vw_texture, kernel);
+  ASSERT_EQ(vw_texture.cols(), cols);
+  ASSERT_EQ(vw_texture.rows(), rows);
+  for (int row = kernel/2; row < rows - kernel/2; row++)
+    for (int col = kernel/2; col < cols - kernel/2; col++)
+      EXPECT_NEAR(texture(col, row), vw_texture(col, row), 1e-3)
+        << "at " << col << ", " << row;
+
+  // Both smooth with the same texture, so only the smoothing is compared
+  DisparityPlanes disparity = make_disparity(cols, rows);
+  expect_same_smoothing(disparity, vw_texture, texture_max, max_kernel,
+                        kernel/2 + max_kernel/2);
+}
+
+// stereo_fltr skips the smoothing for these kernel sizes, which must
+// then leave the disparity as VW does
+TEST( TextureSmoothing, NoKernelMatchesVisionWorkbench ) {
+  srand(13);
+  const int cols = 30, rows = 25, kernel = 5;
+  ImageView<float> image = make_image(cols, rows), texture;
+  ImageView<PixelGray<float> > gray(cols, rows);
+  for (int row = 0; row < rows; row++)
+    for (int col = 0; col < cols; col++)
+      gray(col, row) = image(col, row);
+  vw::stereo::texture_measure(gray, texture, kernel);
+
+  DisparityPlanes disparity = make_disparity(cols, rows);
+  for (int max_kernel = 0; max_kernel <= 1; max_kernel++) {
+    ImageView<PixelMask<Vector2f> > vw_smoothed;
+    vw::stereo::texture_preserving_disparity_filter(masked_disparity(disparity), vw_smoothed,
+                                                    texture, 0.3f, max_kernel);
+    for (int row = 0; row < rows; row++) {
+      for (int col = 0; col < cols; col++) {
+        size_t k = disparity.index(col, row);
+        ASSERT_EQ(bool(disparity.valid[k]), is_valid(vw_smoothed(col, row)));
+        if (!disparity.valid[k])
+          continue;
+        EXPECT_EQ(disparity.dx[k], vw_smoothed(col, row).child()[0]);
+        EXPECT_EQ(disparity.dy[k], vw_smoothed(col, row).child()[1]);
+      }
+    }
+    expect_same_smoothing(disparity, texture, 0.3f, max_kernel, 0);
+  }
+}
+
+TEST( TextureSmoothing, AllInvalidMatchesVisionWorkbench ) {
+  srand(17);
+  const int cols = 24, rows = 19;
+  DisparityPlanes disparity = make_disparity(cols, rows);
+  ImageView<float> texture(cols, rows);
+  for (int row = 0; row < rows; row++)
+    for (int col = 0; col < cols; col++)
+      texture(col, row) = 0;
+  for (size_t k = 0; k < disparity.valid.size(); k++)
+    disparity.valid[k] = 0;
+  expect_same_smoothing(disparity, texture, 0.3f, 9, 0);
+}
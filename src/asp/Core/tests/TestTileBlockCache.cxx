@@ -0,0 +1,137 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <vw/Image/ImageView.h>
+#include <asp/Core/TileBlockCache.h>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+  ImageView<float> make_image(int cols, int rows) {
+    ImageView<float> image(cols, rows);
+    for (int row = 0; row < rows; row++)
+      for (int col = 0; col < cols; col++)
+        image(col, row) = col + 1000*row;
+    return image;
+  }
+}
+
+TEST( TileBlockCache, CropMatchesImage ) {
+  ImageView<float> image = make_image(53, 37);
+  TileBlockCache<ImageView<float> > cache(image, Vector2i(16, 10), 1000000);
+
+  BBox2i boxes[] = {BBox2i(0, 0, 53, 37), BBox2i(5, 7, 20, 13),
+                    BBox2i(48, 30, 5, 7), BBox2i(16, 10, 16, 10)};
+  for (int b = 0; b < 4; b++) {
+    ImageView<float> result = cache.crop(boxes[b]);
+    ASSERT_EQ(boxes[b].width(),  result.cols());
+    ASSERT_EQ(boxes[b].height(), result.rows());
+    for (int row = 0; row < result.rows(); row++)
+      for (int col = 0; col < result.cols(); col++)
+        EXPECT_EQ(image(col + boxes[b].min().x(), row + boxes[b].min().y()),
+                  result(col, row));
+  }
+}
+
+TEST( TileBlockCache, ReusesOverlappingBlocks ) {
+  ImageView<float> image = make_image(64, 64);
+  TileBlockCache<ImageView<float> > cache(image, Vector2i(16, 16), 1000000);
+
+  // Two expanded tiles sharing the middle column of blocks
+  cache.crop(BBox2i(0,  0, 40, 16));
+  EXPECT_EQ(0u, cache.hits());
+  EXPECT_EQ(3u, cache.misses());
+  cache.crop(BBox2i(24, 0, 40, 16));
+  EXPECT_EQ(2u, cache.hits());
+  EXPECT_EQ(4u, cache.misses());
+}
+
+TEST( TileBlockCache, EvictsOverBudget ) {
+  ImageView<float> image = make_image(64, 16);
+  // Room for two 16x16 float blocks
+  TileBlockCache<ImageView<float> > cache(image, Vector2i(16, 16), 2*16*16*sizeof(float));
+
+  cache.crop(BBox2i(0, 0, 64, 16)); // Blocks 0 to 3, only 2 and 3 remain
+  EXPECT_EQ(4u, cache.misses());
+  cache.crop(BBox2i(32, 0, 32, 16));
+  EXPECT_EQ(2u, cache.hits());
+  ImageView<float> result = cache.crop(BBox2i(0, 0, 16, 16));
+  EXPECT_EQ(5u, cache.misses());
+  EXPECT_EQ(image(7, 9), result(7, 9));
+}
+
+namespace {
+  // A stage which reads its input in overlapping windows, tile by tile in
+  // row-major order: the sum over a 5x5 window, with zeros outside.
+  template <class ViewT>
+  ImageView<float> window_sums_by_tile(ViewT const& input, Vector2i const& tile_size) {
+    ImageView<float> result(input.cols(), input.rows());
+    for (int y = 0; y < input.rows(); y += tile_size[1]) {
+      for (int x = 0; x < input.cols(); x += tile_size[0]) {
+        BBox2i tile(x, y, tile_size[0], tile_size[1]);
+        tile.crop(bounding_box(result));
+        BBox2i window = tile;
+        window.expand(2);
+        typename ViewT::prerasterize_type in = input.prerasterize(window);
+        for (int row = tile.min().y(); row < tile.max().y(); row++) {
+          for (int col = tile.min().x(); col < tile.max().x(); col++) {
+            float sum = 0;
+            for (int dy = -2; dy <= 2; dy++)
+              for (int dx = -2; dx <= 2; dx++)
+                sum += in(col + dx, row + dy);
+            result(col, row) = sum;
+          }
+        }
+      }
+    }
+    return result;
+  }
+}
+
+TEST( TileBlockCache, StreamedMatchesStaged ) {
+  ImageView<float> image = make_image(100, 200);
+
+  // Staged, with the whole input at hand
+  ImageView<float> staged(image.cols(), image.rows());
+  for (int row = 0; row < image.rows(); row++) {
+    for (int col = 0; col < image.cols(); col++) {
+      float sum = 0;
+      for (int dy = -2; dy <= 2; dy++)
+        for (int dx = -2; dx <= 2; dx++)
+          if (col + dx >= 0 && col + dx < image.cols() &&
+              row + dy >= 0 && row + dy < image.rows())
+            sum += image(col + dx, row + dy);
+      staged(col, row) = sum;
+    }
+  }
+
+  // Streamed through a band of blocks, each of which is computed once
+  Vector2i block_size(16, 16), read_tile_size(24, 24);
+  size_t bytes = band_cache_bytes(Vector2i(image.cols(), image.rows()), block_size,
+                                  read_tile_size, 4, sizeof(float));
+  EXPECT_LT(bytes, image.cols() * image.rows() * sizeof(float));
+  boost::shared_ptr<TileBlockCache<ImageView<float> > >
+    cache(new TileBlockCache<ImageView<float> >(image, block_size, bytes));
+  ImageView<float> streamed = window_sums_by_tile(TileBlockCacheView<ImageView<float> >(cache),
+                                                  read_tile_size);
+  EXPECT_EQ(cache->num_blocks(), cache->misses());
+  for (int row = 0; row < image.rows(); row++)
+    for (int col = 0; col < image.cols(); col++)
+      EXPECT_EQ(staged(col, row), streamed(col, row));
+}
@@ -0,0 +1,83 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <asp/Core/TileManifest.h>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+  TileRecord make_record(int x, boost::uint64_t key, double seconds, double valid) {
+    TileRecord t;
+    t.bbox           = BBox2i(x, 0, 64, 32);
+    t.input_key      = key;
+    t.seconds        = seconds;
+    t.valid_fraction = valid;
+    return t;
+  }
+}
+
+TEST( TileManifest, ReadWrite ) {
+  TileManifest manifest;
+  manifest.settings_key   = 18446744073709551557ULL; // Needs all 64 bits
+  manifest.image_size     = Vector2i(128, 32);
+  manifest.corr_timeout   = 900;
+  manifest.seconds_per_op = 1.25e-9;
+  manifest.add(make_record(0,  12345, 3.5, 0.75));
+  manifest.add(make_record(64, 67890, 0.1, 0));
+
+  UnlinkName file("TestTileManifest-manifest.txt");
+  write_tile_manifest(file, manifest);
+  TileManifest in;
+  ASSERT_TRUE(read_tile_manifest(file, in));
+  EXPECT_EQ(manifest.settings_key,   in.settings_key);
+  EXPECT_EQ(manifest.image_size,     in.image_size);
+  EXPECT_EQ(manifest.corr_timeout,   in.corr_timeout);
+  EXPECT_EQ(manifest.seconds_per_op, in.seconds_per_op);
+  ASSERT_EQ(2u, in.tiles.size());
+  ASSERT_TRUE(in.find(BBox2i(64, 0, 64, 32)) != NULL);
+  TileRecord const* first = in.find(BBox2i(0, 0, 64, 32));
+  ASSERT_TRUE(first != NULL);
+  EXPECT_EQ(12345u, first->input_key);
+  EXPECT_EQ(3.5,    first->seconds);
+  EXPECT_EQ(0.75,   first->valid_fraction);
+  EXPECT_TRUE(in.find(BBox2i(0, 0, 64, 16)) == NULL);
+
+  EXPECT_FALSE(read_tile_manifest("TestTileManifest-missing.txt", in));
+  EXPECT_EQ("dir/run-D-manifest.txt", tile_manifest_file("dir/run-D.tif"));
+}
+
+TEST( TileManifest, Stale ) {
+  TileManifest old_manifest;
+  old_manifest.corr_timeout   = 100;
+  old_manifest.seconds_per_op = 0;
+  old_manifest.add(make_record(0,  1, 10, 0.9)); // Fast
+  old_manifest.add(make_record(64, 2, 80, 0.9)); // Near the timeout
+
+  // Same inputs and timeout
+  EXPECT_FALSE(tile_is_stale(old_manifest, make_record(0,  1, 0, 0), 100, 0));
+  EXPECT_FALSE(tile_is_stale(old_manifest, make_record(64, 2, 0, 0), 100, 0));
+  // Changed inputs, or a tile not seen before
+  EXPECT_TRUE (tile_is_stale(old_manifest, make_record(0,  3, 0, 0), 100, 0));
+  EXPECT_TRUE (tile_is_stale(old_manifest, make_record(32, 1, 0, 0), 100, 0));
+  // A longer timeout redoes only the tile which may have been cut short
+  EXPECT_FALSE(tile_is_stale(old_manifest, make_record(0,  1, 0, 0), 200, 0));
+  EXPECT_TRUE (tile_is_stale(old_manifest, make_record(64, 2, 0, 0), 200, 0));
+  // A much shorter one affects both
+  EXPECT_TRUE (tile_is_stale(old_manifest, make_record(0,  1, 0, 0), 15, 0));
+}
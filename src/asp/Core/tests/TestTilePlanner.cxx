@@ -0,0 +1,200 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <asp/Core/TilePlanner.h>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/core/null_deleter.hpp>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+  // Expensive towards the top-left corner of a 512 x 512 region
+  double corner_cost(BBox2i const& box) {
+    double range = (box.min().x() < 128 && box.min().y() < 128) ? 100 : 1;
+    return predicted_correlation_cost(box, BBox2i(0, 0, range, 0));
+  }
+
+  void add_to(Mutex * mutex, int * total, int value) {
+    Mutex::Lock lock(*mutex);
+    *total += value;
+  }
+}
+
+TEST( TilePlanner, Split ) {
+  BBox2i tile(0, 0, 512, 512);
+  // Cheap enough as a whole
+  EXPECT_EQ(1u, split_tile_by_cost(tile, corner_cost, 1e20, 64).size());
+
+  // Only the expensive corner gets split down to the minimum size
+  double max_cost = predicted_correlation_cost(BBox2i(0, 0, 256, 256), BBox2i(0, 0, 1, 0));
+  std::vector<BBox2i> pieces = split_tile_by_cost(tile, corner_cost, max_cost, 64);
+  ASSERT_EQ(3u + 3u + 4u, pieces.size());
+  int area = 0;
+  for (size_t i = 0; i < pieces.size(); i++) {
+    area += pieces[i].width() * pieces[i].height();
+    EXPECT_TRUE(tile.contains(pieces[i]));
+    if (i > 0) // Row-major
+      EXPECT_TRUE(pieces[i-1].min().y() <  pieces[i].min().y() ||
+                  (pieces[i-1].min().y() == pieces[i].min().y() &&
+                   pieces[i-1].min().x() <  pieces[i].min().x()));
+  }
+  EXPECT_EQ(512*512, area);
+  EXPECT_EQ(BBox2i(0, 0, 64, 64), pieces[0]);
+
+  // Odd sizes are covered exactly
+  pieces = split_tile_by_cost(BBox2i(0, 0, 301, 257), corner_cost, 0, 100);
+  ASSERT_EQ(4u, pieces.size());
+  EXPECT_EQ(BBox2i(150, 128, 151, 129), pieces[3]);
+}
+
+TEST( TilePlanner, Median ) {
+  std::vector<double> costs;
+  EXPECT_EQ(0, median_cost(costs));
+  costs.push_back(5); costs.push_back(1); costs.push_back(100);
+  EXPECT_EQ(5, median_cost(costs));
+}
+
+TEST( TilePlanner, CooperativeQueue ) {
+  CooperativeTaskQueue queue;
+  Mutex mutex;
+  int total = 0;
+  std::vector<CooperativeTaskQueue::TaskFunc> tasks1, tasks2;
+  for (int i = 0; i < 100; i++) {
+    tasks1.push_back(boost::bind(add_to, &mutex, &total, 1));
+    tasks2.push_back(boost::bind(add_to, &mutex, &total, 2));
+  }
+  boost::thread other(boost::bind(&CooperativeTaskQueue::run, &queue, tasks2));
+  queue.run(tasks1);
+  other.join();
+  EXPECT_EQ(300, total);
+}
+
+namespace {
+  void add_slowly(Mutex * mutex, int * total) {
+    boost::this_thread::sleep(boost::posix_time::milliseconds(2));
+    Mutex::Lock lock(*mutex);
+    (*total)++;
+  }
+}
+
+TEST( TilePlanner, CooperativeQueueHelpers ) {
+  // With no other thread waiting, the helpers still take pieces of the batch
+  CooperativeTaskQueue queue(4);
+  Mutex mutex;
+  int total = 0;
+  std::vector<CooperativeTaskQueue::TaskFunc> tasks;
+  for (int i = 0; i < 50; i++)
+    tasks.push_back(boost::bind(add_slowly, &mutex, &total));
+  queue.run(tasks);
+  EXPECT_EQ(50, total);
+  EXPECT_GT(queue.num_stolen(), 0u);
+
+  // A thread which is busy outside the queue is not waited for
+  boost::shared_ptr<CooperativeTaskQueue> shared(new CooperativeTaskQueue(2));
+  {
+    CooperativeTaskQueue::Busy busy(shared);
+    shared->run(tasks);
+  }
+  EXPECT_EQ(100, total);
+}
+
+namespace {
+  void add_or_throw(Mutex * mutex, int * calls, int value) {
+    {
+      Mutex::Lock lock(*mutex);
+      calls[value]++;
+    }
+    if (value == 7)
+      vw_throw(ArgumentErr() << "Task " << value << " failed.");
+  }
+}
+
+TEST( TilePlanner, CooperativeQueueThrows ) {
+  // A task which throws is run once, and its exception reaches run()
+  CooperativeTaskQueue queue(4);
+  Mutex mutex;
+  int calls[20] = {0};
+  std::vector<CooperativeTaskQueue::TaskFunc> tasks;
+  for (int i = 0; i < 20; i++)
+    tasks.push_back(boost::bind(add_or_throw, &mutex, calls, i));
+  try {
+    queue.run(tasks);
+    FAIL() << "The exception of the task did not reach run().";
+  } catch (vw::Exception const& e) {
+    EXPECT_NE(std::string(e.what()).find("Task 7 failed."), std::string::npos);
+  }
+  for (int i = 0; i < 20; i++)
+    EXPECT_EQ(1, calls[i]) << "task " << i;
+}
+
+TEST( TilePlanner, PredictedMemory ) {
+  BBox2i tile(0, 0, 512, 512);
+  size_t narrow = predicted_correlation_memory(tile, BBox2i(0, 0, 10, 2),  Vector2i(21, 21),
+                                               3, false, 0, 0);
+  size_t wide   = predicted_correlation_memory(tile, BBox2i(0, 0, 400, 2), Vector2i(21, 21),
+                                               3, false, 0, 0);
+  EXPECT_GT(narrow, size_t(512*512*5));
+  EXPECT_GT(wide, narrow);
+
+  // The SGM cost volume dominates, up to its limit
+  size_t sgm   = predicted_correlation_memory(tile, BBox2i(0, 0, 400, 2), Vector2i(5, 5),
+                                              3, true, 256, 0);
+  size_t sgm_limited = predicted_correlation_memory(tile, BBox2i(0, 0, 400, 2), Vector2i(5, 5),
+                                                    3, true, 256, 100);
+  EXPECT_GT(sgm, size_t(512) * 512 * 401 * 3);
+  EXPECT_LT(sgm_limited, sgm);
+  EXPECT_GT(sgm_limited, size_t(100) * 1024 * 1024);
+}
+
+namespace {
+  void hold_memory(MemoryBudget * budget, size_t bytes, Mutex * mutex,
+                   size_t * max_seen, size_t * current) {
+    MemoryBudget::Reservation reservation(boost::shared_ptr<MemoryBudget>
+                                          (budget, boost::null_deleter()), bytes);
+    {
+      Mutex::Lock lock(*mutex);
+      *current += bytes;
+      *max_seen = std::max(*max_seen, *current);
+    }
+    boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+    Mutex::Lock lock(*mutex);
+    *current -= bytes;
+  }
+}
+
+TEST( TilePlanner, MemoryBudget ) {
+  MemoryBudget budget(100);
+  Mutex mutex;
+  size_t max_seen = 0, current = 0;
+  std::vector<boost::shared_ptr<boost::thread> > threads;
+  for (int i = 0; i < 8; i++)
+    threads.push_back(boost::shared_ptr<boost::thread>
+      (new boost::thread(boost::bind(hold_memory, &budget, 40, &mutex, &max_seen, &current))));
+  for (size_t i = 0; i < threads.size(); i++)
+    threads[i]->join();
+  EXPECT_LE(max_seen, 80u);
+  EXPECT_LE(budget.peak_bytes(), 100u);
+  EXPECT_GT(budget.num_waits(), 0u);
+
+  // A tile over the budget by itself still gets through
+  budget.acquire(500);
+  budget.release(500);
+  EXPECT_EQ(500u, budget.peak_bytes());
+}
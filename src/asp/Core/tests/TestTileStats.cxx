@@ -0,0 +1,91 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <asp/Core/TileStats.h>
+#include <fstream>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+  TileStats make_stats(int x, int y, double ip_seconds, double corr_seconds) {
+    TileStats s;
+    s.bbox         = BBox2i(x, y, 100, 100);
+    s.ip_seconds   = ip_seconds;
+    s.corr_seconds = corr_seconds;
+    s.num_matches  = 42;
+    s.fit_status   = TILE_FIT_ACCEPTED;
+    return s;
+  }
+
+  std::vector<std::string> read_lines(std::string const& file) {
+    std::vector<std::string> lines;
+    std::ifstream fh(file.c_str());
+    std::string line;
+    while (std::getline(fh, line))
+      lines.push_back(line);
+    return lines;
+  }
+}
+
+TEST( TileStats, Write ) {
+  std::vector<TileStats> stats;
+  stats.push_back(make_stats(0,   0, 1.5, 2));
+  stats.push_back(make_stats(100, 0, 0,   4));
+
+  UnlinkName csv("TestTileStats.csv");
+  write_tile_stats(csv, "csv", stats);
+  std::vector<std::string> lines = read_lines(csv);
+  ASSERT_EQ(3u, lines.size()); // With the header
+  EXPECT_EQ("0, 0, 100, 100, 1.5, 42, accepted, 0, 2, 0, 0", lines[1]);
+
+  UnlinkName json("TestTileStats.json");
+  write_tile_stats(json, "json", stats);
+  lines = read_lines(json);
+  ASSERT_EQ(4u, lines.size());
+  EXPECT_EQ("[", lines[0]);
+  EXPECT_NE(std::string::npos, lines[1].find("\"fit_status\": \"accepted\""));
+  EXPECT_EQ(',', lines[1][lines[1].size() - 1]);
+  EXPECT_EQ('}', lines[2][lines[2].size() - 1]);
+  EXPECT_EQ("]", lines[3]);
+
+  EXPECT_THROW(write_tile_stats(csv, "xml", stats), ArgumentErr);
+}
+
+TEST( TileStats, Heatmap ) {
+  // A 250 x 150 region starting at (100, 50), the last tiles are partial
+  std::vector<TileStats> stats;
+  stats.push_back(make_stats(100, 50,  1, 2));
+  stats.push_back(make_stats(300, 150, 0, 5));
+  stats.push_back(make_stats(0,   0,   9, 9)); // Outside the region
+  ImageView<float> heatmap = tile_stats_heatmap(stats, BBox2i(100, 50, 250, 150),
+                                                Vector2i(100, 100), -1);
+  ASSERT_EQ(3, heatmap.cols());
+  ASSERT_EQ(2, heatmap.rows());
+  EXPECT_EQ(3,  heatmap(0, 0));
+  EXPECT_EQ(5,  heatmap(2, 1));
+  EXPECT_EQ(-1, heatmap(1, 0));
+  EXPECT_EQ(-1, heatmap(0, 1));
+}
+
+TEST( TileStats, StatusNames ) {
+  EXPECT_EQ("none",     tile_fit_status_name(TILE_FIT_NONE));
+  EXPECT_EQ("rejected", tile_fit_status_name(TILE_FIT_REJECTED));
+  EXPECT_EQ("cached",   tile_fit_status_name(TILE_FIT_CACHED));
+  EXPECT_GE(max_resident_memory_mb(), 0);
+}
@@ -0,0 +1,152 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <vw/Image/ImageView.h>
+#include <asp/Core/TiledBlobIndex.h>
+
+#include <cstdlib>
+#include <map>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+
+  // Specks, and long snakes which cross many tile seams
+  ImageView<uint8> make_mask(int cols, int rows) {
+    ImageView<uint8> mask(cols, rows);
+    for (int row = 0; row < rows; row++)
+      for (int col = 0; col < cols; col++)
+        mask(col, row) = (rand() % 3 == 0) || (row % 6 == 0 && col % 17 != 3) ||
+          (col % 9 == 0 && row % 13 != 5);
+    return mask;
+  }
+
+  ImageView<uint8> crop_mask(ImageView<uint8> const& mask, BBox2i const& box) {
+    ImageView<uint8> out(box.width(), box.height());
+    for (int row = 0; row < box.height(); row++)
+      for (int col = 0; col < box.width(); col++)
+        out(col, row) = mask(col + box.min().x(), row + box.min().y());
+    return out;
+  }
+}
+
+TEST( TiledBlobIndex, LabelComponents ) {
+  ImageView<uint8> mask(5, 3);
+  // 1 0 1 0 0
+  // 0 1 1 0 1
+  // 1 0 0 0 1
+  mask(0, 0) = mask(2, 0) = mask(1, 1) = mask(2, 1) = mask(4, 1) = mask(0, 2) = mask(4, 2) = 1;
+
+  ImageView<int32> labels;
+  EXPECT_EQ(label_components(mask, false, labels), 4);
+  EXPECT_EQ(labels(0, 0), 0);
+  EXPECT_EQ(labels(2, 0), 1);
+  EXPECT_EQ(labels(1, 1), 1);
+  EXPECT_EQ(labels(4, 1), 2);
+  EXPECT_EQ(labels(0, 2), 3);
+  EXPECT_EQ(labels(1, 0), -1);
+
+  // Diagonal neighbors join everything on the left
+  EXPECT_EQ(label_components(mask, true, labels), 2);
+  EXPECT_EQ(labels(0, 0), 0);
+  EXPECT_EQ(labels(0, 2), 0);
+  EXPECT_EQ(labels(4, 2), 1);
+}
+
+TEST( TiledBlobIndex, MatchesWholeImage ) {
+  srand(3);
+  const int cols = 61, rows = 47;
+  ImageView<uint8> mask = make_mask(cols, rows);
+
+  int tile_sizes[] = {1, 4, 16, 61, 100};
+  for (int eight = 0; eight < 2; eight++) {
+    ImageView<int32> expected;
+    int num_expected = label_components(mask, eight, expected);
+    std::vector<size_t> expected_sizes(num_expected, 0);
+    for (int row = 0; row < rows; row++)
+      for (int col = 0; col < cols; col++)
+        if (expected(col, row) >= 0)
+          expected_sizes[expected(col, row)]++;
+
+    for (size_t s = 0; s < sizeof(tile_sizes)/sizeof(tile_sizes[0]); s++) {
+      TiledBlobIndex index(Vector2i(cols, rows), tile_sizes[s], eight);
+      // In any order, as the tiles would come from the threads
+      for (size_t t = index.tiles().size(); t-- > 0; )
+        index.add_tile(t, crop_mask(mask, index.tiles()[t]));
+      index.merge();
+      ASSERT_EQ(index.num_blobs(), size_t(num_expected)) << "tile size " << tile_sizes[s];
+
+      // The blobs must be the same sets of pixels as the whole image labels
+      std::map<int32, int32> blob_of_label;
+      for (size_t t = 0; t < index.tiles().size(); t++) {
+        BBox2i box = index.tiles()[t];
+        ImageView<int32> blobs;
+        ASSERT_TRUE(index.tile_blobs(t, crop_mask(mask, box), blobs));
+        for (int row = 0; row < box.height(); row++) {
+          for (int col = 0; col < box.width(); col++) {
+            int32 label = expected(col + box.min().x(), row + box.min().y());
+            int32 blob  = blobs(col, row);
+            ASSERT_EQ(label < 0, blob < 0);
+            if (label < 0)
+              continue;
+            if (blob_of_label.count(label) == 0)
+              blob_of_label[label] = blob;
+            ASSERT_EQ(blob_of_label[label], blob);
+            ASSERT_EQ(index.blob_size(blob), expected_sizes[label]);
+            BBox2i bbox = index.blob_bbox(blob);
+            EXPECT_TRUE(bbox.contains(BBox2i(col + box.min().x(), row + box.min().y(), 1, 1)));
+          }
+        }
+      }
+      EXPECT_EQ(blob_of_label.size(), size_t(num_expected));
+      EXPECT_EQ(index.tile_index(cols - 1, rows - 1), index.tiles().size() - 1);
+    }
+  }
+}
+
+TEST( TiledBlobIndex, ChangedMask ) {
+  const int cols = 8, rows = 4;
+  ImageView<uint8> mask(cols, rows);
+  for (int row = 0; row < rows; row++)
+    for (int col = 0; col < cols; col++)
+      mask(col, row) = (col == 1 || col == 5);
+
+  TiledBlobIndex index(Vector2i(cols, rows), 4, true);
+  for (size_t t = 0; t < index.tiles().size(); t++)
+    index.add_tile(t, crop_mask(mask, index.tiles()[t]));
+  index.merge();
+
+  // A pixel more gives the same number of components but not the same
+  // sizes, so nothing in the tile is taken for a known blob
+  ImageView<int32> blobs;
+  mask(2, 0) = 1;
+  EXPECT_FALSE(index.tile_blobs(0, crop_mask(mask, index.tiles()[0]), blobs));
+  ASSERT_EQ(blobs.cols(), 4);
+  for (int row = 0; row < blobs.rows(); row++)
+    for (int col = 0; col < blobs.cols(); col++)
+      EXPECT_EQ(blobs(col, row), -1);
+
+  // A component more
+  mask(3, 3) = 1;
+  EXPECT_FALSE(index.tile_blobs(0, crop_mask(mask, index.tiles()[0]), blobs));
+
+  // The other tile is still fine
+  EXPECT_TRUE(index.tile_blobs(1, crop_mask(mask, index.tiles()[1]), blobs));
+  EXPECT_EQ(blobs(1, 0), 1);
+}
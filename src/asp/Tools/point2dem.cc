@@ -97,6 +97,7 @@ struct Options : vw::cartography::GdalWriteOptions {
   bool        use_surface_sampling;
   bool        has_las_or_csv;
   Vector2i    max_output_size;
+  int         multi_spacing_memory_mb;
 
   // Output
   std::string out_prefix, output_file_type;
@@ -399,6 +400,8 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
 	    "Outlier removal based on threshold. Points with triangulation error larger than this (in meters) will be removed from the cloud.")
     ("max-output-size",          po::value(&opt.max_output_size)->default_value(Vector2(9999999, 9999999)),
 	    "Don't write the output DEM if it is calculated to be this size or greater.")
+    ("multi-spacing-memory-mb",  po::value(&opt.multi_spacing_memory_mb)->default_value(1024),
+	    "With several DEM spacings, the most memory, in MB, for the DEMs at the coarser spacings found together with the finest one. Those which do not fit are rasterized on their own. Set to 0 to rasterize each spacing on its own.")
     ("median-filter-params",          po::value(&opt.median_filter_params)->default_value(Vector2(0, 0),
 	    "window_size threshold"), "If the point cloud height at the current point differs by more than the given threshold from the median of heights in the window of given size centered at the point, remove it as an outlier. Use for example 11 and 40.0.")
     ("erode-length",   po::value<int>(&opt.erode_len)->default_value(0),
@@ -458,6 +461,11 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
 			    << usage << general_options );
   }
 
+  if (opt.multi_spacing_memory_mb < 0){
+    vw_throw( ArgumentErr() << "The value of --multi-spacing-memory-mb must be non-negative.\n"
+			    << usage << general_options );
+  }
+
   if ( (dem_spacing1.size() > 0) && (dem_spacing2.size() > 0) ){
     vw_throw( ArgumentErr() << "The DEM spacing was specified twice.\n"
 			    << usage << general_options );
@@ -878,13 +886,15 @@ namespace asp{
 
 
 
-/// Do more work!
+/// Do more work! If the DEM at this spacing was already found, as a
+/// companion of another one, it is written out rather than rasterized.
 void do_software_rasterization( asp::OrthoRasterizerView& rasterizer,
                                 Options& opt,
                                 cartography::GeoReference& georef,
                                 ImageViewRef<double> const& error_image,
                                 double estim_max_error,
-                                size_t *num_invalid_pixels) {
+                                size_t *num_invalid_pixels,
+                                ImageView<float> const* precomputed_dem = NULL) {
 
   vw_out() << "\t-- Starting DEM rasterization --\n";
   vw_out() << "\t--> DEM spacing: " <<     rasterizer.spacing() << " pt/px\n";
@@ -933,7 +943,20 @@ void do_software_rasterization( asp::OrthoRasterizerView& rasterizer,
   // rather than filling holes in the cloud first. This is faster.
   rasterizer.set_hole_fill_len(0);
 
-  ImageViewRef< PixelGray<float> > rasterizer_fsaa = generate_fsaa_raster( rasterizer, opt );
+  ImageViewRef< PixelGray<float> > rasterizer_fsaa;
+  if (precomputed_dem) {
+    rasterizer_fsaa = pixel_cast< PixelGray<float> >(*precomputed_dem);
+    // The tiles that found it counted the holes of another DEM.
+    // Compare as they do, so the count is that of its own pass.
+    double fill_value = rasterizer.fill_value();
+    *num_invalid_pixels = 0;
+    for (int row = 0; row < precomputed_dem->rows(); row++)
+      for (int col = 0; col < precomputed_dem->cols(); col++)
+        if (double((*precomputed_dem)(col, row)) == fill_value)
+          (*num_invalid_pixels)++;
+  } else {
+    rasterizer_fsaa = generate_fsaa_raster( rasterizer, opt );
+  }
 
   // Write out the DEM. We've set the texture to be the height.
   Vector2 tile_size(vw_settings().default_tile_size(),
@@ -1086,19 +1109,82 @@ void do_software_rasterization_multi_spacing( const ImageViewRef<Vector3>& proj_
 
   std::string base_out_prefix = opt.out_prefix;
 
+  // With several spacings, the DEMs at the coarser ones can be found
+  // from the points read for the finest one, rather than reading the
+  // cloud again for each. They are kept in memory until written, as
+  // many as fit in the memory given for them, the smallest first. The
+  // others are rasterized on their own.
+  bool one_pass = (opt.dem_spacing.size() > 1 && !opt.use_surface_sampling &&
+                   opt.fsaa <= 1 && !opt.no_dem && opt.multi_spacing_memory_mb > 0);
+  std::vector<size_t> order;
+  for (size_t i=0; i<opt.dem_spacing.size(); ++i)
+    order.push_back(i);
+  size_t num_companions = 0;
+  if (one_pass) {
+    // The spacing of 0 is resolved by the rasterizer
+    size_t finest = 0;
+    double finest_spacing = std::numeric_limits<double>::max();
+    std::vector< std::pair<double, size_t> > coarser; // Bytes, spacing index
+    for (size_t i=0; i<opt.dem_spacing.size(); ++i) {
+      rasterizer.initialize_spacing(opt.dem_spacing[i]);
+      // The heights, and which of them are found
+      double bytes = double(rasterizer.cols())*double(rasterizer.rows())
+        *(sizeof(float) + sizeof(uint8));
+      coarser.push_back(std::make_pair(bytes, i));
+      if (rasterizer.spacing() < finest_spacing) {
+        finest_spacing = rasterizer.spacing();
+        finest = i;
+      }
+    }
+    coarser.erase(coarser.begin() + finest);
+    std::sort(coarser.begin(), coarser.end());
+
+    double budget = double(opt.multi_spacing_memory_mb)*1024*1024, used = 0;
+    std::vector<size_t> separate;
+    order.assign(1, finest);
+    for (size_t j=0; j<coarser.size(); ++j) {
+      if (used + coarser[j].first <= budget) {
+        used += coarser[j].first;
+        order.push_back(coarser[j].second);
+      } else {
+        separate.push_back(coarser[j].second);
+      }
+    }
+    num_companions = order.size() - 1;
+    order.insert(order.end(), separate.begin(), separate.end());
+    if (!separate.empty())
+      vw_out() << "The DEMs at " << separate.size() << " of the spacings do not fit in "
+               << "--multi-spacing-memory-mb with the others, so each of them takes "
+               << "its own pass over the cloud.\n";
+  }
+
   // Call the function for each dem spacing
-  for (size_t i=0; i<opt.dem_spacing.size(); ++i) {
+  for (size_t k=0; k<order.size(); ++k) {
+    size_t i = order[k];
     double this_spacing = opt.dem_spacing[i];
 
     // Required second init step for each spacing
     rasterizer.initialize_spacing(this_spacing);
 
+    ImageView<float> const* precomputed_dem = NULL;
+    if (k == 0 && num_companions > 0) {
+      std::vector<double> companions;
+      for (size_t j=1; j<=num_companions; ++j)
+        companions.push_back(opt.dem_spacing[order[j]]);
+      rasterizer.set_companion_spacings(companions);
+    } else if (k >= 1 && k <= num_companions) {
+      precomputed_dem = &rasterizer.companion_dem(k-1);
+    }
+
     // Each spacing gets a variation of the output prefix
     if (i == 0)
       opt.out_prefix = base_out_prefix;
     else // Write later iterations to a different path!!
       opt.out_prefix = base_out_prefix + "_" + vw::num_to_str(i);
-    do_software_rasterization( rasterizer, opt, georef, error_image, estim_max_error, &num_invalid_pixels);
+    do_software_rasterization( rasterizer, opt, georef, error_image, estim_max_error,
+                               &num_invalid_pixels, precomputed_dem);
+    if (precomputed_dem)
+      rasterizer.release_companion_dem(k-1);
   } // End loop through spacings
 
   opt.out_prefix = base_out_prefix; // Restore the original value
@@ -490,7 +490,8 @@ namespace asp {
 
     bool using_sgm = (stereo_settings().stereo_algorithm > vw::stereo::CORRELATION_WINDOW);
     if (using_sgm) {
-      if (stereo_settings().subpixel_mode < 6) {
+      // Mode 12 is the converging affine mode, which is not for SGM
+      if (stereo_settings().subpixel_mode < 6 || stereo_settings().subpixel_mode == 12) {
         vw_out() << "SGM subpixel mode not specified, using the default subpixel method.\n";
         stereo_settings().subpixel_mode = 0; // Make sure stereo_rfne does not do anything
       }
@@ -35,6 +35,8 @@
 // blend the results.
 
 #include <asp/Tools/stereo.h>
+#include <asp/Core/CenterlineWeights.h>
+#include <asp/Core/DisparityBlend.h>
 #include <vw/Stereo/DisparityMap.h>
 #include <boost/filesystem.hpp>
 
@@ -256,50 +258,46 @@ bool get_roi_from_tile(std::string const& tile_path, Position pos,
 }
 
 /// Load the desired portion of a disparity tile and associated image weights.
+/// - Only the ROI is read, plus, for each row and column crossing it, as
+///   much of the tile as it takes to find where its valid pixels start and end.
 bool load_image_and_weights(std::string const& file_path, BBox2i const& roi,
                             DispImageType & image, WeightsType & weights) {
   // Verify image exists
   if (file_path == "")
     return false;
     
-  // Load the image from disk
-  DispImageType full_image = DiskImageType(file_path);
-  
-  // Compute the desired weights
-  centerline_weights(full_image, weights, roi);
-  
-  // Extract the desired portion of the full image
-  image = crop(full_image, roi);
+  centerline_weights_in_roi(DiskImageType(file_path), roi, image, weights);
   
   return true;
 }
 
-/// Perform the blending
-void blend_tile_region(DispImageType      & main_image, WeightsType      & main_weights,
-                       BBox2i const& main_roi,
-                       DispImageType const& neighbor,   WeightsType const& neighbor_weights,
-                       BBox2i const& neighbor_roi) {
-
-  // Multiply-accumulate the image values, then accumulate the weights.
-  // Careful when dealing with no-data values.
-  DispImageType cropped_image   = crop(main_image,   main_roi);
-  WeightsType   cropped_weights = crop(main_weights, main_roi);
-
-  for (int col = 0; col < neighbor.cols(); col++) {
-    for (int row = 0; row < neighbor.rows(); row++) {
-      
-      if (!is_valid(neighbor(col, row)) || neighbor_weights(col, row) <= 0) continue;
-
-      // If there was no data before, there will be data now
-      cropped_image(col, row).validate();
-      cropped_image(col, row) += neighbor(col, row) * neighbor_weights(col, row);
-      cropped_weights(col, row) += neighbor_weights(col, row);
+/// Split a disparity image into planes, for the blending kernel.
+template <class ViewT>
+DisparityPlanes disparity_planes(ImageViewBase<ViewT> const& view) {
+  ViewT const& image = view.impl();
+  DisparityPlanes planes(image.cols(), image.rows());
+  for (int row = 0; row < image.rows(); row++) {
+    for (int col = 0; col < image.cols(); col++) {
+      typename ViewT::pixel_type pix = image(col, row);
+      size_t k = planes.index(col, row);
+      planes.dx[k]    = pix.child()[0];
+      planes.dy[k]    = pix.child()[1];
+      planes.valid[k] = is_valid(pix);
     }
   }
+  return planes;
+}
 
-  // Put the modified portion backs into the larger images
-  crop(main_image,   main_roi) = cropped_image;
-  crop(main_weights, main_roi) = cropped_weights;
+/// Put the planes back together into a disparity image of the same size.
+void copy_disparity_planes(DisparityPlanes const& planes, DispImageType & image) {
+  for (int row = 0; row < image.rows(); row++) {
+    for (int col = 0; col < image.cols(); col++) {
+      size_t k = planes.index(col, row);
+      image(col, row) = PixelMask<Vector2f>(Vector2f(planes.dx[k], planes.dy[k]));
+      if (!planes.valid[k])
+        image(col, row).invalidate();
+    }
+  }
 }
 
 struct BlendOptions {
@@ -380,9 +378,13 @@ tile_blend( DispImageType const& input_image,
   // - This sets the non-blended portion of the image.
   DispImageType output_image = crop(input_image, output_bbox);
 
-  // Compute weights for the main tile
+  // Compute weights for the main tile. These must be found the same
+  // way as for the neighbors, or else the blend would be biased.
   WeightsType main_weights;
-  centerline_weights(input_image, main_weights, output_bbox);
+  CenterlineExtents main_extents;
+  centerline_extents(input_image, output_bbox, std::max(input_image.cols(), input_image.rows()),
+                     main_extents);
+  centerline_weights_from_extents(main_extents, output_image, main_weights);
 
   if (debug) {
     write_image("main_image.tif", output_image);
@@ -434,15 +436,19 @@ tile_blend( DispImageType const& input_image,
   
   vw_out() << "Performing blending...\n";
 
-  // Blend in the neighbors one section at a time.
+  // Blend in the neighbors one section at a time, multiply-accumulating
+  // the values and accumulating the weights.
+  SimdLevel simd_level = detect_simd_level();
+  DisparityPlanes output_planes = disparity_planes(output_image);
   for (size_t i=0; i<NUM_NEIGHBORS; ++i) {
     if (opt.tile_paths[i] == "") // Check tile validity
       continue;
     // We discard the neighboring tile mask here because the weights will take 
     //  care of those pixels and we don't want to OR in the mask of the neighbor.
-    blend_tile_region(output_image,             main_weights, input_rois[i],
-                      validate_mask(images[i]), weights[i],   tile_rois[i]);
+    blend_disparity_region(simd_level, output_planes, main_weights, input_rois[i],
+                           disparity_planes(validate_mask(images[i])), weights[i]);
   }
+  copy_disparity_planes(output_planes, output_image);
 
   vw_out() << "Postmultiply...\n";
   
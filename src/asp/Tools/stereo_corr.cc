@@ -20,6 +20,9 @@
 ///
 
 #include <boost/core/null_deleter.hpp>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <vw/Core/Stopwatch.h>
 #include <vw/InterestPoint.h>
 #include <vw/Camera/CameraTransform.h>
 #include <vw/Camera/PinholeModel.h>
@@ -29,8 +32,13 @@
 #include <vw/Stereo/CostFunctions.h>
 #include <vw/Stereo/DisparityMap.h>
 #include <asp/Tools/stereo.h>
+#include <asp/Tools/stereo_stream.h>
 #include <asp/Core/DemDisparity.h>
 #include <asp/Core/LocalHomography.h>
+#include <asp/Core/TileBlockCache.h>
+#include <asp/Core/TileManifest.h>
+#include <asp/Core/TileStats.h>
+#include <asp/Core/TilePlanner.h>
 #include <asp/Sessions/StereoSession.h>
 #include <asp/Sessions/StereoSessionPinhole.h>
 #include <xercesc/util/PlatformUtils.hpp>
@@ -64,6 +72,12 @@ bool homography_ip_matching1( vw::ImageViewBase<Image1T> const& image1,
 			       			  double nodata2 = std::numeric_limits<double>::quiet_NaN(),
 			       			  std::vector<ip::InterestPoint>& final_ip1 = NULL,
  			       			  std::vector<ip::InterestPoint>& final_ip2 = NULL );
+bool homography_ip_filter1( std::vector<ip::InterestPoint> const& matched_ip1,
+			    std::vector<ip::InterestPoint> const& matched_ip2,
+			    std::string const& output_name,
+			    int inlier_threshold,
+			    std::vector<ip::InterestPoint>& final_ip1,
+			    std::vector<ip::InterestPoint>& final_ip2 );
 Vector2i homography_rectification1( bool adjust_left_image_size,
 			    					Vector2i const& left_size,
 			    					Vector2i const& right_size,
@@ -115,7 +129,12 @@ BBox2f piecewiseAlignment_affineepipolar( ImageView<float> tile_left_image,
 										  Vector2i& right_size,
 										  vw::Matrix<double>& left_matrix,
 										  vw::Matrix<double>& right_matrix,
-										  BBox2f local_search_range);
+										  BBox2f local_search_range,
+										  std::vector<ip::InterestPoint> const& seed_ip1,
+										  std::vector<ip::InterestPoint> const& seed_ip2,
+										  std::vector<ip::InterestPoint>& matchedRANSAC_ip1,
+										  std::vector<ip::InterestPoint>& matchedRANSAC_ip2,
+										  TileStats * stats = NULL);
 
 /// Returns the properly cast cost mode type
 stereo::CostFunctionType get_cost_mode_value() {
@@ -435,25 +454,25 @@ std::string strip_path(std::string out_prefix, std::string filename){
   return filename;
 }
 
-/// Detect IP in the _sub images or the original images if they are not too large.
-/// - Usually an IP file is written in stereo_pprc, but for some input scenarios
-///   this function will need to be used to generate them here.
-/// - The input match file path can be changed depending on what exists on disk.
-/// - Returns the scale from the image used for IP to the full size image.
-/// - The binary interest point file will be written to disk.
-double compute_ip(ASPGlobalOptions & opt, std::string & match_filename) {
-
-  vw_out() << "\t    * Loading images for IP detection.\n";
-
-  // Choose whether to use the full or _sub images
+/// Whether IP for this run are found on the full size images rather than on the
+/// _sub images. Other alignment methods find IP in the stereo_pprc phase using
+/// the full size.
+bool use_full_size_for_ip(ASPGlobalOptions const& opt) {
 
   // Use the full image if all dimensions are smaller than this.
   const int SIZE_CUTOFF = 8000;
 
-  const std::string left_image_path_full  = opt.out_prefix+"-L.tif";
-  const std::string right_image_path_full = opt.out_prefix+"-R.tif";
-  const std::string left_image_path_sub   = opt.out_prefix+"-L_sub.tif";
-  const std::string right_image_path_sub  = opt.out_prefix+"-R_sub.tif";
+  Vector2i full_size = file_image_size(opt.out_prefix+"-L.tif");
+  return (((full_size[0] < SIZE_CUTOFF) && (full_size[1] < SIZE_CUTOFF))
+          || ((stereo_settings().alignment_method != "epipolar") &&
+              (stereo_settings().alignment_method != "none"    )   ));
+}
+
+/// Find the match file for this run, if it was already created.
+/// - Sets match_filename to the file found, or else to the file compute_ip() will write.
+/// - Sets ip_scale to the scale from the image used for IP to the full size image.
+bool find_existing_ip(ASPGlobalOptions const& opt, std::string & match_filename,
+                      double & ip_scale) {
 
   // TODO: Just call the right function everywhere rather than computing its result by hand.
   const std::string full_match_file       = ip::match_filename(opt.out_prefix, opt.in_file1, opt.in_file2);
@@ -466,11 +485,13 @@ double compute_ip(ASPGlobalOptions & opt, std::string & match_filename) {
   // need processing. Check if the desired file exists, and read that
   // one, or create it if missing.
   
+  ip_scale = 1.0;
+
   // Try the full match file first
   if (fs::exists(full_match_file)) {
     vw_out() << "IP file found: " << full_match_file << std::endl;
     match_filename = full_match_file;
-    return 1.0;
+    return true;
   }
 
   // TODO: Unify with function in vw/src/InterestPoint/Matcher.h!
@@ -492,40 +513,53 @@ double compute_ip(ASPGlobalOptions & opt, std::string & match_filename) {
     if (fs::exists(match_names[i])) {
       vw_out() << "IP file found: " << match_names[i] << std::endl;
       match_filename = match_names[i];
-      return 1.0;
+      return true;
     }
   }
 
   // Now try the sub match file, which requires us to compute the scale.
-  std::string left_image_path  = left_image_path_full;
-  std::string right_image_path = right_image_path_full;
-  Vector2i full_size     = file_image_size(left_image_path_full);
-  bool     use_full_size = (((full_size[0] < SIZE_CUTOFF) && (full_size[1] < SIZE_CUTOFF))
-                            || ((stereo_settings().alignment_method != "epipolar") &&
-                                (stereo_settings().alignment_method != "none"    )   ));
-  // Other alignment methods find IP in the stereo_pprc phase using the full size.
-
-  // Compute the scale.
+  if (use_full_size_for_ip(opt)) {
+    match_filename = aligned_match_file;
+    return false;
+  }
+
+  ip_scale = sum(elem_quot( Vector2(file_image_size( opt.out_prefix+"-L_sub.tif" )),
+                            Vector2(file_image_size( opt.out_prefix+"-L.tif" ) ) )) +
+             sum(elem_quot( Vector2(file_image_size( opt.out_prefix+"-R_sub.tif" )),
+                            Vector2(file_image_size( opt.out_prefix+"-R.tif" ) ) ));
+  ip_scale /= 4.0f;
+  match_filename = sub_match_file; // If not using full size we should expect this file
+    
+  // Check for the file.
+  if (fs::exists(sub_match_file)) {
+    vw_out() << "IP file found: " << sub_match_file << std::endl;
+    return true;
+  }
+  return false;
+}
+
+/// Detect IP in the _sub images or the original images if they are not too large.
+/// - Usually an IP file is written in stereo_pprc, but for some input scenarios
+///   this function will need to be used to generate them here.
+/// - The input match file path can be changed depending on what exists on disk.
+/// - Returns the scale from the image used for IP to the full size image.
+/// - The binary interest point file will be written to disk.
+double compute_ip(ASPGlobalOptions & opt, std::string & match_filename) {
+
+  vw_out() << "\t    * Loading images for IP detection.\n";
+
   double ip_scale = 1.0;
+  if (find_existing_ip(opt, match_filename, ip_scale))
+    return ip_scale;
+
+  // Choose whether to use the full or _sub images
+  bool use_full_size = use_full_size_for_ip(opt);
+  std::string left_image_path  = opt.out_prefix+"-L.tif";
+  std::string right_image_path = opt.out_prefix+"-R.tif";
   if (!use_full_size) {
-    left_image_path  = left_image_path_sub;
-    right_image_path = right_image_path_sub;
-    
-    ip_scale = sum(elem_quot( Vector2(file_image_size( opt.out_prefix+"-L_sub.tif" )),
-                              Vector2(file_image_size( opt.out_prefix+"-L.tif" ) ) )) +
-               sum(elem_quot( Vector2(file_image_size( opt.out_prefix+"-R_sub.tif" )),
-                              Vector2(file_image_size( opt.out_prefix+"-R.tif" ) ) ));
-    ip_scale /= 4.0f;
-    match_filename = sub_match_file; // If not using full size we should expect this file
-    
-    // Check for the file.
-    if (fs::exists(sub_match_file)) {
-      vw_out() << "IP file found: " << sub_match_file << std::endl;
-      return ip_scale;
-    }
+    left_image_path  = opt.out_prefix+"-L_sub.tif";
+    right_image_path = opt.out_prefix+"-R_sub.tif";
   }
-  else
-    match_filename = aligned_match_file;
 
   vw_out() << "No IP file found, computing IP now.\n";
   
@@ -597,6 +631,40 @@ double compute_ip(ASPGlobalOptions & opt, std::string & match_filename) {
   return ip_scale;
 }
 
+/// Load the matches between the whole left and right images, if a match file
+/// was made already, in the coordinates of the full size L.tif and R.tif.
+/// Returns false if there is no match file.
+bool load_global_matches(ASPGlobalOptions const& opt,
+                         vector<ip::InterestPoint> & ip1,
+                         vector<ip::InterestPoint> & ip2) {
+
+  std::string match_filename;
+  double ip_scale = 1.0;
+  if (!find_existing_ip(opt, match_filename, ip_scale))
+    return false;
+
+  vw_out() << "\t    * Loading match file: " << match_filename << "\n";
+  ip::read_binary_match_file(match_filename, ip1, ip2);
+
+  // Matches between the input images still need the alignment applied.
+  // Those between L and R, or L_sub and R_sub, need at most a scale.
+  if ( (match_filename != opt.out_prefix + "-L__R.match") &&
+       (match_filename != opt.out_prefix + "-L_sub__R_sub.match") ) {
+    ip_scale = adjust_ip_for_align_matrix(opt.out_prefix, ip1, ip2, ip_scale);
+    adjust_ip_for_epipolar_transform(opt, match_filename, ip1, ip2);
+  }
+
+  if (ip_scale != 1.0) {
+    for (size_t i = 0; i < ip1.size(); i++) {
+      ip1[i].x /= ip_scale;  ip1[i].y /= ip_scale;
+      ip2[i].x /= ip_scale;  ip2[i].y /= ip_scale;
+      ip1[i].ix = ip1[i].x;  ip1[i].iy = ip1[i].y;
+      ip2[i].ix = ip2[i].x;  ip2[i].iy = ip2[i].y;
+    }
+  }
+  return true;
+}
+
 
 
 
@@ -949,6 +1017,272 @@ void lowres_correlation( ASPGlobalOptions & opt ) {
 
 
 
+/// Run the piecewise affine epipolar alignment of a tile, or fetch its
+/// result from the on-disk cache if the tile pixels, the input search
+/// range, the seed matches and the IP settings did not change since it was computed.
+/// - An empty cache_dir disables the cache.
+/// - The seed matches, in tile coordinates, are used instead of detecting
+///   interest points if there are enough of them.
+BBox2f cached_piecewise_alignment(std::string const& cache_dir,
+                                  ImageView<PixelGray<float> > const& tile_left_image,
+                                  ImageView<PixelGray<float> > const& tile_right_image,
+                                  BBox2i const& bbox, BBox2i const& expanded_bbox,
+                                  Vector2i & left_size, Vector2i & right_size,
+                                  Matrix<double> & left_matrix, Matrix<double> & right_matrix,
+                                  BBox2f const& local_search_range,
+                                  std::vector<ip::InterestPoint> const& seed_ip1,
+                                  std::vector<ip::InterestPoint> const& seed_ip2,
+                                  TileStats * stats = NULL) {
+
+  std::vector<ip::InterestPoint> inlier_ip1, inlier_ip2;
+  if (cache_dir.empty())
+    return piecewiseAlignment_affineepipolar(tile_left_image, tile_right_image, bbox,
+                                             left_size, right_size, left_matrix, right_matrix,
+                                             local_search_range, seed_ip1, seed_ip2,
+                                             inlier_ip1, inlier_ip2, stats);
+
+  std::string cache_file = tile_alignment_file(cache_dir, bbox);
+  boost::uint64_t key = tile_alignment_key(bbox, expanded_bbox,
+                                           tile_checksum(tile_left_image),
+                                           tile_checksum(tile_right_image),
+                                           local_search_range,
+                                           matches_checksum(seed_ip1, seed_ip2));
+  TileAlignment alignment;
+  if (read_tile_alignment(cache_file, key, alignment)) {
+    VW_OUT(DebugMessage, "stereo") << "Using cached alignment for tile " << bbox << "\n";
+    left_size    = alignment.aligned_size;
+    left_matrix  = alignment.left_matrix;
+    right_matrix = alignment.right_matrix;
+    if (stats) {
+      stats->fit_status  = alignment.fit_status;
+      stats->num_matches = alignment.num_matches;
+    }
+    return alignment.search_range;
+  }
+
+  // The outcome of the fit is cached too, so it is needed even if the
+  // caller does not want it.
+  TileStats local_stats;
+  TileStats * fit_stats = stats ? stats : &local_stats;
+  BBox2f search_range
+    = piecewiseAlignment_affineepipolar(tile_left_image, tile_right_image, bbox,
+                                        left_size, right_size, left_matrix, right_matrix,
+                                        local_search_range, seed_ip1, seed_ip2,
+                                        inlier_ip1, inlier_ip2, fit_stats);
+
+  alignment.key          = key;
+  alignment.aligned_size = left_size;
+  alignment.left_matrix  = left_matrix;
+  alignment.right_matrix = right_matrix;
+  alignment.search_range = search_range;
+  alignment.left_ip      = inlier_ip1;
+  alignment.right_ip     = inlier_ip2;
+  alignment.fit_status   = fit_stats->fit_status;
+  alignment.num_matches  = fit_stats->num_matches;
+  try {
+    write_tile_alignment(cache_file, alignment);
+  } catch (std::exception const& e) {
+    // A failure to cache is not a reason to fail the correlation
+    vw_out(WarningMessage) << "Could not cache the alignment of tile " << bbox
+                           << ": " << e.what() << "\n";
+  }
+
+  return search_range;
+}
+
+
+/// Crop a region of an image, through the block cache if there is one.
+template <class ViewT>
+ImageView<typename ViewT::pixel_type>
+crop_through_cache(boost::shared_ptr<TileBlockCache<ViewT> > const& cache,
+                   ViewT const& image, BBox2i const& box) {
+  if (cache)
+    return cache->crop(box);
+  return crop(image, box);
+}
+
+/// The piecewise alignment of a correlation tile, together with the
+/// tile images warped by it, ready to be correlated.
+struct AlignedTile {
+  BBox2i expanded_bbox;    // The tile grown by the alignment margin
+  int    margin;
+  BBox2f search_range;     // Search range in the aligned tiles
+  Matrix<double> left_matrix, right_matrix;
+  Vector2i aligned_size;
+  ImageView<PixelGray<float> > left_img,  right_img;
+  ImageView<vw::uint8>         left_mask, right_mask;
+  TileStats stats;         // Of the interest point matching and the fit
+};
+
+/// Computes the piecewise alignment of correlation tiles on its own
+/// threads, ahead of the correlator, which collects them with take().
+/// At most a fixed number of aligned tiles are held in memory, beyond
+/// that the workers wait for the correlator to catch up.
+class AlignmentPrefetcher: private boost::noncopyable {
+public:
+  typedef boost::function<boost::shared_ptr<AlignedTile>(BBox2i const&)> AlignFunc;
+
+  /// The tiles should be listed in the order they will be correlated.
+  AlignmentPrefetcher(std::vector<BBox2i> const& tiles, AlignFunc const& align_func,
+                      int num_threads, int capacity):
+    m_tiles(tiles), m_align_func(align_func),
+    m_results(tiles.size()), m_status(tiles.size(), PENDING),
+    m_next(0), m_in_flight(0), m_capacity(std::max(capacity, 1)), m_stop(false),
+    m_queue(num_threads) {
+    for (size_t i = 0; i < m_tiles.size(); i++)
+      m_index[std::make_pair(m_tiles[i].min().x(), m_tiles[i].min().y())] = i;
+    for (int t = 0; t < num_threads; t++)
+      m_queue.add_task(boost::shared_ptr<Task>(new Worker(*this)));
+  }
+
+  ~AlignmentPrefetcher() {
+    stop();
+  }
+
+  /// Stop the workers once their current tiles are done, and wait for them.
+  void stop() {
+    {
+      Mutex::Lock lock(m_mutex);
+      if (m_stop)
+        return;
+      m_stop = true;
+    }
+    m_cond.notify_all();
+    m_queue.join_all();
+  }
+
+  /// Get the alignment of a tile, waiting for it if a worker is on it.
+  /// Returns an empty pointer if the tile was not started yet, is not
+  /// known here, or its alignment failed. The caller must then do it.
+  boost::shared_ptr<AlignedTile> take(BBox2i const& bbox) {
+    Mutex::Lock lock(m_mutex);
+    std::map<std::pair<int, int>, size_t>::const_iterator it
+      = m_index.find(std::make_pair(bbox.min().x(), bbox.min().y()));
+    if (it == m_index.end())
+      return boost::shared_ptr<AlignedTile>();
+
+    size_t i = it->second;
+    if (m_status[i] == PENDING) {
+      // The correlator got here first, keep the workers off this tile
+      m_status[i] = TAKEN;
+      return boost::shared_ptr<AlignedTile>();
+    }
+    while (m_status[i] == RUNNING)
+      m_cond.wait(lock);
+
+    boost::shared_ptr<AlignedTile> result = m_results[i];
+    m_results[i].reset();
+    if (m_status[i] == READY)
+      m_in_flight--;
+    m_status[i] = TAKEN;
+    m_cond.notify_all(); // A slot was freed
+    return result;
+  }
+
+private:
+  enum Status { PENDING, RUNNING, READY, TAKEN };
+
+  class Worker: public Task {
+    AlignmentPrefetcher & m_parent;
+  public:
+    Worker(AlignmentPrefetcher & parent): m_parent(parent) {}
+    void operator()() { m_parent.work(); }
+  };
+
+  // Align tiles in order until all are handled or we are told to stop
+  void work() {
+    while (true) {
+      size_t i;
+      {
+        Mutex::Lock lock(m_mutex);
+        while (!m_stop && m_in_flight >= m_capacity)
+          m_cond.wait(lock);
+        while (m_next < m_tiles.size() && m_status[m_next] != PENDING)
+          m_next++;
+        if (m_stop || m_next >= m_tiles.size())
+          return;
+        i = m_next++;
+        m_status[i] = RUNNING;
+        m_in_flight++;
+      }
+
+      boost::shared_ptr<AlignedTile> result;
+      try {
+        result = m_align_func(m_tiles[i]);
+      } catch (std::exception const& e) {
+        VW_OUT(DebugMessage, "stereo") << "Alignment ahead of correlation failed for tile "
+                                       << m_tiles[i] << ": " << e.what() << "\n";
+      }
+
+      {
+        Mutex::Lock lock(m_mutex);
+        m_results[i] = result;
+        m_status [i] = READY;
+      }
+      m_cond.notify_all();
+    }
+  }
+
+  std::vector<BBox2i> m_tiles;
+  AlignFunc           m_align_func;
+  std::map<std::pair<int, int>, size_t>        m_index;
+  std::vector<boost::shared_ptr<AlignedTile> > m_results;
+  std::vector<Status> m_status;
+  size_t    m_next;      // The next tile a worker may pick up
+  int       m_in_flight; // Tiles being aligned or waiting for the correlator
+  int       m_capacity;
+  bool      m_stop;
+  Mutex     m_mutex;
+  Condition m_cond;
+  FifoWorkQueue m_queue;
+};
+
+
+/// Fraction of the pixels of an image in the given box which are valid.
+template <class ImageT>
+double valid_fraction(ImageT const& image, BBox2i const& bbox) {
+  if (bbox.empty())
+    return 0;
+  size_t num_valid = 0;
+  for (int row = bbox.min().y(); row < bbox.max().y(); row++) {
+    for (int col = bbox.min().x(); col < bbox.max().x(); col++) {
+      if (is_valid(image(col, row)))
+        num_valid++;
+    }
+  }
+  return double(num_valid) / (double(bbox.width()) * bbox.height());
+}
+
+/// Collects the records and stats of the tiles as the correlation threads
+/// finish them. The input keys are found only if asked for, as that means
+/// reading the inputs of each tile again.
+class TileRecorder: private boost::noncopyable {
+public:
+  TileRecorder(bool with_input_keys): m_with_input_keys(with_input_keys) {}
+
+  bool with_input_keys() const { return m_with_input_keys; }
+
+  void add(TileRecord const& record, TileStats const& stats) {
+    Mutex::Lock lock(m_mutex);
+    m_records.push_back(record);
+    m_stats.push_back(stats);
+  }
+  std::vector<TileRecord> records() const {
+    Mutex::Lock lock(m_mutex);
+    return m_records;
+  }
+  std::vector<TileStats> stats() const {
+    Mutex::Lock lock(m_mutex);
+    return m_stats;
+  }
+private:
+  bool m_with_input_keys;
+  std::vector<TileRecord> m_records;
+  std::vector<TileStats>  m_stats;
+  mutable Mutex m_mutex;
+};
+
+
 /// This correlator takes a low resolution disparity image as an input
 /// so that it may narrow its search range for each tile that is processed.
 
@@ -971,6 +1305,18 @@ class SeededCorrelatorView : public ImageViewBase<SeededCorrelatorView> {
   stereo::CostFunctionType m_cost_mode;
   int      m_corr_timeout;
   double   m_seconds_per_op;
+  std::string m_align_cache_dir; // Empty if the alignment cache is not used
+  boost::shared_ptr<AlignmentPrefetcher> m_prefetcher; // Optional, aligns tiles ahead of time
+  // Optional, shared by neighbouring tiles whose margins overlap
+  boost::shared_ptr<TileBlockCache<DiskImageView<PixelGray<float> > > > m_left_cache, m_right_cache;
+  boost::shared_ptr<TileBlockCache<DiskImageView<vw::uint8> > > m_left_mask_cache, m_right_mask_cache;
+  boost::shared_ptr<MatchIndex> m_global_matches; // Optional, to seed the tile alignment
+  boost::shared_ptr<TileRecorder> m_recorder; // Optional, for the tile manifest and stats
+  // Optional, to correlate the most expensive tiles in pieces
+  double   m_max_tile_cost;
+  int      m_min_split_size;
+  boost::shared_ptr<CooperativeTaskQueue> m_split_queue;
+  boost::shared_ptr<MemoryBudget> m_memory_budget; // Optional, limits the tiles in memory
 
 public:
 
@@ -992,14 +1338,16 @@ public:
 						ImageView<Matrix3x3>  & local_size,
                         Vector2i const& kernel_size,
                         stereo::CostFunctionType cost_mode,
-                        int corr_timeout, double seconds_per_op):
+                        int corr_timeout, double seconds_per_op,
+                        std::string const& align_cache_dir = ""):
     m_left_image(left_image.impl()), m_right_image(right_image.impl()),
     m_left_mask (left_mask.impl ()), m_right_mask (right_mask.impl ()),
     m_sub_disp(sub_disp.impl()), m_sub_disp_spread(sub_disp_spread.impl()),
     m_local_hom(local_hom),
 	m_local_hom_L(local_hom_L), m_local_size(local_size),
     m_kernel_size(kernel_size),  m_cost_mode(cost_mode),
-    m_corr_timeout(corr_timeout), m_seconds_per_op(seconds_per_op){ 
+    m_corr_timeout(corr_timeout), m_seconds_per_op(seconds_per_op),
+    m_align_cache_dir(align_cache_dir), m_max_tile_cost(0), m_min_split_size(0){ 
     m_upscale_factor[0] = double(m_left_image.cols()) / m_sub_disp.cols();
     m_upscale_factor[1] = double(m_left_image.rows()) / m_sub_disp.rows();
     m_seed_bbox = bounding_box( m_sub_disp );
@@ -1020,45 +1368,353 @@ public:
     vw_throw(NoImplErr() << "SeededCorrelatorView::operator()(...) is not implemented");
     return pixel_type();
   }
-  	/// Does the work
-  	typedef CropView<ImageView<pixel_type> > prerasterize_type;
-  	inline prerasterize_type prerasterize(BBox2i const& bbox) const {
+  /// The box in D_sub corresponding to a full-resolution tile
+  BBox2i seed_bbox_for(BBox2i const& bbox) const {
+    BBox2i seed_bbox( elem_quot(bbox.min(), m_upscale_factor),
+                      elem_quot(bbox.max(), m_upscale_factor) );
+    seed_bbox.expand(1);
+    seed_bbox.crop( m_seed_bbox );
+    return seed_bbox;
+  }
+
+  /// The margin a tile is grown by for its piecewise alignment
+  static int alignment_margin() {
+    //<RM>: increase bbox where the piecewise alignment is applied to reduce border artifacts
+    return ASPGlobalOptions::corr_tile_size() * 0.4; //<RM>: This can be lower to improve speed
+  }
+
+  /// The tile grown by the alignment margin, within the image
+  BBox2i expanded_tile_bbox(BBox2i const& bbox) const {
+    BBox2i expanded_bbox = bbox;
+    expanded_bbox.expand(alignment_margin());
+    expanded_bbox.crop(bounding_box(m_left_image));
+    return expanded_bbox;
+  }
+
+  /// Crop a tile with a margin, find its piecewise alignment, and warp
+  /// both tile images with it. This is the interest point heavy part of
+  /// the work, which can run ahead of the correlation on other threads.
+  boost::shared_ptr<AlignedTile> align_tile(BBox2i const& bbox) const {
+
+    boost::shared_ptr<AlignedTile> tile(new AlignedTile);
+
+    int ts = ASPGlobalOptions::corr_tile_size();
+    tile->margin        = alignment_margin();
+    tile->expanded_bbox = expanded_tile_bbox(bbox);
+    BBox2i const& newBBox = tile->expanded_bbox;
+
+    //<RM>: the alignment is going to be applied only to the tile itself 
+    ImageView<PixelGray<float> > tile_right_image
+      = crop_through_cache(m_right_cache, m_right_image, newBBox);
+    ImageView<PixelGray<float> > tile_left_image
+      = crop_through_cache(m_left_cache,  m_left_image,  newBBox);
+    ImageView<vw::uint8> tile_right_image_mask
+      = crop_through_cache(m_right_mask_cache, m_right_mask, newBBox);
+    ImageView<vw::uint8> tile_left_image_mask
+      = crop_through_cache(m_left_mask_cache,  m_left_mask,  newBBox);
+
+    // The search range to fall back to if the alignment fails
+    BBox2f local_search_range
+      = stereo::get_disparity_range( crop( m_sub_disp, seed_bbox_for(bbox) ) );
+
+    //<RM>: the piecewise alignment might require a transformation for each tile individually
+    tile->left_matrix  = math::identity_matrix<3>();
+    tile->right_matrix = math::identity_matrix<3>();
+    Vector2i left_size = newBBox.size(), right_size = newBBox.size();
+    std::vector<ip::InterestPoint> seed_ip1, seed_ip2;
+    if (m_global_matches)
+      m_global_matches->matches_in_box(newBBox, seed_ip1, seed_ip2);
+    tile->search_range = cached_piecewise_alignment(m_align_cache_dir,
+                                                    tile_left_image, tile_right_image,
+                                                    bbox, newBBox, left_size, right_size,
+                                                    tile->left_matrix, tile->right_matrix,
+                                                    local_search_range, seed_ip1, seed_ip2,
+                                                    &tile->stats);
+    //new_local_search_range = piecewiseAlignment_homography(tile_left_image, tile_right_image, bbox, left_size, right_size, align_left_matrix, align_right_matrix, local_search_range); //<RM>: Alternative method - not very good
+    tile->aligned_size = left_size;
+    right_size = left_size;
+
+    //<RM>: tranform left tile
+    ImageView< PixelMask<InputPixelType> > left_trans_masked_img
+      = transform (copy_mask( tile_left_image.impl(), create_mask(tile_left_image_mask.impl()) ),
+                   HomographyTransform(tile->left_matrix),
+                   left_size.x(), left_size.y());
+    tile->left_img  = apply_mask(left_trans_masked_img);
+    tile->left_mask = channel_cast_rescale<uint8>(select_channel(left_trans_masked_img, 1));
+    //<RM>: tranform right tile
+    ImageView< PixelMask<InputPixelType> > right_trans_masked_img
+      = transform (copy_mask(tile_right_image.impl(), create_mask(tile_right_image_mask.impl()) ),
+                   HomographyTransform(tile->right_matrix),
+                   right_size.x(), right_size.y());
+    tile->right_img  = apply_mask(right_trans_masked_img);
+    tile->right_mask = channel_cast_rescale<uint8>(select_channel(right_trans_masked_img, 1));
+
+#if DEBUG_RM
+    char outputName[30];
+    cartography::GdalWriteOptions geo_opt;
+    int W = bbox.min().x()/ts, H = bbox.min().y()/ts;
+    cout << "[tile(" << H << "," << W << " newBBox = " << newBBox << endl;
+    cout << "[tile(" << H << "," << W << " left_size after piecewise alignment = " << left_size << endl;
+    cout << "[tile(" << H << "," << W << ") " << tile->right_matrix << "]" << endl;
+    cout << "[tile(" << H << "," << W << ") " << tile->left_matrix << "]" << endl;
+    sprintf(outputName, "tile_R_%d_%d.tif", H, W);
+    block_write_gdal_image(outputName, tile_right_image, geo_opt);
+    sprintf(outputName, "tile_L_%d_%d.tif", H, W);
+    block_write_gdal_image(outputName, tile_left_image, geo_opt);
+    sprintf(outputName, "piecewiseHomography_R_%d_%d.tif", H, W);
+    block_write_gdal_image(outputName, tile->right_img, geo_opt);
+    sprintf(outputName, "piecewiseHomography_L_%d_%d.tif", H, W);
+    block_write_gdal_image(outputName, tile->left_img, geo_opt);
+#endif
+
+    return tile;
+  }
+
+  /// Use this object to get tile alignments computed ahead of time
+  void set_alignment_prefetcher(boost::shared_ptr<AlignmentPrefetcher> prefetcher) {
+    m_prefetcher = prefetcher;
+  }
+
+  /// Use the matches between the whole images which fall in a tile to align it.
+  void set_global_matches(boost::shared_ptr<MatchIndex> global_matches) {
+    m_global_matches = global_matches;
+  }
+
+  /// Crop the expanded tiles out of in-memory blocks of the size of a
+  /// tile, shared between tiles, rather than reading each margin again.
+  /// Most of the memory goes to the images, the rest to the masks.
+  void set_tile_caches(size_t max_bytes) {
+    int ts = ASPGlobalOptions::corr_tile_size();
+    Vector2i block_size(ts, ts);
+    size_t image_bytes = max_bytes / 10 * 4, mask_bytes = max_bytes / 10;
+    m_left_cache.reset (new TileBlockCache<ImageType>(m_left_image,  block_size, image_bytes));
+    m_right_cache.reset(new TileBlockCache<ImageType>(m_right_image, block_size, image_bytes));
+    m_left_mask_cache.reset (new TileBlockCache<MaskType>(m_left_mask,  block_size, mask_bytes));
+    m_right_mask_cache.reset(new TileBlockCache<MaskType>(m_right_mask, block_size, mask_bytes));
+  }
+
+  void log_tile_cache_stats() const {
+    if (!m_left_cache)
+      return;
+    VW_OUT(DebugMessage, "stereo") << "Tile block cache: " << m_left_cache->hits()
+                                   << " hits, " << m_left_cache->misses()
+                                   << " misses per image.\n";
+  }
+
+  double seconds_per_op() const { return m_seconds_per_op; }
+
+  /// Keep track of the time taken by each tile and of its inputs.
+  void set_tile_recorder(boost::shared_ptr<TileRecorder> recorder) {
+    m_recorder = recorder;
+  }
+
+  /// The full resolution search range of a tile as seeded by D_sub and
+  /// D_sub_spread, before any local alignment.
+  BBox2i seeded_search_range(BBox2i const& bbox) const {
+    if ( stereo_settings().seed_mode == 0 )
+      return stereo_settings().search_range;
+
+    BBox2i seed_bbox = seed_bbox_for(bbox);
+    BBox2f search_range = stereo::get_disparity_range( crop( m_sub_disp, seed_bbox ) );
+    if ( m_sub_disp_spread.cols() != 0 && m_sub_disp_spread.rows() != 0 ) {
+      BBox2f spread = stereo::get_disparity_range( crop( m_sub_disp_spread, seed_bbox ) );
+      search_range.min() -= spread.max();
+      search_range.max() += spread.max();
+    }
+    search_range = grow_bbox_to_int(search_range);
+    search_range.expand(1);
+    search_range.min() = floor(elem_prod(search_range.min(), m_upscale_factor));
+    search_range.max() = ceil (elem_prod(search_range.max(), m_upscale_factor));
+    return grow_bbox_to_int(search_range);
+  }
+
+  /// The predicted cost of correlating a tile, from its seeded search range.
+  double predicted_cost(BBox2i const& bbox) const {
+    return predicted_correlation_cost(bbox, seeded_search_range(bbox));
+  }
+
+  /// Correlate the tiles predicted to cost more than max_cost in smaller
+  /// pieces, each with the search range of its own part of D_sub. The
+  /// pieces go through the given queue, so that threads waiting on their
+  /// own pieces, and the helper threads of the queue when some thread has
+  /// run out of tiles, help with those of other tiles.
+  void set_tile_splitting(double max_cost, int min_size,
+                          boost::shared_ptr<CooperativeTaskQueue> queue) {
+    m_max_tile_cost  = max_cost;
+    m_min_split_size = min_size;
+    m_split_queue    = queue;
+  }
+
+  /// The predicted memory needed to correlate a tile. With local
+  /// homography the aligned tiles include the alignment margin.
+  size_t predicted_memory(BBox2i const& bbox) const {
+    BBox2i region = bbox;
+    if (stereo_settings().use_local_homography)
+      region.expand(ASPGlobalOptions::corr_tile_size() * 0.4);
+    return predicted_correlation_memory(region, seeded_search_range(bbox), m_kernel_size,
+                                        stereo_settings().corr_max_levels,
+                                        stereo_settings().stereo_algorithm
+                                          > vw::stereo::CORRELATION_WINDOW,
+                                        stereo_settings().sgm_collar_size,
+                                        stereo_settings().corr_memory_limit_mb);
+  }
+
+  /// Start on a tile only when its predicted memory fits in the budget
+  /// along with that of the tiles already being correlated.
+  void set_memory_budget(boost::shared_ptr<MemoryBudget> budget) {
+    m_memory_budget = budget;
+  }
+
+  /// Hash of everything the correlation of a tile reads with piecewise
+  /// alignment. This is the key of the tile in the alignment cache,
+  /// covering both images over the expanded tile, the search range from
+  /// D_sub, the seed matches and the IP settings, with the masks of the
+  /// expanded tile added, as the warped tiles are all that is correlated.
+  boost::uint64_t aligned_tile_input_key(BBox2i const& bbox) const {
+    BBox2i expanded_bbox = expanded_tile_bbox(bbox);
+    std::vector<ip::InterestPoint> seed_ip1, seed_ip2;
+    if (m_global_matches)
+      m_global_matches->matches_in_box(expanded_bbox, seed_ip1, seed_ip2);
+    BBox2f search_range
+      = stereo::get_disparity_range( crop( m_sub_disp, seed_bbox_for(bbox) ) );
+
+    boost::uint64_t key
+      = tile_alignment_key(bbox, expanded_bbox,
+                           tile_checksum(crop_through_cache(m_left_cache,  m_left_image,
+                                                            expanded_bbox)),
+                           tile_checksum(crop_through_cache(m_right_cache, m_right_image,
+                                                            expanded_bbox)),
+                           search_range, matches_checksum(seed_ip1, seed_ip2));
+    key = tile_checksum(crop_through_cache(m_left_mask_cache,  m_left_mask,  expanded_bbox), key);
+    key = tile_checksum(crop_through_cache(m_right_mask_cache, m_right_mask, expanded_bbox), key);
+    return key;
+  }
+
+  /// Hash of everything the correlation of a tile reads: the left image
+  /// and mask around it, the right image and mask over the area it can
+  /// be matched to, and the low-resolution disparity seeding it.
+  boost::uint64_t tile_input_key(BBox2i const& bbox) const {
+
+    if ( stereo_settings().seed_mode > 0 && stereo_settings().use_local_homography )
+      return aligned_tile_input_key(bbox);
+
+    // The pyramid correlator reads a kernel (and prefilter) sized collar
+    // around the tile at each level, which grows with the subsampling.
+    const int rm_half_kernel = 5;
+    int collar = (std::max(m_kernel_size[0], m_kernel_size[1])/2 + rm_half_kernel)
+                 << std::min(int(stereo_settings().corr_max_levels), 8);
+    BBox2i left_box = bbox;
+    left_box.expand(collar);
+    left_box.crop(bounding_box(m_left_image));
+
+    int box[4] = {bbox.min().x(), bbox.min().y(), bbox.width(), bbox.height()};
+    boost::uint64_t key = hash_bytes(box, sizeof(box));
+    if ( stereo_settings().seed_mode > 0 ) {
+      BBox2i seed_bbox = seed_bbox_for(bbox);
+      key = tile_checksum(ImageView<PixelMask<Vector2f> >(crop( m_sub_disp, seed_bbox )), key);
+      if ( m_sub_disp_spread.cols() != 0 && m_sub_disp_spread.rows() != 0 )
+        key = tile_checksum(ImageView<PixelMask<Vector2i> >(crop( m_sub_disp_spread, seed_bbox )),
+                            key);
+    }
+
+    BBox2i int_range = seeded_search_range(bbox);
+    int range[4] = {int_range.min().x(), int_range.min().y(),
+                    int_range.max().x(), int_range.max().y()};
+    key = hash_bytes(range, sizeof(range), key);
+
+    BBox2i right_box = left_box;
+    right_box.min() += int_range.min();
+    right_box.max() += int_range.max();
+    right_box.crop(bounding_box(m_right_image));
+
+    key = tile_checksum(ImageView<PixelGray<float> >(crop(m_left_image, left_box)), key);
+    key = tile_checksum(ImageView<vw::uint8>(crop(m_left_mask, left_box)), key);
+    key = tile_checksum(ImageView<PixelGray<float> >(crop(m_right_image, right_box)), key);
+    key = tile_checksum(ImageView<vw::uint8>(crop(m_right_mask, right_box)), key);
+    return key;
+  }
+
+  /// Does the work
+  typedef CropView<ImageView<pixel_type> > prerasterize_type;
+  inline prerasterize_type prerasterize(BBox2i const& bbox) const {
+    TileStats stats;
+    if (!m_recorder)
+      return split_and_correlate(bbox, stats);
+
+    Stopwatch sw;
+    sw.start();
+    prerasterize_type result = split_and_correlate(bbox, stats);
+    sw.stop();
+
+    TileRecord record;
+    record.bbox           = bbox;
+    record.seconds        = sw.elapsed_seconds();
+    record.valid_fraction = valid_fraction(result, bbox);
+    if (m_recorder->with_input_keys())
+      record.input_key = tile_input_key(bbox);
+    stats.bbox           = bbox;
+    stats.valid_fraction = record.valid_fraction;
+    stats.max_rss_mb     = max_resident_memory_mb();
+    m_recorder->add(record, stats);
+    return result;
+  }
+
+  /// Correlate a tile, in pieces if it was predicted to be too expensive.
+  /// Each piece reserves its own memory, whichever thread runs it.
+  prerasterize_type split_and_correlate(BBox2i const& bbox, TileStats & stats) const {
+    std::vector<BBox2i> pieces;
+    if (m_split_queue)
+      pieces = split_tile_by_cost(bbox, boost::bind(&SeededCorrelatorView::predicted_cost,
+                                                    this, _1),
+                                  m_max_tile_cost, m_min_split_size);
+    if (pieces.size() <= 1) {
+      CooperativeTaskQueue::Busy busy(m_split_queue);
+      MemoryBudget::Reservation reservation(m_memory_budget,
+                                            m_memory_budget ? predicted_memory(bbox) : 0);
+      return prerasterize_helper(bbox, stats);
+    }
+
+    VW_OUT(DebugMessage, "stereo") << "Correlating tile " << bbox << " in "
+                                   << pieces.size() << " pieces.\n";
+    ImageView<pixel_type> result(bbox.width(), bbox.height());
+    std::vector<TileStats> piece_stats(pieces.size());
+    std::vector<CooperativeTaskQueue::TaskFunc> tasks;
+    for (size_t i = 0; i < pieces.size(); i++)
+      tasks.push_back(boost::bind(&SeededCorrelatorView::correlate_piece, this,
+                                  pieces[i], bbox, &result, &piece_stats[i]));
+    m_split_queue->run(tasks);
+
+    for (size_t i = 0; i < pieces.size(); i++) {
+      stats.corr_seconds += piece_stats[i].corr_seconds;
+      stats.search_area   = std::max(stats.search_area, piece_stats[i].search_area);
+    }
+    return prerasterize_type(result, -bbox.min().x(), -bbox.min().y(), cols(), rows());
+  }
+
+  // Correlate one piece of a tile into its place in the tile result. The
+  // pieces do not overlap, so they can be written from several threads.
+  void correlate_piece(BBox2i const& piece, BBox2i const& bbox,
+                       ImageView<pixel_type> * result, TileStats * stats) const {
+    MemoryBudget::Reservation reservation(m_memory_budget,
+                                          m_memory_budget ? predicted_memory(piece) : 0);
+    crop(*result, piece - bbox.min()) = crop(prerasterize_helper(piece, *stats), piece);
+  }
+
+  /// Correlate a tile, filling in the stats of the alignment and correlation
+  inline prerasterize_type prerasterize_helper(BBox2i const& bbox, TileStats & stats) const {
 
     bool use_local_homography = stereo_settings().use_local_homography;
     Matrix<double> lowres_hom  = math::identity_matrix<3>();
     Matrix<double> fullres_hom = math::identity_matrix<3>();
-    ImageView<InputPixelType> right_trans_img;
-    ImageView<vw::uint8     > right_trans_mask;
-	//<RM>: Added variables
-	//<RM>: increase bbox where the piecewise alignment is applied to reduce border artifacts
-	BBox2f new_local_search_range;
-	int ts = ASPGlobalOptions::corr_tile_size();
-	int margin = ts * 0.4; //<RM>: This can be lower to improve speed
-#if DEBUG_RM
-  	cout << "start of tile " << bbox << endl;
-	char outputName[30];
-	cartography::GdalWriteOptions geo_opt;
-	int W = bbox.min().x()/ts, H = bbox.min().y()/ts;
-#endif
-	//<RM>: the left image tile might be transformed as well depending on the alignment technique
-    ImageView<InputPixelType> left_trans_img; 
-    ImageView<vw::uint8     > left_trans_mask;
-	//<RM>: new bbox that includes a margin of pixels 
-	BBox2i newBBox = bbox;
-	newBBox.expand(margin);
-	newBBox.crop(bounding_box(m_left_image));
+    //<RM>: the aligned tiles, when piecewise alignment is used
+    boost::shared_ptr<AlignedTile> aligned;
+    int ts = ASPGlobalOptions::corr_tile_size();
 #if DEBUG_RM
-	cout << "[tile(" << H << "," << W << " newBBox = " << newBBox << endl;
-	cout << "[tile(" << H << "," << W << " bbox = " << bbox << endl;
+    cout << "start of tile " << bbox << endl;
+    char outputName[30];
+    cartography::GdalWriteOptions geo_opt;
+    int W = bbox.min().x()/ts, H = bbox.min().y()/ts;
 #endif
-	//<RM>: the alignment is going to be applied only to the tile itself 
-	ImageView<PixelGray<float> > tile_right_image = crop(m_right_image.impl(), newBBox);
-	ImageView<PixelGray<float> > tile_left_image = crop(m_left_image.impl(), newBBox);
-	ImageView<vw::uint8> tile_right_image_mask = crop(m_right_mask.impl(), newBBox);
-	ImageView<vw::uint8> tile_left_image_mask = crop(m_left_mask.impl(), newBBox);
-	//<RM>: the piecewise alignment is might require a transformation for each tile individually
-	Matrix<double>  align_left_matrix  = math::identity_matrix<3>(),
-                   	align_right_matrix = math::identity_matrix<3>();
 
     bool do_round = true; // round integer disparities after transform
     // User strategies
@@ -1066,10 +1722,7 @@ public:
     if ( stereo_settings().seed_mode > 0 ) {
 
       // The low-res version of bbox
-      BBox2i seed_bbox( elem_quot(bbox.min(), m_upscale_factor),
-			                  elem_quot(bbox.max(), m_upscale_factor) );
-      seed_bbox.expand(1);
-      seed_bbox.crop( m_seed_bbox );
+      BBox2i seed_bbox = seed_bbox_for(bbox);
       // Get the disparity range in d_sub corresponding to this tile.
       VW_OUT(DebugMessage, "stereo") << "Getting disparity range for : " << seed_bbox << "\n";
       DispSeedImageType disparity_in_box = crop( m_sub_disp, seed_bbox );
@@ -1077,7 +1730,6 @@ public:
       if (!use_local_homography){
         local_search_range = stereo::get_disparity_range( disparity_in_box );
       }else{ // use local homography
-        int ts = ASPGlobalOptions::corr_tile_size();
         lowres_hom = m_local_hom(bbox.min().x()/ts, bbox.min().y()/ts);
         local_search_range = stereo::get_disparity_range
           (transform_disparities(do_round, seed_bbox,
@@ -1115,50 +1767,26 @@ public:
       } //endif has_sub_disp_spread
 
       if (use_local_homography){
-        Vector3 upscale(     m_upscale_factor[0],     m_upscale_factor[1], 1 );
-        Vector3 dnscale( 1.0/m_upscale_factor[0], 1.0/m_upscale_factor[1], 1 );
-        fullres_hom = diagonal_matrix(upscale)*lowres_hom*diagonal_matrix(dnscale);
-		//<RM>: from this point on the fullres_hom is going to be overwritten by the tranformation calculated by a different piecewise alignment technique
-		local_search_range = stereo::get_disparity_range( disparity_in_box );		
-		Vector2i left_size = newBBox.size(), right_size = newBBox.size();
-	    new_local_search_range = piecewiseAlignment_affineepipolar(tile_left_image, tile_right_image, bbox, left_size, right_size, align_left_matrix, align_right_matrix, local_search_range);
-		//new_local_search_range = piecewiseAlignment_homography(tile_left_image, tile_right_image, bbox, left_size, right_size, align_left_matrix, align_right_matrix, local_search_range); //<RM>: Alternative method - not very good
-		right_size = left_size;
-		fullres_hom = align_right_matrix;
-		//<RM>: write tranformation matrices for both left and right tiles to file
-		m_local_hom(bbox.min().x()/ts, bbox.min().y()/ts) = fullres_hom; 
-		m_local_hom_L(bbox.min().x()/ts, bbox.min().y()/ts) = align_left_matrix;
-		//<RM>: write the aligned tile size to file to be accessed later by stereo_rfne
-		m_local_size(bbox.min().x()/ts, bbox.min().y()/ts)(0,0) = left_size.x();
-        m_local_size(bbox.min().x()/ts, bbox.min().y()/ts)(0,1) = left_size.y();
-		//<RM>: tranform left tile
-		ImageView< PixelMask<InputPixelType> > left_trans_masked_img = transform (copy_mask( tile_left_image.impl(),
-																		  create_mask(tile_left_image_mask.impl()) ),
-	               														  HomographyTransform(align_left_matrix),
-																		  left_size.x(), left_size.y()); 
-        left_trans_img  = apply_mask(left_trans_masked_img);
-        left_trans_mask = channel_cast_rescale<uint8>(select_channel(left_trans_masked_img, 1));
-		//<RM>: tranform right tile
-        ImageView< PixelMask<InputPixelType> > right_trans_masked_img = transform (copy_mask(tile_right_image.impl(),
-					 													   create_mask(tile_right_image_mask.impl()) ),
-	               														   HomographyTransform(fullres_hom),
-																		   right_size.x(), right_size.y()); 
-        right_trans_img  = apply_mask(right_trans_masked_img);
-        right_trans_mask = channel_cast_rescale<uint8>(select_channel(right_trans_masked_img, 1));
+        //<RM>: from this point on the fullres_hom is going to be overwritten by the tranformation calculated by a different piecewise alignment technique
+        local_search_range = stereo::get_disparity_range( disparity_in_box );
+        // The alignment may have been computed ahead of time by the prefetcher.
+        // If it failed there, redo it here so any error is reported.
+        if (m_prefetcher)
+          aligned = m_prefetcher->take(bbox);
+        if (!aligned)
+          aligned = align_tile(bbox);
+        stats.ip_seconds  = aligned->stats.ip_seconds;
+        stats.num_matches = aligned->stats.num_matches;
+        stats.fit_status  = aligned->stats.fit_status;
+        fullres_hom = aligned->right_matrix;
+        //<RM>: write tranformation matrices for both left and right tiles to file
+        m_local_hom(bbox.min().x()/ts, bbox.min().y()/ts) = fullres_hom; 
+        m_local_hom_L(bbox.min().x()/ts, bbox.min().y()/ts) = aligned->left_matrix;
+        //<RM>: write the aligned tile size to file to be accessed later by stereo_rfne
+        m_local_size(bbox.min().x()/ts, bbox.min().y()/ts)(0,0) = aligned->aligned_size.x();
+        m_local_size(bbox.min().x()/ts, bbox.min().y()/ts)(0,1) = aligned->aligned_size.y();
 #if DEBUG_RM
-		cout << "[tile(" << H << "," << W << " left_size after piecewise alignment = " << left_size << endl;
-		cout << "[tile(" << H << "," << W << " right_size after piecewise alignment = " << right_size << endl;
-		cout << "[tile(" << H << "," << W << " local_search_range = " << local_search_range << endl;
-		cout << "[tile(" << H << "," << W << ") " << fullres_hom << "]" << endl;
-		cout << "[tile(" << H << "," << W << ") " << align_left_matrix << "]" << endl;
-		sprintf(outputName, "tile_R_%d_%d.tif", H, W);
-		block_write_gdal_image(outputName, tile_right_image, geo_opt);
-		sprintf(outputName, "tile_L_%d_%d.tif", H, W);
-		block_write_gdal_image(outputName, tile_left_image, geo_opt);
-		sprintf(outputName, "piecewiseHomography_R_%d_%d.tif", H, W);
-		block_write_gdal_image(outputName, right_trans_img, geo_opt);
-		sprintf(outputName, "piecewiseHomography_L_%d_%d.tif", H, W);
-		block_write_gdal_image(outputName, left_trans_img, geo_opt);
+        cout << "[tile(" << H << "," << W << " local_search_range = " << local_search_range << endl;
 #endif
       } //endif use_local_homography
 
@@ -1194,15 +1822,15 @@ public:
 
     // Now we are ready to actually perform correlation
     const int rm_half_kernel = 5; // Filter kernel size used by CorrelationView
-    if (use_local_homography){
+    if (use_local_homography && aligned){
 		//<RM>: apply stereo to the aligned left and right tile
 		typedef vw::stereo::PyramidCorrelationView<ImageView<InputPixelType>, ImageView<InputPixelType>, 
                                                    ImageView<vw::uint8     >, ImageView<vw::uint8     > > CorrView;
-		CorrView corr_view( left_trans_img,   right_trans_img,
-                          left_trans_mask,    right_trans_mask,
+		CorrView corr_view( aligned->left_img,  aligned->right_img,
+                          aligned->left_mask, aligned->right_mask,
                           static_cast<vw::stereo::PrefilterModeType>(stereo_settings().pre_filter_mode),
                           stereo_settings().slogW,
-                          fullres_hom != math::identity_matrix<3>() ? new_local_search_range : local_search_range, 
+                          fullres_hom != math::identity_matrix<3>() ? aligned->search_range : local_search_range, 
                           m_kernel_size,  m_cost_mode,
                           m_corr_timeout, m_seconds_per_op,
                           stereo_settings().xcorr_threshold,
@@ -1214,23 +1842,29 @@ public:
                           sgm_subpixel_mode, sgm_search_buffer, stereo_settings().corr_memory_limit_mb,
                           stereo_settings().corr_blob_filter_area,
                           stereo_settings().stereo_debug );
-		ImageView<pixel_type> stereo_result = corr_view.prerasterize(bounding_box(left_trans_img));
+		BBox2f used_range = fullres_hom != math::identity_matrix<3>() ? aligned->search_range : local_search_range;
+		stats.search_area = double(used_range.width()) * used_range.height();
+		Stopwatch corr_timer;
+		corr_timer.start();
+		ImageView<pixel_type> stereo_result = corr_view.prerasterize(bounding_box(aligned->left_img));
+		corr_timer.stop();
+		stats.corr_seconds = corr_timer.elapsed_seconds();
 #if DEBUG_RM
 		cout << "[tile(" << H << "," << W << " Stereo done!" << endl;
 #endif
       	ImageView<pixel_type> stereo_result_inv;
       	ImageView<vw::uint8> stereo_result_mask_inv;  
-	  	ImageView<vw::uint8> stereo_result_mask = left_trans_mask;
+	  	ImageView<vw::uint8> stereo_result_mask = aligned->left_mask;
 		//<RM>: the disparity map needs to fit the original tile size therefore the transform needs to be undone
 	  	ImageView< PixelMask<pixel_type> > stereo_result_masked_img_inv = transform (copy_mask(stereo_result.impl(), 																			  stereo_result_mask.impl()),
-	               														  HomographyTransform(inverse(align_left_matrix)),
-																		  newBBox.width(), newBBox.height());
+	               														  HomographyTransform(inverse(aligned->left_matrix)),
+																		  aligned->expanded_bbox.width(), aligned->expanded_bbox.height());
       	stereo_result_inv  = apply_mask(stereo_result_masked_img_inv);
       	stereo_result_mask_inv = channel_cast_rescale<uint8>(select_channel(stereo_result_masked_img_inv, 2));
 		//<RM>: remove the margin
 		ImageView<pixel_type> stereo_result_corrected(bbox.width(), bbox.height());
-		double marginMinX = bbox.min().x() == 0 ? 0 : margin;
-		double marginMinY = bbox.min().y() == 0 ? 0 : margin;
+		double marginMinX = bbox.min().x() == 0 ? 0 : aligned->margin;
+		double marginMinY = bbox.min().y() == 0 ? 0 : aligned->margin;
 		for(int j=0; j<bbox.height(); j++ ){
 			for(int i=0; i<bbox.width(); i++ ){
 				stereo_result_corrected(i,j)[0] = stereo_result_inv(i+marginMinX ,j+marginMinY)[0];
@@ -1251,7 +1885,7 @@ public:
 		cout << "end of tile " << bbox << endl;	
 #endif
 	if(fullres_hom != math::identity_matrix<3>()) 
-		cout << "local_search_range " << new_local_search_range << endl;
+		cout << "local_search_range " << aligned->search_range << endl;
 	else
 		cout << "local_search_range " << local_search_range << endl;
 		return prerasterize_type(stereo_result_corrected,-bbox.min().x(),-bbox.min().y(),cols(),rows() );
@@ -1274,7 +1908,13 @@ public:
                           stereo_settings().corr_blob_filter_area,
                           stereo_settings().stereo_debug );
 	cout << "local_search_range " << local_search_range << endl;
-      return corr_view.prerasterize(bbox);
+      stats.search_area = double(local_search_range.width()) * local_search_range.height();
+      Stopwatch corr_timer;
+      corr_timer.start();
+      prerasterize_type result = corr_view.prerasterize(bbox);
+      corr_timer.stop();
+      stats.corr_seconds = corr_timer.elapsed_seconds();
+      return result;
     }
     
   } // End function prerasterize_helper
@@ -1286,8 +1926,202 @@ public:
 }; // End class SeededCorrelatorView
 
 
+/// The correlation tiles of a region, in the order in which they are written out.
+std::vector<BBox2i> corr_tile_list(BBox2i const& crop_win, Vector2i const& tile_size) {
+  std::vector<BBox2i> tiles;
+  for (int y = crop_win.min().y(); y < crop_win.max().y(); y += tile_size.y()) {
+    for (int x = crop_win.min().x(); x < crop_win.max().x(); x += tile_size.x()) {
+      BBox2i tile(x, y, tile_size.x(), tile_size.y());
+      tile.crop(crop_win);
+      tiles.push_back(tile);
+    }
+  }
+  return tiles;
+}
+
+/// Hash of the settings which affect every tile of the disparity. The
+/// timeout is kept apart in the manifest, as it affects only the tiles
+/// which come close to it. Which tiles are split depends on the cost of
+/// all of them, so the split threshold in use goes in as well.
+boost::uint64_t corr_settings_key(ASPGlobalOptions const& opt, BBox2i const& crop_win,
+                                  Vector2i const& image_size, double split_max_cost) {
+  StereoSettings const& s = stereo_settings();
+  double values[] = {double(s.seed_mode), double(s.use_local_homography),
+                     double(s.corr_kernel[0]), double(s.corr_kernel[1]),
+                     double(s.cost_mode), double(s.pre_filter_mode), s.slogW,
+                     double(s.xcorr_threshold), double(s.min_xcorr_level),
+                     double(s.corr_max_levels), double(s.stereo_algorithm),
+                     double(s.corr_blob_filter_area),
+                     double(s.search_range_limit.min().x()), double(s.search_range_limit.min().y()),
+                     double(s.search_range_limit.max().x()), double(s.search_range_limit.max().y()),
+                     double(opt.raster_tile_size[0]), double(opt.raster_tile_size[1]),
+                     double(crop_win.min().x()), double(crop_win.min().y()),
+                     double(crop_win.width()), double(crop_win.height()),
+                     double(image_size[0]), double(image_size[1]),
+                     s.corr_split_cost_factor, split_max_cost};
+  return hash_bytes(values, sizeof(values));
+}
+
+/// Read the left alignments and aligned tile sizes written by the run
+/// which left the manifest, for the tiles an update keeps. Returns false
+/// if they are missing or were made for another tiling.
+bool read_previous_tile_alignments(ASPGlobalOptions const& opt,
+                                   ImageView<Matrix3x3> const& local_hom,
+                                   ImageView<Matrix3x3> & local_hom_L,
+                                   ImageView<Matrix3x3> & local_size) {
+  ImageView<Matrix3x3> old_hom_L, old_size;
+  try {
+    read_local_homographies(opt.out_prefix + "-local_hom_L.txt", old_hom_L);
+    read_local_homographies(opt.out_prefix + "-local_size.txt",  old_size);
+  } catch (vw::IOErr const& e) {
+    vw_out(WarningMessage) << "Cannot update the disparity without the tile alignments "
+                           << "of the previous run (" << e.what() << "). "
+                           << "Computing the whole disparity.\n";
+    return false;
+  }
+  if (old_hom_L.cols() != local_hom.cols() || old_hom_L.rows() != local_hom.rows() ||
+      old_size.cols()  != local_hom.cols() || old_size.rows()  != local_hom.rows()) {
+    vw_out(WarningMessage) << "The tile alignments of the previous run are for other "
+                           << "tiles. Computing the whole disparity.\n";
+    return false;
+  }
+  local_hom_L = old_hom_L;
+  local_size  = old_size;
+  return true;
+}
+
+/// Recomputes the tiles of an existing disparity whose inputs have changed
+/// since the run which wrote the manifest, and writes them into it.
+class DisparityTileUpdater: private boost::noncopyable {
+public:
+  DisparityTileUpdater(SeededCorrelatorView const& corr_view, BBox2i const& crop_win,
+                       TileManifest const& old_manifest, std::string const& d_file,
+                       std::vector<BBox2i> const& tiles):
+    m_corr_view(corr_view), m_crop_win(crop_win), m_old_manifest(old_manifest),
+    m_d_file(d_file), m_tiles(tiles), m_records(tiles.size()), m_updated(tiles.size(), false),
+    m_num_updated(0) {}
+
+  /// Check all tiles, and return the records of the new manifest.
+  std::vector<TileRecord> run(int num_threads) {
+    FifoWorkQueue queue(num_threads);
+    for (size_t i = 0; i < m_tiles.size(); i++)
+      queue.add_task(boost::shared_ptr<Task>(new Worker(*this, i)));
+    queue.join_all();
+    if (!m_error.empty())
+      vw_throw( IOErr() << "Failed to update " << m_d_file << ": " << m_error );
+    vw_out() << "\t--> Recomputed " << m_num_updated << " of " << m_tiles.size()
+             << " tiles.\n";
+    return m_records;
+  }
+
+  /// Stats for the tiles which were kept, from what the manifest says of
+  /// them, so that those written for this run cover all tiles. Only the
+  /// time and the valid fraction are known.
+  std::vector<TileStats> kept_stats() const {
+    std::vector<TileStats> stats;
+    for (size_t i = 0; i < m_tiles.size(); i++) {
+      if (m_updated[i])
+        continue;
+      TileStats s;
+      s.bbox           = m_records[i].bbox;
+      s.corr_seconds   = m_records[i].seconds;
+      s.valid_fraction = m_records[i].valid_fraction;
+      stats.push_back(s);
+    }
+    return stats;
+  }
+
+private:
+  class Worker: public Task {
+    DisparityTileUpdater & m_parent;
+    size_t m_index;
+  public:
+    Worker(DisparityTileUpdater & parent, size_t index): m_parent(parent), m_index(index) {}
+    void operator()() { m_parent.update(m_index); }
+  };
+
+  void update(size_t i) {
+    try {
+      TileRecord record;
+      record.bbox      = m_tiles[i];
+      record.input_key = m_corr_view.tile_input_key(record.bbox);
+      if (!tile_is_stale(m_old_manifest, record, stereo_settings().corr_timeout,
+                         m_corr_view.seconds_per_op())) {
+        m_records[i] = *m_old_manifest.find(record.bbox);
+        return;
+      }
+
+      Stopwatch sw;
+      sw.start();
+      ImageView<PixelMask<Vector2f> > result = crop(m_corr_view, record.bbox);
+      sw.stop();
+      record.seconds        = sw.elapsed_seconds();
+      record.valid_fraction = valid_fraction(result, bounding_box(result));
+
+      // GDAL is not safe for concurrent updates of the same file
+      Mutex::Lock lock(m_mutex);
+      patch_image_region(m_d_file, ImageView<PixelMask<Vector2i> >
+                         (pixel_cast<PixelMask<Vector2i> >(result)),
+                         record.bbox.min() - m_crop_win.min());
+      m_records[i] = record;
+      m_updated[i] = true;
+      m_num_updated++;
+    } catch (std::exception const& e) {
+      Mutex::Lock lock(m_mutex);
+      if (m_error.empty())
+        m_error = e.what();
+    }
+  }
+
+  SeededCorrelatorView const& m_corr_view;
+  BBox2i                      m_crop_win;
+  TileManifest const&         m_old_manifest;
+  std::string                 m_d_file;
+  std::vector<BBox2i>         m_tiles;
+  std::vector<TileRecord>     m_records;
+  std::vector<bool>           m_updated;
+  size_t                      m_num_updated;
+  std::string                 m_error;
+  Mutex                       m_mutex;
+};
+
+/// Write the stats of the correlation tiles, in the order they are in the
+/// image, and a heatmap of the time per tile with a pixel per tile.
+void write_corr_tile_stats(ASPGlobalOptions const& opt, std::vector<TileStats> stats,
+                           BBox2i const& crop_win, bool has_georef,
+                           cartography::GeoReference const& georef) {
+
+  std::map<std::pair<int, int>, TileStats> sorted; // By row, then column
+  for (size_t i = 0; i < stats.size(); i++)
+    sorted[std::make_pair(stats[i].bbox.min().y(), stats[i].bbox.min().x())] = stats[i];
+  stats.clear();
+  for (std::map<std::pair<int, int>, TileStats>::const_iterator it = sorted.begin();
+       it != sorted.end(); it++)
+    stats.push_back(it->second);
+
+  std::string format     = stereo_settings().corr_tile_stats;
+  std::string stats_file = opt.out_prefix + "-D-tile-stats." + format;
+  vw_out() << "Writing: " << stats_file << "\n";
+  write_tile_stats(stats_file, format, stats);
+
+  // The tiles are square
+  int    ts     = opt.raster_tile_size[0];
+  float  nodata = -1.0;
+  cartography::GeoReference heatmap_georef;
+  if (has_georef)
+    heatmap_georef = resample(cartography::crop(georef, crop_win), 1.0/ts);
+  std::string heatmap_file = opt.out_prefix + "-D-tile-stats.tif";
+  vw_out() << "Writing: " << heatmap_file << "\n";
+  vw::cartography::block_write_gdal_image(heatmap_file,
+                                          tile_stats_heatmap(stats, crop_win,
+                                                             opt.raster_tile_size, nodata),
+                                          has_georef, heatmap_georef,
+                                          true, nodata, opt,
+                                          TerminalProgressCallback("asp", "\t--> Tile stats:"));
+}
+
 /// Main stereo correlation function, called after parsing input arguments.
-void stereo_correlation( ASPGlobalOptions& opt ) {
+void stereo_correlation( ASPGlobalOptions& opt, DisparitySink const& sink ) {
 
   // The first thing we will do is compute the low-resolution correlation.
 
@@ -1365,6 +2199,15 @@ if ( stereo_settings().seed_mode > 0 && stereo_settings().use_local_homography )
 	read_local_homographies(local_hom_file, local_size);
   }
 
+  // The per-tile alignment cache is only meaningful with piecewise alignment
+  std::string align_cache_dir;
+  if ( stereo_settings().seed_mode > 0 && stereo_settings().use_local_homography &&
+       stereo_settings().corr_align_cache ){
+    align_cache_dir = opt.out_prefix + "-align-cache";
+    fs::create_directories(align_cache_dir);
+    vw_out() << "\t--> Using tile alignment cache: " << align_cache_dir << "\n";
+  }
+
   stereo::CostFunctionType cost_mode = get_cost_mode_value();
   Vector2i kernel_size    = stereo_settings().corr_kernel;
   BBox2i   trans_crop_win = stereo_settings().trans_crop_win;
@@ -1374,18 +2217,146 @@ if ( stereo_settings().seed_mode > 0 && stereo_settings().use_local_homography )
     seconds_per_op = calc_seconds_per_op(cost_mode, left_disk_image, right_disk_image, kernel_size);
 
   // Set up the reference to the stereo disparity code
-  // - Processing is limited to trans_crop_win for use with parallel_stereo.
-  ImageViewRef<PixelMask<Vector2f> > fullres_disparity =
-    crop(SeededCorrelatorView( left_disk_image, right_disk_image, Lmask, Rmask,
-                               sub_disp, sub_disp_spread, local_hom,
-							   local_hom_L, local_size,  //Ricardo Monteiro
-							   kernel_size, 
-                               cost_mode, corr_timeout, seconds_per_op),  
-         trans_crop_win);
+  SeededCorrelatorView corr_view( left_disk_image, right_disk_image, Lmask, Rmask,
+                                  sub_disp, sub_disp_spread, local_hom,
+                                  local_hom_L, local_size,  //Ricardo Monteiro
+                                  kernel_size, 
+                                  cost_mode, corr_timeout, seconds_per_op,
+                                  align_cache_dir);
+
+  // Seed the tile alignment with the matches for the whole images
+  if ( stereo_settings().seed_mode > 0 && stereo_settings().use_local_homography &&
+       stereo_settings().corr_seed_from_match_file ) {
+    vector<ip::InterestPoint> global_ip1, global_ip2;
+    if (load_global_matches(opt, global_ip1, global_ip2)) {
+      vw_out() << "\t--> Seeding the tile alignment with " << global_ip1.size()
+               << " matches.\n";
+      corr_view.set_global_matches(boost::shared_ptr<MatchIndex>
+        (new MatchIndex(global_ip1, global_ip2, ASPGlobalOptions::corr_tile_size())));
+    } else {
+      vw_out(WarningMessage) << "No match file found, interest points will be "
+                             << "detected in each tile.\n";
+    }
+  }
+
+  // Expanded tiles overlap, so read each block of the inputs only once
+  if ( stereo_settings().seed_mode > 0 && stereo_settings().use_local_homography &&
+       stereo_settings().corr_tile_cache_mb > 0 )
+    corr_view.set_tile_caches(size_t(stereo_settings().corr_tile_cache_mb) * 1024 * 1024);
+
+  // Correlate the tiles predicted to be much more expensive than most in
+  // smaller pieces, which get narrower search ranges and can be shared out
+  // among the threads. The local homography is found per whole tile, and
+  // SGM needs whole tiles, so they are left alone.
+  double split_factor = stereo_settings().corr_split_cost_factor;
+  double split_max_cost = 0; // None are split
+  if ( split_factor > 0 && stereo_settings().seed_mode > 0 &&
+       !stereo_settings().use_local_homography &&
+       stereo_settings().stereo_algorithm == vw::stereo::CORRELATION_WINDOW ) {
+    std::vector<BBox2i> tiles = corr_tile_list(trans_crop_win, opt.raster_tile_size);
+    std::vector<double> costs(tiles.size());
+    for (size_t i = 0; i < tiles.size(); i++)
+      costs[i] = corr_view.predicted_cost(tiles[i]);
+    split_max_cost = split_factor * median_cost(costs);
+    int num_split = 0;
+    for (size_t i = 0; i < costs.size(); i++)
+      if (costs[i] > split_max_cost) num_split++;
+    int min_size = std::max(ASPGlobalOptions::corr_tile_size() / 8, 64);
+    vw_out() << "\t--> Splitting " << num_split << " of " << tiles.size()
+             << " tiles predicted to cost more than " << split_factor
+             << " times the median.\n";
+    corr_view.set_tile_splitting(split_max_cost, min_size,
+                                 boost::shared_ptr<CooperativeTaskQueue>
+                                   (new CooperativeTaskQueue(opt.num_threads)));
+  }
+
+  // Keep the tiles being correlated at once within the memory budget,
+  // less what the input block caches may take.
+  boost::shared_ptr<MemoryBudget> memory_budget;
+  if (stereo_settings().corr_max_memory_mb > 0) {
+    int budget_mb = stereo_settings().corr_max_memory_mb;
+    if ( stereo_settings().seed_mode > 0 && stereo_settings().use_local_homography )
+      budget_mb -= std::max(stereo_settings().corr_tile_cache_mb, 0);
+    if (budget_mb <= 0) {
+      vw_out(WarningMessage) << "The memory budget does not leave room for correlation "
+                             << "beyond the tile cache. Tiles will be correlated one at a time.\n";
+      budget_mb = 1;
+    }
+    vw_out() << "\t--> Correlating tiles within a memory budget of " << budget_mb << " MB.\n";
+    memory_budget.reset(new MemoryBudget(size_t(budget_mb) * 1024 * 1024));
+    corr_view.set_memory_budget(memory_budget);
+  }
 
   // With SGM, we must do the entire image chunk as one tile. Otherwise,
   // if it gets done in smaller tiles, there will be artifacts at tile boundaries.
   bool using_sgm = (stereo_settings().stereo_algorithm > vw::stereo::CORRELATION_WINDOW);
+
+  // In incremental mode, keep a record of how each tile was made. If the
+  // previous run left one, made with the same settings, only the tiles
+  // which changed since are computed again.
+  string d_file        = opt.out_prefix + "-D.tif";
+  string manifest_file = tile_manifest_file(d_file);
+  bool incremental = stereo_settings().corr_incremental;
+  if (incremental && sink) {
+    vw_out(WarningMessage) << "Incremental correlation does not apply when the disparity "
+                           << "is not written to disk.\n";
+    incremental = false;
+  }
+  if (incremental && using_sgm) {
+    vw_out(WarningMessage) << "Incremental correlation is not supported with SGM. "
+                           << "Computing the whole disparity.\n";
+    incremental = false;
+  }
+  TileManifest manifest, old_manifest;
+  boost::shared_ptr<TileRecorder> recorder;
+  bool update_existing = false;
+  if (incremental) {
+    manifest.settings_key   = corr_settings_key(opt, trans_crop_win,
+                                                bounding_box(left_disk_image).size(),
+                                                split_max_cost);
+    manifest.image_size     = trans_crop_win.size();
+    manifest.corr_timeout   = corr_timeout;
+    manifest.seconds_per_op = seconds_per_op;
+    update_existing = fs::exists(d_file) &&
+                      read_tile_manifest(manifest_file, old_manifest) &&
+                      old_manifest.settings_key == manifest.settings_key &&
+                      old_manifest.image_size   == manifest.image_size;
+    // The tiles which are kept keep the alignment the previous run left for
+    // them. The right one was read in with local_hom already.
+    if (update_existing && stereo_settings().seed_mode > 0 &&
+        stereo_settings().use_local_homography)
+      update_existing = read_previous_tile_alignments(opt, local_hom, local_hom_L, local_size);
+  }
+  bool record_keys = incremental && !update_existing;
+  bool tile_stats  = (stereo_settings().corr_tile_stats != "none");
+  if (record_keys || tile_stats) {
+    recorder.reset(new TileRecorder(record_keys));
+    corr_view.set_tile_recorder(recorder);
+  }
+
+  // Optionally compute the piecewise alignment of upcoming tiles on separate
+  // threads, so the correlation threads do not stall on interest point matching.
+  // The workers start right away and use corr_view itself, so it must be set
+  // up in full by now. An update aligns only the tiles which changed, and
+  // those are not known ahead of time.
+  boost::shared_ptr<AlignmentPrefetcher> prefetcher;
+  int align_threads = stereo_settings().corr_align_threads;
+  if ( stereo_settings().seed_mode > 0 && stereo_settings().use_local_homography &&
+       align_threads > 0 && !update_existing ){
+    std::vector<BBox2i> tiles = corr_tile_list(trans_crop_win, opt.raster_tile_size);
+    // Hold at most one aligned tile per thread beyond those being correlated
+    int capacity = opt.num_threads + align_threads;
+    vw_out() << "\t--> Aligning tiles ahead of correlation with "
+             << align_threads << " thread(s).\n";
+    prefetcher.reset(new AlignmentPrefetcher(tiles,
+                                             boost::bind(&SeededCorrelatorView::align_tile,
+                                                         boost::cref(corr_view), _1),
+                                             align_threads, capacity));
+    corr_view.set_alignment_prefetcher(prefetcher);
+  }
+
+  // - Processing is limited to trans_crop_win for use with parallel_stereo.
+  ImageViewRef<PixelMask<Vector2f> > fullres_disparity = crop(corr_view, trans_crop_win);
   /*if (using_sgm) {
     Vector2i image_size = bounding_box(fullres_disparity).size();
     int max_dim = std::max(image_size[0], image_size[1]);
@@ -1417,9 +2388,26 @@ if ( stereo_settings().seed_mode > 0 && stereo_settings().use_local_homography )
   bool   has_nodata      = false;
   double nodata          = -32768.0;
 
-  string d_file = opt.out_prefix + "-D.tif";
-  vw_out() << "Writing: " << d_file << "\n";
-  if (stereo_settings().stereo_algorithm > vw::stereo::CORRELATION_WINDOW) {
+  if (sink) {
+    vw_out() << "\t--> Passing the disparity on to the next stages without writing it.\n";
+  } else if (update_existing) {
+    vw_out() << "Updating: " << d_file << "\n";
+  } else {
+    vw_out() << "Writing: " << d_file << "\n";
+    // A manifest left from before would not describe the new file
+    if (fs::exists(manifest_file))
+      fs::remove(manifest_file);
+  }
+  std::vector<TileStats> kept_stats; // Of the tiles an update leaves alone
+  if (sink) {
+    // The later stages pull the tiles they need straight from here
+    sink(fullres_disparity);
+  } else if (update_existing) {
+    DisparityTileUpdater updater(corr_view, trans_crop_win, old_manifest, d_file,
+                                 corr_tile_list(trans_crop_win, opt.raster_tile_size));
+    manifest.add(updater.run(opt.num_threads));
+    kept_stats = updater.kept_stats();
+  } else if (stereo_settings().stereo_algorithm > vw::stereo::CORRELATION_WINDOW) {
     // SGM performs subpixel correlation in this step, so write out floats.
     
     // Rasterize the image first as one block, then write it out using multiple blocks.
@@ -1445,7 +2433,11 @@ if ( stereo_settings().seed_mode > 0 && stereo_settings().use_local_homography )
 			        has_nodata, nodata, opt,
 			        TerminalProgressCallback("asp", "\t--> Correlation :") );
   }
+  // The alignment workers use corr_view, so they must be done before it goes
+  if (prefetcher)
+    prefetcher->stop();
 //<RM>: overwrite transformations applied to right tile and also write to file the transformations applied to the left tile and the aligned tile size for each tile
+// This goes before the manifest, which must not describe tiles whose alignments were not written.
 if ( stereo_settings().seed_mode > 0 && stereo_settings().use_local_homography ){
     string local_hom_file = opt.out_prefix + "-local_hom.txt";
     write_local_homographies(local_hom_file, local_hom);
@@ -1455,10 +2447,54 @@ if ( stereo_settings().seed_mode > 0 && stereo_settings().use_local_homography )
 	write_local_homographies(local_size_file, local_size);
   }
 
+  if (record_keys)
+    manifest.add(recorder->records());
+  if (incremental)
+    write_tile_manifest(manifest_file, manifest);
+  if (tile_stats) {
+    std::vector<TileStats> stats = recorder->stats();
+    stats.insert(stats.end(), kept_stats.begin(), kept_stats.end());
+    write_corr_tile_stats(opt, stats, trans_crop_win, has_left_georef, left_georef);
+  }
+  corr_view.log_tile_cache_stats();
+  if (memory_budget)
+    vw_out() << "\t--> Peak predicted memory of concurrent tiles: "
+             << memory_budget->peak_bytes() / (1024 * 1024) << " MB, with "
+             << memory_budget->num_waits() << " waits for memory.\n";
+
   vw_out() << "\n[ " << current_posix_time_string() << " ] : CORRELATION FINISHED \n";
 
 } // End function stereo_correlation
 
+void set_corr_raster_options( ASPGlobalOptions& opt ) {
+
+  // Leave the number of parallel block threads equal to the default unless we
+  //  are using SGM in which case only one block at a time should be processed.
+  // - Processing multiple blocks is possible, but it is better to use a larger blocks
+  //   with more threads applied to the single block.
+  // - Thread handling is still a little confusing because opt.num_threads is ONLY used
+  //   to control the number of parallel image blocks written at a time.  Everything else
+  //   reads directly from vw_settings().default_num_threads()
+  const bool using_sgm = (stereo_settings().stereo_algorithm > vw::stereo::CORRELATION_WINDOW);
+  opt.num_threads = vw_settings().default_num_threads();
+  if (using_sgm)
+    opt.num_threads = 1;
+
+  // Integer correlator requires large tiles
+  //---------------------------------------------------------
+  int ts = stereo_settings().corr_tile_size_ovr;
+  
+  // GDAL block write sizes must be a multiple to 16 so if the input value is
+  //  not a multiple of 16 increase it until it is.
+  const int TILE_MULTIPLE = 16;
+  if (ts % TILE_MULTIPLE != 0)
+    ts = ((ts / TILE_MULTIPLE) + 1) * TILE_MULTIPLE;
+    
+  opt.raster_tile_size = Vector2i(ts, ts);
+}
+
+// stereo_stream links in this stage and has its own main()
+#ifndef ASP_STEREO_STREAM
 int main(int argc, char* argv[]) {
 
   //try {
@@ -1473,29 +2509,7 @@ int main(int argc, char* argv[]) {
 			 verbose, output_prefix, opt_vec);
     ASPGlobalOptions opt = opt_vec[0];
 
-    // Leave the number of parallel block threads equal to the default unless we
-    //  are using SGM in which case only one block at a time should be processed.
-    // - Processing multiple blocks is possible, but it is better to use a larger blocks
-    //   with more threads applied to the single block.
-    // - Thread handling is still a little confusing because opt.num_threads is ONLY used
-    //   to control the number of parallel image blocks written at a time.  Everything else
-    //   reads directly from vw_settings().default_num_threads()
-    const bool using_sgm = (stereo_settings().stereo_algorithm > vw::stereo::CORRELATION_WINDOW);
-    opt.num_threads = vw_settings().default_num_threads();
-    if (using_sgm)
-      opt.num_threads = 1;
-
-    // Integer correlator requires large tiles
-    //---------------------------------------------------------
-    int ts = stereo_settings().corr_tile_size_ovr;
-    
-    // GDAL block write sizes must be a multiple to 16 so if the input value is
-    //  not a multiple of 16 increase it until it is.
-    const int TILE_MULTIPLE = 16;
-    if (ts % TILE_MULTIPLE != 0)
-      ts = ((ts / TILE_MULTIPLE) + 1) * TILE_MULTIPLE;
-      
-    opt.raster_tile_size = Vector2i(ts, ts);
+    set_corr_raster_options(opt);
 
     // Internal Processes
     //---------------------------------------------------------
@@ -1506,6 +2520,7 @@ int main(int argc, char* argv[]) {
 
   return 0;
 }
+#endif
 
 //<RM>: Added functions
 
@@ -1517,7 +2532,12 @@ BBox2f piecewiseAlignment_affineepipolar( ImageView<float> tile_left_image,
 										  Vector2i& right_size,
 										  vw::Matrix<double>& left_matrix,
 										  vw::Matrix<double>& right_matrix,
-										  BBox2f local_search_range)
+										  BBox2f local_search_range,
+										  std::vector<ip::InterestPoint> const& seed_ip1,
+										  std::vector<ip::InterestPoint> const& seed_ip2,
+										  std::vector<ip::InterestPoint>& matchedRANSAC_ip1,
+										  std::vector<ip::InterestPoint>& matchedRANSAC_ip2,
+										  TileStats * stats)
 {
 	using namespace vw;
 	//<RM>: piecewise alignment is only applied if it generates an average vertical disparity value of ..
@@ -1532,24 +2552,48 @@ BBox2f piecewiseAlignment_affineepipolar( ImageView<float> tile_left_image,
 	double left_nodata_value  = numeric_limits<double>::quiet_NaN();
   	double right_nodata_value = numeric_limits<double>::quiet_NaN();
     std::vector<ip::InterestPoint> matched_ip1, matched_ip2;
-	std::vector<ip::InterestPoint> matchedRANSAC_ip1,matchedRANSAC_ip2;
+	matchedRANSAC_ip1.clear();
+	matchedRANSAC_ip2.clear();
 	std::vector<ip::InterestPoint> matchedRANSAC_final_ip1, matchedRANSAC_final_ip2;
 	ip::InterestPoint aux_r_ip, aux_l_ip;
 	char outputName[30];
 	double newAvgDeltaY;
 	double *newAvgDeltaYP = &newAvgDeltaY;
+	TileStats no_stats;
+	if (stats == NULL)
+		stats = &no_stats;
+	Stopwatch ip_timer;
+	ip_timer.start();
 #if DEBUG_RM 
 	int X = bbox.min().x()/ASPGlobalOptions::corr_tile_size();
 	int Y = bbox.min().y()/ASPGlobalOptions::corr_tile_size();
 	sprintf(outputName, "matches_%d_%d", Y, X);
 #endif
-    try {
-		homography_ip_matching1( tile_left_image, tile_right_image,
+	//<RM>: start from the matches of the whole image pair which fall in this tile, if there are enough of them
+	int min_seed_matches = stereo_settings().corr_min_seed_matches;
+	if (!seed_ip1.empty() && int(seed_ip1.size()) >= min_seed_matches) {
+		try {
+			homography_ip_filter1( seed_ip1, seed_ip2, outputName, threshRANSAC,
+								   matchedRANSAC_ip1, matchedRANSAC_ip2 );
+		}catch(...){}
+		if (int(matchedRANSAC_ip1.size()) < min_seed_matches) {
+			matchedRANSAC_ip1.clear();
+			matchedRANSAC_ip2.clear();
+		}
+	}
+	//<RM>: otherwise detect interest points in the tile
+	if (matchedRANSAC_ip1.empty()) {
+    	try {
+			homography_ip_matching1( tile_left_image, tile_right_image,
                                            stereo_settings().ip_per_tile,
                                            outputName, threshRANSAC, 
                                            left_nodata_value, right_nodata_value,
 					  					   matchedRANSAC_ip1, matchedRANSAC_ip2); 
-	}catch(...){}
+		}catch(...){}
+	}
+	ip_timer.stop();
+	stats->ip_seconds  = ip_timer.elapsed_seconds();
+	stats->num_matches = matchedRANSAC_ip1.size();
 	//<RM>: estimate global alignment for this specific tile
 	avgDeltaY = calcAverageDeltaY(matchedRANSAC_ip1, matchedRANSAC_ip2); 
 #if DEBUG_RM 
@@ -1567,23 +2611,29 @@ BBox2f piecewiseAlignment_affineepipolar( ImageView<float> tile_left_image,
 		} catch ( ... ) {
 		  	left_matrix = math::identity_matrix<3>();
 			right_matrix = math::identity_matrix<3>();
+			stats->fit_status = TILE_FIT_FAILED;
 			return local_search_range;
 		}
 		//<RM>: check left_matrix and right_matrix
 		if(!check_homography_matrix(left_matrix, right_matrix, ransac_ip1, ransac_ip2, avgDeltaY, bbox, newAvgDeltaYP)){
 			left_matrix = math::identity_matrix<3>();
 			right_matrix = math::identity_matrix<3>();
+			stats->fit_status = TILE_FIT_REJECTED;
 			return local_search_range;
 		}
 	//<RM>: if the alignment cannot be improved
 	}else{ 
 		left_matrix = math::identity_matrix<3>();
 		right_matrix = math::identity_matrix<3>();
+		stats->fit_status = TILE_FIT_NO_MATCH;
 		return local_search_range;
 	}
 	//<RM>: in case the affine_epipolar_rectification1 returned identity matrix
-	if(left_matrix == math::identity_matrix<3>() && right_matrix == math::identity_matrix<3>())
+	if(left_matrix == math::identity_matrix<3>() && right_matrix == math::identity_matrix<3>()){
+		stats->fit_status = TILE_FIT_FAILED;
 		return local_search_range;
+	}
+	stats->fit_status = TILE_FIT_ACCEPTED;
 
 	//<RM>: estimate new search range
 	//return calcSearchRange(matchedRANSAC_ip1, matchedRANSAC_ip2, left_matrix, right_matrix, threshSearchRange);
@@ -1755,11 +2805,24 @@ Vector2i affine_epipolar_rectification1( Vector2i const& left_size,
     using namespace vw;
 
     std::vector<ip::InterestPoint> matched_ip1, matched_ip2;
-    detect_match_ip( matched_ip1, matched_ip2,
+    // Optionally detect on a subsampled tile and refine the matches in full resolution
+    pyramid_detect_match_ip( matched_ip1, matched_ip2,
 		     image1.impl(), image2.impl(),
-		     ip_per_tile,
+		     ip_per_tile, stereo_settings().corr_ip_pyramid_levels,
 		     nodata1, nodata2 );
 
+    return homography_ip_filter1(matched_ip1, matched_ip2, output_name, inlier_threshold,
+                                 final_ip1, final_ip2);
+  }
+
+//<RM>: homography_ip_filter1 - the outlier removal part of homography_ip_matching1, also used on matches from the match file
+  bool homography_ip_filter1( std::vector<ip::InterestPoint> const& matched_ip1,
+			      std::vector<ip::InterestPoint> const& matched_ip2,
+			      std::string const& output_name,
+			      int inlier_threshold,
+			      std::vector<ip::InterestPoint>& final_ip1,
+			      std::vector<ip::InterestPoint>& final_ip2) {
+
     if ( matched_ip1.size() == 0 || matched_ip2.size() == 0 )
       return false;
     std::vector<Vector3> ransac_ip1 = iplist_to_vectorlist(matched_ip1),
@@ -1781,7 +2844,7 @@ Vector2i affine_epipolar_rectification1( Vector2i const& left_size,
       return false;
     }
 
-    BOOST_FOREACH( size_t& index, indices ) {
+    BOOST_FOREACH( size_t const& index, indices ) {
       final_ip1.push_back(matched_ip1[index]);
       final_ip2.push_back(matched_ip2[index]);
     }
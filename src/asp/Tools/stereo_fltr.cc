@@ -19,17 +19,21 @@
 /// \file stereo_fltr.cc
 ///
 #include <asp/Tools/stereo.h>
+#include <asp/Tools/stereo_stream.h>
 
 #include <vw/Stereo/DisparityMap.h>
 #include <vw/Stereo/Algorithms.h>
 #include <vw/Cartography/GeoReferenceUtils.h>
+#include <vw/Core/ThreadPool.h>
 #include <vw/Image/BlobIndex.h>
-#include <vw/Image/ErodeView.h>
 #include <vw/Image/InpaintView.h>
 
 #include <asp/Core/ThreadedEdgeMask.h>
+#include <asp/Core/TextureSmoothing.h>
+#include <asp/Core/TiledBlobIndex.h>
 #include <asp/Sessions/StereoSession.h>
 #include <xercesc/util/PlatformUtils.hpp>
+#include <set>
 
 using namespace vw;
 using namespace asp;
@@ -100,20 +104,43 @@ public:
     ImageView<typename ImageT::pixel_type> input_tile      = crop(m_img,      bbox2);
     ImageView<pixel_type                 > input_disp_tile = crop(m_disp_img, bbox2);
 
-    ImageView<float> texture_image;
-    vw::stereo::texture_measure(input_tile, texture_image, m_texture_smooth_range);
-    //write_image( "texture_image.tif", texture_image );
-
-
     ImageView<pixel_type > disp_tile_median;
     vw::stereo::disparity_median_filter(input_disp_tile, disp_tile_median, m_median_filter_size);
-    
-    ImageView<pixel_type > disp_tile_filtered;
-    vw::stereo::texture_preserving_disparity_filter(disp_tile_median, disp_tile_filtered, texture_image, 
-                                                    m_texture_max, m_max_smooth_kernel_size);
+    if (m_max_smooth_kernel_size <= 1)
+      return prerasterize_type(disp_tile_median,
+                               -bbox2.min().x(), -bbox2.min().y(),
+                               cols(), rows() );
+
+    // The texture and the smoothing come from summed-area tables, so
+    // large kernels cost no more per pixel than small ones
+    ImageView<float> intensity = select_channel(input_tile, 0), texture_image;
+    asp::texture_measure(intensity, m_texture_smooth_range, texture_image);
+
+    DisparityPlanes disp_planes(disp_tile_median.cols(), disp_tile_median.rows());
+    for (int row = 0; row < disp_planes.rows; row++) {
+      for (int col = 0; col < disp_planes.cols; col++) {
+        pixel_type const& p = disp_tile_median(col, row);
+        size_t k = disp_planes.index(col, row);
+        disp_planes.dx[k]    = p.child()[0];
+        disp_planes.dy[k]    = p.child()[1];
+        disp_planes.valid[k] = is_valid(p);
+      }
+    }
+    DisparityPlanes smoothed;
+    asp::texture_preserving_smoothing(disp_planes, texture_image, m_texture_max,
+                                      m_max_smooth_kernel_size, smoothed);
+
+    // Only the valid pixels are changed
+    for (int row = 0; row < smoothed.rows; row++) {
+      for (int col = 0; col < smoothed.cols; col++) {
+        size_t k = smoothed.index(col, row);
+        if (smoothed.valid[k])
+          disp_tile_median(col, row) = pixel_type(Vector2f(smoothed.dx[k], smoothed.dy[k]));
+      }
+    }
 
     // Fake the bounds on the returned image region
-    return prerasterize_type(disp_tile_filtered,
+    return prerasterize_type(disp_tile_median,
                              -bbox2.min().x(), -bbox2.min().y(),
                              cols(), rows() );
   }
@@ -143,21 +170,41 @@ texture_aware_disparity_filter( ImageViewBase<ImageT    > const& img,
 
 
 
-// Erode blobs from given image by iterating through tiles, biasing
-// each tile by a factor of blob size, removing blobs in the tile,
-// then shrinking the tile back. The bias is necessary to help avoid
-// fragmenting (and then unnecessarily removing) blobs.
+// Fill the small holes of a disparity, then remove its small blobs.
+// The holes and blobs are found over the whole image before any tile is
+// computed, with the tiles labeled in parallel and joined across their
+// seams, so they are the same whichever tile they are seen from. Holes
+// are 4-connected and blobs 8-connected. A size of 0 turns a step off.
 template <class ImageT>
-class PerTileErode: public ImageViewBase<PerTileErode<ImageT> >{
+class BlobFilterView: public ImageViewBase<BlobFilterView<ImageT> >{
   ImageT m_img;
+  int    m_fill_max_size, m_erode_max_size;
+  boost::shared_ptr<TiledBlobIndex> m_holes, m_blobs;
+
 public:
-  PerTileErode( ImageViewBase<ImageT>   const& img):
-    m_img(img.impl()){}
+  BlobFilterView( ImageViewBase<ImageT> const& img, int fill_max_size, int erode_max_size,
+                  int tile_size, int num_threads ):
+    m_img(img.impl()), m_fill_max_size(fill_max_size), m_erode_max_size(erode_max_size){
+
+    // The blobs are found in the image with its holes filled, so the
+    // holes must be known first
+    Vector2i size(cols(), rows());
+    if (m_fill_max_size > 0) {
+      m_holes.reset(new TiledBlobIndex(size, tile_size, false));
+      build_index(*m_holes, true, num_threads);
+      vw_out() << "\t    * Identified " << num_small(*m_holes, m_fill_max_size) << " holes\n";
+    }
+    if (m_erode_max_size > 0) {
+      m_blobs.reset(new TiledBlobIndex(size, tile_size, true));
+      build_index(*m_blobs, false, num_threads);
+      vw_out() << "\t    * Eroding " << num_small(*m_blobs, m_erode_max_size) << " islands\n";
+    }
+  }
 
   // Image View interface
   typedef typename ImageT::pixel_type pixel_type;
   typedef pixel_type                  result_type;
-  typedef ProceduralPixelAccessor<PerTileErode> pixel_accessor;
+  typedef ProceduralPixelAccessor<BlobFilterView> pixel_accessor;
 
   inline int32 cols  () const { return m_img.cols(); }
   inline int32 rows  () const { return m_img.rows(); }
@@ -166,30 +213,63 @@ public:
   inline pixel_accessor origin() const { return pixel_accessor( *this, 0, 0 ); }
 
   inline pixel_type operator()( double /*i*/, double /*j*/, int32 /*p*/ = 0 ) const {
-    vw_throw(NoImplErr() << "PerTileErode::operator()(...) is not implemented");
+    vw_throw(NoImplErr() << "BlobFilterView::operator()(...) is not implemented");
     return pixel_type();
   }
 
   typedef CropView<ImageView<pixel_type> > prerasterize_type;
   inline prerasterize_type prerasterize(BBox2i const& bbox) const {
 
-    int area = stereo_settings().erode_max_size;
+    // Work on whole tiles of the indices, as they are labeled in tiles
+    BBox2i region = aligned(bbox);
+    ImageView<pixel_type> tile_img = crop(m_img, region);
+    ImageView<uint8> filled;
+
+    if (m_holes) {
+      ImageView<int32> holes;
+      hole_blobs(tile_img, region, holes);
+
+      // A hole is filled from its edge, which may be past the tile
+      std::set<int32> small_holes;
+      BBox2i needed = region;
+      for (int row = bbox.min().y(); row < bbox.max().y(); row++) {
+        for (int col = bbox.min().x(); col < bbox.max().x(); col++) {
+          int32 hole = holes(col - region.min().x(), row - region.min().y());
+          if (hole < 0 || m_holes->blob_size(hole) > size_t(m_fill_max_size) ||
+              small_holes.count(hole))
+            continue;
+          small_holes.insert(hole);
+          BBox2i hole_box = m_holes->blob_bbox(hole);
+          hole_box.expand(1);
+          hole_box.crop(bounding_box(m_img));
+          needed.grow(hole_box);
+        }
+      }
+      if (!(needed == region)) {
+        region   = aligned(needed);
+        tile_img = crop(m_img, region);
+        hole_blobs(tile_img, region, holes);
+      }
 
-    // We look a beyond the current tile, to avoid cutting blobs
-    // if possible. Skinny blobs will be cut though.
-    int bias = 2*int(ceil(sqrt(double(area))));
+      filled = filled_mask(tile_img, holes);
+      if (!small_holes.empty())
+        tile_img = inpaint_holes(tile_img, holes, small_holes);
+    }
 
-    BBox2i bbox2 = bbox;
-    bbox2.expand(bias);
-    bbox2.crop(bounding_box(m_img));
-    ImageView<pixel_type> tile_img = crop(m_img, bbox2);
-
-    int tile_size = max(bbox2.width(), bbox2.height()); // don't subsplit
-    BlobIndexThreaded smallBlobIndex(tile_img, area, tile_size);
-    ImageView<pixel_type> clean_tile_img = applyErodeView(tile_img,
-                                                          smallBlobIndex);
-    return prerasterize_type(clean_tile_img,
-                             -bbox2.min().x(), -bbox2.min().y(),
+    if (m_blobs) {
+      ImageView<int32> blobs;
+      blobs_of(*m_blobs, m_holes ? filled : validity(tile_img, false), region, blobs);
+      for (int row = 0; row < tile_img.rows(); row++) {
+        for (int col = 0; col < tile_img.cols(); col++) {
+          int32 blob = blobs(col, row);
+          if (blob >= 0 && m_blobs->blob_size(blob) <= size_t(m_erode_max_size))
+            invalidate(tile_img(col, row));
+        }
+      }
+    }
+
+    return prerasterize_type(tile_img,
+                             -region.min().x(), -region.min().y(),
                              cols(), rows() );
   }
 
@@ -197,13 +277,135 @@ public:
   inline void rasterize(DestT const& dest, BBox2i bbox) const {
     vw::rasterize(prerasterize(bbox), dest, bbox);
   }
+
+private:
+  class IndexTask: public Task {
+    BlobFilterView const& m_view;
+    TiledBlobIndex      & m_index;
+    size_t m_tile;
+    bool   m_holes;
+  public:
+    IndexTask(BlobFilterView const& view, TiledBlobIndex & index, size_t tile, bool holes):
+      m_view(view), m_index(index), m_tile(tile), m_holes(holes) {}
+    void operator()() {
+      BBox2i box = m_index.tiles()[m_tile];
+      ImageView<pixel_type> tile_img = crop(m_view.m_img, box);
+      if (m_holes) {
+        m_index.add_tile(m_tile, validity(tile_img, true));
+      } else if (m_view.m_holes) {
+        ImageView<int32> holes;
+        m_view.hole_blobs(tile_img, box, holes);
+        m_index.add_tile(m_tile, m_view.filled_mask(tile_img, holes));
+      } else {
+        m_index.add_tile(m_tile, validity(tile_img, false));
+      }
+    }
+  };
+
+  void build_index(TiledBlobIndex & index, bool holes, int num_threads) const {
+    FifoWorkQueue queue(num_threads);
+    for (size_t t = 0; t < index.tiles().size(); t++)
+      queue.add_task(boost::shared_ptr<Task>(new IndexTask(*this, index, t, holes)));
+    queue.join_all();
+    index.merge();
+  }
+
+  static size_t num_small(TiledBlobIndex const& index, int max_size) {
+    size_t n = 0;
+    for (size_t b = 0; b < index.num_blobs(); b++)
+      n += (index.blob_size(int32(b)) <= size_t(max_size));
+    return n;
+  }
+
+  // The smallest region made of whole index tiles which holds the box
+  BBox2i aligned(BBox2i const& box) const {
+    if (!m_holes && !m_blobs)
+      return box;
+    int ts = (m_holes ? m_holes : m_blobs)->tile_size();
+    BBox2i region(Vector2i((box.min().x()/ts)*ts, (box.min().y()/ts)*ts),
+                  Vector2i(((box.max().x() + ts - 1)/ts)*ts, ((box.max().y() + ts - 1)/ts)*ts));
+    region.crop(bounding_box(m_img));
+    return region;
+  }
+
+  static ImageView<uint8> validity(ImageView<pixel_type> const& img, bool invert) {
+    ImageView<uint8> mask(img.cols(), img.rows());
+    for (int row = 0; row < img.rows(); row++)
+      for (int col = 0; col < img.cols(); col++)
+        mask(col, row) = (is_valid(img(col, row)) != invert);
+    return mask;
+  }
+
+  // The valid pixels, and those of the holes which will be filled
+  ImageView<uint8> filled_mask(ImageView<pixel_type> const& img,
+                               ImageView<int32> const& holes) const {
+    ImageView<uint8> mask = validity(img, false);
+    for (int row = 0; row < img.rows(); row++) {
+      for (int col = 0; col < img.cols(); col++) {
+        int32 hole = holes(col, row);
+        if (hole >= 0 && m_holes->blob_size(hole) <= size_t(m_fill_max_size))
+          mask(col, row) = 1;
+      }
+    }
+    return mask;
+  }
+
+  void hole_blobs(ImageView<pixel_type> const& img, BBox2i const& region,
+                  ImageView<int32> & holes) const {
+    blobs_of(*m_holes, validity(img, true), region, holes);
+  }
+
+  // The blobs in a region made of whole tiles, given its mask. A tile
+  // which does not come out as it was indexed, as when a filter upstream
+  // is not deterministic, is left with no blobs, so it is not changed.
+  static void blobs_of(TiledBlobIndex const& index, ImageView<uint8> const& mask,
+                       BBox2i const& region, ImageView<int32> & blobs) {
+    blobs.set_size(region.width(), region.height());
+    int ts = index.tile_size();
+    for (int row = region.min().y(); row < region.max().y(); row += ts) {
+      for (int col = region.min().x(); col < region.max().x(); col += ts) {
+        size_t tile = index.tile_index(col, row);
+        BBox2i box  = index.tiles()[tile] - region.min();
+        ImageView<int32> tile_blobs;
+        if (!index.tile_blobs(tile, crop(mask, box), tile_blobs))
+          vw_out(WarningMessage) << "The disparity in " << index.tiles()[tile]
+                                 << " differs from when its blobs were found. "
+                                 << "Its holes and blobs are left as they are.\n";
+        crop(blobs, box) = tile_blobs;
+      }
+    }
+  }
+
+  // Fill the given holes with the VW inpainting, as when the holes were
+  // indexed with VW. Each is filled from the pixels around it, which are
+  // all in the image, so the result does not depend on the tile.
+  static ImageView<pixel_type> inpaint_holes(ImageView<pixel_type> const& img,
+                                             ImageView<int32> const& holes,
+                                             std::set<int32> const& which) {
+    ImageView<PixelMask<uint8> > hole_mask(img.cols(), img.rows());
+    for (int row = 0; row < img.rows(); row++) {
+      for (int col = 0; col < img.cols(); col++) {
+        hole_mask(col, row) = PixelMask<uint8>(1);
+        if (!which.count(holes(col, row)))
+          hole_mask(col, row).invalidate();
+      }
+    }
+    // The holes were sized already, so there is no limit here, and this
+    // runs on a thread of the pool, so it takes one thread and one tile.
+    BlobIndexThreaded hole_index(hole_mask, 0, std::max(img.cols(), img.rows()), 1);
+    bool use_grassfire = true;
+    pixel_type default_inpaint_val;
+    return inpaint(img, hole_index, use_grassfire, default_inpaint_val);
+  }
 };
 
 template <class ImageT>
-PerTileErode<ImageT>
-per_tile_erode( ImageViewBase<ImageT> const& img) {
-  typedef PerTileErode<ImageT> return_type;
-  return return_type( img.impl() );
+BlobFilterView<ImageT>
+blob_filter( ImageViewBase<ImageT> const& img, int fill_max_size, int erode_max_size ) {
+  typedef BlobFilterView<ImageT> return_type;
+  return return_type( img.impl(), fill_max_size, erode_max_size,
+                      vw::vw_settings().default_tile_size(),
+                      vw::vw_settings().default_num_threads() );
 }
 
 // Run several cleanup passes with desired cleanup mode.
@@ -239,9 +441,10 @@ struct MultipleDisparityCleanUp {
 };
 
 template <class ImageT>
-void write_good_pixel_and_filtered( ImageViewBase<ImageT> const& inputview,
-                                    ASPGlobalOptions const& opt ) {
-  // Write Good Pixel Map
+void write_good_pixel_map( ImageViewBase<ImageT> const& inputview,
+                           ASPGlobalOptions const& opt,
+                           bool has_left_georef, cartography::GeoReference const& left_georef,
+                           bool has_nodata, double nodata ) {
   // Sub-sampling so that the user can actually view it.
   double sub_scale = double( min( inputview.impl().cols(),
                                 inputview.impl().rows() ) ) / 2048.0;
@@ -259,12 +462,6 @@ void write_good_pixel_and_filtered( ImageViewBase<ImageT> const& inputview,
                   )
                  ), sub_scale);
 
-  // Determine if we can attach geo information to the output image
-  cartography::GeoReference left_georef;
-  bool has_left_georef = read_georeference(left_georef,  opt.out_prefix + "-L.tif");
-  bool has_nodata = false;
-  double nodata = -32768.0;
-
   vw::cartography::GeoReference good_pixel_georef;
   if (has_left_georef) {
     // Account for scale. Note that goodPixelImage is not guaranteed to respect
@@ -278,76 +475,152 @@ void write_good_pixel_and_filtered( ImageViewBase<ImageT> const& inputview,
     ( goodPixelFile, goodPixelImage, has_left_georef, good_pixel_georef,
       has_nodata, nodata,
       opt, TerminalProgressCallback("asp", "\t--> Good pixel map: ") );
+}
 
-  bool removeSmallBlobs = (stereo_settings().erode_max_size > 0);
-
+/// Write the filtered disparity to F.tif, or pass it on to the next stage.
+template <class ImageT>
+void write_filtered( ImageViewBase<ImageT> const& disparity,
+                     ASPGlobalOptions const& opt, DisparitySink const& sink,
+                     bool has_left_georef, cartography::GeoReference const& left_georef,
+                     bool has_nodata, double nodata ) {
+  if (sink) {
+    sink(disparity.impl());
+    return;
+  }
   string outF = opt.out_prefix + "-F.tif";
+  vw_out() << "Writing: " << outF << endl;
+  vw::cartography::block_write_gdal_image( outF, disparity.impl(),
+                                           has_left_georef, left_georef,
+                                           has_nodata, nodata, opt,
+                                           TerminalProgressCallback
+                                           ("asp","\t--> Filtering: ") );
+}
 
-  // Fill holes
-  if(stereo_settings().enable_fill_holes) {
-    // Generate a list of blobs below a maximum size
-    // - This requires the entire input image to be read in
-    //    and produces a single blob list for the entire image.
-    vw_out() << "\t--> Filling holes with inpainting method.\n";
-    BlobIndexThreaded smallHoleIndex( invert_mask( inputview.impl() ),
-                                      stereo_settings().fill_hole_max_size,
-                                      vw::vw_settings().default_tile_size(),
-                                      vw::vw_settings().default_num_threads()
-                                      );
-    vw_out() << "\t    * Identified " << smallHoleIndex.num_blobs() << " holes\n";
-    bool use_grassfire = true;
-    typename ImageT::pixel_type default_inpaint_val;
-
-
-    if (!removeSmallBlobs) { // Skip small blob removal
-      // Write out the image to disk, filling in the blobs in the process
-      vw_out() << "Writing: " << outF << endl;
-      vw::cartography::block_write_gdal_image( outF,
-                                   inpaint(inputview.impl(), smallHoleIndex,
-                                           use_grassfire, default_inpaint_val),
-                                   has_left_georef, left_georef,
-                                   has_nodata, nodata, opt,
-                                   TerminalProgressCallback
-                                   ("asp","\t--> Filtering: ") );
+template <class ImageT>
+void write_good_pixel_and_filtered( ImageViewBase<ImageT> const& inputview,
+                                    ASPGlobalOptions const& opt,
+                                    DisparitySink const& sink,
+                                    bool good_pixels_after_blobs = false ) {
+
+  // Determine if we can attach geo information to the output image
+  cartography::GeoReference left_georef;
+  bool has_left_georef = read_georeference(left_georef,  opt.out_prefix + "-L.tif");
+  bool has_nodata = false;
+  double nodata = -32768.0;
+
+  // The good pixel map takes a pass over the whole disparity, which when
+  // streaming means computing it all once more.
+  bool good_pixel_map = (!sink || stereo_settings().stream_save_intermediates);
+
+  int fill_max_size  = stereo_settings().enable_fill_holes ?
+    stereo_settings().fill_hole_max_size : 0;
+  int erode_max_size = stereo_settings().erode_max_size;
+  if (fill_max_size <= 0 && erode_max_size <= 0) {
+    if (good_pixel_map)
+      write_good_pixel_map(inputview, opt, has_left_georef, left_georef, has_nodata, nodata);
+    write_filtered(inputview.impl(),
+                   opt, sink, has_left_georef, left_georef, has_nodata, nodata);
+    return;
+  }
+
+  // Blobs are removed after the holes are filled, so that a small blob
+  // goes together with the holes inside it. Finding them reads the whole
+  // input, so it is done once for both outputs.
+  if (fill_max_size > 0)
+    vw_out() << "\t--> Filling holes.\n";
+  if (erode_max_size > 0)
+    vw_out() << "\t--> Removing small blobs.\n";
+  BlobFilterView<ImageT> filtered = blob_filter(inputview.impl(), fill_max_size, erode_max_size);
+
+  if (good_pixel_map) {
+    if (good_pixels_after_blobs)
+      write_good_pixel_map(filtered, opt, has_left_georef, left_georef, has_nodata, nodata);
+    else
+      write_good_pixel_map(inputview, opt, has_left_georef, left_georef, has_nodata, nodata);
+  }
+  write_filtered(filtered, opt, sink, has_left_georef, left_georef, has_nodata, nodata);
+} //end write_good_pixel_and_filtered
+
+/// Filter the refined disparity and write it to F.tif, or pass it on to
+/// the next stage. The filtered view refers to blob indices local to
+/// this function, hence it is handed to a sink rather than returned.
+template <class DispT>
+void filter_disparity( ASPGlobalOptions& opt, DispT const& disparity,
+                       DisparitySink const& sink ) {
+
+  // Applying additional clipping from the edge. We make new
+  // mask files to avoid a weird and tricky segfault due to ownership issues.
+  DiskImageView<vw::uint8> left_mask ( opt.out_prefix+"-lMask.tif" );
+  DiskImageView<vw::uint8> right_mask( opt.out_prefix+"-rMask.tif" );
+  int32 mask_buffer = stereo_settings().mask_buffer_size;
+  if (mask_buffer < 0) // If Unset, set to the subpixel kernel size.
+    mask_buffer = max( stereo_settings().subpixel_kernel );
+
+
+  DiskImageView<PixelGray<float> > left_disk_image (opt.out_prefix+"-L.tif");
+
+  vw_out() << "\t--> Cleaning up disparity map prior to filtering processes ("
+           << stereo_settings().rm_cleanup_passes << " pass).\n";
+
+  // If the user wants to do no filtering at all, that amounts
+  // to doing no passes.
+  if (stereo_settings().filter_mode == 0)
+    stereo_settings().rm_cleanup_passes = 0;
+
+  if ( stereo_settings().mask_flatfield ) {
+    ImageViewRef<PixelMask<Vector2f> > filtered_disparity;
+    if ( stereo_settings().rm_cleanup_passes >= 1 )
+    {
+      filtered_disparity =
+        stereo::disparity_mask
+        (MultipleDisparityCleanUp<DispT>()
+         (disparity, stereo_settings().rm_cleanup_passes),
+         apply_mask(asp::threaded_edge_mask(left_mask, 0,mask_buffer,1024)),
+         apply_mask(asp::threaded_edge_mask(right_mask,0,mask_buffer,1024)));
     }
-    else { // Add small blob removal step
-      // Write out the image to disk, filling in and removing blobs in the process
-      // - Blob removal is done second to make sure inner-blob holes are removed.
-      vw_out() << "Writing: " << outF << endl;
-      vw::cartography::block_write_gdal_image( outF,
-                                   per_tile_erode
-                                   (inpaint(inputview.impl(),
-                                            smallHoleIndex,
-                                            use_grassfire,
-                                            default_inpaint_val) ),
-                                   has_left_georef, left_georef,
-                                   has_nodata, nodata, opt,
-                                   TerminalProgressCallback
-                                   ("asp","\t--> Filtering: ") );
+    else { // No cleanup passes
+      filtered_disparity =
+        stereo::disparity_mask
+        (disparity,
+         apply_mask(asp::threaded_edge_mask(left_mask, 0,mask_buffer,1024)),
+         apply_mask(asp::threaded_edge_mask(right_mask,0,mask_buffer,1024)));
     }
 
-  } else { // No hole filling
-    if (!removeSmallBlobs) { // Skip small blob removal
-      vw_out() << "Writing: " << outF << endl;
-      vw::cartography::block_write_gdal_image( outF, inputview.impl(),
-                                   has_left_georef, left_georef,
-                                   has_nodata, nodata, opt,
-                                   TerminalProgressCallback
-                                   ("asp", "\t--> Filtering: ") );
-    }
-    else { // Add small blob removal step
-      vw_out() << "\t--> Removing small blobs.\n";
-      // Write out the image to disk, removing the blobs in the process
-      vw_out() << "Writing: " << outF << endl;
-      vw::cartography::block_write_gdal_image(outF, per_tile_erode(inputview.impl()),
-                                  has_left_georef, left_georef,
-                                  has_nodata, nodata, opt,
-                                  TerminalProgressCallback
-                                  ("asp","\t--> Filtering: ") );
+    // This is only turned on for apollo. The small blobs are removed
+    // together with the holes, and the good pixel map shows them removed.
+    write_good_pixel_and_filtered(filtered_disparity, opt, sink, true);
+  } else { // mask_flatfield == false
+    // No Erosion step
+    if ( stereo_settings().rm_cleanup_passes >= 1 ) {
+      // Apply an outlier removal filter
+      write_good_pixel_and_filtered
+        (stereo::disparity_mask
+          (MultipleDisparityCleanUp<DispT>()
+            (disparity, stereo_settings().rm_cleanup_passes),
+             apply_mask(asp::threaded_edge_mask(left_mask, 0,mask_buffer,1024)),
+             apply_mask(asp::threaded_edge_mask(right_mask,0,mask_buffer,1024))),
+           opt, sink);
     }
+    else { // No cleanup passes
+      write_good_pixel_and_filtered
+        (stereo::disparity_mask
+          (
+           texture_aware_disparity_filter(left_disk_image, disparity, 
+                                          stereo_settings().median_filter_size,
+                                          stereo_settings().disp_smooth_size+2, // Compute texture a little larger than smooth radius
+                                          stereo_settings().disp_smooth_texture, 
+                                          stereo_settings().disp_smooth_size),
+            apply_mask(asp::threaded_edge_mask(left_mask, 0,mask_buffer,1024)),
+            apply_mask(asp::threaded_edge_mask(right_mask,0,mask_buffer,1024))),
+          opt, sink);
+    } // End cleanup passes check
+  } // End mask_flatfield check
+}
 
-  } // End no hole filling case
-} //end write_good_pixel_and_filtered
+void stream_filtering( ASPGlobalOptions& opt, DisparityViewRef const& disparity,
+                       DisparitySink const& sink ) {
+  filter_disparity(opt, disparity, sink);
+}
 
 void stereo_filtering( ASPGlobalOptions& opt ) {
 
@@ -357,93 +630,11 @@ void stereo_filtering( ASPGlobalOptions& opt ) {
 
   try {
 
-    // Rasterize the results so far to a temporary file on disk.
-    // This file is deleted once we complete the second half of the
-    // disparity map filtering process.
-
     // Apply filtering for high frequencies
     typedef DiskImageView<PixelMask<Vector2f> > input_type;
     input_type disparity_disk_image(post_correlation_fname);
 
-    // Applying additional clipping from the edge. We make new
-    // mask files to avoid a weird and tricky segfault due to ownership issues.
-    DiskImageView<vw::uint8> left_mask ( opt.out_prefix+"-lMask.tif" );
-    DiskImageView<vw::uint8> right_mask( opt.out_prefix+"-rMask.tif" );
-    int32 mask_buffer = stereo_settings().mask_buffer_size;
-    if (mask_buffer < 0) // If Unset, set to the subpixel kernel size.
-      mask_buffer = max( stereo_settings().subpixel_kernel );
-
-
-    DiskImageView<PixelGray<float> > left_disk_image (opt.out_prefix+"-L.tif");
-
-    vw_out() << "\t--> Cleaning up disparity map prior to filtering processes ("
-             << stereo_settings().rm_cleanup_passes << " pass).\n";
-
-    // If the user wants to do no filtering at all, that amounts
-    // to doing no passes.
-    if (stereo_settings().filter_mode == 0)
-      stereo_settings().rm_cleanup_passes = 0;
-
-    if ( stereo_settings().mask_flatfield ) {
-      ImageViewRef<PixelMask<Vector2f> > filtered_disparity;
-      if ( stereo_settings().rm_cleanup_passes >= 1 )
-      {
-        filtered_disparity =
-          stereo::disparity_mask
-          (MultipleDisparityCleanUp<input_type>()
-           (disparity_disk_image, stereo_settings().rm_cleanup_passes),
-           apply_mask(asp::threaded_edge_mask(left_mask, 0,mask_buffer,1024)),
-           apply_mask(asp::threaded_edge_mask(right_mask,0,mask_buffer,1024)));
-      }
-      else { // No cleanup passes
-        filtered_disparity =
-          stereo::disparity_mask
-          (disparity_disk_image,
-           apply_mask(asp::threaded_edge_mask(left_mask, 0,mask_buffer,1024)),
-           apply_mask(asp::threaded_edge_mask(right_mask,0,mask_buffer,1024)));
-      }
-
-      // This is only turned on for apollo. Blob detection doesn't
-      // work too great when tracking a whole lot of spots. HiRISE
-      // seems to keep breaking this so I've keep it turned off.
-      //
-      // The crash happens inside Boost Graph when dealing with
-      // large number of blobs.
-      BlobIndexThreaded bindex( filtered_disparity,
-                                stereo_settings().erode_max_size,
-                                vw::vw_settings().default_tile_size(),
-                                vw::vw_settings().default_num_threads()
-                                );
-      vw_out() << "\t    * Eroding " << bindex.num_blobs() << " islands\n";
-      write_good_pixel_and_filtered
-        ( ErodeView<ImageViewRef<PixelMask<Vector2f> > >(filtered_disparity,
-                                                         bindex ), opt );
-    } else { // mask_flatfield == false
-      // No Erosion step
-      if ( stereo_settings().rm_cleanup_passes >= 1 ) {
-        // Apply an outlier removal filter
-        write_good_pixel_and_filtered
-          (stereo::disparity_mask
-            (MultipleDisparityCleanUp<input_type>()
-              (disparity_disk_image, stereo_settings().rm_cleanup_passes),
-               apply_mask(asp::threaded_edge_mask(left_mask, 0,mask_buffer,1024)),
-               apply_mask(asp::threaded_edge_mask(right_mask,0,mask_buffer,1024))),
-             opt);
-      }
-      else { // No cleanup passes
-        write_good_pixel_and_filtered
-          (stereo::disparity_mask
-            (
-             texture_aware_disparity_filter(left_disk_image, disparity_disk_image, 
-                                            stereo_settings().median_filter_size,
-                                            stereo_settings().disp_smooth_size+2, // Compute texture a little larger than smooth radius
-                                            stereo_settings().disp_smooth_texture, 
-                                            stereo_settings().disp_smooth_size),
-              apply_mask(asp::threaded_edge_mask(left_mask, 0,mask_buffer,1024)),
-              apply_mask(asp::threaded_edge_mask(right_mask,0,mask_buffer,1024))),
-            opt);
-      } // End cleanup passes check
-    } // End mask_flatfield check
+    filter_disparity(opt, disparity_disk_image, DisparitySink());
 
   } catch (IOErr const& e) {
     vw_throw( ArgumentErr() << "\nUnable to start at filtering stage -- could not read input files.\n"
@@ -451,6 +642,8 @@ void stereo_filtering( ASPGlobalOptions& opt ) {
   }
 } // end stereo_filtering()
 
+// stereo_stream links in this stage and has its own main()
+#ifndef ASP_STEREO_STREAM
 int main(int argc, char* argv[]) {
 
   try {
@@ -488,3 +681,4 @@ int main(int argc, char* argv[]) {
 
   return 0;
 }
+#endif
@@ -20,12 +20,14 @@
 ///
 
 #include <asp/Tools/stereo.h>
+#include <asp/Tools/stereo_stream.h>
 #include <vw/Stereo/PreFilter.h>
 #include <vw/Stereo/CostFunctions.h>
 #include <vw/Stereo/SubpixelView.h>
 #include <vw/Stereo/EMSubpixelCorrelatorView.h>
 #include <vw/Stereo/DisparityMap.h>
 #include <asp/Core/LocalHomography.h>
+#include <asp/Core/AffineSubpixel.h>
 #include <asp/Sessions/StereoSession.h>
 #include <xercesc/util/PlatformUtils.hpp>
 
@@ -41,6 +43,26 @@ namespace vw {
   template<> struct PixelFormatID<PixelMask<Vector<float, 5> > >   { static const PixelFormatEnum value = VW_PIXEL_GENERIC_6_CHANNEL; };
 }
 
+// The affine mode which refines each pixel only until it converges,
+// rather than running the fixed iterations of the Vision Workbench ones.
+const int CONVERGING_SUBPIXEL_MODE = 12;
+
+bool converging_subpixel() {
+  return stereo_settings().subpixel_mode == CONVERGING_SUBPIXEL_MODE;
+}
+
+// A crop of an image, filtered as correlation filters it. It extends
+// past the image with the edge values.
+template <class ImageT>
+ImageView<float> filtered_crop(ImageViewBase<ImageT> const& image, BBox2i const& box) {
+  ImageView<PixelGray<float> > image_crop
+    = pixel_cast<PixelGray<float> >(crop(edge_extend(image.impl(), ConstantEdgeExtension()), box));
+  PrefilterModeType prefilter_mode =
+    static_cast<vw::stereo::PrefilterModeType>(stereo_settings().pre_filter_mode);
+  return select_channel(prefilter_image(image_crop, prefilter_mode,
+                                        stereo_settings().slogW), 0);
+}
+
 template <class Image1T, class Image2T>
 ImageViewRef<PixelMask<Vector2f> >
 refine_disparity(Image1T const& left_image,
@@ -53,7 +75,11 @@ refine_disparity(Image1T const& left_image,
   PrefilterModeType prefilter_mode = 
     static_cast<vw::stereo::PrefilterModeType>(stereo_settings().pre_filter_mode);
 
-  if ((stereo_settings().subpixel_mode == 0) || (stereo_settings().subpixel_mode > 5)) {
+  if (stereo_settings().subpixel_mode == CONVERGING_SUBPIXEL_MODE) {
+    // Done tile by tile in PerTileRfne
+    if (verbose)
+      vw_out() << "\t--> Using affine subpixel mode, iterating each pixel until it converges\n";
+  } else if ((stereo_settings().subpixel_mode == 0) || (stereo_settings().subpixel_mode > 5)) {
     // Do nothing (includes SGM specific subpixel modes)
     if (verbose)
       vw_out() << "\t--> Skipping subpixel mode.\n";
@@ -164,7 +190,9 @@ refine_disparity(Image1T const& left_image,
       per_pixel_filter(em_disparity_disk_image,
                        EMCorrelator::ExtractDisparityFunctor());
   } // End EM subpixel cases 
-  if ((stereo_settings().subpixel_mode < 0) || (stereo_settings().subpixel_mode > 5)){
+  if ((stereo_settings().subpixel_mode < 0) ||
+      (stereo_settings().subpixel_mode > 5 &&
+       stereo_settings().subpixel_mode != CONVERGING_SUBPIXEL_MODE)){
     if (verbose) {
       vw_out() << "\t--> Invalid Subpixel mode selection: " << stereo_settings().subpixel_mode << endl;
       vw_out() << "\t--> Doing nothing\n";
@@ -189,6 +217,7 @@ class PerTileRfne: public ImageViewBase<PerTileRfne<Image1T, Image2T, SeedDispT>
   ImageView<Matrix3x3> m_local_hom_L; //<RM>: 
   ImageView<Matrix3x3> m_local_size; //<RM>:
   ASPGlobalOptions const&       m_opt;
+  boost::shared_ptr<SubpixelIterationLog> m_iterations; // Optional, for the converging mode
   Vector2              m_upscale_factor;
 
 public:
@@ -201,12 +230,13 @@ public:
                ImageView    <Matrix3x3> const& local_hom,
 			   ImageView    <Matrix3x3> const& local_hom_L, 
 			   ImageView    <Matrix3x3> const& local_size,
-               ASPGlobalOptions const& opt):
+               ASPGlobalOptions const& opt,
+               boost::shared_ptr<SubpixelIterationLog> iterations):
     m_left_image(left_image.impl()), m_right_image(right_image.impl()),
     m_left_mask(left_mask), m_right_mask(right_mask),
     m_integer_disp( integer_disp.impl() ), m_sub_disp( sub_disp.impl() ),
     m_local_hom(local_hom), m_local_hom_L(local_hom_L), m_local_size(local_size),
-	m_opt(opt){
+	m_opt(opt), m_iterations(iterations){
 
     m_upscale_factor = Vector2(double(m_left_image.impl().cols()) / m_sub_disp.cols(),
                                double(m_left_image.impl().rows()) / m_sub_disp.rows());
@@ -304,8 +334,12 @@ public:
 
 	  BBox2i newBBoxDisp = BBox2i(0, 0, left_size.x(), left_size.y());
 	  ImageView<pixel_type> tile_disparity_trans;
-	  tile_disparity_trans = crop(refine_disparity(left_trans_img, right_trans_img,
- 											   disp_trans_img, m_opt, verbose), newBBoxDisp);
+	  if (converging_subpixel())
+	    tile_disparity_trans = converging_tile(left_trans_masked_img, right_trans_masked_img,
+	                                           disp_trans_img, newBBoxDisp, bbox);
+	  else
+	    tile_disparity_trans = crop(refine_disparity(left_trans_img, right_trans_img,
+	                                                 disp_trans_img, m_opt, verbose), newBBoxDisp);
 #if DEBUG_RM
       sprintf(outputName, "disp1_%d_%d.tif", H, W);
 	  vw::cartography::block_write_gdal_image(outputName, tile_disparity_trans, geo_opt);
@@ -343,6 +377,10 @@ public:
 	sprintf(outputName, "disp3_%d_%d.tif", H, W);			
 	vw::cartography::block_write_gdal_image(outputName, tile_disparity, geo_opt);
 #endif
+    }else if (converging_subpixel()){
+      tile_disparity = converging_tile(copy_mask(m_left_image,  create_mask(m_left_mask )),
+                                       copy_mask(m_right_image, create_mask(m_right_mask)),
+                                       m_integer_disp, bbox, bbox);
     }else{
       tile_disparity = crop(refine_disparity(m_left_image, m_right_image,
                                              m_integer_disp, m_opt, verbose), bbox);
@@ -358,6 +396,89 @@ public:
   inline void rasterize(DestT const& dest, BBox2i bbox) const {
     vw::rasterize(prerasterize(bbox), dest, bbox);
   }
+
+private:
+  // Refine the disparity in bbox of the given masked images, starting
+  // from the integer disparity, with each pixel iterating only until it
+  // converges, and log the iterations used for the tile. With local
+  // homography the images are those of the tile, aligned. There is no
+  // pyramid, and the pixels outside the masks are left out of the windows.
+  template <class LeftT, class RightT, class DispT>
+  ImageView<pixel_type> converging_tile(ImageViewBase<LeftT > const& left_image,
+                                        ImageViewBase<RightT> const& right_image,
+                                        ImageViewBase<DispT > const& integer_disp,
+                                        BBox2i const& bbox, BBox2i const& tile) const {
+    ImageView<pixel_type> tile_disparity = crop(integer_disp.impl(), bbox);
+    DisparityPlanes planes(bbox.width(), bbox.height());
+    BBox2f range;
+    for (int row = 0; row < bbox.height(); row++) {
+      for (int col = 0; col < bbox.width(); col++) {
+        pixel_type const& d = tile_disparity(col, row);
+        size_t k = planes.index(col, row);
+        planes.dx[k]    = d.child()[0];
+        planes.dy[k]    = d.child()[1];
+        planes.valid[k] = is_valid(d);
+        if (is_valid(d))
+          range.grow(d.child());
+      }
+    }
+
+    AffineSubpixelOptions sub_opt;
+    for (int i = 0; i < 2; i++) // The kernel must be odd
+      sub_opt.kernel_size[i] = stereo_settings().subpixel_kernel[i] | 1;
+    sub_opt.max_iterations = stereo_settings().subpixel_affine_iter;
+    sub_opt.threshold      = stereo_settings().subpixel_convergence_threshold;
+    IterationHistogram histogram(sub_opt.max_iterations);
+
+    if (range.min().x() <= range.max().x()) {
+      // The windows may move by max_shift, and the filter needs the
+      // pixels around them too
+      int margin = std::max(sub_opt.kernel_size.x(), sub_opt.kernel_size.y())/2
+        + int(ceil(sub_opt.max_shift)) + 1 + int(ceil(3*stereo_settings().slogW)) + 1;
+
+      BBox2i left_box = bbox;
+      left_box.expand(margin);
+      BBox2i right_box(bbox.min() + Vector2i(int(floor(range.min().x())), int(floor(range.min().y()))),
+                       bbox.max() + Vector2i(int(ceil (range.max().x())), int(ceil (range.max().y()))));
+      right_box.expand(margin);
+
+      ImageView<float> left  = filtered_crop(apply_mask(left_image.impl()),  left_box);
+      ImageView<float> right = filtered_crop(apply_mask(right_image.impl()), right_box);
+      ImageView<uint8> left_mask  = mask_crop(left_image,  left_box);
+      ImageView<uint8> right_mask = mask_crop(right_image, right_box);
+      converging_affine_subpixel(left, left_mask, left_box.min(),
+                                 right, right_mask, right_box.min(),
+                                 bbox.min(), planes, sub_opt, histogram);
+
+      for (int row = 0; row < bbox.height(); row++) {
+        for (int col = 0; col < bbox.width(); col++) {
+          size_t k = planes.index(col, row);
+          tile_disparity(col, row) = pixel_type(Vector2f(planes.dx[k], planes.dy[k]));
+          if (!planes.valid[k])
+            tile_disparity(col, row).invalidate();
+        }
+      }
+    }
+
+    if (m_iterations)
+      m_iterations->record(tile, histogram);
+    VW_OUT(DebugMessage, "stereo") << "Subpixel iterations in tile " << tile << ": "
+                                   << histogram.summary() << "\n";
+    return tile_disparity;
+  }
+
+  // Which pixels of a crop of a masked image are valid. It extends past
+  // the image with the edge values.
+  template <class ImageT>
+  static ImageView<uint8> mask_crop(ImageViewBase<ImageT> const& image, BBox2i const& box) {
+    ImageView<typename ImageT::pixel_type> image_crop
+      = crop(edge_extend(image.impl(), ConstantEdgeExtension()), box);
+    ImageView<uint8> mask(box.width(), box.height());
+    for (int row = 0; row < box.height(); row++)
+      for (int col = 0; col < box.width(); col++)
+        mask(col, row) = is_valid(image_crop(col, row));
+    return mask;
+  }
 };
 
 template <class Image1T, class Image2T, class SeedDispT>
@@ -371,19 +492,21 @@ per_tile_rfne( ImageViewBase<Image1T  > const& left,
                ImageView<Matrix3x3    > const& local_hom,
 			   ImageView<Matrix3x3    > const& local_hom_L, 
 			   ImageView<Matrix3x3    > const& local_size,
-               ASPGlobalOptions const& opt) {
+               ASPGlobalOptions const& opt,
+               boost::shared_ptr<SubpixelIterationLog> iterations) {
   typedef PerTileRfne<Image1T, Image2T, SeedDispT> return_type;
   return return_type( left.impl(), right.impl(), left_mask, right_mask,
                       integer_disp.impl(), sub_disp.impl(), local_hom,
 					  local_hom_L, local_size,
-					  opt );
+					  opt, iterations );
 }
 
-void stereo_refinement( ASPGlobalOptions const& opt ) {
+DisparityViewRef refined_disparity( ASPGlobalOptions const& opt,
+                                    DisparityViewRef const& integer_disp,
+                                    boost::shared_ptr<SubpixelIterationLog> iterations ) {
 
   ImageViewRef<PixelGray<float>    > left_image, right_image;
   ImageViewRef<uint8               > left_mask,  right_mask;
-  ImageViewRef<PixelMask<Vector2f> > integer_disp;
   ImageViewRef<PixelMask<Vector2f> > sub_disp;
   ImageView<Matrix3x3> local_hom;
   ImageView<Matrix3x3> local_hom_L;
@@ -399,16 +522,6 @@ void stereo_refinement( ASPGlobalOptions const& opt ) {
     left_mask    = DiskImageView<uint8>(left_mask_file );
     right_mask   = DiskImageView<uint8>(right_mask_file);
 
-    // Read the correct type of correlation file (float for SGM/MGM, otherwise integer)
-    std::string disp_file = opt.out_prefix + "-D.tif";
-    boost::shared_ptr<DiskImageResource> rsrc(DiskImageResourcePtr(disp_file));
-    ChannelTypeEnum disp_data_type = rsrc->channel_type();
-    if (disp_data_type == VW_CHANNEL_INT32)
-      integer_disp = pixel_cast<PixelMask<Vector2f> >(
-                      DiskImageView< PixelMask<Vector2i> >(disp_file));
-    else // File on disk is float
-      integer_disp = DiskImageView< PixelMask<Vector2f> >(disp_file);
-    
     if ( stereo_settings().seed_mode > 0 &&
          stereo_settings().use_local_homography ){
       sub_disp = DiskImageView<PixelMask<Vector2f> >(opt.out_prefix+"-D_sub.tif");
@@ -456,15 +569,56 @@ void stereo_refinement( ASPGlobalOptions const& opt ) {
   ImageView<PixelGray<float>    > left_dummy(1, 1), right_dummy(1, 1);
   ImageView<PixelMask<Vector2f> > dummy_disp(1, 1);
   refine_disparity(left_dummy, right_dummy, dummy_disp, opt, verbose);
+  if (converging_subpixel()) {
+    if (stereo_settings().subpixel_convergence_threshold <= 0)
+      vw_throw( ArgumentErr() << "Subpixel mode " << CONVERGING_SUBPIXEL_MODE
+                              << " needs a positive subpixel-convergence-threshold.\n" );
+    vw_out() << "\t--> Refining each pixel until its disparity changes by less than "
+             << stereo_settings().subpixel_convergence_threshold << " pixels.\n";
+  }
 
-  ImageViewRef< PixelMask<Vector2f> > refined_disp
-    = crop(per_tile_rfne(left_image, right_image, 
+  return crop(per_tile_rfne(left_image, right_image, 
 			 left_mask, // Ricardo Monteiro
 			 right_mask,
              integer_disp, sub_disp, local_hom,
 			 local_hom_L, local_size, // Ricardo Monteiro
-			 opt), 
+			 opt, iterations), 
            stereo_settings().trans_crop_win);
+}
+
+void write_subpixel_iterations( ASPGlobalOptions const& opt,
+                                SubpixelIterationLog const& iterations ) {
+  if (iterations.num_tiles() == 0)
+    return;
+
+  string file = opt.out_prefix + "-subpixel-iterations.txt";
+  vw_out() << "Writing: " << file << "\n";
+  iterations.write(file);
+  vw_out() << "Subpixel refinement iterations: "
+           << iterations.total().summary() << "\n";
+}
+
+void stereo_refinement( ASPGlobalOptions const& opt ) {
+
+  ImageViewRef<PixelMask<Vector2f> > integer_disp;
+  try {
+    // Read the correct type of correlation file (float for SGM/MGM, otherwise integer)
+    std::string disp_file = opt.out_prefix + "-D.tif";
+    boost::shared_ptr<DiskImageResource> rsrc(DiskImageResourcePtr(disp_file));
+    ChannelTypeEnum disp_data_type = rsrc->channel_type();
+    if (disp_data_type == VW_CHANNEL_INT32)
+      integer_disp = pixel_cast<PixelMask<Vector2f> >(
+                      DiskImageView< PixelMask<Vector2i> >(disp_file));
+    else // File on disk is float
+      integer_disp = DiskImageView< PixelMask<Vector2f> >(disp_file);
+  } catch (IOErr const& e) {
+    vw_throw( ArgumentErr() << "\nUnable to start at refinement stage -- could not read input files.\n" 
+                            << e.what() << "\nExiting.\n\n" );
+  }
+
+  boost::shared_ptr<SubpixelIterationLog> iterations(new SubpixelIterationLog);
+  ImageViewRef< PixelMask<Vector2f> > refined_disp = refined_disparity(opt, integer_disp,
+                                                                       iterations);
   
   cartography::GeoReference left_georef;
   bool   has_left_georef = read_georeference(left_georef,  opt.out_prefix + "-L.tif");
@@ -477,8 +631,11 @@ void stereo_refinement( ASPGlobalOptions const& opt ) {
                               has_left_georef, left_georef,
                               has_nodata, nodata, opt,
                               TerminalProgressCallback("asp", "\t--> Refinement :") );
+  write_subpixel_iterations(opt, *iterations);
 }
 
+// stereo_stream links in this stage and has its own main()
+#ifndef ASP_STEREO_STREAM
 int main(int argc, char* argv[]) {
 
   try {
@@ -513,3 +670,4 @@ int main(int argc, char* argv[]) {
 
   return 0;
 }
+#endif
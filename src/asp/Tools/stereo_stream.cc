@@ -0,0 +1,222 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file stereo_stream.cc
+///
+/// Runs correlation, refinement, filtering and triangulation in one
+/// process. Writing the point cloud pulls tiles through the stages,
+/// and the disparities in between are kept in a band of cached blocks
+/// rather than written to D.tif, RD.tif and F.tif, unless asked to.
+
+#include <asp/Tools/stereo.h>
+#include <asp/Tools/stereo_stream.h>
+#include <asp/Core/TileBlockCache.h>
+#include <asp/Sessions/StereoSession.h>
+#include <vw/Cartography/GeoReferenceUtils.h>
+#include <boost/bind.hpp>
+#include <xercesc/util/PlatformUtils.hpp>
+
+using namespace vw;
+using namespace asp;
+using namespace std;
+
+namespace {
+
+  typedef TileBlockCache<DisparityViewRef> StageCache;
+
+  /// The caches between the stages, by the name of the stage filling them
+  typedef vector<pair<string, boost::shared_ptr<StageCache> > > StageCacheList;
+
+  /// Hand a disparity on to the next stage. That stage reads it in
+  /// overlapping windows of read_tile_size, so it is kept in blocks of
+  /// the size it is computed in, in a cache holding a band of rows wide
+  /// enough for the threads writing the point cloud. If saving, it is
+  /// written to disk and read back instead, as the separate stages do,
+  /// as integers if asked to.
+  DisparityViewRef stage_output( DisparityViewRef const& disparity,
+                                 ASPGlobalOptions const& opt, Vector2i const& read_tile_size,
+                                 bool save, bool integer, string const& suffix,
+                                 string const& tag, StageCacheList & caches ) {
+    if (!save) {
+      size_t bytes = band_cache_bytes(Vector2i(disparity.cols(), disparity.rows()),
+                                      opt.raster_tile_size, read_tile_size,
+                                      vw_settings().default_num_threads(),
+                                      sizeof(PixelMask<Vector2f>));
+      vw_out() << "\t--> Keeping up to " << bytes / (1024 * 1024) << " MB of the "
+               << tag << " output in memory.\n";
+      boost::shared_ptr<StageCache> cache(new StageCache(disparity, opt.raster_tile_size, bytes));
+      caches.push_back(make_pair(tag, cache));
+      return TileBlockCacheView<DisparityViewRef>(cache);
+    }
+
+    cartography::GeoReference left_georef;
+    bool   has_left_georef = read_georeference(left_georef,  opt.out_prefix + "-L.tif");
+    bool   has_nodata      = false;
+    double nodata          = -32768.0;
+
+    string file = opt.out_prefix + suffix;
+    vw_out() << "Writing: " << file << "\n";
+    if (integer) {
+      vw::cartography::block_write_gdal_image(file, pixel_cast<PixelMask<Vector2i> >(disparity),
+                                              has_left_georef, left_georef,
+                                              has_nodata, nodata, opt,
+                                              TerminalProgressCallback("asp", "\t--> " + tag + " :") );
+      return pixel_cast<PixelMask<Vector2f> >(DiskImageView< PixelMask<Vector2i> >(file));
+    }
+    vw::cartography::block_write_gdal_image(file, disparity,
+                                            has_left_georef, left_georef,
+                                            has_nodata, nodata, opt,
+                                            TerminalProgressCallback("asp", "\t--> " + tag + " :") );
+    return DiskImageView< PixelMask<Vector2f> >(file);
+  }
+
+  /// Warn about blocks which left a cache before the next stage was done
+  /// with them, and so were computed twice.
+  void report_stage_caches( StageCacheList const& caches ) {
+    for (size_t i = 0; i < caches.size(); i++) {
+      StageCache const& cache = *caches[i].second;
+      if (cache.misses() > cache.num_blocks())
+        vw_out(WarningMessage) << cache.misses() - cache.num_blocks() << " blocks of the "
+                               << caches[i].first << " output were computed again after "
+                               << "leaving the cache.\n";
+    }
+  }
+
+  /// Triangulate the filtered disparity.
+  void triangulate_filtered( vector<ASPGlobalOptions> const& tri_opt_vec,
+                             string const& output_prefix,
+                             DisparityViewRef const& filtered ) {
+    vector<DisparityViewRef> disparities;
+    StageCacheList unused;
+    if (stereo_settings().stream_save_intermediates)
+      disparities.push_back(stage_output(filtered, tri_opt_vec[0],
+                                         tri_opt_vec[0].raster_tile_size, true, false,
+                                         "-F.tif", "Filtering", unused));
+    else
+      disparities.push_back(filtered); // Each tile is read once, no need to cache
+    triangulate_disparities(output_prefix, tri_opt_vec, disparities);
+  }
+
+  /// Receives the integer disparity from correlation and takes it
+  /// through refinement, filtering and triangulation. All of it is
+  /// computed while the point cloud is written, within this call.
+  struct StreamStages {
+    ASPGlobalOptions         m_corr_opt, m_rfne_opt;
+    vector<ASPGlobalOptions> m_tri_opt_vec;
+    string                   m_output_prefix;
+
+    void operator()( DisparityViewRef const& integer_disp ) const {
+      bool save = stereo_settings().stream_save_intermediates;
+
+      // The refined view refers to its options, which must outlive it
+      ASPGlobalOptions rfne_opt = m_rfne_opt, fltr_opt = m_tri_opt_vec[0];
+      StageCacheList caches;
+      boost::shared_ptr<SubpixelIterationLog> iterations(new SubpixelIterationLog);
+
+      // SGM correlates the whole image as one tile with all threads. The
+      // threads writing the point cloud would each start one, so the
+      // disparity is written first with the correlation options, which
+      // allow a single block at a time. It is subpixel already.
+      bool using_sgm = (stereo_settings().stereo_algorithm > vw::stereo::CORRELATION_WINDOW);
+      if (using_sgm && !save)
+        vw_out() << "\t--> SGM correlates one tile at a time, will write the "
+                 << "disparity to disk.\n";
+      DisparityViewRef disp = stage_output(integer_disp, m_corr_opt,
+                                           m_rfne_opt.raster_tile_size, save || using_sgm,
+                                           !using_sgm, "-D.tif", "Correlation", caches);
+
+      vw_out() << "\n[ " << current_posix_time_string()
+               << " ] : Stage 2 --> REFINEMENT \n";
+      DisparityViewRef refined_disp = refined_disparity(rfne_opt, disp, iterations);
+
+      // Hole filling and blob removal index the holes and blobs over the
+      // whole disparity before writing any of it, which would refine it
+      // all twice
+      bool whole_pass = stereo_settings().enable_fill_holes ||
+                        stereo_settings().erode_max_size > 0;
+      if (whole_pass && !save)
+        vw_out(WarningMessage) << "Hole filling and blob removal need the whole "
+                               << "refined disparity, will write it to disk.\n";
+      refined_disp = stage_output(refined_disp, rfne_opt, fltr_opt.raster_tile_size,
+                                  save || whole_pass, false, "-RD.tif", "Refinement", caches);
+
+      vw_out() << "\n[ " << current_posix_time_string()
+               << " ] : Stage 3 --> FILTERING \n";
+      stream_filtering(fltr_opt, refined_disp,
+                       boost::bind(triangulate_filtered, boost::cref(m_tri_opt_vec),
+                                   boost::cref(m_output_prefix), _1));
+      report_stage_caches(caches);
+      write_subpixel_iterations(rfne_opt, *iterations);
+    }
+  };
+
+} // end anonymous namespace
+
+int main(int argc, char* argv[]) {
+
+  try {
+    xercesc::XMLPlatformUtils::Initialize();
+
+    vw_out() << "\n[ " << current_posix_time_string()
+             << " ] : Stages 1 to 4 --> CORRELATION THROUGH TRIANGULATION \n";
+
+    stereo_register_sessions();
+
+    bool verbose = false;
+    vector<ASPGlobalOptions> opt_vec;
+    string output_prefix;
+    asp::parse_multiview(argc, argv, CorrelationDescription(),
+                         verbose, output_prefix, opt_vec);
+
+    // Local homographies are found during correlation and written at its
+    // end, when refinement would already have needed them. The flat field
+    // masking is done on files by the sessions.
+    if (opt_vec.size() != 1)
+      vw_throw( ArgumentErr() << "stereo_stream works on a single stereo pair.\n" );
+    if (stereo_settings().seed_mode > 0 && stereo_settings().use_local_homography)
+      vw_throw( ArgumentErr() << "stereo_stream cannot be used with local homographies.\n" );
+    if (stereo_settings().mask_flatfield)
+      vw_throw( ArgumentErr() << "stereo_stream cannot be used with mask-flatfield.\n" );
+
+    // Each stage uses its usual tile size
+    StreamStages stages;
+    stages.m_corr_opt = opt_vec[0];
+    set_corr_raster_options(stages.m_corr_opt);
+
+    stages.m_rfne_opt = opt_vec[0];
+    int ts = ASPGlobalOptions::rfne_tile_size();
+    stages.m_rfne_opt.raster_tile_size = Vector2i(ts, ts);
+
+    stages.m_tri_opt_vec = opt_vec;
+    ts = ASPGlobalOptions::tri_tile_size();
+    stages.m_tri_opt_vec[0].raster_tile_size = Vector2i(ts, ts);
+    stages.m_output_prefix = output_prefix;
+
+    // Internal Processes
+    //---------------------------------------------------------
+    ASPGlobalOptions corr_opt = stages.m_corr_opt;
+    stereo_correlation( corr_opt, stages );
+
+    vw_out() << "\n[ " << current_posix_time_string()
+             << " ] : TRIANGULATION FINISHED \n";
+
+    xercesc::XMLPlatformUtils::Terminate();
+  } ASP_STANDARD_CATCHES;
+
+  return 0;
+}
@@ -0,0 +1,78 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file stereo_stream.h
+///
+/// The entry points of the correlation, refinement, filtering and
+/// triangulation stages, through which stereo_stream runs them in one
+/// process, handing the disparity from one to the next as an image
+/// view rather than through D.tif, RD.tif and F.tif.
+
+#ifndef __ASP_TOOLS_STEREO_STREAM_H__
+#define __ASP_TOOLS_STEREO_STREAM_H__
+
+#include <vw/Image/ImageViewRef.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Math/Vector.h>
+#include <asp/Core/StereoSettings.h>
+#include <asp/Core/AffineSubpixel.h>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <string>
+#include <vector>
+
+typedef vw::ImageViewRef<vw::PixelMask<vw::Vector2f> > DisparityViewRef;
+
+/// Receives the output of a stage in place of it being written to disk.
+/// The view is only guaranteed to be valid during the call.
+typedef boost::function<void(DisparityViewRef const&)> DisparitySink;
+
+/// Set the tile size and number of threads used for correlation.
+void set_corr_raster_options( asp::ASPGlobalOptions& opt );
+
+/// Compute the full resolution disparity and write it to D.tif, or
+/// pass it to the sink if there is one.
+void stereo_correlation( asp::ASPGlobalOptions& opt,
+                         DisparitySink const& sink = DisparitySink() );
+
+/// The subpixel refinement of an integer disparity. The view refers to
+/// opt, which must outlive it. With the converging subpixel mode, the
+/// iterations each tile takes are recorded in the log, if given.
+DisparityViewRef refined_disparity( asp::ASPGlobalOptions const& opt,
+                                    DisparityViewRef const& integer_disp,
+                                    boost::shared_ptr<asp::SubpixelIterationLog> iterations
+                                    = boost::shared_ptr<asp::SubpixelIterationLog>() );
+
+/// Write how many iterations the tiles in the log took, per tile and in
+/// total, if any were recorded.
+void write_subpixel_iterations( asp::ASPGlobalOptions const& opt,
+                                asp::SubpixelIterationLog const& iterations );
+
+/// Filter a refined disparity and pass the result to the sink. The
+/// good pixel map is only written with stream-save-intermediates.
+void stream_filtering( asp::ASPGlobalOptions& opt, DisparityViewRef const& disparity,
+                       DisparitySink const& sink );
+
+/// Triangulate the given filtered disparities, one per stereo pair, or
+/// those in F.tif if none are given.
+void triangulate_disparities( std::string const& output_prefix,
+                              std::vector<asp::ASPGlobalOptions> const& opt_vec,
+                              std::vector<DisparityViewRef> const& disparities
+                              = std::vector<DisparityViewRef>() );
+
+#endif // __ASP_TOOLS_STEREO_STREAM_H__
@@ -26,7 +26,11 @@
 #include <vw/InterestPoint/InterestData.h>
 
 #include <asp/Camera/RPCModel.h>
+#include <asp/Camera/RPCStereoModel.h>
+#include <asp/Camera/CameraRayTable.h>
+#include <asp/Camera/LinescanDGModel.h>
 #include <asp/Tools/stereo.h>
+#include <asp/Tools/stereo_stream.h>
 #include <asp/Tools/jitter_adjust.h>
 #include <asp/Tools/ccd_adjust.h>
 
@@ -40,6 +44,7 @@
 #include <asp/Sessions/StereoSessionSpot.h>
 #include <asp/Sessions/StereoSessionASTER.h>
 #include <xercesc/util/PlatformUtils.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <ctime>
 
 using namespace vw;
@@ -57,6 +62,59 @@ namespace vw {
   template<> struct PixelFormatID<Vector<float,  2> >  { static const PixelFormatEnum value = VW_PIXEL_GENERIC_2_CHANNEL; };
 }
 
+/// The smallest triangulation angle, in terms of dot product, as the
+/// stereo model takes it.
+double triangulation_angle_tol() {
+  return vw::stereo::StereoModel::robust_1_minus_cos
+    (stereo_settings().min_triangulation_angle*M_PI/180);
+}
+
+/// Triangulate a batch of pixels, pixels[c][i] being pixel i as seen in
+/// camera c, one pixel at a time through the stereo model. DG linescan
+/// cameras are wrapped for the batch in a cache of their position and
+/// pose, so over a row of a tile these are interpolated once per image
+/// line. The cameras are those the stereo model was made with.
+template <class StereoModelT>
+void triangulate_batch(StereoModelT const& stereo_model,
+                       vector<const camera::CameraModel*> const& cameras,
+                       vector< vector<Vector2> > const& pixels,
+                       vector<Vector3> & points, vector<Vector3> & errors) {
+  typedef asp::LinescanDGLineCache<vw::camera::PiecewiseAPositionInterpolation,
+                                   vw::camera::SLERPPoseInterpolation> DGLineCache;
+  vector< boost::shared_ptr<camera::CameraModel> > line_caches;
+  vector<const camera::CameraModel*> batch_cameras = cameras;
+  for (size_t c = 0; c < cameras.size(); c++) {
+    asp::DGCameraModel const* dg_cam = dynamic_cast<asp::DGCameraModel const*>(cameras[c]);
+    if (dg_cam == NULL)
+      continue;
+    line_caches.push_back(boost::shared_ptr<camera::CameraModel>(new DGLineCache(*dg_cam)));
+    batch_cameras[c] = line_caches.back().get();
+  }
+  boost::scoped_ptr<StereoModelT> batch_model;
+  if (!line_caches.empty())
+    batch_model.reset(new StereoModelT(batch_cameras, stereo_settings().use_least_squares,
+                                       triangulation_angle_tol()));
+  StereoModelT const& model = batch_model ? *batch_model : stereo_model;
+
+  size_t num_pixels = pixels[0].size();
+  points.resize(num_pixels);
+  errors.resize(num_pixels);
+  vector<Vector2> pixVec(pixels.size());
+  for (size_t i = 0; i < num_pixels; i++) {
+    for (size_t c = 0; c < pixels.size(); c++)
+      pixVec[c] = pixels[c][i];
+    points[i] = model(pixVec, errors[i]);
+  }
+}
+
+/// RPC models find the rays of the whole batch before intersecting them.
+inline void triangulate_batch(asp::RPCStereoModel const& stereo_model,
+                              vector<const camera::CameraModel*> const& /*cameras*/,
+                              vector< vector<Vector2> > const& pixels,
+                              vector<Vector3> & points, vector<Vector3> & errors) {
+  stereo_model.triangulate_batch(pixels, points, errors);
+}
+
 /// The main class for taking in a set of disparities and returning a point cloud via joint triangulation.
 template <class DisparityImageT, class TXT, class StereoModelT>
 class StereoTXAndErrorView : public ImageViewBase<StereoTXAndErrorView<DisparityImageT, TXT, StereoModelT> >
@@ -64,7 +122,9 @@ class StereoTXAndErrorView : public ImageViewBase<StereoTXAndErrorView<Disparity
   vector<DisparityImageT> m_disparity_maps;
   vector<TXT>  m_transforms; // e.g., map-projection or homography to undo
   StereoModelT m_stereo_model;
+  vector<const camera::CameraModel*> m_cameras; // Those of the stereo model
   bool         m_is_map_projected;
+  boost::shared_ptr<asp::RayTableStereoModel> m_ray_model; // Used instead if set
   typedef typename DisparityImageT::pixel_type DPixelT;
 
 public:
@@ -77,11 +137,16 @@ public:
   StereoTXAndErrorView( vector<DisparityImageT> const& disparity_maps,
                         vector<TXT>             const& transforms,
                         StereoModelT            const& stereo_model,
-                        bool is_map_projected) :
+                        vector<const camera::CameraModel*> const& cameras,
+                        bool is_map_projected,
+                        boost::shared_ptr<asp::RayTableStereoModel> ray_model
+                        = boost::shared_ptr<asp::RayTableStereoModel>()) :
     m_disparity_maps(disparity_maps),
     m_transforms(transforms),
     m_stereo_model(stereo_model),
-    m_is_map_projected(is_map_projected) {
+    m_cameras(cameras),
+    m_is_map_projected(is_map_projected),
+    m_ray_model(ray_model) {
 
     // Sanity check
     for (int p = 1; p < (int)m_disparity_maps.size(); p++){
@@ -124,7 +189,10 @@ public:
     return result; // Contains location and error vector
   }
 
-  typedef StereoTXAndErrorView<ImageViewRef<DPixelT>, TXT, StereoModelT> prerasterize_type;
+  /// A tile is triangulated a row at a time. The row is de-warped into
+  /// one array of pixels per camera, which are then triangulated as a
+  /// batch, rather than going through operator() for each pixel.
+  typedef CropView<ImageView<pixel_type> > prerasterize_type;
   inline prerasterize_type prerasterize( BBox2i const& bbox ) const {
     return PreRasterHelper( bbox, m_transforms );
   }
@@ -142,16 +210,20 @@ private:
     // Code for NON-MAP-PROJECTED session types.
     if (m_is_map_projected == false) {
       // We explicitly bring in-memory the disparities for the current box
-      // to speed up processing later, and then we pretend this is the entire
-      // image by virtually enlarging it using a CropView.
-      vector< ImageViewRef<DPixelT> > disparity_cropviews;
-      for (int p = 0; p < (int)m_disparity_maps.size(); p++){
-        ImageView<DPixelT> clip( crop( m_disparity_maps[p], bbox ) );
-        ImageViewRef<DPixelT> cropview_clip = crop(clip, -bbox.min().x(), -bbox.min().y(), cols(), rows() );
-        disparity_cropviews.push_back(cropview_clip);
+      // to speed up processing later.
+      vector< ImageView<DPixelT> > disparity_clips;
+      for (int p = 0; p < (int)m_disparity_maps.size(); p++)
+        disparity_clips.push_back(crop( m_disparity_maps[p], bbox ));
+
+      // The pixels of each camera the tile uses, for the ray tables
+      vector<BBox2i> camera_boxes;
+      if (m_ray_model) {
+        camera_boxes.push_back(transforms[0].reverse_bbox(bbox));
+        for (int p = 0; p < (int)m_disparity_maps.size(); p++)
+          camera_boxes.push_back(transforms[p+1].reverse_bbox(right_bbox(bbox, disparity_clips[p])));
       }
 
-      return prerasterize_type(disparity_cropviews, transforms, m_stereo_model, m_is_map_projected);
+      return triangulate_tile(bbox, disparity_clips, transforms, camera_boxes);
     }
 
     // Code for MAP-PROJECTED session types.
@@ -162,7 +234,8 @@ private:
     // transforms so we are not having a race condition with setting
     // the cache in both transforms while the other threads want to do the same.
     vector<T> transforms_copy = transforms;
-    transforms_copy[0].reverse_bbox(bbox); // As a side effect this call makes transforms_copy create a local cache we want later
+    vector<BBox2i> camera_boxes;
+    camera_boxes.push_back(transforms_copy[0].reverse_bbox(bbox)); // As a side effect this call makes transforms_copy create a local cache we want later
 
     if (transforms_copy.size() != m_disparity_maps.size() + 1){
       vw_throw( ArgumentErr() << "In multi-view triangulation, "
@@ -170,29 +243,83 @@ private:
                 << "than the number of images." );
     }
 
-    vector< ImageViewRef<DPixelT> > disparity_cropviews;
+    vector< ImageView<DPixelT> > disparity_clips;
     for (int p = 0; p < (int)m_disparity_maps.size(); p++){
 
       // We explicitly bring in-memory the disparities for the current
-      // box to speed up processing later, and then we pretend this is
-      // the entire image by virtually enlarging it using a CropView.
+      // box to speed up processing later.
       ImageView<DPixelT> clip( crop( m_disparity_maps[p], bbox ) );
-      ImageViewRef<DPixelT> cropview_clip = crop(clip, -bbox.min().x(), -bbox.min().y(), cols(), rows() );
-      disparity_cropviews.push_back(cropview_clip);
-
-      // Work out what spots in the right image we'll be touching.
-      BBox2i disparity_range = stereo::get_disparity_range(clip);
-      disparity_range.max() += Vector2i(1,1);
-      BBox2i right_bbox = bbox + disparity_range.min();
-      right_bbox.max() += disparity_range.size();
+      disparity_clips.push_back(clip);
 
       // Also cache the data for subsequent transforms
-      transforms_copy[p+1].reverse_bbox(right_bbox); // As a side effect this call makes transforms_copy create a local cache we want later
+      camera_boxes.push_back(transforms_copy[p+1].reverse_bbox(right_bbox(bbox, clip))); // As a side effect this call makes transforms_copy create a local cache we want later
     }
 
-    return prerasterize_type(disparity_cropviews, transforms_copy, m_stereo_model, m_is_map_projected);
+    return triangulate_tile(bbox, disparity_clips, transforms_copy, camera_boxes);
   } // End function PreRasterHelper() DGMapRPC version
 
+  /// Work out what spots in the right image we'll be touching.
+  static BBox2i right_bbox( BBox2i const& bbox, ImageView<DPixelT> const& disparity ) {
+    BBox2i disparity_range = stereo::get_disparity_range(disparity);
+    disparity_range.max() += Vector2i(1,1);
+    BBox2i right_bbox = bbox + disparity_range.min();
+    right_bbox.max() += disparity_range.size();
+    return right_bbox;
+  }
+
+  /// Triangulate a tile given its disparities, and pretend it is the
+  /// entire image by virtually enlarging it using a CropView. The rays
+  /// come from tables over the camera boxes if there is a ray model.
+  template <class T>
+  prerasterize_type triangulate_tile( BBox2i const& bbox,
+                                      vector< ImageView<DPixelT> > const& disparities,
+                                      vector<T> const& transforms,
+                                      vector<BBox2i> const& camera_boxes ) const {
+
+    vector<asp::CameraRayTable> tables;
+    if (m_ray_model) {
+      vector<BBox2> boxes;
+      for (size_t p = 0; p < camera_boxes.size(); p++)
+        boxes.push_back(BBox2(camera_boxes[p]));
+      tables = m_ray_model->tabulate(boxes);
+    }
+
+    int num_disp = disparities.size();
+    ImageView<pixel_type> tile(bbox.width(), bbox.height());
+    vector< vector<Vector2> > pixels(num_disp + 1, vector<Vector2>(bbox.width()));
+    vector<Vector3> points, errors;
+    const Vector2 flag_pix(std::numeric_limits<double>::quiet_NaN(),
+                           std::numeric_limits<double>::quiet_NaN());
+
+    for (int row = 0; row < bbox.height(); row++) {
+
+      // De-warp the whole row in to the native camera coordinates
+      for (int col = 0; col < bbox.width(); col++) {
+        Vector2 pix(col + bbox.min().x(), row + bbox.min().y());
+        pixels[0][col] = transforms[0].reverse(pix); // De-warp "left" pixel
+        for (int c = 0; c < num_disp; c++){
+          DPixelT disp = disparities[c](col, row);
+          if (is_valid(disp)) // De-warp the "right" pixel
+            pixels[c+1][col] = transforms[c+1].reverse( pix + stereo::DispHelper(disp) );
+          else // Insert flag values
+            pixels[c+1][col] = flag_pix;
+        }
+      }
+
+      // Compute the location of the 3D point observed by each pixel
+      if (m_ray_model)
+        m_ray_model->triangulate_batch(tables, pixels, points, errors);
+      else
+        triangulate_batch(m_stereo_model, m_cameras, pixels, points, errors);
+      for (int col = 0; col < bbox.width(); col++) {
+        subvector(tile(col, row), 0, 3) = points[col];
+        subvector(tile(col, row), 3, 3) = errors[col];
+      }
+    }
+
+    return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(), cols(), rows());
+  }
+
 }; // End class StereoTXAndErrorView
 
 /// Just a wrapper function for StereoTXAndErrorView view construction
@@ -201,10 +328,12 @@ StereoTXAndErrorView<DisparityT, TXT, StereoModelT>
 stereo_error_triangulate( vector<DisparityT> const& disparities,
                           vector<TXT>        const& transforms,
                           StereoModelT       const& model,
-                          bool is_map_projected ) {
+                          vector<const camera::CameraModel*> const& cameras,
+                          bool is_map_projected,
+                          boost::shared_ptr<asp::RayTableStereoModel> ray_model ) {
 
   typedef StereoTXAndErrorView<DisparityT, TXT, StereoModelT> result_type;
-  return result_type( disparities, transforms, model, is_map_projected );
+  return result_type( disparities, transforms, model, cameras, is_map_projected, ray_model );
 }
 
 /// Bin the disparities, and from each bin get a disparity value.
@@ -335,6 +464,25 @@ namespace asp{
     bool has_nodata = false;
     double nodata = -std::numeric_limits<float>::max(); // smallest float
 
+    if (stereo_settings().save_quantized_point_cloud){
+      if ( (opt.session->name() == "isis") || (opt.session->name() == "isismapisis")){
+        asp::write_quantized_gdal_image
+          ( point_cloud_file, shift,
+            stereo_settings().point_cloud_rounding_error,
+            point_cloud,
+            has_georef, georef, has_nodata, nodata,
+            opt, TerminalProgressCallback("asp", "\t--> Triangulating: "));
+      }else{
+        asp::block_write_quantized_gdal_image
+          ( point_cloud_file, shift,
+            stereo_settings().point_cloud_rounding_error,
+            point_cloud,
+            has_georef, georef, has_nodata, nodata,
+            opt, TerminalProgressCallback("asp", "\t--> Triangulating: "));
+      }
+      return;
+    }
+
     // TODO: Replace this with with a function call!
     if ( (opt.session->name() == "isis") || (opt.session->name() == "isismapisis")){
       // ISIS does not support multi-threading
@@ -460,9 +608,12 @@ namespace asp{
 }
 
 /// Main triangulation function
+/// Triangulate the filtered disparities of the given stereo pairs, read
+/// from F.tif unless they are passed in.
 template <class SessionT>
 void stereo_triangulation( string          const& output_prefix,
-                           vector<ASPGlobalOptions> const& opt_vec ) {
+                           vector<ASPGlobalOptions> const& opt_vec,
+                           vector<DisparityViewRef> const& disparities ) {
 
   typedef          ImageViewRef<PixelMask<Vector2f> >  PVImageT;
   typedef typename SessionT::stereo_model_type         StereoModelT;
@@ -524,8 +675,14 @@ void stereo_triangulation( string          const& output_prefix,
     } // End try/catch
 
     vector<PVImageT> disparity_maps;
-    for (int p = 0; p < (int)opt_vec.size(); p++){
-      disparity_maps.push_back(opt_vec[p].session->pre_pointcloud_hook(opt_vec[p].out_prefix+"-F.tif"));
+    if (!disparities.empty()) {
+      VW_ASSERT(disparities.size() == opt_vec.size(),
+                ArgumentErr() << "Expecting one disparity per stereo pair.\n");
+      disparity_maps = disparities;
+    } else {
+      for (int p = 0; p < (int)opt_vec.size(); p++){
+        disparity_maps.push_back(opt_vec[p].session->pre_pointcloud_hook(opt_vec[p].out_prefix+"-F.tif"));
+      }
     }
 
     std::string match_file = output_prefix + "-disp.match";
@@ -588,15 +745,30 @@ void stereo_triangulation( string          const& output_prefix,
 
     // Convert the angle tol to be in terms of dot product and pass it
     // to the stereo model.
-    double angle_tol = vw::stereo::StereoModel::robust_1_minus_cos(stereo_settings().min_triangulation_angle*M_PI/180);
+    double angle_tol = triangulation_angle_tol();
     StereoModelT stereo_model( camera_ptrs, stereo_settings().use_least_squares,
                                angle_tol);
 
+    // Rays looked up in tables instead of found for every pixel
+    boost::shared_ptr<asp::RayTableStereoModel> ray_model;
+    if (stereo_settings().ray_table_tolerance > 0) {
+      if (stereo_settings().use_least_squares) {
+        vw_out(WarningMessage) << "Ray tables are not used with least squares "
+                               << "triangulation.\n";
+      } else {
+        double planet_radius
+          = opt_vec[0].session->get_georef().datum().semi_major_axis();
+        ray_model.reset(new asp::RayTableStereoModel
+                        (camera_ptrs, angle_tol, stereo_settings().ray_table_spacing,
+                         stereo_settings().ray_table_tolerance, planet_radius));
+      }
+    }
+
     // Apply radius function and stereo model in one go
     vw_out() << "\t--> Generating a 3D point cloud." << endl;
     ImageViewRef<Vector6> point_cloud = per_pixel_filter
       (stereo_error_triangulate
-       (disparity_maps, transforms, stereo_model, is_map_projected),
+       (disparity_maps, transforms, stereo_model, camera_ptrs, is_map_projected, ray_model),
        universe_radius_func);
 
     // If we crop the left and right images, at each run we must
@@ -619,6 +791,9 @@ void stereo_triangulation( string          const& output_prefix,
       vw_out() << "Computed the point cloud center. Will stop here." << endl;
       return;
     }
+    if (stereo_settings().save_quantized_point_cloud && cloud_center == Vector3())
+      vw_throw( ArgumentErr() << "A quantized point cloud needs the point cloud center. "
+                << "It cannot be saved in double precision.\n" );
 
     // We are supposed to do the triangulation in trans_crop_win only
     // so force rasterization in that box only using crop().
@@ -648,7 +823,36 @@ void stereo_triangulation( string          const& output_prefix,
   } // End outer try/catch
 } // End function stereo_triangulation()
 
+void triangulate_disparities( string const& output_prefix,
+                              vector<ASPGlobalOptions> const& opt_vec,
+                              vector<DisparityViewRef> const& disparities ) {
+
+  // TODO: De-template these classes!
+
+#define INSTANTIATE(T,NAME) if ( opt_vec[0].session->name() == NAME ) { \
+    stereo_triangulation<T>(output_prefix, opt_vec, disparities); }
+
+  INSTANTIATE(StereoSessionPinhole,           "pinhole"           );
+  INSTANTIATE(StereoSessionNadirPinhole,      "nadirpinhole"      );
+  INSTANTIATE(StereoSessionRPC,               "rpc"               );
+  INSTANTIATE(StereoSessionDG,                "dg"                );
+  INSTANTIATE(StereoSessionDGMapRPC,          "dgmaprpc"          );
+  INSTANTIATE(StereoSessionRPCMapRPC,         "rpcmaprpc"         );
+  INSTANTIATE(StereoSessionPinholeMapPinhole, "pinholemappinhole" );
+  INSTANTIATE(StereoSessionSpot,              "spot5"             );
+  INSTANTIATE(StereoSessionSpot5MapRPC,       "spot5maprpc"       );
+  INSTANTIATE(StereoSessionASTER,             "aster"             );
+  INSTANTIATE(StereoSessionASTERMapRPC,       "astermaprpc"       );
+#if defined(ASP_HAVE_PKG_ISISIO) && ASP_HAVE_PKG_ISISIO == 1
+  INSTANTIATE(StereoSessionIsis,         "isis"                   );
+  INSTANTIATE(StereoSessionIsisMapIsis,  "isismapisis"            );
+#endif
+
+#undef INSTANTIATE
+}
 
+// stereo_stream links in this stage and has its own main()
+#ifndef ASP_STEREO_STREAM
 int main( int argc, char* argv[] ) {
 
   try {
@@ -690,29 +894,7 @@ int main( int argc, char* argv[] ) {
 
     // Internal Processes
     //---------------------------------------------------------
-
-   // TODO: De-template these classes!
-
-#define INSTANTIATE(T,NAME) if ( opt_vec[0].session->name() == NAME ) { \
-      stereo_triangulation<T>(output_prefix, opt_vec); }
-
-    INSTANTIATE(StereoSessionPinhole,           "pinhole"           );
-    INSTANTIATE(StereoSessionNadirPinhole,      "nadirpinhole"      );
-    INSTANTIATE(StereoSessionRPC,               "rpc"               );
-    INSTANTIATE(StereoSessionDG,                "dg"                );
-    INSTANTIATE(StereoSessionDGMapRPC,          "dgmaprpc"          );
-    INSTANTIATE(StereoSessionRPCMapRPC,         "rpcmaprpc"         );
-    INSTANTIATE(StereoSessionPinholeMapPinhole, "pinholemappinhole" );
-    INSTANTIATE(StereoSessionSpot,              "spot5"             );
-    INSTANTIATE(StereoSessionSpot5MapRPC,       "spot5maprpc"       );
-    INSTANTIATE(StereoSessionASTER,             "aster"             );
-    INSTANTIATE(StereoSessionASTERMapRPC,       "astermaprpc"       );
-#if defined(ASP_HAVE_PKG_ISISIO) && ASP_HAVE_PKG_ISISIO == 1
-    INSTANTIATE(StereoSessionIsis,         "isis"                   );
-    INSTANTIATE(StereoSessionIsisMapIsis,  "isismapisis"            );
-#endif
-
-#undef INSTANTIATE
+    triangulate_disparities(output_prefix, opt_vec);
 
     vw_out() << "\n[ " << current_posix_time_string() << " ] : TRIANGULATION FINISHED \n";
 
@@ -721,3 +903,4 @@ int main( int argc, char* argv[] ) {
 
   return 0;
 }
+#endif